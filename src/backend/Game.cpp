@@ -151,6 +151,35 @@ bool Game::operator != (const Game& rhs) const
         mMoveScores != rhs.mMoveScores;
 }
 
+void Game::WritePGNMove(std::ostream& str, const Position& pos, const Move& move, bool forceMoveNumber, bool includeScore, ScoreType score)
+{
+    const bool isWhiteMove = pos.GetSideToMove() == White;
+
+    if (isWhiteMove)
+    {
+        // White moves always get a move number indication: "N. "
+        str << pos.GetMoveCount() << ". ";
+    }
+    else if (forceMoveNumber)
+    {
+        // Black move number indication required when:
+        // - game starts with black to move (no preceding white move)
+        // - commentary preceded this black move (every white move has {score})
+        str << pos.GetMoveCount() << "... ";
+    }
+
+    str << pos.MoveToString(move) << ' ';
+
+    if (includeScore)
+    {
+        // Scores are stored from white's perspective; negate for black's moves
+        // so the comment reflects the side-to-move's perspective.
+        // Format: {score/0} — fishtest/scoreWDLstat-compatible
+        if (!isWhiteMove) score = -score;
+        str << '{' << ScoreToStr(score) << "/0} ";
+    }
+}
+
 std::string Game::ToPGNMoveList(bool includeScores) const
 {
     std::stringstream str;
@@ -159,31 +188,8 @@ std::string Game::ToPGNMoveList(bool includeScores) const
 
     for (size_t i = 0; i < mMoves.size(); ++i)
     {
-        const bool isWhiteMove = pos.GetSideToMove() == White;
-
-        if (isWhiteMove)
-        {
-            // White moves always get a move number indication: "N. "
-            str << pos.GetMoveCount() << ". ";
-        }
-        else if (i == 0 || includeScores)
-        {
-            // Black move number indication required when:
-            // - game starts with black to move (i == 0, no preceding white move)
-            // - commentary preceded this black move (every white move has {score})
-            str << pos.GetMoveCount() << "... ";
-        }
-
-        str << pos.MoveToString(mMoves[i]) << ' ';
-
-        if (includeScores && i < mMoveScores.size())
-        {
-            // Scores are stored from white's perspective; negate for black's moves
-            // so the comment reflects the side-to-move's perspective.
-            // Format: {score/0} — fishtest/scoreWDLstat-compatible
-            const ScoreType score = isWhiteMove ? mMoveScores[i] : ScoreType(-mMoveScores[i]);
-            str << '{' << ScoreToStr(score) << "/0} ";
-        }
+        const bool includeScore = includeScores && i < mMoveScores.size();
+        WritePGNMove(str, pos, mMoves[i], i == 0 || includeScores, includeScore, includeScore ? mMoveScores[i] : 0);
 
         const bool moveResult = pos.DoMove(mMoves[i]);
         ASSERT(moveResult);
@@ -195,56 +201,66 @@ std::string Game::ToPGNMoveList(bool includeScores) const
     return str.str();
 }
 
-std::string Game::ToPGN(bool includeScores) const
+const char* Game::ScoreToPGNResult(Score score)
 {
-    std::stringstream str;
+    switch (score)
+    {
+    case Score::WhiteWins:  return "1-0";
+    case Score::BlackWins:  return "0-1";
+    case Score::Draw:       return "1/2-1/2";
+    default:                return "";
+    }
+}
 
-    std::string resultStr;
+void Game::WritePGNHeader(std::ostream& str, const Position& initPosition, const Position& finalPosition,
+                          Score score, bool isForcedScore, uint32_t repetitionCount, uint32_t roundNumber)
+{
     std::string terminationStr;
 
-    const Game::Score gameScore = GetScore();
-    if (gameScore == Game::Score::WhiteWins)
-    {
-        resultStr = "1-0";
-        terminationStr = "checkmate";
-    }
-    else if (gameScore == Game::Score::BlackWins)
+    if (score == Game::Score::WhiteWins || score == Game::Score::BlackWins)
     {
-        resultStr = "0-1";
         terminationStr = "checkmate";
     }
-    else if (gameScore == Game::Score::Draw)
+    else if (score == Game::Score::Draw)
     {
-        resultStr = "1/2-1/2";
-        if (GetRepetitionCount(GetPosition()) >= 2) terminationStr = "3-fold repetition";
-        else if (GetPosition().IsFiftyMoveRuleDraw()) terminationStr = "50 moves rule";
-        else if (CheckInsufficientMaterial(GetPosition())) terminationStr = "insufficient material";
+        if (repetitionCount >= 2) terminationStr = "3-fold repetition";
+        else if (finalPosition.IsFiftyMoveRuleDraw()) terminationStr = "50 moves rule";
+        else if (CheckInsufficientMaterial(finalPosition)) terminationStr = "insufficient material";
         else terminationStr = "unknown";
     }
 
-    if (mForcedScore != Score::Unknown)
+    if (isForcedScore)
     {
         terminationStr = "adjudication";
     }
 
-    const bool isNonStandardStart = mInitPosition.ToFEN() != Position::InitPositionFEN;
+    const bool isNonStandardStart = initPosition.ToFEN() != Position::InitPositionFEN;
 
     str << "[Event \"?\"]" << std::endl;
     str << "[Site \"?\"]" << std::endl;
     str << "[Date \"????.??.??\"]" << std::endl;
-    str << "[Round \"" << mMetadata.roundNumber << "\"]" << std::endl;
+    str << "[Round \"" << roundNumber << "\"]" << std::endl;
     str << "[White \"Caissa\"]" << std::endl;
     str << "[Black \"Caissa\"]" << std::endl;
-    str << "[Result \"" << resultStr << "\"]" << std::endl;
+    str << "[Result \"" << ScoreToPGNResult(score) << "\"]" << std::endl;
     // Supplemental tags in ASCII order (§8.1.1): FEN(F=70) < SetUp(S=83) < Termination(T=84)
     if (isNonStandardStart)
     {
-        str << "[FEN \"" << mInitPosition.ToFEN() << "\"]" << std::endl;
+        str << "[FEN \"" << initPosition.ToFEN() << "\"]" << std::endl;
         str << "[SetUp \"1\"]" << std::endl;
     }
     str << "[Termination \"" << terminationStr << "\"]" << std::endl;
     str << std::endl;
-    str << ToPGNMoveList(includeScores) << resultStr;
+}
+
+std::string Game::ToPGN(bool includeScores) const
+{
+    std::stringstream str;
+
+    const Game::Score gameScore = GetScore();
+
+    WritePGNHeader(str, mInitPosition, mPosition, gameScore, mForcedScore != Score::Unknown, GetRepetitionCount(mPosition), mMetadata.roundNumber);
+    str << ToPGNMoveList(includeScores) << ScoreToPGNResult(gameScore);
 
     return str.str();
-}
\ No newline at end of file
+}
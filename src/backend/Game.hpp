@@ -3,6 +3,7 @@
 #include "Position.hpp"
 
 #include <vector>
+#include <iosfwd>
 
 namespace std {
 
@@ -41,6 +42,7 @@ public:
     Color GetSideToMove() const { return mPosition.GetSideToMove(); }
 
     void SetMetadata(const GameMetadata& metadata) { mMetadata = metadata; }
+    const GameMetadata& GetMetadata() const { return mMetadata; }
 
     bool operator == (const Game& rhs) const;
     bool operator != (const Game& rhs) const;
@@ -66,6 +68,12 @@ public:
     // print whole game as PNG string
     std::string ToPGN(bool includeScores = false) const;
 
+    // PGN building blocks used by ToPGN(), for tools replaying games without building Game objects
+    static void WritePGNMove(std::ostream& str, const Position& pos, const Move& move, bool forceMoveNumber, bool includeScore = false, ScoreType score = 0);
+    static void WritePGNHeader(std::ostream& str, const Position& initPosition, const Position& finalPosition,
+                               Score score, bool isForcedScore, uint32_t repetitionCount, uint32_t roundNumber = 1);
+    static const char* ScoreToPGNResult(Score score);
+
 private:
 
     Score CalculateScore() const;
@@ -1,6 +1,8 @@
 #include "Numa.hpp"
 #include "Memory.hpp"
 
+#include <thread>
+
 #if defined(PLATFORM_WINDOWS)
 
 #define WIN32_LEAN_AND_MEAN
@@ -45,6 +47,36 @@ bool PinCurrentThreadToNumaNode(uint32_t node)
     return true;
 }
 
+std::vector<uint32_t> GetNodeProcessors(uint32_t node)
+{
+    std::vector<uint32_t> processors;
+
+    GROUP_AFFINITY nodeGroupAffinity{};
+    if (GetNumaNodeProcessorMaskEx((USHORT)node, &nodeGroupAffinity))
+    {
+        // processor index is encoded as (group * 64 + index within group)
+        for (uint32_t i = 0; i < 64; ++i)
+        {
+            if (nodeGroupAffinity.Mask & (KAFFINITY(1) << i))
+            {
+                processors.push_back(64u * nodeGroupAffinity.Group + i);
+            }
+        }
+    }
+
+    return processors;
+}
+
+bool PinCurrentThreadToProcessor(uint32_t processor)
+{
+    GROUP_AFFINITY affinity{};
+    affinity.Group = (WORD)(processor / 64u);
+    affinity.Mask = KAFFINITY(1) << (processor % 64u);
+
+    GROUP_AFFINITY prev{};
+    return FALSE != SetThreadGroupAffinity(GetCurrentThread(), &affinity, &prev);
+}
+
 void* AllocateOnNode(size_t size, uint32_t node)
 {
     void* ptr = ::VirtualAllocExNuma(GetCurrentProcess(), nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE, node);
@@ -124,6 +156,43 @@ bool PinCurrentThreadToNumaNode(uint32_t node)
     return rc == 0;
 }
 
+std::vector<uint32_t> GetNodeProcessors(uint32_t node)
+{
+    std::vector<uint32_t> processors;
+
+    if (!g_numaAvailable)
+    {
+        if (node == 0)
+        {
+            for (uint32_t i = 0; i < std::thread::hardware_concurrency(); ++i)
+                processors.push_back(i);
+        }
+        return processors;
+    }
+
+    if (node >= s_sets.size())
+        return processors;
+
+    for (uint32_t cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        if (CPU_ISSET(cpu, &s_sets[node]))
+            processors.push_back(cpu);
+
+    return processors;
+}
+
+bool PinCurrentThreadToProcessor(uint32_t processor)
+{
+    if (processor >= CPU_SETSIZE)
+        return false;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(processor, &set);
+
+    int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set);
+    return rc == 0;
+}
+
 void* AllocateOnNode(size_t size, uint32_t node)
 {
     if (!g_numaAvailable)
@@ -161,6 +230,23 @@ bool PinCurrentThreadToNumaNode(uint32_t node)
     return true;
 }
 
+std::vector<uint32_t> GetNodeProcessors(uint32_t node)
+{
+    std::vector<uint32_t> processors;
+    if (node == 0)
+    {
+        for (uint32_t i = 0; i < std::thread::hardware_concurrency(); ++i)
+            processors.push_back(i);
+    }
+    return processors;
+}
+
+bool PinCurrentThreadToProcessor(uint32_t processor)
+{
+    UNUSED(processor);
+    return true;
+}
+
 void* AllocateOnNode(size_t size, uint32_t node)
 {
     UNUSED(node);
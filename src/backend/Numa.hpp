@@ -16,6 +16,12 @@ uint32_t GetNumNodes();
 // pins the current thread to a specific NUMA node, returns true on success
 bool PinCurrentThreadToNumaNode(uint32_t node);
 
+// returns list of logical processors belonging to a specific NUMA node
+std::vector<uint32_t> GetNodeProcessors(uint32_t node);
+
+// pins the current thread to a single logical processor, returns true on success
+bool PinCurrentThreadToProcessor(uint32_t processor);
+
 // allocates memory on a specific NUMA node
 void* AllocateOnNode(size_t size, uint32_t node);
 
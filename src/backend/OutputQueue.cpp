@@ -0,0 +1,221 @@
+#include "OutputQueue.hpp"
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+namespace output {
+
+using Clock = std::chrono::steady_clock;
+
+struct Node
+{
+    std::atomic<Node*> next = nullptr;
+    std::string text;
+};
+
+// intrusive multiple-producer single-consumer queue (Vyukov)
+// producers only perform a single atomic exchange, consumer is the output thread
+static Node s_stubNode;
+static std::atomic<Node*> s_head = &s_stubNode;
+static Node* s_tail = &s_stubNode;
+
+static std::atomic<uint64_t> s_numEnqueued = 0;
+static std::atomic<uint64_t> s_numWritten = 0;
+
+// bumped on every enqueue and stop request, the output thread sleeps on it when there's nothing to write
+static std::atomic<uint32_t> s_wakeUpCounter = 0;
+
+static std::atomic<bool> s_threadRunning = false;
+static std::atomic<bool> s_stopThread = false;
+static std::thread s_thread;
+static std::mutex s_synchronousWriteMutex;
+
+// info lines rate limiting (token bucket, burst of up to one second worth of lines)
+static std::mutex s_rateLimitMutex;
+static uint32_t s_infoRateLimit = 0;
+static double s_rateLimitTokens = 0.0;
+static Clock::time_point s_rateLimitLastRefill;
+static std::atomic<uint64_t> s_numDroppedLines = 0;
+
+static void Push(Node* node)
+{
+    node->next.store(nullptr, std::memory_order_relaxed);
+    Node* prev = s_head.exchange(node, std::memory_order_acq_rel);
+    prev->next.store(node, std::memory_order_release);
+}
+
+// returns nullptr if the queue is empty or a producer is in the middle of pushing
+static Node* Pop()
+{
+    Node* tail = s_tail;
+    Node* next = tail->next.load(std::memory_order_acquire);
+
+    if (tail == &s_stubNode)
+    {
+        if (!next) return nullptr;
+        s_tail = next;
+        tail = next;
+        next = next->next.load(std::memory_order_acquire);
+    }
+
+    if (next)
+    {
+        s_tail = next;
+        return tail;
+    }
+
+    if (tail != s_head.load(std::memory_order_acquire))
+    {
+        return nullptr;
+    }
+
+    Push(&s_stubNode);
+
+    next = tail->next.load(std::memory_order_acquire);
+    if (next)
+    {
+        s_tail = next;
+        return tail;
+    }
+
+    return nullptr;
+}
+
+static void OutputThreadFunc()
+{
+    uint64_t numWritten = s_numWritten.load();
+
+    for (;;)
+    {
+        const uint32_t wakeUpCounter = s_wakeUpCounter.load(std::memory_order_acquire);
+        const uint64_t numEnqueued = s_numEnqueued.load(std::memory_order_acquire);
+
+        if (numWritten == numEnqueued)
+        {
+            if (s_stopThread.load(std::memory_order_acquire))
+            {
+                break;
+            }
+
+            s_wakeUpCounter.wait(wakeUpCounter, std::memory_order_acquire);
+            continue;
+        }
+
+        // write everything that is available, flush only once per batch
+        while (numWritten < numEnqueued)
+        {
+            Node* node = Pop();
+            if (!node)
+            {
+                // producer was preempted between exchange and linking the node
+                std::this_thread::yield();
+                continue;
+            }
+
+            std::cout << node->text << '\n';
+            delete node;
+            numWritten++;
+        }
+
+        std::cout.flush();
+
+        s_numWritten.store(numWritten, std::memory_order_release);
+        s_numWritten.notify_all();
+    }
+}
+
+void StartThread()
+{
+    if (s_threadRunning) return;
+
+    s_stopThread = false;
+    s_thread = std::thread(OutputThreadFunc);
+    s_threadRunning = true;
+}
+
+void StopThread()
+{
+    if (!s_threadRunning) return;
+
+    Flush();
+
+    s_threadRunning = false;
+    s_stopThread = true;
+    s_wakeUpCounter.fetch_add(1, std::memory_order_release);
+    s_wakeUpCounter.notify_one();
+    s_thread.join();
+}
+
+static bool ConsumeInfoLineToken()
+{
+    std::unique_lock<std::mutex> lock(s_rateLimitMutex);
+
+    if (s_infoRateLimit == 0)
+    {
+        return true;
+    }
+
+    const Clock::time_point now = Clock::now();
+    const double elapsed = std::chrono::duration<double>(now - s_rateLimitLastRefill).count();
+    s_rateLimitLastRefill = now;
+    s_rateLimitTokens = std::min(static_cast<double>(s_infoRateLimit), s_rateLimitTokens + elapsed * s_infoRateLimit);
+
+    if (s_rateLimitTokens < 1.0)
+    {
+        return false;
+    }
+
+    s_rateLimitTokens -= 1.0;
+    return true;
+}
+
+void WriteLine(std::string&& line, LineType type)
+{
+    if (type == LineType::Info && !ConsumeInfoLineToken())
+    {
+        s_numDroppedLines.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    if (!s_threadRunning.load(std::memory_order_acquire))
+    {
+        std::unique_lock<std::mutex> lock(s_synchronousWriteMutex);
+        std::cout << line << std::endl;
+        return;
+    }
+
+    Node* node = new Node;
+    node->text = std::move(line);
+    Push(node);
+
+    s_numEnqueued.fetch_add(1, std::memory_order_release);
+    s_wakeUpCounter.fetch_add(1, std::memory_order_release);
+    s_wakeUpCounter.notify_one();
+}
+
+void Flush()
+{
+    if (!s_threadRunning.load(std::memory_order_acquire)) return;
+
+    const uint64_t target = s_numEnqueued.load(std::memory_order_acquire);
+    for (uint64_t numWritten = s_numWritten.load(std::memory_order_acquire); numWritten < target; numWritten = s_numWritten.load(std::memory_order_acquire))
+    {
+        s_numWritten.wait(numWritten, std::memory_order_acquire);
+    }
+}
+
+void SetInfoRateLimit(uint32_t linesPerSecond)
+{
+    std::unique_lock<std::mutex> lock(s_rateLimitMutex);
+    s_infoRateLimit = linesPerSecond;
+    s_rateLimitTokens = static_cast<double>(linesPerSecond);
+    s_rateLimitLastRefill = Clock::now();
+}
+
+uint64_t GetNumDroppedLines()
+{
+    return s_numDroppedLines.load(std::memory_order_relaxed);
+}
+
+} // namespace output
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "Common.hpp"
+
+#include <string>
+
+
+// Asynchronous stdout writer. Lines are pushed to a lock-free queue and written by a dedicated
+// output thread, so a slow consumer of the engine's output never stalls the search.
+// Lines are written in the order they were enqueued.
+namespace output {
+
+enum class LineType : uint8_t
+{
+    Regular,
+    Info,       // 'info' line that can be dropped when info rate limit is exceeded
+};
+
+// spawn the output thread, before that (and after StopThread) lines are written synchronously
+void StartThread();
+
+// write all pending lines and join the output thread
+void StopThread();
+
+// enqueue a single line (without trailing newline), never blocks on stdout
+void WriteLine(std::string&& line, LineType type = LineType::Regular);
+
+// block until all lines enqueued so far are written and stdout is flushed
+// NOTE: must be called before writing to std::cout directly to preserve ordering
+void Flush();
+
+// limit number of 'info' lines written per second, 0 disables the limit
+void SetInfoRateLimit(uint32_t linesPerSecond);
+
+// total number of 'info' lines dropped because of the rate limit
+uint64_t GetNumDroppedLines();
+
+} // namespace output
@@ -293,4 +293,33 @@ int32_t PackedNeuralNetwork::Run(const uint16_t* stmFeatures, const uint32_t stm
     return Run(stmAccum, nstmAccum, variant);
 }
 
+void PackedNeuralNetwork::Run(const BatchInput* inputs, uint32_t numInputs, int32_t* outOutputs) const
+{
+    Accumulator stmAccum;
+    Accumulator nstmAccum;
+
+    const auto prefetchInput = [this](const BatchInput& input)
+    {
+        for (uint32_t i = 0; i < input.stmNumFeatures; ++i)
+            Prefetch(accumulatorWeights + input.stmFeatures[i] * AccumulatorSize);
+        for (uint32_t i = 0; i < input.nstmNumFeatures; ++i)
+            Prefetch(accumulatorWeights + input.nstmFeatures[i] * AccumulatorSize);
+    };
+
+    if (numInputs > 0)
+        prefetchInput(inputs[0]);
+
+    for (uint32_t i = 0; i < numInputs; ++i)
+    {
+        const BatchInput& input = inputs[i];
+
+        if (i + 1 < numInputs)
+            prefetchInput(inputs[i + 1]);
+
+        stmAccum.Refresh(accumulatorWeights, accumulatorBiases, input.stmNumFeatures, input.stmFeatures);
+        nstmAccum.Refresh(accumulatorWeights, accumulatorBiases, input.nstmNumFeatures, input.nstmFeatures);
+        outOutputs[i] = Run(stmAccum, nstmAccum, input.variant);
+    }
+}
+
 } // namespace nn
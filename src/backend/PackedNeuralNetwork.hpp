@@ -163,6 +163,19 @@ struct alignas(CACHELINE_SIZE) PackedNeuralNetwork
 
     // Calculate neural network output based on input
     int32_t Run(const uint16_t* stmFeatures, const uint32_t stmNumFeatures, const uint16_t* nstmFeatures, const uint32_t nstmNumFeatures, uint32_t variant) const;
+
+    struct BatchInput
+    {
+        const uint16_t* stmFeatures;
+        const uint16_t* nstmFeatures;
+        uint32_t stmNumFeatures;
+        uint32_t nstmNumFeatures;
+        uint32_t variant;
+    };
+
+    // Calculate neural network outputs for a batch of positions (e.g. a validation set)
+    // Accumulators are reused and weights of the next position are prefetched while the current one is evaluated
+    void Run(const BatchInput* inputs, uint32_t numInputs, int32_t* outOutputs) const;
 };
 
 } // namespace nn
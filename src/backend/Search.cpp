@@ -7,6 +7,8 @@
 #include "Tablebase.hpp"
 #include "TimeManager.hpp"
 #include "Tuning.hpp"
+#include "SearchTrace.hpp"
+#include "OutputQueue.hpp"
 
 #include <algorithm>
 
@@ -353,11 +355,11 @@ void Search::DoSearch(const Game& game, SearchParam& param, SearchResult& outRes
         {
             if (!game.GetPosition().IsInCheck(game.GetPosition().GetSideToMove()))
             {
-                std::cout << "info depth 0 score cp 0" << std::endl;
+                output::WriteLine("info depth 0 score cp 0");
             }
             if (game.GetPosition().IsInCheck(game.GetPosition().GetSideToMove()))
             {
-                std::cout << "info depth 0 score mate 0" << std::endl;
+                output::WriteLine("info depth 0 score mate 0");
             }
         }
         return;
@@ -376,6 +378,8 @@ void Search::DoSearch(const Game& game, SearchParam& param, SearchResult& outRes
         // try returning tablebase move immediately
         if (param.useRootTablebase && numPvLines == 1)
         {
+            SEARCH_TRACE_SCOPE("RootTablebaseProbe");
+
             int32_t wdl = 0;
             Move tbMove;
 
@@ -403,6 +407,8 @@ void Search::DoSearch(const Game& game, SearchParam& param, SearchResult& outRes
 
     SearchStats globalStats;
 
+    const uint64_t numDroppedLinesAtStart = output::GetNumDroppedLines();
+
     // kick off worker threads
     for (uint32_t i = 1; i < param.numThreads; ++i)
     {
@@ -434,12 +440,15 @@ void Search::DoSearch(const Game& game, SearchParam& param, SearchResult& outRes
     Search_Internal(0, numPvLines, game, param, globalStats);
 
     // wait for worker threads
-    for (uint32_t i = 1; i < param.numThreads; ++i)
     {
-        ThreadData* threadData = mThreadData[i];
-        std::unique_lock<std::mutex> lock(threadData->taskFinishedMutex);
-        threadData->taskFinishedCV.wait(lock, [&threadData]() { return threadData->taskFinished; });
-        threadData->taskFinished = false;
+        SEARCH_TRACE_SCOPE("WaitForWorkers");
+        for (uint32_t i = 1; i < param.numThreads; ++i)
+        {
+            ThreadData* threadData = mThreadData[i];
+            std::unique_lock<std::mutex> lock(threadData->taskFinishedMutex);
+            threadData->taskFinishedCV.wait(lock, [&threadData]() { return threadData->taskFinished; });
+            threadData->taskFinished = false;
+        }
     }
 
     // select best PV line from finished threads
@@ -543,18 +552,20 @@ void Search::DoSearch(const Game& game, SearchParam& param, SearchResult& outRes
             {
                 const ThreadData* threadData = mThreadData[i];
                 const PvLine& pvLine = threadData->pvLines.front();
-                std::cout << "info string thread " << i
+                std::stringstream ss{ std::ios_base::out };
+                ss << "info string thread " << i
                     << " completed depth " << threadData->depthCompleted
                     << " move " << pvLine.moves.front().ToString() << " score " << pvLine.score
                     << " votes " << votesOf(i);
-                if (i == bestThreadIndex) std::cout << " (selected)";
-                std::cout << std::endl;
+                if (i == bestThreadIndex) ss << " (selected)";
+                output::WriteLine(std::move(ss).str());
             }
 #endif // CONFIGURATION_FINAL
         }
 
         // make sure the last reported PV matches the move that is about to be played
-        if (bestThreadIndex != 0 && param.debugLog)
+        // (also when some of the PV lines were dropped due to info lines rate limit)
+        if ((bestThreadIndex != 0 || output::GetNumDroppedLines() != numDroppedLinesAtStart) && param.debugLog)
         {
             SearchContext searchContext{ game, param, globalStats };
             const TimePoint searchTime = TimePoint::GetCurrent() - param.limits.startTimePoint;
@@ -571,7 +582,7 @@ void Search::DoSearch(const Game& game, SearchParam& param, SearchResult& outRes
                     0,
                     bestThreadIndex,
                 };
-                ReportPV(reportParam, mThreadData[bestThreadIndex]->pvLines[pvIndex], BoundsType::Exact, searchTime);
+                ReportPV(reportParam, mThreadData[bestThreadIndex]->pvLines[pvIndex], BoundsType::Exact, searchTime, true);
             }
         }
 
@@ -594,18 +605,25 @@ void Search::WorkerThreadCallback(Search* search, uint32_t index)
 
     ThreadData* threadData = search->mThreadData[index];
 
+#ifdef ENABLE_SEARCH_TRACE
+    char threadName[32];
+    snprintf(threadName, sizeof(threadName), "Search Thread %u", index);
+#endif // ENABLE_SEARCH_TRACE
+
     while (!threadData->stopThread)
     {
         {
             // wait for task
             std::function<void()> callback;
             {
+                SEARCH_TRACE_SCOPE("Idle");
                 std::unique_lock<std::mutex> lock(threadData->newTaskMutex);
                 threadData->newTaskCV.wait(lock, [threadData]() { return threadData->callback || threadData->stopThread; });
                 if (threadData->stopThread) break;
                 callback = std::move(threadData->callback);
             }
 
+            SEARCH_TRACE_THREAD_NAME(threadName, index);
             callback();
         }
 
@@ -619,7 +637,7 @@ void Search::WorkerThreadCallback(Search* search, uint32_t index)
     }
 }
 
-void Search::ReportPV(const AspirationWindowSearchParam& param, const PvLine& pvLine, BoundsType boundsType, const TimePoint& searchTime) const
+void Search::ReportPV(const AspirationWindowSearchParam& param, const PvLine& pvLine, BoundsType boundsType, const TimePoint& searchTime, bool isFinal) const
 {
     const float timeInSeconds = searchTime.ToSeconds();
 
@@ -631,6 +649,8 @@ void Search::ReportPV(const AspirationWindowSearchParam& param, const PvLine& pv
         return;
     }
 
+    SEARCH_TRACE_SCOPE("ReportPV", "depth", param.depth);
+
     std::stringstream ss{ std::ios_base::out };
 
     const uint64_t numNodes = param.searchContext.stats.nodes.load();
@@ -740,7 +760,9 @@ void Search::ReportPV(const AspirationWindowSearchParam& param, const PvLine& pv
     }
 #endif // COLLECT_SEARCH_STATS
 
-    std::cout << std::move(ss.str()) << std::endl;
+    // in analysis mode intermediate PV lines can be dropped if the GUI can't keep up
+    const bool isDroppable = !isFinal && param.searchParam.limits.analysisMode;
+    output::WriteLine(std::move(ss).str(), isDroppable ? output::LineType::Info : output::LineType::Regular);
 }
 
 void Search::Search_Internal(const uint32_t threadID, const uint32_t numPvLines, const Game& game, SearchParam& param, SearchStats& outStats)
@@ -748,6 +770,11 @@ void Search::Search_Internal(const uint32_t threadID, const uint32_t numPvLines,
     const bool isMainThread = threadID == 0;
     ThreadData& thread = *(mThreadData[threadID]);
 
+    if (isMainThread)
+    {
+        SEARCH_TRACE_THREAD_NAME("Search Thread 0", 0);
+    }
+
     // clear per-thread data for new search
     thread.stats = SearchThreadStats{};
     thread.depthCompleted = 0;
@@ -767,6 +794,8 @@ void Search::Search_Internal(const uint32_t threadID, const uint32_t numPvLines,
     // main iterative deepening loop
     for (uint16_t depth = 1; depth <= param.limits.maxDepth; ++depth)
     {
+        SEARCH_TRACE_SCOPE("Iteration", "depth", depth);
+
         SearchResult tempResult;
         tempResult.resize(numPvLines);
 
@@ -858,6 +887,13 @@ void Search::Search_Internal(const uint32_t threadID, const uint32_t numPvLines,
         const ScoreType primaryMoveScore = tempResult.front().score;
         const Move primaryMove = !tempResult.front().moves.empty() ? tempResult.front().moves.front() : Move::Invalid();
 
+#ifdef ENABLE_SEARCH_TRACE
+        if (!thread.pvLines.empty() && !thread.pvLines.front().moves.empty() && thread.pvLines.front().moves.front() != primaryMove)
+        {
+            SEARCH_TRACE_INSTANT("RootMoveSwitch", "depth", depth);
+        }
+#endif // ENABLE_SEARCH_TRACE
+
         // update time manager
         if (isMainThread && !param.limits.analysisMode)
         {
@@ -997,7 +1033,10 @@ PvLine Search::AspirationWindowSearch(ThreadData& thread, const AspirationWindow
         rootNode.alpha = ScoreType(alpha);
         rootNode.beta = ScoreType(beta);
 
-        pvLine.score = NegaMax<NodeType::Root>(thread, &rootNode, param.searchContext);
+        {
+            SEARCH_TRACE_SCOPE("AspirationSearch", "window", beta - alpha);
+            pvLine.score = NegaMax<NodeType::Root>(thread, &rootNode, param.searchContext);
+        }
         ASSERT(pvLine.score >= -CheckmateValue && pvLine.score <= CheckmateValue);
         SearchUtils::GetPvLine(rootNode, maxPvLine, pvLine.moves);
 
@@ -1014,12 +1053,14 @@ PvLine Search::AspirationWindowSearch(ThreadData& thread, const AspirationWindow
             alpha = std::max<int32_t>(alpha - window, -CheckmateValue);
             depth = param.depth;
             boundsType = BoundsType::UpperBound;
+            SEARCH_TRACE_INSTANT("FailLow", "score", pvLine.score);
         }
         else if (pvLine.score >= beta)
         {
             pvLine.score = ScoreType(beta);
             beta = std::min<int32_t>(beta + window, CheckmateValue);
             boundsType = BoundsType::LowerBound;
+            SEARCH_TRACE_INSTANT("FailHigh", "score", pvLine.score);
 
             // reduce re-search depth
             if (depth > 1 && depth + AspirationDepthMargin > param.depth) depth--;
@@ -1544,6 +1585,7 @@ ScoreType Search::NegaMax(ThreadData& thread, NodeInfo* node, SearchContext& ctx
             (ProbeSyzygy_WDL(position, &wdl) || ProbeGaviota(position, nullptr, &wdl))) [[unlikely]]
         {
             thread.stats.tbHits++;
+            SEARCH_TRACE_INSTANT("TablebaseHit", "wdl", wdl);
 
             const ScoreType tbWinScore = TablebaseWinValue - ScoreType(100 * position.GetNumPiecesExcludingKing()) - ScoreType(node->ply);
             ASSERT(tbWinScore > KnownWinValue);
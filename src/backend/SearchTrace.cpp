@@ -0,0 +1,196 @@
+#include "SearchTrace.hpp"
+
+#ifdef ENABLE_SEARCH_TRACE
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace SearchTrace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Event
+{
+    const char* name;
+    const char* argName;
+    int64_t argValue;
+    int64_t timestamp; // nanoseconds since recording start
+    char phase;
+};
+
+struct ThreadBuffer
+{
+    std::mutex mutex; // only contended when flushing
+    std::vector<Event> events;
+    std::string name;
+    uint32_t threadId = 0;
+    uint32_t sortIndex = 0;
+};
+
+static std::atomic<bool> s_recording = false;
+static std::mutex s_mutex;
+static std::vector<std::unique_ptr<ThreadBuffer>> s_threadBuffers;
+static FILE* s_file = nullptr;
+static bool s_firstEventWritten = false;
+static Clock::time_point s_startTime;
+
+static thread_local ThreadBuffer* t_threadBuffer = nullptr;
+
+static ThreadBuffer& GetThreadBuffer()
+{
+    if (!t_threadBuffer) [[unlikely]]
+    {
+        std::unique_lock<std::mutex> lock(s_mutex);
+        s_threadBuffers.emplace_back(std::make_unique<ThreadBuffer>());
+        t_threadBuffer = s_threadBuffers.back().get();
+        t_threadBuffer->threadId = static_cast<uint32_t>(s_threadBuffers.size());
+        t_threadBuffer->events.reserve(4096);
+    }
+    return *t_threadBuffer;
+}
+
+static void PushEvent(char phase, const char* name, const char* argName, int64_t argValue)
+{
+    const int64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - s_startTime).count();
+
+    ThreadBuffer& buffer = GetThreadBuffer();
+    std::unique_lock<std::mutex> lock(buffer.mutex);
+    buffer.events.push_back({ name, argName, argValue, timestamp, phase });
+}
+
+bool IsRecording()
+{
+    return s_recording.load(std::memory_order_relaxed);
+}
+
+bool Start(const char* filePath)
+{
+    Stop();
+
+    std::unique_lock<std::mutex> lock(s_mutex);
+
+    s_file = fopen(filePath, "w");
+    if (!s_file)
+    {
+        std::cout << "info string Failed to open search trace file: " << filePath << std::endl;
+        return false;
+    }
+
+    // JSON Array Format - closing bracket is optional, so the file stays valid even if the engine gets killed
+    fputs("[\n", s_file);
+    s_firstEventWritten = false;
+    s_startTime = Clock::now();
+
+    for (const auto& buffer : s_threadBuffers)
+    {
+        std::unique_lock<std::mutex> bufferLock(buffer->mutex);
+        buffer->events.clear();
+    }
+
+    s_recording = true;
+    return true;
+}
+
+void Stop()
+{
+    Flush();
+
+    std::unique_lock<std::mutex> lock(s_mutex);
+
+    s_recording = false;
+
+    if (s_file)
+    {
+        fputs("\n]\n", s_file);
+        fclose(s_file);
+        s_file = nullptr;
+    }
+}
+
+static void WriteEventSeparator()
+{
+    if (s_firstEventWritten) fputs(",\n", s_file);
+    s_firstEventWritten = true;
+}
+
+void Flush()
+{
+    std::unique_lock<std::mutex> lock(s_mutex);
+
+    if (!s_file)
+    {
+        return;
+    }
+
+    std::vector<Event> events;
+    std::string threadName;
+    uint32_t sortIndex = 0;
+
+    for (const auto& buffer : s_threadBuffers)
+    {
+        {
+            std::unique_lock<std::mutex> bufferLock(buffer->mutex);
+            events.swap(buffer->events);
+            threadName = buffer->name;
+            sortIndex = buffer->sortIndex;
+        }
+
+        if (!threadName.empty())
+        {
+            WriteEventSeparator();
+            fprintf(s_file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}},\n",
+                buffer->threadId, threadName.c_str());
+            fprintf(s_file, "{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"sort_index\":%u}}",
+                buffer->threadId, sortIndex);
+        }
+
+        for (const Event& event : events)
+        {
+            WriteEventSeparator();
+            fprintf(s_file, "{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%" PRId64 ".%03u,\"pid\":1,\"tid\":%u",
+                event.name, event.phase, event.timestamp / 1000, static_cast<uint32_t>(event.timestamp % 1000), buffer->threadId);
+            if (event.phase == 'i')
+            {
+                fputs(",\"s\":\"t\"", s_file);
+            }
+            if (event.argName)
+            {
+                fprintf(s_file, ",\"args\":{\"%s\":%" PRId64 "}", event.argName, event.argValue);
+            }
+            fputc('}', s_file);
+        }
+
+        events.clear();
+    }
+
+    fflush(s_file);
+}
+
+void SetThreadName(const char* name, uint32_t sortIndex)
+{
+    ThreadBuffer& buffer = GetThreadBuffer();
+    std::unique_lock<std::mutex> lock(buffer.mutex);
+    buffer.name = name;
+    buffer.sortIndex = sortIndex;
+}
+
+void Begin(const char* name, const char* argName, int64_t argValue)
+{
+    PushEvent('B', name, argName, argValue);
+}
+
+void End(const char* name)
+{
+    PushEvent('E', name, nullptr, 0);
+}
+
+void Instant(const char* name, const char* argName, int64_t argValue)
+{
+    PushEvent('i', name, argName, argValue);
+}
+
+} // namespace SearchTrace
+
+#endif // ENABLE_SEARCH_TRACE
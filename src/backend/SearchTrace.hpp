@@ -0,0 +1,67 @@
+#pragma once
+
+#include "Common.hpp"
+
+// record per-thread search timelines in Chrome trace format (viewable in Perfetto or chrome://tracing)
+// recording is started at runtime with "SearchTraceFile" UCI option
+//#define ENABLE_SEARCH_TRACE
+
+
+#ifdef ENABLE_SEARCH_TRACE
+
+namespace SearchTrace {
+
+// start recording events, they will be appended to the given JSON file on every Flush() call
+bool Start(const char* filePath);
+
+// write pending events and close the trace file
+void Stop();
+
+// write pending events of all threads to the trace file
+// NOTE: must be called when no search is running
+void Flush();
+
+bool IsRecording();
+
+// name the calling thread in the timeline view
+void SetThreadName(const char* name, uint32_t sortIndex);
+
+// Note: names and argument names must be string literals (only the pointer is stored)
+void Begin(const char* name, const char* argName = nullptr, int64_t argValue = 0);
+void End(const char* name);
+void Instant(const char* name, const char* argName = nullptr, int64_t argValue = 0);
+
+class Scope
+{
+public:
+    INLINE Scope(const char* name, const char* argName = nullptr, int64_t argValue = 0)
+        : mName(IsRecording() ? name : nullptr)
+    {
+        if (mName) Begin(mName, argName, argValue);
+    }
+
+    INLINE ~Scope()
+    {
+        if (mName) End(mName);
+    }
+
+private:
+    const char* mName;
+};
+
+} // namespace SearchTrace
+
+#define SEARCH_TRACE_CONCAT_INNER(a, b) a##b
+#define SEARCH_TRACE_CONCAT(a, b) SEARCH_TRACE_CONCAT_INNER(a, b)
+
+#define SEARCH_TRACE_SCOPE(...) SearchTrace::Scope SEARCH_TRACE_CONCAT(searchTraceScope_, __LINE__)(__VA_ARGS__)
+#define SEARCH_TRACE_INSTANT(...) do { if (SearchTrace::IsRecording()) SearchTrace::Instant(__VA_ARGS__); } while (0)
+#define SEARCH_TRACE_THREAD_NAME(name, index) do { if (SearchTrace::IsRecording()) SearchTrace::SetThreadName(name, index); } while (0)
+
+#else
+
+#define SEARCH_TRACE_SCOPE(...) do { } while (0)
+#define SEARCH_TRACE_INSTANT(...) do { } while (0)
+#define SEARCH_TRACE_THREAD_NAME(name, index) do { } while (0)
+
+#endif // ENABLE_SEARCH_TRACE
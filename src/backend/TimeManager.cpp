@@ -1,6 +1,9 @@
 #include "TimeManager.hpp"
 #include "Game.hpp"
 #include "Tuning.hpp"
+#include "OutputQueue.hpp"
+
+#include <sstream>
 
 
 DEFINE_PARAM(TM_MovesLeftMidpoint, 35, 25, 60);
@@ -58,7 +61,9 @@ void InitTimeManager(const Game& game, const TimeManagerInitData& data, SearchLi
             idealTime *= static_cast<float>(TM_PredictedMoveMissScale) / 1000.0f;
 
 #ifndef CONFIGURATION_FINAL
-        std::cout << "info string idealTime=" << idealTime << "ms maxTime=" << maxTime << "ms" << std::endl;
+        std::stringstream ss{ std::ios_base::out };
+        ss << "info string idealTime=" << idealTime << "ms maxTime=" << maxTime << "ms";
+        output::WriteLine(std::move(ss).str());
 #endif // CONFIGURATION_FINAL
 
         limits.idealTimeBase = limits.idealTimeCurrent = TimePoint::FromSeconds(0.001f * idealTime);
@@ -116,6 +121,8 @@ void UpdateTimeManager(const TimeManagerUpdateData& data, SearchLimits& limits,
     }
 
 #ifndef CONFIGURATION_FINAL
-    std::cout << "info string ideal time " << limits.idealTimeCurrent.ToSeconds() * 1000.0f << " ms" << std::endl;
+    std::stringstream ss{ std::ios_base::out };
+    ss << "info string ideal time " << limits.idealTimeCurrent.ToSeconds() * 1000.0f << " ms";
+    output::WriteLine(std::move(ss).str());
 #endif // CONFIGURATION_FINAL
 }
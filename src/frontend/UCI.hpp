@@ -55,6 +55,8 @@ private:
     bool Command_ScoreMoves();
     bool Command_EvalDetailed(const std::vector<std::string>& args);
     bool Command_Benchmark(uint32_t depth);
+    bool Command_BenchmarkSuite(const std::vector<std::string>& args);
+    bool Command_AnalyzeEpd(const std::vector<std::string>& args);
 
     void StopSearchThread();
     void DoSearch();
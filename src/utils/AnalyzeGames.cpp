@@ -68,29 +68,39 @@ struct GamesStats
     double evalErrorSum_Score = 0.0;
 };
 
-void AnalyzeGames(const char* path, GamesStats& outStats)
-{
-    std::cout << "Reading " << path << "..." << std::endl;
+// games collections bigger than this are split into ranges analyzed in parallel
+static constexpr uint64_t c_MinGamesRangeSize = 16ull * 1024ull * 1024ull;
 
+void AnalyzeGames(const char* path, const GameCollection::Index::Range& range, GamesStats& outStats)
+{
     FileInputStream gamesFile(path);
+    if (!gamesFile.IsOpen() || !gamesFile.SetPosition(range.beginOffset))
+    {
+        return;
+    }
 
-    GamesStats localStats;
+    GameCollection::GameReplayCursor cursor(gamesFile);
 
-    Game game;
-    std::vector<Move> moves;
+    GamesStats localStats;
 
-    while (GameCollection::ReadGame(gamesFile, game, moves))
+    for (size_t gameIndex = 0; gameIndex < range.numGames; ++gameIndex)
     {
-        Position pos = game.GetInitialPosition();
+        if (!cursor.NextGame())
+        {
+            break;
+        }
 
-        if (game.GetScore() == Game::Score::Unknown) continue;
+        const Game::Score gameScore = cursor.ResolveGameScore();
 
-        ASSERT(game.GetMoves().size() == game.GetMoveScores().size());
+        if (gameScore == Game::Score::Unknown) continue;
 
-        for (size_t i = 0; i < game.GetMoves().size(); ++i)
+        ASSERT(cursor.HasMoveScores());
+
+        while (cursor.NextMove())
         {
-            const Move move = pos.MoveFromPacked(game.GetMoves()[i]);
-            const ScoreType moveScore = game.GetMoveScores()[i];
+            const Position& pos = cursor.GetPosition();
+            const Move move = cursor.GetMove();
+            const ScoreType moveScore = cursor.GetMoveScore();
 
             if (move.IsQuiet() &&
                 pos.GetNumPieces() >= 4 &&
@@ -105,7 +115,7 @@ void AnalyzeGames(const char* path, GamesStats& outStats)
 
                     if (pos.GetHalfMoveCount() <= 100)
                     {
-                        localStats.gameResultVsHalfMoveCounter[(uint32_t)game.GetScore()][pos.GetHalfMoveCount()]++;
+                        localStats.gameResultVsHalfMoveCounter[(uint32_t)gameScore][pos.GetHalfMoveCount()]++;
                     }
 
                     const float moveScoreAsGameScore = InternalEvalToExpectedGameScore(moveScore);
@@ -114,14 +124,14 @@ void AnalyzeGames(const char* path, GamesStats& outStats)
                     if (c_collectMaterialStats)
                     {
                         MaterialStats& matStats = localStats.materialStats[matKey];
-                        matStats.wins += (game.GetScore() == Game::Score::WhiteWins ? 1 : 0);
-                        matStats.draws += (game.GetScore() == Game::Score::Draw ? 1 : 0);
-                        matStats.losses += (game.GetScore() == Game::Score::BlackWins ? 1 : 0);
+                        matStats.wins += (gameScore == Game::Score::WhiteWins ? 1 : 0);
+                        matStats.draws += (gameScore == Game::Score::Draw ? 1 : 0);
+                        matStats.losses += (gameScore == Game::Score::BlackWins ? 1 : 0);
                         matStats.avgEvalScore += moveScoreAsGameScore;
                     }
 
                     localStats.evalErrorSum_Score += Sqr(staticEvalAsGameScore - moveScoreAsGameScore);
-                    localStats.evalErrorSum_WDL += Sqr(staticEvalAsGameScore - GameScoreToExpectedGameScore(game.GetScore()));
+                    localStats.evalErrorSum_WDL += Sqr(staticEvalAsGameScore - GameScoreToExpectedGameScore(gameScore));
 
                     localStats.numPositions++;
                     if (matKey.numWhitePawns == 0 && matKey.numBlackPawns == 0) localStats.numPawnlessPositions++;
@@ -177,10 +187,6 @@ void AnalyzeGames(const char* path, GamesStats& outStats)
                 }
             }
 
-            if (!pos.DoMove(move))
-            {
-                break;
-            }
         }
 
         localStats.numGames++;
@@ -226,33 +232,53 @@ void AnalyzeGames()
 
     const std::string gamesPath = DATA_PATH "selfplayGames/";
 
-    Waitable waitable;
+    std::vector<std::filesystem::path> paths;
+    for (const auto& path : std::filesystem::directory_iterator(gamesPath))
     {
-        threadpool::TaskBuilder taskBuilder(waitable);
-
-        std::vector<std::filesystem::path> paths;
-        for (const auto& path : std::filesystem::directory_iterator(gamesPath))
+        if (GameCollection::IsGameCollectionPath(path.path().string()))
         {
             paths.push_back(path.path());
         }
+    }
 
-        // sort paths by file size
-        std::sort(paths.begin(), paths.end(), [](const std::filesystem::path& a, const std::filesystem::path& b)
-        {
-            return std::filesystem::file_size(a) > std::filesystem::file_size(b);
-        });
+    // sort paths by file size
+    std::sort(paths.begin(), paths.end(), [](const std::filesystem::path& a, const std::filesystem::path& b)
+    {
+        return std::filesystem::file_size(a) > std::filesystem::file_size(b);
+    });
+
+    std::cout << "Found " << paths.size() << " paths" << std::endl;
+
+    const uint32_t numThreads = threadpool::ThreadPool::GetInstance().GetNumThreads();
 
-        std::cout << "Found " << paths.size() << " paths" << std::endl;
+    // split big files into ranges, so a single big collection doesn't serialize the analysis
+    std::vector<std::pair<std::string, GameCollection::Index::Range>> ranges;
+    for (const std::filesystem::path& path : paths)
+    {
+        std::cout << "Reading " << path.string() << "..." << std::endl;
 
-        for (const std::filesystem::path& path : paths)
+        std::vector<GameCollection::Index::Range> fileRanges;
+        if (!GameCollection::SplitCollection(path.string(), c_MinGamesRangeSize, numThreads, fileRanges))
         {
-            taskBuilder.Task("LoadPositions", [path, &stats](const threadpool::TaskContext&)
-            {
-                AnalyzeGames(path.string().c_str(), stats);
-            });
+            std::cout << "ERROR: Failed to index " << path.string() << std::endl;
+            continue;
+        }
+
+        for (const GameCollection::Index::Range& range : fileRanges)
+        {
+            ranges.emplace_back(path.string(), range);
         }
     }
 
+    Waitable waitable;
+    {
+        threadpool::TaskBuilder taskBuilder(waitable);
+        taskBuilder.ParallelFor("AnalyzeGames", static_cast<uint32_t>(ranges.size()), [&ranges, &stats](const threadpool::TaskContext&, uint32_t rangeIndex)
+        {
+            AnalyzeGames(ranges[rangeIndex].first.c_str(), ranges[rangeIndex].second, stats);
+        });
+    }
+
     waitable.Wait();
 
     // piece-count distribution (no queens)
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "Common.hpp"
+
+#include <vector>
+
+// helpers shared by the compact binary file formats (games collections, training data)
+
+inline uint64_t ComputeChecksum(const uint8_t* data, size_t size)
+{
+    uint64_t hash = size;
+
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = Murmur3(hash ^ word) + i;
+    }
+
+    uint64_t tail = 0;
+    memcpy(&tail, data + i, size - i);
+    return Murmur3(hash ^ tail);
+}
+
+INLINE static void WriteVarUInt(std::vector<uint8_t>& buffer, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        buffer.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back(static_cast<uint8_t>(value));
+}
+
+INLINE static bool ReadVarUInt(const uint8_t*& data, const uint8_t* end, uint32_t& outValue)
+{
+    uint32_t value = 0;
+    for (uint32_t shift = 0; shift < 35; shift += 7)
+    {
+        if (data >= end) return false;
+        const uint8_t byte = *data++;
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            outValue = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+INLINE static uint32_t ZigZagEncode(int32_t value)
+{
+    return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+
+INLINE static int32_t ZigZagDecode(uint32_t value)
+{
+    return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+}
@@ -0,0 +1,52 @@
+#include "Common.hpp"
+#include "GameCollection.hpp"
+
+#include "../backend/Time.hpp"
+
+#include <filesystem>
+
+static bool BuildGameIndex(const std::string& path)
+{
+    const TimePoint startTime = TimePoint::GetCurrent();
+
+    GameCollection::Index index;
+    if (!index.LoadOrBuild(path))
+    {
+        std::cout << "ERROR: Failed to index games collection: " << path << std::endl;
+        return false;
+    }
+
+    const float elapsedTime = (TimePoint::GetCurrent() - startTime).ToSeconds();
+
+    std::cout
+        << path << ": "
+        << index.GetNumGames() << " games, "
+        << index.GetNumMoves() << " moves, "
+        << (index.GetCollectionSize() / (1024.0 * 1024.0)) << " MB indexed in "
+        << elapsedTime << " s" << std::endl;
+
+    return true;
+}
+
+// build (or update) sidecar index files for games collections, arguments are files or directories
+void BuildGameIndex(const std::vector<std::string>& args)
+{
+    for (const std::string& arg : args)
+    {
+        if (std::filesystem::is_directory(arg))
+        {
+            for (const auto& entry : std::filesystem::directory_iterator(arg))
+            {
+                const std::string path = entry.path().string();
+                if (entry.is_regular_file() && GameCollection::IsGameCollectionPath(path))
+                {
+                    BuildGameIndex(path);
+                }
+            }
+        }
+        else
+        {
+            BuildGameIndex(arg);
+        }
+    }
+}
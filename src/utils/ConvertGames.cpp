@@ -0,0 +1,121 @@
+#include "Common.hpp"
+#include "GameCollection.hpp"
+
+#include "../backend/Time.hpp"
+
+#include <filesystem>
+
+// decode all games from a collection, returns number of decoded games
+static uint64_t DecodeAllGames(const std::string& path, float& outElapsedTime)
+{
+    const TimePoint startTime = TimePoint::GetCurrent();
+
+    FileInputStream stream(path.c_str());
+    GameCollection::Reader reader(stream);
+
+    Game game;
+    std::vector<Move> moves;
+    uint64_t numGames = 0;
+    while (reader.ReadGame(game, moves))
+    {
+        numGames++;
+    }
+
+    outElapsedTime = (TimePoint::GetCurrent() - startTime).ToSeconds();
+    return numGames;
+}
+
+// convert games collection from the legacy (PackedMove + int16 score per move) to the compact encoding
+void ConvertGames(const std::vector<std::string>& args)
+{
+    if (args.size() < 2)
+    {
+        std::cout << "Usage: convertGames <input> <output> [blockSize <KB>]" << std::endl;
+        return;
+    }
+
+    const std::string& inputPath = args[0];
+    const std::string& outputPath = args[1];
+
+    size_t blockSize = GameCollection::CompactWriter::DefaultBlockSize;
+    if (args.size() >= 4 && args[2] == "blockSize")
+    {
+        blockSize = std::max<size_t>(1, std::stoull(args[3])) * 1024;
+    }
+
+    FileInputStream inputStream(inputPath.c_str());
+    if (!inputStream.IsOpen())
+    {
+        std::cout << "ERROR: Failed to open games collection: " << inputPath << std::endl;
+        return;
+    }
+
+    if (GameCollection::IsCompactCollection(inputStream))
+    {
+        std::cout << "ERROR: Games collection is already compact: " << inputPath << std::endl;
+        return;
+    }
+
+    uint64_t numGames = 0;
+    uint64_t numMoves = 0;
+    GameCollection::CompactWriter::Stats stats;
+    {
+        FileOutputStream outputStream(outputPath.c_str());
+        if (!outputStream.IsOpen())
+        {
+            std::cout << "ERROR: Failed to open output file: " << outputPath << std::endl;
+            return;
+        }
+
+        GameCollection::CompactWriter writer(outputStream, blockSize);
+
+        Game game;
+        std::vector<Move> moves;
+        while (GameCollection::ReadGame(inputStream, game, moves))
+        {
+            if (!writer.WriteGame(game))
+            {
+                std::cout << "ERROR: Failed to encode game " << numGames << std::endl;
+                return;
+            }
+
+            numGames++;
+            numMoves += moves.size();
+        }
+
+        if (!writer.Flush())
+        {
+            return;
+        }
+
+        stats = writer.GetStats();
+    }
+
+    const uint64_t inputSize = std::filesystem::file_size(inputPath);
+    const uint64_t outputSize = std::filesystem::file_size(outputPath);
+
+    std::cout << "Converted " << numGames << " games (" << numMoves << " moves)" << std::endl;
+    std::cout << "Size: " << inputSize << " -> " << outputSize << " bytes (" << (100.0 * outputSize / std::max<uint64_t>(1, inputSize)) << "%), "
+        << (numMoves ? 8.0 * outputSize / numMoves : 0.0) << " bits per move" << std::endl;
+
+    // moves and scores are reported separately, scores don't compress nearly as well as moves
+    const double bitsPerMove = numMoves ? 8.0 / numMoves : 0.0;
+    std::cout << "Bits per move: "
+        << (stats.movesSize * bitsPerMove) << " move indices, "
+        << (stats.scoresSize * bitsPerMove) << " scores, "
+        << (stats.gameHeadersSize * bitsPerMove) << " game headers, "
+        << ((outputSize - stats.movesSize - stats.scoresSize - stats.gameHeadersSize) * bitsPerMove) << " block headers" << std::endl;
+
+    // verify the output and compare decoding speed of both encodings
+    float legacyTime = 0.0f, compactTime = 0.0f;
+    const uint64_t numLegacyGames = DecodeAllGames(inputPath, legacyTime);
+    const uint64_t numCompactGames = DecodeAllGames(outputPath, compactTime);
+
+    if (numCompactGames != numGames || numLegacyGames != numGames)
+    {
+        std::cout << "ERROR: Decoded " << numCompactGames << " games from compact collection, expected " << numGames << std::endl;
+        return;
+    }
+
+    std::cout << "Decoding time: legacy " << legacyTime << " s, compact " << compactTime << " s" << std::endl;
+}
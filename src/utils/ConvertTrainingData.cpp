@@ -0,0 +1,179 @@
+#include "Common.hpp"
+#include "ThreadPool.hpp"
+#include "TrainerCommon.hpp"
+
+#include "../backend/Time.hpp"
+#include "../backend/Waitable.hpp"
+
+#include <filesystem>
+#include <atomic>
+
+using namespace threadpool;
+
+// number of entries read from the input file at once
+static constexpr size_t c_ConversionBatchSize = 64 * 1024;
+
+// decode all chunks of a compressed file using given number of tasks, returns number of decoded entries
+static uint64_t DecodeAllChunks(const std::string& path, const TrainingDataFile::Reader& reader, uint32_t numTasks, float& outElapsedTime)
+{
+    const TimePoint startTime = TimePoint::GetCurrent();
+
+    std::atomic<uint64_t> numEntries = 0;
+    std::atomic<uint32_t> nextChunk = 0;
+
+    Waitable waitable;
+    {
+        TaskBuilder taskBuilder(waitable);
+        taskBuilder.ParallelFor("DecodeChunks", numTasks, [&](const TaskContext&, uint32_t)
+        {
+            FileInputStream stream(path.c_str());
+            std::vector<PositionEntry> entries;
+
+            for (uint32_t chunkIndex = nextChunk++; chunkIndex < reader.GetNumChunks(); chunkIndex = nextChunk++)
+            {
+                if (!reader.ReadChunk(stream, chunkIndex, entries))
+                {
+                    return;
+                }
+                numEntries += entries.size();
+            }
+        });
+    }
+    waitable.Wait();
+
+    outElapsedTime = (TimePoint::GetCurrent() - startTime).ToSeconds();
+    return numEntries;
+}
+
+// convert raw training data file (array of PositionEntry) to the compressed chunked format
+void ConvertTrainingData(const std::vector<std::string>& args)
+{
+    if (args.size() < 2)
+    {
+        std::cout << "Usage: convertTrainingData <input> <output> [chunkSize <entries>]" << std::endl;
+        return;
+    }
+
+    const std::string& inputPath = args[0];
+    const std::string& outputPath = args[1];
+
+    uint32_t chunkSize = TrainingDataFile::DefaultChunkSize;
+    if (args.size() >= 4 && args[2] == "chunkSize")
+    {
+        chunkSize = std::max<uint32_t>(1, static_cast<uint32_t>(std::stoul(args[3])));
+    }
+
+    if (TrainingDataFile::IsCompressedFile(inputPath))
+    {
+        std::cout << "ERROR: Training data file is already compressed: " << inputPath << std::endl;
+        return;
+    }
+
+    FileInputStream inputStream(inputPath.c_str());
+    if (!inputStream.IsOpen())
+    {
+        std::cout << "ERROR: Failed to open training data file: " << inputPath << std::endl;
+        return;
+    }
+
+    const uint64_t numEntries = inputStream.GetSize() / sizeof(PositionEntry);
+
+    const TimePoint startTime = TimePoint::GetCurrent();
+    {
+        FileOutputStream outputStream(outputPath.c_str());
+        if (!outputStream.IsOpen())
+        {
+            std::cout << "ERROR: Failed to open output file: " << outputPath << std::endl;
+            return;
+        }
+
+        TrainingDataFile::Writer writer(outputStream, chunkSize);
+
+        std::vector<PositionEntry> entries;
+        for (uint64_t i = 0; i < numEntries; i += entries.size())
+        {
+            entries.resize(std::min<uint64_t>(c_ConversionBatchSize, numEntries - i));
+            if (!inputStream.Read(entries.data(), entries.size() * sizeof(PositionEntry)))
+            {
+                std::cout << "ERROR: Failed to read training data file: " << inputPath << std::endl;
+                return;
+            }
+
+            for (const PositionEntry& entry : entries)
+            {
+                if (!writer.Write(entry))
+                {
+                    return;
+                }
+            }
+        }
+
+        if (!writer.Finish())
+        {
+            return;
+        }
+    }
+    const float encodingTime = (TimePoint::GetCurrent() - startTime).ToSeconds();
+
+    const uint64_t inputSize = numEntries * sizeof(PositionEntry);
+    const uint64_t outputSize = std::filesystem::file_size(outputPath);
+
+    std::cout << "Converted " << numEntries << " positions in " << encodingTime << " s" << std::endl;
+    std::cout << "Size: " << inputSize << " -> " << outputSize << " bytes (" << (100.0 * outputSize / std::max<uint64_t>(1, inputSize)) << "%), "
+        << (numEntries ? static_cast<double>(outputSize) / numEntries : 0.0) << " bytes per position" << std::endl;
+
+    // verify the output
+    FileInputStream compressedStream(outputPath.c_str());
+    TrainingDataFile::Reader reader;
+    if (!reader.Open(compressedStream) || reader.GetNumEntries() != numEntries)
+    {
+        std::cout << "ERROR: Failed to open converted file: " << outputPath << std::endl;
+        return;
+    }
+
+    {
+        inputStream.SetPosition(0);
+
+        std::vector<PositionEntry> inputEntries;
+        std::vector<PositionEntry> decodedEntries;
+        for (uint32_t chunkIndex = 0; chunkIndex < reader.GetNumChunks(); ++chunkIndex)
+        {
+            if (!reader.ReadChunk(compressedStream, chunkIndex, decodedEntries))
+            {
+                return;
+            }
+
+            inputEntries.resize(decodedEntries.size());
+            if (!inputStream.Read(inputEntries.data(), inputEntries.size() * sizeof(PositionEntry)) ||
+                memcmp(inputEntries.data(), decodedEntries.data(), inputEntries.size() * sizeof(PositionEntry)) != 0)
+            {
+                std::cout << "ERROR: Decoded chunk " << chunkIndex << " does not match the input" << std::endl;
+                return;
+            }
+        }
+    }
+
+    // measure decoding throughput with a single and all threads
+    const uint32_t numThreads = ThreadPool::GetInstance().GetNumThreads();
+    for (const uint32_t numTasks : { 1u, numThreads })
+    {
+        float decodingTime = 0.0f;
+        const uint64_t numDecodedEntries = DecodeAllChunks(outputPath, reader, numTasks, decodingTime);
+
+        if (numDecodedEntries != numEntries)
+        {
+            std::cout << "ERROR: Decoded " << numDecodedEntries << " positions, expected " << numEntries << std::endl;
+            return;
+        }
+
+        std::cout << "Decoding (" << numTasks << (numTasks > 1 ? " threads): " : " thread): ")
+            << decodingTime << " s, "
+            << static_cast<uint64_t>(numDecodedEntries / std::max(1.0e-6f, decodingTime)) << " pos/sec, "
+            << (numDecodedEntries * sizeof(PositionEntry) / (1024.0 * 1024.0) / std::max(1.0e-6f, decodingTime)) << " MB/s of raw data" << std::endl;
+
+        if (numThreads == 1)
+        {
+            break;
+        }
+    }
+}
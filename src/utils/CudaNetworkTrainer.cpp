@@ -60,6 +60,7 @@ public:
         for (uint32_t i = 0; i < ThreadPool::GetInstance().GetNumThreads(); ++i)
         {
             m_randomGenerators.emplace_back(m_randomDevice());
+            m_dataLoaderThreadContexts.emplace_back();
         }
 
         // Initialize CUDA batch data
@@ -112,6 +113,7 @@ private:
     };
 
     TrainingDataLoader m_dataLoader;
+    std::vector<TrainingDataLoader::ThreadContext> m_dataLoaderThreadContexts; // per-thread sampler state
 
     nn::WeightsStoragePtr m_featureTransformerWeights;
     nn::WeightsStoragePtr m_lastLayerWeights;
@@ -209,7 +211,7 @@ void CudaNetworkTrainer::GenerateTrainingSet(TrainingDataSet& outSet, TaskBuilde
 
         auto& rng = m_randomGenerators[ctx.threadId];
 
-        if (!m_dataLoader.FetchNextPosition(rng, entry, pos, kingBucketMask))
+        if (!m_dataLoader.FetchNextPosition(m_dataLoaderThreadContexts[ctx.threadId], rng, entry, pos, kingBucketMask))
             return;
 
         // flip the board randomly in pawnless positions
@@ -0,0 +1,780 @@
+#include "Common.hpp"
+#include "ThreadPool.hpp"
+#include "TrainerCommon.hpp"
+
+#include "../backend/Time.hpp"
+#include "../backend/Waitable.hpp"
+
+#include <filesystem>
+#include <algorithm>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <iomanip>
+
+using namespace threadpool;
+
+// Deduplication of training positions, keyed on Position::GetHash().
+// Pass 1: input files are read in parallel and entries, tagged with their input order, are scattered into hash
+//         partitions, kept in memory or spilled to temporary files when the corpus doesn't fit the memory budget.
+//         Partitions still exceeding the per-thread budget are split again on the next hash bits, one at a time,
+//         so the number of open temporary files never exceeds c_NumPartitions.
+// Pass 2: partitions are sorted by hash and input order in parallel (each fits in memory) and runs of equal
+//         hashes are merged according to the policy. Partitions are written in order, so the output is ordered
+//         by hash (shuffled as a side effect) and doesn't depend on thread scheduling.
+
+enum class DedupPolicy : uint8_t
+{
+    KeepFirst,      // keep the first copy (in input order)
+    Average,        // keep a single copy with averaged score and the most frequent game result
+    Cap,            // keep the first 'maxCopies' copies (in input order)
+};
+
+struct DedupParams
+{
+    DedupPolicy policy = DedupPolicy::KeepFirst;
+    uint32_t maxCopies = 4;
+    float memoryInGB = 4.0f;
+    std::string outputPath;
+    std::string tempPath;
+    bool compressedOutput = false;
+};
+
+struct HashedEntry
+{
+    uint64_t hash;
+    uint64_t inputIndex; // read task index in the upper 32 bits, entry index within the task in the lower 32 bits
+    PositionEntry entry;
+};
+
+static_assert(sizeof(HashedEntry) == 48, "Invalid HashedEntry size");
+
+// memory needed to deduplicate a single entry in the second pass (sorted entry and merged output entry)
+static constexpr uint64_t c_BytesPerEntry = sizeof(HashedEntry) + sizeof(PositionEntry);
+
+// number of entries read and partitioned by a single task
+static constexpr uint64_t c_EntriesPerTask = 256 * 1024;
+
+// number of most duplicated positions reported
+static constexpr uint32_t c_NumTopPositions = 10;
+
+// fan-out of a single on-disk partitioning pass (number of temporary files open at once)
+static constexpr uint32_t c_PartitionBits = 8;
+static constexpr uint32_t c_NumPartitions = 1u << c_PartitionBits;
+
+// max depth of recursive partitioning, deeper levels would use the hash bits consumed by GetPartitionIndex
+static constexpr uint32_t c_MaxPartitionLevels = 4;
+
+struct InputFile
+{
+    std::string path;
+    std::unique_ptr<TrainingDataFile::Reader> compressedFile; // null for raw PositionEntry files
+    uint64_t numEntries = 0;
+};
+
+// range of entries (raw files) or chunks (compressed files) of a single input file
+struct ReadTask
+{
+    uint32_t fileIndex;
+    uint64_t begin;
+    uint64_t count;
+};
+
+struct Partition
+{
+    std::mutex mutex;
+    std::unique_ptr<FileOutputStream> file; // null if kept in memory
+    std::string path;
+    std::vector<HashedEntry> entries;
+    uint64_t numEntries = 0;
+};
+
+struct DedupStats
+{
+    std::atomic<uint64_t> numInputEntries = 0;
+    std::atomic<uint64_t> numInvalidEntries = 0;
+    std::atomic<uint64_t> numUniquePositions = 0;
+    std::atomic<uint64_t> numOutputEntries = 0;
+    std::atomic<uint64_t> copiesHistogram[5] = {}; // 1, 2-9, 10-99, 100-999, 1000+ copies
+
+    std::mutex mutex;
+    std::vector<std::pair<uint64_t, PositionEntry>> topPositions; // (number of copies, entry)
+};
+
+// partition index at given recursion level, every level consumes next c_PartitionBits of the hash
+static uint32_t GetPartitionIndex(uint64_t hash, uint32_t numPartitions, uint32_t level = 0)
+{
+    return static_cast<uint32_t>((((hash << (level * c_PartitionBits)) >> 32) * numPartitions) >> 32);
+}
+
+// group entries by partition (counting sort), so every partition can be appended with a single write
+static void GroupByPartition(const std::vector<HashedEntry>& entries, uint32_t numPartitions, uint32_t level,
+                             std::vector<HashedEntry>& outEntries, std::vector<uint32_t>& outOffsets)
+{
+    outOffsets.assign(numPartitions + 1, 0);
+    for (const HashedEntry& entry : entries)
+    {
+        outOffsets[GetPartitionIndex(entry.hash, numPartitions, level) + 1]++;
+    }
+    for (uint32_t i = 0; i < numPartitions; ++i)
+    {
+        outOffsets[i + 1] += outOffsets[i];
+    }
+
+    outEntries.resize(entries.size());
+    std::vector<uint32_t> cursors(outOffsets.begin(), outOffsets.end() - 1);
+    for (const HashedEntry& entry : entries)
+    {
+        outEntries[cursors[GetPartitionIndex(entry.hash, numPartitions, level)]++] = entry;
+    }
+}
+
+// scatter an on-disk partition into c_NumPartitions sub-partitions using the hash bits of the next level
+// sub-partitions are appended to 'outPartitions' in hash order, files are created only for non-empty ones
+static bool SplitPartition(Partition& partition, uint32_t level, std::deque<Partition>& outPartitions, std::vector<Partition*>& outSubPartitions)
+{
+    outSubPartitions.clear();
+    for (uint32_t i = 0; i < c_NumPartitions; ++i)
+    {
+        outSubPartitions.push_back(&outPartitions.emplace_back());
+    }
+
+    FileInputStream stream(partition.path.c_str());
+    if (!stream.IsOpen())
+    {
+        std::cout << "ERROR: Failed to read temporary file: " << partition.path << std::endl;
+        return false;
+    }
+
+    std::vector<HashedEntry> entries;
+    std::vector<HashedEntry> sortedEntries;
+    std::vector<uint32_t> offsets;
+
+    for (uint64_t begin = 0; begin < partition.numEntries; begin += c_EntriesPerTask)
+    {
+        entries.resize(std::min(c_EntriesPerTask, partition.numEntries - begin));
+        if (!stream.Read(entries.data(), entries.size() * sizeof(HashedEntry)))
+        {
+            std::cout << "ERROR: Failed to read temporary file: " << partition.path << std::endl;
+            return false;
+        }
+
+        GroupByPartition(entries, c_NumPartitions, level, sortedEntries, offsets);
+
+        for (uint32_t i = 0; i < c_NumPartitions; ++i)
+        {
+            const uint32_t numEntries = offsets[i + 1] - offsets[i];
+            if (numEntries == 0)
+            {
+                continue;
+            }
+
+            Partition& subPartition = *outSubPartitions[i];
+            if (!subPartition.file)
+            {
+                subPartition.path = partition.path + "." + std::to_string(i);
+                subPartition.file = std::make_unique<FileOutputStream>(subPartition.path.c_str());
+                if (!subPartition.file->IsOpen())
+                {
+                    std::cout << "ERROR: Failed to create temporary file: " << subPartition.path << std::endl;
+                    return false;
+                }
+            }
+
+            if (!subPartition.file->Write(sortedEntries.data() + offsets[i], numEntries * sizeof(HashedEntry)))
+            {
+                std::cout << "ERROR: Failed to write temporary file: " << subPartition.path << std::endl;
+                return false;
+            }
+            subPartition.numEntries += numEntries;
+        }
+    }
+
+    for (Partition* subPartition : outSubPartitions)
+    {
+        subPartition->file.reset();
+    }
+
+    std::filesystem::remove(partition.path);
+    return true;
+}
+
+// split oversized partitions recursively, collecting partitions processed by the second pass in hash order
+static bool CollectLeafPartitions(Partition& partition, uint32_t level, uint64_t maxPartitionEntries, std::deque<Partition>& subPartitionStorage, std::vector<Partition*>& outLeafPartitions)
+{
+    if (partition.numEntries == 0)
+    {
+        if (!partition.path.empty())
+        {
+            std::filesystem::remove(partition.path);
+        }
+        return true;
+    }
+
+    if (partition.path.empty() || partition.numEntries <= maxPartitionEntries)
+    {
+        outLeafPartitions.push_back(&partition);
+        return true;
+    }
+
+    if (level + 1 >= c_MaxPartitionLevels)
+    {
+        // most likely a single position with enormous number of copies, can't be split further
+        std::cout << "WARNING: Partition " << partition.path << " exceeds the memory budget (" << partition.numEntries << " positions)" << std::endl;
+        outLeafPartitions.push_back(&partition);
+        return true;
+    }
+
+    std::vector<Partition*> subPartitions;
+    if (!SplitPartition(partition, level + 1, subPartitionStorage, subPartitions))
+    {
+        return false;
+    }
+
+    for (Partition* subPartition : subPartitions)
+    {
+        if (!CollectLeafPartitions(*subPartition, level + 1, maxPartitionEntries, subPartitionStorage, outLeafPartitions))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void AddTopPosition(std::vector<std::pair<uint64_t, PositionEntry>>& topPositions, uint64_t numCopies, const PositionEntry& entry)
+{
+    if (topPositions.size() < c_NumTopPositions || numCopies > topPositions.back().first)
+    {
+        if (topPositions.size() == c_NumTopPositions)
+        {
+            topPositions.pop_back();
+        }
+
+        const auto iter = std::find_if(topPositions.begin(), topPositions.end(), [numCopies](const auto& p) { return p.first < numCopies; });
+        topPositions.insert(iter, { numCopies, entry });
+    }
+}
+
+static bool ReadTaskEntries(const InputFile& file, const ReadTask& task, std::vector<PositionEntry>& outEntries)
+{
+    outEntries.clear();
+
+    FileInputStream stream(file.path.c_str());
+    if (!stream.IsOpen())
+    {
+        return false;
+    }
+
+    if (file.compressedFile)
+    {
+        std::vector<PositionEntry> chunkEntries;
+        for (uint64_t i = 0; i < task.count; ++i)
+        {
+            if (!file.compressedFile->ReadChunk(stream, static_cast<uint32_t>(task.begin + i), chunkEntries))
+            {
+                return false;
+            }
+            outEntries.insert(outEntries.end(), chunkEntries.begin(), chunkEntries.end());
+        }
+        return true;
+    }
+
+    outEntries.resize(task.count);
+    return stream.SetPosition(task.begin * sizeof(PositionEntry)) &&
+        stream.Read(outEntries.data(), task.count * sizeof(PositionEntry));
+}
+
+// merge a run of entries with equal hashes according to the policy
+static void MergeDuplicates(const DedupParams& params, const HashedEntry* begin, const HashedEntry* end, std::vector<PositionEntry>& outEntries)
+{
+    const size_t numCopies = end - begin;
+
+    switch (params.policy)
+    {
+    case DedupPolicy::KeepFirst:
+        outEntries.push_back(begin->entry);
+        break;
+
+    case DedupPolicy::Cap:
+        for (size_t i = 0; i < std::min<size_t>(numCopies, params.maxCopies); ++i)
+        {
+            outEntries.push_back(begin[i].entry);
+        }
+        break;
+
+    case DedupPolicy::Average:
+    {
+        int64_t scoreSum = 0;
+        uint32_t resultCounts[3] = { 0, 0, 0 };
+        for (const HashedEntry* iter = begin; iter != end; ++iter)
+        {
+            scoreSum += iter->entry.score;
+            if (iter->entry.wdlScore < 3)
+            {
+                resultCounts[iter->entry.wdlScore]++;
+            }
+        }
+
+        PositionEntry entry = begin->entry;
+        entry.score = static_cast<ScoreType>(scoreSum / static_cast<int64_t>(numCopies));
+
+        // most frequent game result, draw on ties
+        if (resultCounts[0] + resultCounts[1] + resultCounts[2] > 0)
+        {
+            uint8_t result = static_cast<uint8_t>(Game::Score::Draw);
+            if (resultCounts[1] > resultCounts[result]) result = static_cast<uint8_t>(Game::Score::WhiteWins);
+            if (resultCounts[2] > resultCounts[result]) result = static_cast<uint8_t>(Game::Score::BlackWins);
+            entry.wdlScore = result;
+        }
+
+        outEntries.push_back(entry);
+        break;
+    }
+    }
+}
+
+static bool CollectInputFiles(const std::vector<std::string>& paths, std::vector<InputFile>& outFiles)
+{
+    for (const std::string& path : paths)
+    {
+        std::vector<std::string> filePaths;
+        if (std::filesystem::is_directory(path))
+        {
+            for (const auto& entry : std::filesystem::directory_iterator(path))
+            {
+                if (entry.is_regular_file())
+                {
+                    filePaths.push_back(entry.path().string());
+                }
+            }
+            std::sort(filePaths.begin(), filePaths.end());
+        }
+        else
+        {
+            filePaths.push_back(path);
+        }
+
+        for (const std::string& filePath : filePaths)
+        {
+            InputFile file;
+            file.path = filePath;
+
+            FileInputStream stream(filePath.c_str());
+            if (!stream.IsOpen())
+            {
+                std::cout << "ERROR: Failed to open training data file: " << filePath << std::endl;
+                return false;
+            }
+
+            if (TrainingDataFile::IsCompressedFile(filePath))
+            {
+                file.compressedFile = std::make_unique<TrainingDataFile::Reader>();
+                if (!file.compressedFile->Open(stream))
+                {
+                    return false;
+                }
+                file.numEntries = file.compressedFile->GetNumEntries();
+            }
+            else
+            {
+                file.numEntries = stream.GetSize() / sizeof(PositionEntry);
+            }
+
+            outFiles.push_back(std::move(file));
+        }
+    }
+
+    return true;
+}
+
+static bool DedupTrainingData(const std::vector<std::string>& inputPaths, const DedupParams& params)
+{
+    std::vector<InputFile> inputFiles;
+    if (!CollectInputFiles(inputPaths, inputFiles))
+    {
+        return false;
+    }
+
+    uint64_t totalNumEntries = 0;
+    std::vector<ReadTask> readTasks;
+    for (uint32_t fileIndex = 0; fileIndex < inputFiles.size(); ++fileIndex)
+    {
+        const InputFile& file = inputFiles[fileIndex];
+        totalNumEntries += file.numEntries;
+
+        const uint64_t numUnits = file.compressedFile ? file.compressedFile->GetNumChunks() : file.numEntries;
+        const uint64_t unitsPerTask = file.compressedFile ? std::max<uint64_t>(1, c_EntriesPerTask / TrainingDataFile::DefaultChunkSize) : c_EntriesPerTask;
+        for (uint64_t begin = 0; begin < numUnits; begin += unitsPerTask)
+        {
+            readTasks.push_back({ fileIndex, begin, std::min(unitsPerTask, numUnits - begin) });
+        }
+    }
+
+    if (totalNumEntries == 0)
+    {
+        std::cout << "ERROR: No training data found" << std::endl;
+        return false;
+    }
+
+    // every partition, together with its merged output, must fit in memory while all threads process one partition
+    // each in the second pass (the sort is in place, so there is no scratch buffer)
+    // the on-disk fan-out is fixed to keep the number of open files low, oversized partitions are split later
+    const uint32_t numThreads = ThreadPool::GetInstance().GetNumThreads();
+    const double memoryBudget = static_cast<double>(params.memoryInGB) * 1024.0 * 1024.0 * 1024.0;
+    const double requiredMemory = static_cast<double>(totalNumEntries) * c_BytesPerEntry;
+    const bool inMemory = requiredMemory <= memoryBudget;
+    const uint64_t maxPartitionEntries = std::max<uint64_t>(1, static_cast<uint64_t>(memoryBudget / numThreads / c_BytesPerEntry));
+    const uint32_t numPartitions = inMemory ? numThreads : c_NumPartitions;
+
+    std::cout << "Deduplicating " << totalNumEntries << " positions from " << inputFiles.size() << " files, "
+        << numPartitions << (inMemory ? " partitions in memory" : " partitions on disk") << std::endl;
+
+    std::vector<Partition> partitions(numPartitions);
+    if (!inMemory)
+    {
+        const std::string tempPath = params.tempPath.empty() ? params.outputPath : params.tempPath + "/" + std::filesystem::path(params.outputPath).filename().string();
+        for (uint32_t i = 0; i < numPartitions; ++i)
+        {
+            partitions[i].path = tempPath + ".part" + std::to_string(i);
+            partitions[i].file = std::make_unique<FileOutputStream>(partitions[i].path.c_str());
+            if (!partitions[i].file->IsOpen())
+            {
+                std::cout << "ERROR: Failed to create temporary file: " << partitions[i].path << std::endl;
+                return false;
+            }
+        }
+    }
+
+    DedupStats stats;
+    std::atomic<bool> failed = false;
+
+    // pass 1: scatter entries into partitions
+    TimePoint startTime = TimePoint::GetCurrent();
+    {
+        Waitable waitable;
+        {
+            TaskBuilder taskBuilder(waitable);
+            taskBuilder.ParallelFor("PartitionEntries", static_cast<uint32_t>(readTasks.size()), [&](const TaskContext&, uint32_t taskIndex)
+            {
+                const ReadTask& task = readTasks[taskIndex];
+
+                std::vector<PositionEntry> entries;
+                if (!ReadTaskEntries(inputFiles[task.fileIndex], task, entries))
+                {
+                    std::cout << "ERROR: Failed to read training data file: " << inputFiles[task.fileIndex].path << std::endl;
+                    failed = true;
+                    return;
+                }
+
+                std::vector<HashedEntry> hashedEntries;
+                hashedEntries.reserve(entries.size());
+
+                Position pos;
+                for (uint32_t i = 0; i < entries.size(); ++i)
+                {
+                    if (UnpackPosition(entries[i].pos, pos, true) && pos.IsValid())
+                    {
+                        hashedEntries.push_back({ pos.GetHash(), (static_cast<uint64_t>(taskIndex) << 32) | i, entries[i] });
+                    }
+                }
+
+                stats.numInputEntries += entries.size();
+                stats.numInvalidEntries += entries.size() - hashedEntries.size();
+
+                std::vector<HashedEntry> sortedEntries;
+                std::vector<uint32_t> offsets;
+                GroupByPartition(hashedEntries, numPartitions, 0, sortedEntries, offsets);
+
+                for (uint32_t i = 0; i < numPartitions; ++i)
+                {
+                    const uint32_t numEntries = offsets[i + 1] - offsets[i];
+                    if (numEntries == 0)
+                    {
+                        continue;
+                    }
+
+                    Partition& partition = partitions[i];
+                    std::unique_lock<std::mutex> lock(partition.mutex);
+
+                    if (partition.file)
+                    {
+                        if (!partition.file->Write(sortedEntries.data() + offsets[i], numEntries * sizeof(HashedEntry)))
+                        {
+                            std::cout << "ERROR: Failed to write temporary file: " << partition.path << std::endl;
+                            failed = true;
+                        }
+                    }
+                    else
+                    {
+                        partition.entries.insert(partition.entries.end(), sortedEntries.begin() + offsets[i], sortedEntries.begin() + offsets[i + 1]);
+                    }
+
+                    partition.numEntries += numEntries;
+                }
+            });
+        }
+        waitable.Wait();
+    }
+
+    for (Partition& partition : partitions)
+    {
+        partition.file.reset();
+    }
+
+    // split partitions that don't fit the per-thread memory budget (e.g. fan-out was capped)
+    std::deque<Partition> subPartitions;
+    std::vector<Partition*> leafPartitions;
+    for (uint32_t i = 0; i < numPartitions && !failed; ++i)
+    {
+        if (!CollectLeafPartitions(partitions[i], 0, maxPartitionEntries, subPartitions, leafPartitions))
+        {
+            failed = true;
+        }
+    }
+
+    if (!subPartitions.empty())
+    {
+        std::cout << "Split oversized partitions into " << leafPartitions.size() << " partitions" << std::endl;
+    }
+
+    std::cout << "Partitioning time: " << (TimePoint::GetCurrent() - startTime).ToSeconds() << " s" << std::endl;
+
+    FileOutputStream outputStream(params.outputPath.c_str());
+    std::unique_ptr<TrainingDataFile::Writer> compressedWriter;
+    std::mutex outputMutex;
+
+    if (!failed && !outputStream.IsOpen())
+    {
+        std::cout << "ERROR: Failed to open output file: " << params.outputPath << std::endl;
+        failed = true;
+    }
+
+    if (params.compressedOutput)
+    {
+        compressedWriter = std::make_unique<TrainingDataFile::Writer>(outputStream);
+    }
+
+    const auto writeOutputEntries = [&](const std::vector<PositionEntry>& entries)
+    {
+        if (compressedWriter)
+        {
+            for (const PositionEntry& entry : entries)
+            {
+                if (!compressedWriter->Write(entry))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        if (!outputStream.Write(entries.data(), entries.size() * sizeof(PositionEntry)))
+        {
+            std::cout << "ERROR: Failed to write output file: " << params.outputPath << std::endl;
+            return false;
+        }
+        return true;
+    };
+
+    // pass 2: merge duplicates within partitions
+    // partitions are processed in batches of one partition per thread, so the merged outputs waiting for preceding
+    // partitions to be written never exceed the memory budget
+    startTime = TimePoint::GetCurrent();
+    for (size_t batchBegin = 0; batchBegin < leafPartitions.size() && !failed; batchBegin += numThreads)
+    {
+        const uint32_t batchSize = static_cast<uint32_t>(std::min<size_t>(numThreads, leafPartitions.size() - batchBegin));
+
+        // outputs are written in partition order, as soon as all preceding partitions of the batch are done
+        std::vector<std::vector<PositionEntry>> batchOutputs(batchSize);
+        std::vector<uint8_t> batchDone(batchSize, 0);
+        uint32_t numWrittenPartitions = 0;
+
+        Waitable waitable;
+        {
+            TaskBuilder taskBuilder(waitable);
+            taskBuilder.ParallelFor("DedupPartitions", batchSize, [&](const TaskContext&, uint32_t batchIndex)
+            {
+                Partition& partition = *leafPartitions[batchBegin + batchIndex];
+
+                std::vector<HashedEntry> entries = std::move(partition.entries);
+                if (!partition.path.empty())
+                {
+                    entries.resize(partition.numEntries);
+
+                    FileInputStream stream(partition.path.c_str());
+                    if (!stream.IsOpen() || !stream.Read(entries.data(), entries.size() * sizeof(HashedEntry)))
+                    {
+                        std::cout << "ERROR: Failed to read temporary file: " << partition.path << std::endl;
+                        failed = true;
+                        return;
+                    }
+                }
+
+                std::sort(entries.begin(), entries.end(), [](const HashedEntry& a, const HashedEntry& b)
+                {
+                    return a.hash != b.hash ? a.hash < b.hash : a.inputIndex < b.inputIndex;
+                });
+
+                std::vector<PositionEntry> outputEntries;
+                std::vector<std::pair<uint64_t, PositionEntry>> topPositions;
+                uint64_t copiesHistogram[5] = {};
+
+                for (size_t runBegin = 0; runBegin < entries.size(); )
+                {
+                    size_t runEnd = runBegin + 1;
+                    while (runEnd < entries.size() && entries[runEnd].hash == entries[runBegin].hash)
+                    {
+                        runEnd++;
+                    }
+
+                    const uint64_t numCopies = runEnd - runBegin;
+                    copiesHistogram[numCopies == 1 ? 0 : std::min<uint32_t>(4, static_cast<uint32_t>(std::log10(static_cast<double>(numCopies))) + 1)]++;
+                    AddTopPosition(topPositions, numCopies, entries[runBegin].entry);
+
+                    MergeDuplicates(params, entries.data() + runBegin, entries.data() + runEnd, outputEntries);
+                    runBegin = runEnd;
+                }
+
+                entries = std::vector<HashedEntry>();
+
+                if (!partition.path.empty())
+                {
+                    std::filesystem::remove(partition.path);
+                }
+
+                stats.numOutputEntries += outputEntries.size();
+                for (uint32_t i = 0; i < 5; ++i)
+                {
+                    stats.copiesHistogram[i] += copiesHistogram[i];
+                    stats.numUniquePositions += copiesHistogram[i];
+                }
+
+                {
+                    std::unique_lock<std::mutex> lock(stats.mutex);
+                    for (const auto& topPosition : topPositions)
+                    {
+                        AddTopPosition(stats.topPositions, topPosition.first, topPosition.second);
+                    }
+                }
+
+                {
+                    std::unique_lock<std::mutex> lock(outputMutex);
+                    batchOutputs[batchIndex] = std::move(outputEntries);
+                    batchDone[batchIndex] = 1;
+
+                    while (numWrittenPartitions < batchSize && batchDone[numWrittenPartitions])
+                    {
+                        if (!failed && !writeOutputEntries(batchOutputs[numWrittenPartitions]))
+                        {
+                            failed = true;
+                        }
+                        batchOutputs[numWrittenPartitions] = std::vector<PositionEntry>();
+                        numWrittenPartitions++;
+                    }
+                }
+            });
+        }
+        waitable.Wait();
+    }
+
+    if (compressedWriter && !compressedWriter->Finish())
+    {
+        failed = true;
+    }
+
+    const auto removeTempFile = [](const Partition& partition)
+    {
+        if (!partition.path.empty() && std::filesystem::exists(partition.path))
+        {
+            std::filesystem::remove(partition.path);
+        }
+    };
+    std::for_each(partitions.begin(), partitions.end(), removeTempFile);
+    std::for_each(subPartitions.begin(), subPartitions.end(), removeTempFile);
+
+    if (failed)
+    {
+        return false;
+    }
+
+    std::cout << "Deduplication time: " << (TimePoint::GetCurrent() - startTime).ToSeconds() << " s" << std::endl;
+
+    const uint64_t numValidEntries = stats.numInputEntries - stats.numInvalidEntries;
+    std::cout << "Input positions:    " << stats.numInputEntries << " (" << stats.numInvalidEntries << " invalid)" << std::endl;
+    std::cout << "Unique positions:   " << stats.numUniquePositions << std::endl;
+    std::cout << "Duplicate rate:     " << (100.0 * (numValidEntries - stats.numUniquePositions) / std::max<uint64_t>(1, numValidEntries)) << "%" << std::endl;
+    std::cout << "Output positions:   " << stats.numOutputEntries << std::endl;
+    std::cout << "Positions by number of copies:" << std::endl;
+
+    const char* histogramLabels[] = { "1", "2-9", "10-99", "100-999", "1000+" };
+    for (uint32_t i = 0; i < 5; ++i)
+    {
+        std::cout << "    " << std::setw(8) << histogramLabels[i] << ": " << stats.copiesHistogram[i] << std::endl;
+    }
+
+    std::cout << "Most duplicated positions:" << std::endl;
+    for (const auto& [numCopies, entry] : stats.topPositions)
+    {
+        Position pos;
+        VERIFY(UnpackPosition(entry.pos, pos, false));
+        std::cout << "    " << std::setw(10) << numCopies << "  " << pos.ToFEN(true) << std::endl;
+    }
+
+    return true;
+}
+
+// remove duplicated positions from training data files
+void DedupTrainingData(const std::vector<std::string>& args)
+{
+    DedupParams params;
+    std::vector<std::string> inputPaths;
+
+    for (size_t i = 0; i < args.size(); ++i)
+    {
+        if (args[i] == "output" && i + 1 < args.size())
+        {
+            params.outputPath = args[++i];
+        }
+        else if (args[i] == "policy" && i + 1 < args.size())
+        {
+            const std::string& policy = args[++i];
+            if (policy == "first")          params.policy = DedupPolicy::KeepFirst;
+            else if (policy == "average")   params.policy = DedupPolicy::Average;
+            else if (policy == "cap")       params.policy = DedupPolicy::Cap;
+            else
+            {
+                std::cout << "ERROR: Unknown deduplication policy: " << policy << std::endl;
+                return;
+            }
+        }
+        else if (args[i] == "maxCopies" && i + 1 < args.size())
+        {
+            params.maxCopies = std::max<uint32_t>(1, static_cast<uint32_t>(std::stoul(args[++i])));
+        }
+        else if (args[i] == "memory" && i + 1 < args.size())
+        {
+            params.memoryInGB = std::stof(args[++i]);
+        }
+        else if (args[i] == "tmp" && i + 1 < args.size())
+        {
+            params.tempPath = args[++i];
+        }
+        else if (args[i] == "compressed")
+        {
+            params.compressedOutput = true;
+        }
+        else
+        {
+            inputPaths.push_back(args[i]);
+        }
+    }
+
+    if (inputPaths.empty() || params.outputPath.empty())
+    {
+        std::cout << "Usage: dedupTrainingData <files or directories> output <file> [policy first|average|cap] [maxCopies <n>] [memory <GB>] [tmp <dir>] [compressed]" << std::endl;
+        return;
+    }
+
+    DedupTrainingData(inputPaths, params);
+}
@@ -1,38 +1,149 @@
 #include "Common.hpp"
 #include "GameCollection.hpp"
+#include "ThreadPool.hpp"
+
+#include "../backend/Waitable.hpp"
 
 #include <filesystem>
 #include <fstream>
+#include <sstream>
+
+using namespace threadpool;
 
-static bool DumpGames(const std::string& path)
+// number of games converted to PGN by a single task
+static constexpr size_t c_GamesPerTask = 256;
+
+// convert the current game of a cursor to PGN, replaying it just once
+static void AppendGamePGN(GameCollection::GameReplayCursor& cursor, std::stringstream& moveList, std::string& output)
 {
-    std::vector<Move> moves;
+    moveList.str(std::string());
+
+    while (cursor.NextMove())
+    {
+        Game::WritePGNMove(moveList, cursor.GetPosition(), cursor.GetMove(), cursor.GetMoveIndex() == 0);
+    }
+
+    if (!cursor.IsValid())
+    {
+        return;
+    }
+
+    const Game::Score gameScore = cursor.GetGameScore();
+
+    std::stringstream str;
+    Game::WritePGNHeader(str, cursor.GetInitialPosition(), cursor.GetPosition(), gameScore,
+                         cursor.GetForcedScore() != Game::Score::Unknown, cursor.GetRepetitionCount());
+    str << moveList.str() << Game::ScoreToPGNResult(gameScore) << "\n\n";
+
+    output += str.str();
+}
 
+static bool DumpGames(const std::string& path, size_t firstGame, size_t maxGames)
+{
     if (!std::filesystem::exists(path))
     {
         return false;
     }
 
-    FileInputStream gamesFile(path.c_str());
-    if (!gamesFile.IsOpen())
+    GameCollection::Index index;
+    if (!index.LoadOrBuild(path))
     {
         std::cout << "ERROR: Failed to load selfplay data file: " << path << std::endl;
         return false;
     }
 
-    Game game;
-    while (GameCollection::ReadGame(gamesFile, game, moves))
+    const size_t endGame = std::min(index.GetNumGames(), firstGame + std::min(maxGames, index.GetNumGames()));
+    if (firstGame >= endGame)
     {
-        std::cout << game.ToPGN() << std::endl << std::endl;
+        return true;
     }
 
+    // convert games to PGN in parallel, in batches, so the output is written in order without keeping it all in memory
+    const size_t numTasksPerBatch = 4 * ThreadPool::GetInstance().GetNumThreads();
+    std::vector<std::string> taskOutputs(numTasksPerBatch);
+
+    for (size_t batchStart = firstGame; batchStart < endGame; batchStart += numTasksPerBatch * c_GamesPerTask)
+    {
+        const size_t numTasks = std::min(numTasksPerBatch, (endGame - batchStart + c_GamesPerTask - 1) / c_GamesPerTask);
+
+        Waitable waitable;
+        {
+            TaskBuilder taskBuilder(waitable);
+            taskBuilder.ParallelFor("DumpGames", static_cast<uint32_t>(numTasks), [&](const TaskContext&, uint32_t taskIndex)
+            {
+                const size_t taskFirstGame = batchStart + taskIndex * c_GamesPerTask;
+                const size_t taskEndGame = std::min(endGame, taskFirstGame + c_GamesPerTask);
+
+                std::string& output = taskOutputs[taskIndex];
+                output.clear();
+
+                size_t numGamesToSkip = 0;
+                FileInputStream gamesFile(path.c_str());
+                if (!gamesFile.IsOpen() || !index.SeekToGame(gamesFile, taskFirstGame, numGamesToSkip))
+                {
+                    return;
+                }
+
+                GameCollection::GameReplayCursor cursor(gamesFile);
+
+                // preceding games of a compact collection block
+                for (size_t i = 0; i < numGamesToSkip; ++i)
+                {
+                    if (!cursor.NextGame())
+                    {
+                        return;
+                    }
+                }
+
+                std::stringstream moveList;
+                for (size_t i = taskFirstGame; i < taskEndGame; ++i)
+                {
+                    if (!cursor.NextGame())
+                    {
+                        break;
+                    }
+
+                    AppendGamePGN(cursor, moveList, output);
+                }
+            });
+        }
+        waitable.Wait();
+
+        for (size_t i = 0; i < numTasks; ++i)
+        {
+            std::cout << taskOutputs[i];
+        }
+    }
+
+    std::cout << std::flush;
+
     return true;
 }
 
 void DumpGames(const std::vector<std::string>& args)
 {
-    for (const auto& path : args)
+    size_t firstGame = 0;
+    size_t maxGames = SIZE_MAX;
+
+    std::vector<std::string> paths;
+    for (size_t i = 0; i < args.size(); ++i)
+    {
+        if (args[i] == "first" && i + 1 < args.size())
+        {
+            firstGame = std::stoull(args[++i]);
+        }
+        else if (args[i] == "count" && i + 1 < args.size())
+        {
+            maxGames = std::stoull(args[++i]);
+        }
+        else
+        {
+            paths.push_back(args[i]);
+        }
+    }
+
+    for (const auto& path : paths)
     {
-        DumpGames(path);
+        DumpGames(path, firstGame, maxGames);
     }
 }
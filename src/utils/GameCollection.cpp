@@ -1,9 +1,25 @@
 #include "GameCollection.hpp"
+#include "BinaryEncoding.hpp"
 #include "../backend/Game.hpp"
+#include "../backend/MoveList.hpp"
+#include "../backend/MoveGen.hpp"
+#include "../backend/Evaluate.hpp"
+
+#include <filesystem>
+#include <algorithm>
 
 namespace GameCollection
 {
 
+    static bool IsValidGameScore(const Game::Score score)
+    {
+        return
+            score == Game::Score::Unknown ||
+            score == Game::Score::WhiteWins ||
+            score == Game::Score::BlackWins ||
+            score == Game::Score::Draw;
+    }
+
     bool ReadGame(InputStream& stream, Game& game, std::vector<Move>& decodedMoves)
     {
         GameHeader header{};
@@ -35,10 +51,7 @@ namespace GameCollection
             }
         }
 
-        if (header.forcedScore != Game::Score::Unknown &&
-            header.forcedScore != Game::Score::WhiteWins &&
-            header.forcedScore != Game::Score::BlackWins &&
-            header.forcedScore != Game::Score::Draw)
+        if (!IsValidGameScore(header.forcedScore))
         {
             std::cout << "Failed to parse game from " << stream.GetFileName() << ": invalid game score" << std::endl;
             return false;
@@ -79,7 +92,13 @@ namespace GameCollection
         return true;
     }
 
-    bool Writer::WriteGame(const Game& game)
+    bool IsGameCollectionPath(const std::string& path)
+    {
+        const std::string extension = std::filesystem::path(path).extension().string();
+        return extension == ".dat" || extension == ".bin";
+    }
+
+    bool SerializeGame(const Game& game, std::vector<uint8_t>& outBuffer)
     {
         ASSERT(game.GetMoves().size() <= UINT16_MAX);
 
@@ -93,32 +112,1340 @@ namespace GameCollection
             return false;
         }
 
-        std::vector<MoveAndScore> moves;
-        moves.reserve(game.GetMoves().size());
+        const size_t offset = outBuffer.size();
+        outBuffer.resize(offset + sizeof(GameHeader) + sizeof(MoveAndScore) * header.numMoves);
 
-        for (size_t i = 0; i < game.GetMoves().size(); ++i)
+        memcpy(outBuffer.data() + offset, &header, sizeof(GameHeader));
+
+        // Note: header is packed, so moves are not necessarily aligned
+        uint8_t* movesData = outBuffer.data() + offset + sizeof(GameHeader);
+        for (size_t i = 0; i < header.numMoves; ++i)
         {
             const int16_t moveScore = header.hasMoveScores ? game.GetMoveScores()[i] : 0;
-            moves.push_back({ game.GetMoves()[i], moveScore });
+            const MoveAndScore moveAndScore{ game.GetMoves()[i], moveScore };
+            memcpy(movesData + i * sizeof(MoveAndScore), &moveAndScore, sizeof(MoveAndScore));
+        }
+
+        return true;
+    }
+
+    static constexpr uint32_t c_IndexMagic = 'GIDX';
+    static constexpr uint32_t c_IndexVersion = 1;
+
+#pragma pack(push, 1)
+    struct IndexFileHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t numGames;
+        uint64_t collectionSize;
+    };
+#pragma pack(pop)
+
+    std::string Index::GetIndexPath(const std::string& collectionPath)
+    {
+        return collectionPath + ".idx";
+    }
+
+    void Index::Clear()
+    {
+        mEntries.clear();
+        mCollectionSize = 0;
+    }
+
+    bool Index::Build(InputStream& stream)
+    {
+        const uint64_t streamSize = stream.GetSize();
+
+        if (IsCompactCollection(stream))
+        {
+            return BuildCompact(stream);
+        }
+
+        if (mCollectionSize > streamSize || !stream.SetPosition(mCollectionSize))
+        {
+            Clear();
+            if (!stream.SetPosition(0))
+            {
+                return false;
+            }
+        }
+
+        uint64_t offset = mCollectionSize;
+        while (offset + sizeof(GameHeader) <= streamSize)
+        {
+            GameHeader header{};
+            if (!stream.Read(&header, sizeof(header)))
+            {
+                std::cout << "Failed to read game header in file " << stream.GetFileName() << " offset=" << offset << std::endl;
+                return false;
+            }
+
+            if (!IsValidGameScore(header.forcedScore))
+            {
+                std::cout << "Failed to index " << stream.GetFileName() << ": invalid game score at offset=" << offset << std::endl;
+                return false;
+            }
+
+            const uint64_t gameSize = sizeof(GameHeader) + sizeof(MoveAndScore) * header.numMoves;
+            if (offset + gameSize > streamSize)
+            {
+                // incomplete game at the end of the collection
+                break;
+            }
+
+            mEntries.push_back(Entry{ offset, header.numMoves });
+            offset += gameSize;
+
+            if (!stream.SetPosition(offset))
+            {
+                return false;
+            }
+        }
+
+        mCollectionSize = offset;
+        return true;
+    }
+
+    bool Index::Load(const std::string& indexPath)
+    {
+        Clear();
+
+        FileInputStream stream(indexPath.c_str());
+        if (!stream.IsOpen())
+        {
+            return false;
+        }
+
+        IndexFileHeader header{};
+        if (!stream.Read(&header, sizeof(header)) ||
+            header.magic != c_IndexMagic ||
+            header.version != c_IndexVersion ||
+            stream.GetSize() != sizeof(IndexFileHeader) + header.numGames * sizeof(Entry))
+        {
+            std::cout << "Invalid game collection index file: " << indexPath << std::endl;
+            return false;
+        }
+
+        mEntries.resize(header.numGames);
+        if (header.numGames > 0 && !stream.Read(mEntries.data(), header.numGames * sizeof(Entry)))
+        {
+            std::cout << "Failed to read game collection index file: " << indexPath << std::endl;
+            Clear();
+            return false;
+        }
+
+        mCollectionSize = header.collectionSize;
+        return true;
+    }
+
+    bool Index::Save(const std::string& indexPath) const
+    {
+        // write to a temporary file first, so readers never see partially written index
+        const std::string tempPath = indexPath + ".tmp";
+        {
+            FileOutputStream stream(tempPath.c_str());
+            if (!stream.IsOpen())
+            {
+                return false;
+            }
+
+            const IndexFileHeader header{ c_IndexMagic, c_IndexVersion, mEntries.size(), mCollectionSize };
+            if (!stream.Write(&header, sizeof(header)) ||
+                !stream.Write(mEntries.data(), mEntries.size() * sizeof(Entry)))
+            {
+                std::cout << "Failed to write game collection index file: " << indexPath << std::endl;
+                return false;
+            }
+        }
+
+        std::error_code errorCode;
+        std::filesystem::rename(tempPath, indexPath, errorCode);
+        return !errorCode;
+    }
+
+    bool Index::LoadOrBuild(const std::string& collectionPath, bool save)
+    {
+        const std::string indexPath = GetIndexPath(collectionPath);
+
+        if (!std::filesystem::exists(indexPath) || !Load(indexPath))
+        {
+            Clear();
+        }
+
+        const size_t numIndexedGames = mEntries.size();
+
+        FileInputStream stream(collectionPath.c_str());
+        if (!stream.IsOpen())
+        {
+            return false;
+        }
+
+        if (stream.GetSize() != mCollectionSize)
+        {
+            if (!Build(stream))
+            {
+                return false;
+            }
+        }
+
+        if (save && mEntries.size() != numIndexedGames)
+        {
+            if (!Save(indexPath))
+            {
+                std::cout << "Failed to save game collection index file: " << indexPath << std::endl;
+            }
+        }
+
+        return true;
+    }
+
+    uint64_t Index::GetNumMoves() const
+    {
+        uint64_t numMoves = 0;
+        for (const Entry& entry : mEntries)
+        {
+            numMoves += entry.numMoves;
+        }
+        return numMoves;
+    }
+
+    bool Index::SeekToGame(InputStream& stream, size_t gameIndex, size_t& outNumGamesToSkip) const
+    {
+        if (gameIndex >= mEntries.size())
+        {
+            return false;
+        }
+
+        // games of a compact collection block share the block offset
+        const uint64_t offset = mEntries[gameIndex].offset;
+        const auto firstGameInBlock = std::lower_bound(mEntries.begin(), mEntries.begin() + gameIndex, offset,
+            [](const Entry& entry, uint64_t offset) { return entry.offset < offset; });
+        outNumGamesToSkip = static_cast<size_t>(mEntries.begin() + gameIndex - firstGameInBlock);
+
+        return stream.SetPosition(offset);
+    }
+
+    bool Index::ReadGame(InputStream& stream, size_t gameIndex, Game& game, std::vector<Move>& decodedMoves) const
+    {
+        size_t numGamesToSkip = 0;
+        if (!SeekToGame(stream, gameIndex, numGamesToSkip))
+        {
+            return false;
+        }
+
+        Reader reader(stream);
+        for (size_t i = 0; i < numGamesToSkip; ++i)
+        {
+            if (!reader.SkipGame())
+            {
+                return false;
+            }
+        }
+
+        return reader.ReadGame(game, decodedMoves);
+    }
+
+    std::vector<Index::Range> Index::Split(uint32_t numRanges) const
+    {
+        std::vector<Range> ranges;
+
+        if (mEntries.empty())
+        {
+            return ranges;
+        }
+
+        numRanges = std::max(1u, numRanges);
+
+        // offsets are monotonic, so range boundaries can be found with binary search
+        // Note: games of a compact collection block share the block offset, so ranges never split a block
+        size_t firstGame = 0;
+        for (uint32_t i = 1; i <= numRanges && firstGame < mEntries.size(); ++i)
+        {
+            size_t endGame = mEntries.size();
+            if (i < numRanges)
+            {
+                const auto compareOffset = [](const Entry& entry, uint64_t offset) { return entry.offset < offset; };
+                const uint64_t targetOffset = mCollectionSize * i / numRanges;
+                const auto iter = std::lower_bound(mEntries.begin() + firstGame, mEntries.end(), targetOffset, compareOffset);
+                const auto nextBlock = std::lower_bound(mEntries.begin() + firstGame, mEntries.end(), mEntries[firstGame].offset + 1, compareOffset);
+                endGame = static_cast<size_t>(std::max(iter, nextBlock) - mEntries.begin());
+            }
+
+            Range range;
+            range.firstGame = firstGame;
+            range.numGames = endGame - firstGame;
+            range.beginOffset = mEntries[firstGame].offset;
+            range.endOffset = endGame < mEntries.size() ? mEntries[endGame].offset : mCollectionSize;
+            ranges.push_back(range);
+
+            firstGame = endGame;
+        }
+
+        return ranges;
+    }
+
+    bool SplitCollection(const std::string& path, uint64_t minRangeSize, uint32_t maxRanges, std::vector<Index::Range>& outRanges)
+    {
+        outRanges.clear();
+
+        Index index;
+        if (!index.LoadOrBuild(path))
+        {
+            return false;
+        }
+
+        const uint64_t numRanges = std::clamp<uint64_t>(index.GetCollectionSize() / std::max<uint64_t>(1, minRangeSize), 1, std::max(1u, maxRanges));
+        outRanges = index.Split(static_cast<uint32_t>(numRanges));
+        return true;
+    }
+
+    bool Writer::WriteGame(const Game& game)
+    {
+        thread_local std::vector<uint8_t> buffer;
+        buffer.clear();
+
+        if (!SerializeGame(game, buffer))
+        {
+            return false;
         }
 
         {
             std::unique_lock<std::mutex> lock(mMutex);
 
-            if (!mStream.Write(&header, sizeof(header)))
+            if (!mStream.Write(buffer.data(), buffer.size()))
             {
                 std::cout << "Failed to write games collection stream" << std::endl;
                 return false;
             }
+        }
+
+        return true;
+    }
+
+    static constexpr uint64_t c_CompactMagic = 0x31564F434D475343ull; // "CSGMCOV1"
+    static constexpr uint32_t c_CompactVersion = 2;
+
+    // blocks bigger than this are treated as corrupted
+    static constexpr uint32_t c_MaxCompactBlockSize = 64 * 1024 * 1024;
+
+    // move indices above this are followed by an extra byte
+    static constexpr uint32_t c_MoveIndexEscape = 255;
+
+#pragma pack(push, 1)
+    struct CompactFileHeader
+    {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t reserved;
+    };
+
+    struct CompactBlockHeader
+    {
+        uint32_t payloadSize;
+        uint32_t numGames;
+        uint64_t checksum;
+    };
+#pragma pack(pop)
 
-            if (!mStream.Write(moves.data(), sizeof(MoveAndScore) * game.GetMoves().size()))
+    // Compact move encoding: a move is identified by a slot of the moved piece and the index of the target square within
+    // the slot. Pieces are ordered canonically (by group, then by square) and every piece gets a slot big enough for all
+    // the targets it could reach on an empty board, so both encoding and decoding are just table lookups, no attacks
+    // are generated. With regular material all the moves fit a single byte.
+    enum MoveEncodingGroup : uint32_t
+    {
+        MoveEncodingGroup_Pawns,            // 4 slots: push, double push, capture towards A file, capture towards H file
+        MoveEncodingGroup_PromotingPawns,   // 12 slots: 3 targets (as above, without double push), 4 promotions each
+        MoveEncodingGroup_Knights,
+        MoveEncodingGroup_Bishops,
+        MoveEncodingGroup_Rooks,
+        MoveEncodingGroup_Queens,
+        MoveEncodingGroup_King,             // 8 attacks, long castling, short castling
+        MoveEncodingGroup_Count,
+    };
+
+    static constexpr uint32_t c_MoveEncodingSlotSizes[MoveEncodingGroup_Count] = { 4, 12, 8, 13, 14, 27, 10 };
+
+    // ceil(65536 / slotSize), so division of an index (smaller than 256 * slotSize) by the slot size can be done with a multiplication
+    static constexpr uint32_t c_MoveEncodingSlotReciprocals[MoveEncodingGroup_Count] = { 16384, 5462, 8192, 5042, 4682, 2428, 6554 };
+
+    // empty board targets of pieces (knight to king): bitboards and their squares in ascending order (an invalid square marks unused slots)
+    struct MoveTargetTable
+    {
+        uint64_t masks[MoveEncodingGroup_Count - MoveEncodingGroup_Knights][64];
+        uint8_t targets[MoveEncodingGroup_Count - MoveEncodingGroup_Knights][64][27];
+
+        constexpr MoveTargetTable() : masks(), targets()
+        {
+            constexpr int32_t knightSteps[][2] = { { 1, 2 }, { 2, 1 }, { 2, -1 }, { 1, -2 }, { -1, -2 }, { -2, -1 }, { -2, 1 }, { -1, 2 } };
+            constexpr int32_t kingSteps[][2] = { { 1, 0 }, { 1, 1 }, { 0, 1 }, { -1, 1 }, { -1, 0 }, { -1, -1 }, { 0, -1 }, { 1, -1 } };
+
+            for (int32_t square = 0; square < 64; ++square)
+            {
+                const int32_t file = square % 8;
+                const int32_t rank = square / 8;
+
+                const auto addTarget = [&](uint32_t group, int32_t targetFile, int32_t targetRank)
+                {
+                    if (targetFile >= 0 && targetFile < 8 && targetRank >= 0 && targetRank < 8)
+                    {
+                        masks[group - MoveEncodingGroup_Knights][square] |= 1ull << (targetRank * 8 + targetFile);
+                    }
+                };
+
+                for (const auto& step : knightSteps)
+                {
+                    addTarget(MoveEncodingGroup_Knights, file + step[0], rank + step[1]);
+                }
+
+                for (uint32_t i = 0; i < 8; ++i)
+                {
+                    const int32_t* step = kingSteps[i];
+                    addTarget(MoveEncodingGroup_King, file + step[0], rank + step[1]);
+
+                    // odd directions are diagonals
+                    for (int32_t distance = 1; distance < 8; ++distance)
+                    {
+                        addTarget(i % 2 ? MoveEncodingGroup_Bishops : MoveEncodingGroup_Rooks, file + step[0] * distance, rank + step[1] * distance);
+                        addTarget(MoveEncodingGroup_Queens, file + step[0] * distance, rank + step[1] * distance);
+                    }
+                }
+
+                for (uint32_t group = MoveEncodingGroup_Knights; group < MoveEncodingGroup_Count; ++group)
+                {
+                    uint32_t numTargets = 0;
+                    for (uint32_t target = 0; target < 64; ++target)
+                    {
+                        if ((masks[group - MoveEncodingGroup_Knights][square] >> target) & 1)
+                        {
+                            targets[group - MoveEncodingGroup_Knights][square][numTargets++] = static_cast<uint8_t>(target);
+                        }
+                    }
+                    while (numTargets < c_MoveEncodingSlotSizes[group])
+                    {
+                        targets[group - MoveEncodingGroup_Knights][square][numTargets++] = 0xFF;
+                    }
+                }
+            }
+        }
+    };
+
+    static constexpr MoveTargetTable c_MoveTargetTable;
+
+    INLINE static void GetMoveEncodingGroups(const Position& pos, uint64_t (&outPieces)[MoveEncodingGroup_Count])
+    {
+        const SidePosition& currentSide = pos.GetCurrentSide();
+        const Bitboard beforePromotionRank = pos.GetSideToMove() == White ? Bitboard::RankBitboard<6>() : Bitboard::RankBitboard<1>();
+
+        outPieces[MoveEncodingGroup_Pawns]          = currentSide.pawns & ~beforePromotionRank;
+        outPieces[MoveEncodingGroup_PromotingPawns] = currentSide.pawns & beforePromotionRank;
+        outPieces[MoveEncodingGroup_Knights]        = currentSide.knights;
+        outPieces[MoveEncodingGroup_Bishops]        = currentSide.bishops;
+        outPieces[MoveEncodingGroup_Rooks]          = currentSide.rooks;
+        outPieces[MoveEncodingGroup_Queens]         = currentSide.queens;
+        outPieces[MoveEncodingGroup_King]           = currentSide.king;
+    }
+
+    INLINE static uint32_t CountBitsBelow(const Bitboard bitboard, const Square square)
+    {
+        return Bitboard(bitboard.value & (square.GetBitboard().value - 1u)).Count();
+    }
+
+    // index of the n-th set bit
+    INLINE static uint32_t SelectBit(const uint64_t bits, const uint32_t n)
+    {
+        const uint32_t lowBits = static_cast<uint32_t>(bits);
+        const uint32_t numLowBits = PopCount(lowBits);
+        return n < numLowBits ?
+            FirstBitSet(ParallelBitsDeposit(1u << n, lowBits)) :
+            32u + FirstBitSet(ParallelBitsDeposit(1u << (n - numLowBits), static_cast<uint32_t>(bits >> 32)));
+    }
+
+    static bool EncodeMoveIndex(const Position& pos, const Move move, std::vector<uint8_t>& buffer)
+    {
+        uint64_t groupPieces[MoveEncodingGroup_Count];
+        GetMoveEncodingGroups(pos, groupPieces);
+
+        const Square from = move.FromSquare();
+        const Square to = move.ToSquare();
+
+        uint32_t index = 0;
+        uint32_t group = 0;
+        for (; group < MoveEncodingGroup_Count && (groupPieces[group] & from.GetBitboard()) == 0; ++group)
+        {
+            index += c_MoveEncodingSlotSizes[group] * PopCount(groupPieces[group]);
+        }
+
+        if (group == MoveEncodingGroup_Count)
+        {
+            return false;
+        }
+
+        index += c_MoveEncodingSlotSizes[group] * CountBitsBelow(groupPieces[group], from);
+
+        if (group == MoveEncodingGroup_Pawns || group == MoveEncodingGroup_PromotingPawns)
+        {
+            const int32_t forward = pos.GetSideToMove() == White ? 8 : -8;
+            const int32_t offset = static_cast<int32_t>(to.Index()) - static_cast<int32_t>(from.Index());
+
+            uint32_t direction = 0;
+            if (offset == forward)                  direction = 0;
+            else if (offset == 2 * forward)         direction = 1;
+            else if (to.File() + 1 == from.File())  direction = 2;
+            else if (to.File() == from.File() + 1)  direction = 3;
+            else return false;
+
+            if (group == MoveEncodingGroup_PromotingPawns)
+            {
+                if (direction == 1 || move.GetPromoteTo() < Piece::Knight || move.GetPromoteTo() > Piece::Queen)
+                {
+                    return false;
+                }
+                index += 4 * (direction > 0 ? direction - 1 : 0) + static_cast<uint32_t>(move.GetPromoteTo()) - static_cast<uint32_t>(Piece::Knight);
+            }
+            else
+            {
+                index += direction;
+            }
+        }
+        else if (move.IsCastling())
+        {
+            // castling is encoded as king-to-rook move
+            index += to.File() < from.File() ? 8 : 9;
+        }
+        else
+        {
+            const Bitboard targets = c_MoveTargetTable.masks[group - MoveEncodingGroup_Knights][from.Index()];
+            if ((targets & to.GetBitboard()) == 0)
             {
-                std::cout << "Failed to write games collection stream" << std::endl;
                 return false;
             }
+            index += CountBitsBelow(targets, to);
+        }
+
+        if (index >= 2 * c_MoveIndexEscape)
+        {
+            return false;
         }
 
+        if (index >= c_MoveIndexEscape)
+        {
+            buffer.push_back(static_cast<uint8_t>(c_MoveIndexEscape));
+            index -= c_MoveIndexEscape;
+        }
+        buffer.push_back(static_cast<uint8_t>(index));
+
         return true;
     }
 
+    // decode a move index, the move is validated to be pseudo-legal
+    static Move DecodeMoveIndex(const Position& pos, uint32_t index)
+    {
+        uint64_t groupPieces[MoveEncodingGroup_Count];
+        GetMoveEncodingGroups(pos, groupPieces);
+
+        // find the group without branching on the index
+        uint32_t groupBegins[MoveEncodingGroup_Count + 1];
+        groupBegins[0] = 0;
+        uint32_t group = 0;
+        for (uint32_t i = 0; i < MoveEncodingGroup_Count; ++i)
+        {
+            groupBegins[i + 1] = groupBegins[i] + c_MoveEncodingSlotSizes[i] * PopCount(groupPieces[i]);
+            group += index >= groupBegins[i + 1] ? 1 : 0;
+        }
+
+        if (group == MoveEncodingGroup_Count)
+        {
+            return Move::Invalid();
+        }
+
+        const uint32_t indexInGroup = index - groupBegins[group];
+        const uint32_t pieceIndex = (indexInGroup * c_MoveEncodingSlotReciprocals[group]) >> 16;
+        const uint32_t slotIndex = indexInGroup - pieceIndex * c_MoveEncodingSlotSizes[group];
+        const Square from(SelectBit(groupPieces[group], pieceIndex));
+
+        const Bitboard occupiedByCurrent = pos.GetCurrentSide().Occupied();
+        const Bitboard occupiedByOpponent = pos.GetOpponentSide().Occupied();
+        const Bitboard occupied = occupiedByCurrent | occupiedByOpponent;
+
+        if (group >= MoveEncodingGroup_Knights)
+        {
+            if (group == MoveEncodingGroup_King && slotIndex >= 8)
+            {
+                const uint8_t castlingRights = pos.GetOurCastlingRights();
+                const Square rookSquare = slotIndex == 8 ?
+                    Position::GetLongCastleRookSquare(from, castlingRights) :
+                    Position::GetShortCastleRookSquare(from, castlingRights);
+                if (!rookSquare.IsValid())
+                {
+                    return Move::Invalid();
+                }
+
+                // castling is not validated by the target tables
+                return pos.MoveFromPacked(PackedMove(from, rookSquare));
+            }
+
+            const uint8_t toIndex = c_MoveTargetTable.targets[group - MoveEncodingGroup_Knights][from.Index()][slotIndex];
+            if (toIndex >= Square::NumSquares)
+            {
+                return Move::Invalid();
+            }
+
+            const Square to(toIndex);
+            if ((occupiedByCurrent & to.GetBitboard()) || (Bitboard::GetBetween(from, to) & occupied))
+            {
+                return Move::Invalid();
+            }
+
+            static constexpr Piece groupPiece[] = { Piece::Knight, Piece::Bishop, Piece::Rook, Piece::Queen, Piece::King };
+            return Move::Make(from, to, groupPiece[group - MoveEncodingGroup_Knights], Piece::None, (occupiedByOpponent & to.GetBitboard()) != 0);
+        }
+
+        const bool isPromotion = group == MoveEncodingGroup_PromotingPawns;
+        const uint32_t direction = isPromotion ? (slotIndex < 4 ? 0 : slotIndex / 4 + 1) : slotIndex;
+        const int32_t forward = pos.GetSideToMove() == White ? 8 : -8;
+
+        int32_t toIndex = static_cast<int32_t>(from.Index()) + (direction == 1 ? 2 * forward : forward);
+        if (direction == 2)
+        {
+            if (from.File() == 0) return Move::Invalid();
+            toIndex--;
+        }
+        else if (direction == 3)
+        {
+            if (from.File() == 7) return Move::Invalid();
+            toIndex++;
+        }
+
+        if (toIndex < 0 || toIndex >= static_cast<int32_t>(Square::NumSquares))
+        {
+            return Move::Invalid();
+        }
+
+        const Square to(static_cast<uint32_t>(toIndex));
+        const Piece promoteTo = isPromotion ? static_cast<Piece>(static_cast<uint32_t>(Piece::Knight) + slotIndex % 4) : Piece::None;
+
+        if (direction < 2)
+        {
+            if (occupied & to.GetBitboard())
+            {
+                return Move::Invalid();
+            }
+
+            if (direction == 1 && (from.RelativeRank(pos.GetSideToMove()) != 1 || (occupied & Bitboard::GetBetween(from, to))))
+            {
+                return Move::Invalid();
+            }
+
+            return Move::Make(from, to, Piece::Pawn, promoteTo);
+        }
+
+        const bool isEnPassant = to == pos.GetEnPassantSquare();
+        if (!isEnPassant && (occupiedByOpponent & to.GetBitboard()) == 0)
+        {
+            return Move::Invalid();
+        }
+
+        return Move::Make(from, to, Piece::Pawn, promoteTo, true, isEnPassant);
+    }
+
+    static bool EncodeCompactGame(const Game& game, std::vector<uint8_t>& buffer, CompactWriter::Stats& stats)
+    {
+        ASSERT(game.GetMoves().size() <= UINT16_MAX);
+
+        PackedPosition packedPosition;
+        if (!PackPosition(game.GetInitialPosition(), packedPosition))
+        {
+            return false;
+        }
+
+        const uint8_t* packedPositionData = reinterpret_cast<const uint8_t*>(&packedPosition);
+        buffer.insert(buffer.end(), packedPositionData, packedPositionData + sizeof(PackedPosition));
+        buffer.push_back(static_cast<uint8_t>(game.GetForcedScore()));
+
+        const uint32_t numMoves = static_cast<uint32_t>(game.GetMoves().size());
+        const bool hasMoveScores = game.GetMoves().size() == game.GetMoveScores().size();
+        WriteVarUInt(buffer, (numMoves << 1) | (hasMoveScores ? 1u : 0u));
+
+        stats.numGames++;
+        stats.numMoves += numMoves;
+        stats.gameHeadersSize += buffer.size();
+
+        // move index and score delta are interleaved, so the game can be decoded in a single pass
+        Position pos = game.GetInitialPosition();
+        int32_t prevScore = 0;
+        for (uint32_t i = 0; i < numMoves; ++i)
+        {
+            const Move move = game.GetMoves()[i];
+            const size_t moveOffset = buffer.size();
+            if (!EncodeMoveIndex(pos, move, buffer) || !pos.DoMove(move))
+            {
+                return false;
+            }
+            stats.movesSize += buffer.size() - moveOffset;
+
+            if (hasMoveScores)
+            {
+                const int32_t score = game.GetMoveScores()[i];
+                const size_t scoreOffset = buffer.size();
+                WriteVarUInt(buffer, ZigZagEncode(score - prevScore));
+                stats.scoresSize += buffer.size() - scoreOffset;
+                prevScore = score;
+            }
+        }
+
+        return true;
+    }
+
+    struct CompactGameHeader
+    {
+        PackedPosition initialPosition;
+        Game::Score forcedScore;
+        uint32_t numMoves;
+        bool hasMoveScores;
+    };
+
+    static bool ReadCompactGameHeader(const uint8_t*& data, const uint8_t* end, CompactGameHeader& outHeader)
+    {
+        if (static_cast<size_t>(end - data) < sizeof(PackedPosition) + 1)
+        {
+            return false;
+        }
+
+        memcpy(&outHeader.initialPosition, data, sizeof(PackedPosition));
+        data += sizeof(PackedPosition);
+
+        outHeader.forcedScore = static_cast<Game::Score>(*data++);
+        if (!IsValidGameScore(outHeader.forcedScore))
+        {
+            return false;
+        }
+
+        uint32_t movesHeader = 0;
+        if (!ReadVarUInt(data, end, movesHeader))
+        {
+            return false;
+        }
+
+        outHeader.numMoves = movesHeader >> 1;
+        outHeader.hasMoveScores = (movesHeader & 1) != 0;
+        return true;
+    }
+
+    // decode a single ply: move index followed by (optional) score delta
+    INLINE static bool ReadCompactMove(const uint8_t*& data, const uint8_t* end, const Position& pos, bool hasMoveScores, Move& outMove, int32_t& inOutScore)
+    {
+        if (data >= end) return false;
+        uint32_t index = *data++;
+        if (index == c_MoveIndexEscape)
+        {
+            if (data >= end) return false;
+            index += *data++;
+        }
+
+        outMove = DecodeMoveIndex(pos, index);
+        if (!outMove.IsValid())
+        {
+            return false;
+        }
+
+        if (hasMoveScores)
+        {
+            uint32_t encodedDelta = 0;
+            if (!ReadVarUInt(data, end, encodedDelta))
+            {
+                return false;
+            }
+            inOutScore += ZigZagDecode(encodedDelta);
+        }
+
+        return true;
+    }
+
+    // skip encoded moves without decoding them (move indices don't depend on anything but the position)
+    static bool SkipCompactMoves(const uint8_t*& data, const uint8_t* end, uint32_t numMoves, bool hasMoveScores)
+    {
+        for (uint32_t i = 0; i < numMoves; ++i)
+        {
+            if (data >= end) return false;
+            if (*data++ == c_MoveIndexEscape)
+            {
+                if (data++ >= end) return false;
+            }
+
+            uint32_t encodedDelta = 0;
+            if (hasMoveScores && !ReadVarUInt(data, end, encodedDelta))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    static bool DecodeCompactGame(const uint8_t*& data, const uint8_t* end, Game& game, std::vector<Move>& decodedMoves)
+    {
+        CompactGameHeader header;
+        if (!ReadCompactGameHeader(data, end, header))
+        {
+            return false;
+        }
+
+        Position initialPosition;
+        if (!UnpackPosition(header.initialPosition, initialPosition))
+        {
+            return false;
+        }
+        game.Reset(initialPosition);
+
+        decodedMoves.clear();
+        decodedMoves.reserve(header.numMoves);
+
+        int32_t score = 0;
+        for (uint32_t i = 0; i < header.numMoves; ++i)
+        {
+            Move move = Move::Invalid();
+            if (!ReadCompactMove(data, end, game.GetPosition(), header.hasMoveScores, move, score))
+            {
+                return false;
+            }
+
+            if (header.hasMoveScores)
+            {
+                if (!game.DoMove(move, static_cast<ScoreType>(score))) return false;
+            }
+            else
+            {
+                if (!game.DoMove(move)) return false;
+            }
+
+            decodedMoves.push_back(move);
+        }
+
+        game.SetScore(header.forcedScore);
+
+        return true;
+    }
+
+    bool IsCompactCollection(InputStream& stream)
+    {
+        const uint64_t position = stream.GetPosition();
+
+        CompactFileHeader header{};
+        const bool isCompact =
+            stream.GetSize() >= sizeof(header) &&
+            stream.SetPosition(0) &&
+            stream.Read(&header, sizeof(header)) &&
+            header.magic == c_CompactMagic;
+
+        stream.SetPosition(position);
+        return isCompact;
+    }
+
+    bool IsCompactCollection(const std::string& path)
+    {
+        FileInputStream stream(path.c_str());
+        return stream.IsOpen() && IsCompactCollection(stream);
+    }
+
+    CompactWriter::CompactWriter(OutputStream& stream, size_t blockSize)
+        : mStream(stream)
+        , mBlockSize(blockSize)
+    {
+        mBlock.reserve(blockSize + 4096);
+    }
+
+    CompactWriter::~CompactWriter()
+    {
+        Flush();
+    }
+
+    bool CompactWriter::WriteGame(const Game& game)
+    {
+        thread_local std::vector<uint8_t> buffer;
+        buffer.clear();
+
+        Stats gameStats;
+        if (!EncodeCompactGame(game, buffer, gameStats))
+        {
+            return false;
+        }
+
+        std::unique_lock<std::mutex> lock(mMutex);
+
+        mBlock.insert(mBlock.end(), buffer.begin(), buffer.end());
+        mNumGamesInBlock++;
+
+        mStats.numGames += gameStats.numGames;
+        mStats.numMoves += gameStats.numMoves;
+        mStats.gameHeadersSize += gameStats.gameHeadersSize;
+        mStats.movesSize += gameStats.movesSize;
+        mStats.scoresSize += gameStats.scoresSize;
+
+        if (mBlock.size() >= mBlockSize)
+        {
+            return FlushBlock();
+        }
+
+        return true;
+    }
+
+    bool CompactWriter::Flush()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        return FlushBlock();
+    }
+
+    bool CompactWriter::FlushBlock()
+    {
+        if (!mHeaderWritten)
+        {
+            const CompactFileHeader header{ c_CompactMagic, c_CompactVersion, 0 };
+            if (!mStream.Write(&header, sizeof(header)))
+            {
+                std::cout << "Failed to write games collection stream" << std::endl;
+                return false;
+            }
+            mHeaderWritten = true;
+        }
+
+        if (mNumGamesInBlock == 0)
+        {
+            return true;
+        }
+
+        const CompactBlockHeader blockHeader{ static_cast<uint32_t>(mBlock.size()), mNumGamesInBlock, ComputeChecksum(mBlock.data(), mBlock.size()) };
+
+        const bool success = mStream.Write(&blockHeader, sizeof(blockHeader)) && mStream.Write(mBlock.data(), mBlock.size());
+
+        mBlock.clear();
+        mNumGamesInBlock = 0;
+
+        if (!success)
+        {
+            std::cout << "Failed to write games collection stream" << std::endl;
+        }
+
+        return success;
+    }
+
+    CompactReader::CompactReader(InputStream& stream)
+        : mStream(stream)
+    {
+        const uint64_t position = stream.GetPosition();
+
+        CompactFileHeader header{};
+        if (!stream.SetPosition(0) || !stream.Read(&header, sizeof(header)) || header.magic != c_CompactMagic)
+        {
+            std::cout << "Invalid compact games collection: " << stream.GetFileName() << std::endl;
+            return;
+        }
+
+        if (header.version != c_CompactVersion)
+        {
+            std::cout << "Unsupported compact games collection version " << header.version << ": " << stream.GetFileName() << std::endl;
+            return;
+        }
+
+        // continue from a block boundary (e.g. a sidecar index entry)
+        if (position > sizeof(header) && !stream.SetPosition(position))
+        {
+            return;
+        }
+
+        mIsValid = true;
+    }
+
+    bool CompactReader::ReadBlock()
+    {
+        if (mStream.IsEndOfFile())
+        {
+            return false;
+        }
+
+        CompactBlockHeader header{};
+        if (!mStream.Read(&header, sizeof(header)) || header.payloadSize > c_MaxCompactBlockSize)
+        {
+            std::cout << "Failed to read games block header in file " << mStream.GetFileName() << " offset=" << mStream.GetPosition() << std::endl;
+            return false;
+        }
+
+        mBlock.resize(header.payloadSize);
+        if (!mStream.Read(mBlock.data(), header.payloadSize))
+        {
+            std::cout << "Failed to read games block from file " << mStream.GetFileName() << " offset=" << mStream.GetPosition() << std::endl;
+            return false;
+        }
+
+        if (ComputeChecksum(mBlock.data(), mBlock.size()) != header.checksum)
+        {
+            std::cout << "Games block checksum mismatch in file " << mStream.GetFileName() << " offset=" << mStream.GetPosition() << std::endl;
+            return false;
+        }
+
+        mBlockCursor = 0;
+        mNumGamesLeftInBlock = header.numGames;
+        return true;
+    }
+
+    bool CompactReader::ReadGame(Game& game, std::vector<Move>& decodedMoves)
+    {
+        if (!mIsValid)
+        {
+            return false;
+        }
+
+        while (mNumGamesLeftInBlock == 0)
+        {
+            if (!ReadBlock())
+            {
+                return false;
+            }
+        }
+
+        const uint8_t* data = mBlock.data() + mBlockCursor;
+        const uint8_t* end = mBlock.data() + mBlock.size();
+        if (!DecodeCompactGame(data, end, game, decodedMoves))
+        {
+            std::cout << "Failed to parse game from " << mStream.GetFileName() << ": corrupted compact game data" << std::endl;
+            mIsValid = false;
+            return false;
+        }
+
+        mBlockCursor = data - mBlock.data();
+        mNumGamesLeftInBlock--;
+        return true;
+    }
+
+    bool CompactReader::ReadGameData(const uint8_t*& outBegin, const uint8_t*& outEnd)
+    {
+        if (!mIsValid)
+        {
+            return false;
+        }
+
+        while (mNumGamesLeftInBlock == 0)
+        {
+            if (!ReadBlock())
+            {
+                return false;
+            }
+        }
+
+        const uint8_t* data = mBlock.data() + mBlockCursor;
+        const uint8_t* end = mBlock.data() + mBlock.size();
+
+        CompactGameHeader header;
+        outBegin = data;
+        if (!ReadCompactGameHeader(data, end, header) || !SkipCompactMoves(data, end, header.numMoves, header.hasMoveScores))
+        {
+            std::cout << "Failed to parse game from " << mStream.GetFileName() << ": corrupted compact game data" << std::endl;
+            mIsValid = false;
+            return false;
+        }
+        outEnd = data;
+
+        mBlockCursor = data - mBlock.data();
+        mNumGamesLeftInBlock--;
+        return true;
+    }
+
+    bool Index::BuildCompact(InputStream& stream)
+    {
+        const uint64_t streamSize = stream.GetSize();
+
+        // every game of a block is indexed with the block offset, see SeekToGame()
+        if (mCollectionSize < sizeof(CompactFileHeader) || mCollectionSize > streamSize)
+        {
+            Clear();
+            mCollectionSize = sizeof(CompactFileHeader);
+        }
+
+        if (!stream.SetPosition(mCollectionSize))
+        {
+            return false;
+        }
+
+        std::vector<uint8_t> block;
+
+        uint64_t offset = mCollectionSize;
+        while (offset + sizeof(CompactBlockHeader) <= streamSize)
+        {
+            CompactBlockHeader header{};
+            if (!stream.Read(&header, sizeof(header)) || header.payloadSize > c_MaxCompactBlockSize)
+            {
+                std::cout << "Failed to read games block header in file " << stream.GetFileName() << " offset=" << offset << std::endl;
+                return false;
+            }
+
+            const uint64_t blockSize = sizeof(CompactBlockHeader) + header.payloadSize;
+            if (offset + blockSize > streamSize)
+            {
+                // incomplete block at the end of the collection
+                break;
+            }
+
+            block.resize(header.payloadSize);
+            if (!stream.Read(block.data(), header.payloadSize) ||
+                ComputeChecksum(block.data(), block.size()) != header.checksum)
+            {
+                std::cout << "Failed to index " << stream.GetFileName() << ": corrupted games block at offset=" << offset << std::endl;
+                return false;
+            }
+
+            const uint8_t* data = block.data();
+            const uint8_t* end = block.data() + block.size();
+            for (uint32_t i = 0; i < header.numGames; ++i)
+            {
+                CompactGameHeader gameHeader;
+                if (!ReadCompactGameHeader(data, end, gameHeader) ||
+                    !SkipCompactMoves(data, end, gameHeader.numMoves, gameHeader.hasMoveScores))
+                {
+                    std::cout << "Failed to index " << stream.GetFileName() << ": corrupted compact game data at offset=" << offset << std::endl;
+                    return false;
+                }
+
+                mEntries.push_back(Entry{ offset, static_cast<uint16_t>(gameHeader.numMoves) });
+            }
+
+            offset += blockSize;
+        }
+
+        mCollectionSize = offset;
+        return true;
+    }
+
+    Reader::Reader(InputStream& stream)
+        : mStream(stream)
+    {
+        if (IsCompactCollection(stream))
+        {
+            mCompactReader = std::make_unique<CompactReader>(stream);
+        }
+    }
+
+    bool Reader::ReadGame(Game& game, std::vector<Move>& decodedMoves)
+    {
+        if (mCompactReader)
+        {
+            return mCompactReader->ReadGame(game, decodedMoves);
+        }
+
+        return GameCollection::ReadGame(mStream, game, decodedMoves);
+    }
+
+    bool Reader::SkipGame()
+    {
+        if (mCompactReader)
+        {
+            const uint8_t* begin = nullptr;
+            const uint8_t* end = nullptr;
+            return mCompactReader->ReadGameData(begin, end);
+        }
+
+        GameHeader header{};
+        return
+            !mStream.IsEndOfFile() &&
+            mStream.Read(&header, sizeof(header)) &&
+            mStream.SetPosition(mStream.GetPosition() + sizeof(MoveAndScore) * header.numMoves);
+    }
+
+    GameReplayCursor::GameReplayCursor(InputStream& stream)
+        : mStream(stream)
+    {
+        if (IsCompactCollection(stream))
+        {
+            mCompactReader = std::make_unique<CompactReader>(stream);
+        }
+    }
+
+    GameReplayCursor::~GameReplayCursor() = default;
+
+    bool GameReplayCursor::NextGame()
+    {
+        if (!mIsValid)
+        {
+            return false;
+        }
+
+        PackedPosition packedPosition;
+
+        if (mCompactReader)
+        {
+            const uint8_t* data = nullptr;
+            const uint8_t* end = nullptr;
+            if (!mCompactReader->ReadGameData(data, end))
+            {
+                mIsValid = mCompactReader->IsValid();
+                return false;
+            }
+
+            CompactGameHeader header;
+            VERIFY(ReadCompactGameHeader(data, end, header));
+
+            packedPosition = header.initialPosition;
+            mForcedScore = header.forcedScore;
+            mNumMoves = header.numMoves;
+            mHasMoveScores = header.hasMoveScores;
+            mCompactMovesBegin = data;
+            mCompactMovesEnd = end;
+        }
+        else
+        {
+            if (mStream.IsEndOfFile())
+            {
+                return false;
+            }
+
+            GameHeader header{};
+            if (!mStream.Read(&header, sizeof(header)))
+            {
+                std::cout << "Failed to read game header in file " << mStream.GetFileName() << " offset=" << mStream.GetPosition() << std::endl;
+                mIsValid = false;
+                return false;
+            }
+
+            mLegacyMoves.resize(header.numMoves);
+            if (header.numMoves && !mStream.Read(mLegacyMoves.data(), sizeof(MoveAndScore) * header.numMoves))
+            {
+                std::cout << "Failed to read game moves from file " << mStream.GetFileName() << " offset=" << mStream.GetPosition() << std::endl;
+                mIsValid = false;
+                return false;
+            }
+
+            if (!IsValidGameScore(header.forcedScore))
+            {
+                std::cout << "Failed to parse game from " << mStream.GetFileName() << ": invalid game score" << std::endl;
+                mIsValid = false;
+                return false;
+            }
+
+            packedPosition = header.initialPosition;
+            mForcedScore = header.forcedScore;
+            mNumMoves = header.numMoves;
+            mHasMoveScores = header.hasMoveScores;
+        }
+
+        if (!UnpackPosition(packedPosition, mInitialPosition))
+        {
+            mIsValid = false;
+            return false;
+        }
+
+        Rewind();
+        return true;
+    }
+
+    void GameReplayCursor::Rewind()
+    {
+        mPosition = mInitialPosition;
+        mMove = Move::Invalid();
+        mMoveScore = 0;
+        mMoveIndex = 0;
+        mCompactMoves = mCompactMovesBegin;
+
+        mPositionHashes.clear();
+        mPositionHashes.push_back(mPosition.GetHash());
+    }
+
+    bool GameReplayCursor::NextMove()
+    {
+        if (mMove.IsValid())
+        {
+            if (!mPosition.DoMove(mMove))
+            {
+                mIsValid = false;
+                return false;
+            }
+            mPositionHashes.push_back(mPosition.GetHash());
+            mMove = Move::Invalid();
+        }
+
+        if (mMoveIndex >= mNumMoves || !mIsValid)
+        {
+            return false;
+        }
+
+        if (!DecodeNextMove())
+        {
+            std::cout << "Failed to parse game from " << mStream.GetFileName() << ": invalid move in position " << mPosition.ToFEN() << std::endl;
+            mIsValid = false;
+            return false;
+        }
+
+        mMoveIndex++;
+        return true;
+    }
+
+    bool GameReplayCursor::DecodeNextMove()
+    {
+        if (mCompactReader)
+        {
+            // scores are stored as deltas, so the previous ply score is restored from the last decoded one
+            int32_t score = mMoveScore;
+            if (!ReadCompactMove(mCompactMoves, mCompactMovesEnd, mPosition, mHasMoveScores, mMove, score))
+            {
+                return false;
+            }
+            mMoveScore = static_cast<ScoreType>(score);
+            return true;
+        }
+
+        const MoveAndScore& entry = mLegacyMoves[mMoveIndex];
+        mMove = mPosition.MoveFromPacked(entry.move);
+        mMoveScore = mHasMoveScores ? entry.score : 0;
+        return mMove.IsValid();
+    }
+
+    uint32_t GameReplayCursor::GetRepetitionCount() const
+    {
+        // positions before the last irreversible move can't repeat
+        const size_t numPositions = std::min<size_t>(mPositionHashes.size(), mPosition.GetHalfMoveCount() + 1u);
+        return static_cast<uint32_t>(std::count(mPositionHashes.end() - numPositions, mPositionHashes.end(), mPosition.GetHash()));
+    }
+
+    Game::Score GameReplayCursor::GetGameScore() const
+    {
+        if (mForcedScore != Game::Score::Unknown)
+        {
+            return mForcedScore;
+        }
+
+        ASSERT(mMoveIndex == mNumMoves && !mMove.IsValid());
+
+        if (mPosition.IsMate())
+        {
+            return mPosition.GetSideToMove() == White ? Game::Score::BlackWins : Game::Score::WhiteWins;
+        }
+
+        if (GetRepetitionCount() >= 3 ||
+            mPosition.IsFiftyMoveRuleDraw() ||
+            CheckInsufficientMaterial(mPosition) ||
+            mPosition.IsStalemate())
+        {
+            return Game::Score::Draw;
+        }
+
+        return Game::Score::Unknown;
+    }
+
+    Game::Score GameReplayCursor::ResolveGameScore()
+    {
+        if (mForcedScore != Game::Score::Unknown)
+        {
+            return mForcedScore;
+        }
+
+        while (NextMove()) { }
+
+        if (!mIsValid)
+        {
+            return Game::Score::Unknown;
+        }
+
+        const Game::Score score = GetGameScore();
+        Rewind();
+        return score;
+    }
+
 } // namespace GameCollection
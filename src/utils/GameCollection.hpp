@@ -8,6 +8,7 @@
 
 #include <string>
 #include <mutex>
+#include <memory>
 
 namespace GameCollection
 {
@@ -33,6 +34,78 @@ namespace GameCollection
 
     bool ReadGame(InputStream& stream, Game& game, std::vector<Move>& decodedMoves);
 
+    // check if a file is a games collection based on its extension (skips index files, configs, etc.)
+    bool IsGameCollectionPath(const std::string& path);
+
+    // append serialized game (header and moves) to a buffer, in the format expected by ReadGame()
+    bool SerializeGame(const Game& game, std::vector<uint8_t>& outBuffer);
+
+    // Optional sidecar index ("<collection path>.idx") holding byte offset and move count of every game.
+    // Allows O(1) random access to games and splitting a single collection into ranges processed in parallel.
+    // Games of a compact collection are indexed with the offset of their block.
+    class Index
+    {
+    public:
+
+#pragma pack(push, 1)
+        struct Entry
+        {
+            uint64_t offset;
+            uint16_t numMoves;
+        };
+#pragma pack(pop)
+
+        // contiguous range of games
+        struct Range
+        {
+            size_t firstGame = 0;
+            size_t numGames = 0;
+            uint64_t beginOffset = 0;
+            uint64_t endOffset = 0;
+        };
+
+        static std::string GetIndexPath(const std::string& collectionPath);
+
+        // scan game headers starting from the end of already indexed data
+        // Note: incomplete trailing game (e.g. collection being written to) is not indexed
+        bool Build(InputStream& stream);
+
+        bool Load(const std::string& indexPath);
+        bool Save(const std::string& indexPath) const;
+
+        // load the sidecar index of a collection, build (or extend when the collection has grown) and save it if it's stale
+        bool LoadOrBuild(const std::string& collectionPath, bool save = true);
+
+        void Clear();
+
+        size_t GetNumGames() const { return mEntries.size(); }
+        const Entry& GetEntry(size_t gameIndex) const { return mEntries[gameIndex]; }
+
+        // size of the indexed part of the collection
+        uint64_t GetCollectionSize() const { return mCollectionSize; }
+
+        // total number of moves in all the indexed games
+        uint64_t GetNumMoves() const;
+
+        // seek to the game, or to its block in case of compact collections
+        // 'outNumGamesToSkip' is the number of games preceding it in the block (always zero for legacy collections)
+        bool SeekToGame(InputStream& stream, size_t gameIndex, size_t& outNumGamesToSkip) const;
+
+        bool ReadGame(InputStream& stream, size_t gameIndex, Game& game, std::vector<Move>& decodedMoves) const;
+
+        // split games into at most 'numRanges' ranges of roughly equal byte size
+        std::vector<Range> Split(uint32_t numRanges) const;
+
+    private:
+        bool BuildCompact(InputStream& stream);
+
+        std::vector<Entry> mEntries;
+        uint64_t mCollectionSize = 0;
+    };
+
+    // split a games collection file into ranges of at least 'minRangeSize' bytes (at most 'maxRanges') for parallel processing
+    bool SplitCollection(const std::string& path, uint64_t minRangeSize, uint32_t maxRanges, std::vector<Index::Range>& outRanges);
+
     class Writer
     {
     public:
@@ -46,4 +119,170 @@ namespace GameCollection
         std::mutex mMutex;
     };
 
+    // Compact encoding:
+    // - every move is stored as its index in a canonical enumeration of empty board move targets, a single byte in practice
+    // - move scores are stored as zig-zag varint deltas against the previous ply
+    // - games are grouped into blocks, each with a checksum of its payload
+    // - reading can start at the beginning of any block, so compact collections can be indexed and split like legacy ones
+
+    // check if a stream (regardless of its current position) or a file starts with compact collection header
+    bool IsCompactCollection(InputStream& stream);
+    bool IsCompactCollection(const std::string& path);
+
+    class CompactWriter
+    {
+    public:
+        static constexpr size_t DefaultBlockSize = 64 * 1024;
+
+        // encoded size of the written games, broken down by the kind of data (excluding block headers)
+        struct Stats
+        {
+            uint64_t numGames = 0;
+            uint64_t numMoves = 0;
+            uint64_t gameHeadersSize = 0;
+            uint64_t movesSize = 0;
+            uint64_t scoresSize = 0;
+        };
+
+        CompactWriter(OutputStream& stream, size_t blockSize = DefaultBlockSize);
+        ~CompactWriter();
+
+        bool WriteGame(const Game& game);
+
+        // write pending (partially filled) block
+        bool Flush();
+
+        bool IsOK() const { return mStream.IsOK(); }
+
+        const Stats& GetStats() const { return mStats; }
+
+    private:
+        bool FlushBlock();
+
+        OutputStream& mStream;
+        std::mutex mMutex;
+        std::vector<uint8_t> mBlock;
+        uint32_t mNumGamesInBlock = 0;
+        size_t mBlockSize;
+        bool mHeaderWritten = false;
+        Stats mStats;
+    };
+
+    class CompactReader
+    {
+    public:
+        // expects compact collection header at the beginning of the stream,
+        // reading starts at the current stream position if it's past the header (must be a block boundary)
+        CompactReader(InputStream& stream);
+
+        bool IsValid() const { return mIsValid; }
+
+        bool ReadGame(Game& game, std::vector<Move>& decodedMoves);
+
+        // get undecoded data of the next game, valid until the next read
+        bool ReadGameData(const uint8_t*& outBegin, const uint8_t*& outEnd);
+
+    private:
+        bool ReadBlock();
+
+        InputStream& mStream;
+        std::vector<uint8_t> mBlock;
+        size_t mBlockCursor = 0;
+        uint32_t mNumGamesLeftInBlock = 0;
+        bool mIsValid = false;
+    };
+
+    // reads games sequentially from the current stream position, regardless of the collection encoding
+    class Reader
+    {
+    public:
+        Reader(InputStream& stream);
+
+        bool IsCompact() const { return mCompactReader != nullptr; }
+
+        bool ReadGame(Game& game, std::vector<Move>& decodedMoves);
+
+        // skip the next game without decoding its moves
+        bool SkipGame();
+
+    private:
+        InputStream& mStream;
+        std::unique_ptr<CompactReader> mCompactReader;
+    };
+
+    // Lightweight sequential replay of games, for tools that need only the sequence of positions, moves and scores.
+    // Unlike Reader it doesn't build Game objects, so there are no per-move allocations and no repetition tracking buckets.
+    // Usage:
+    //   while (cursor.NextGame())
+    //       while (cursor.NextMove())
+    //           use cursor.GetPosition(), cursor.GetMove(), cursor.GetMoveScore()
+    class GameReplayCursor
+    {
+    public:
+        GameReplayCursor(InputStream& stream);
+        ~GameReplayCursor();
+
+        // start replaying the next game, returns false at the end of the stream or on error
+        bool NextGame();
+
+        // apply the current move (if any) and decode the next one
+        // returns false at the end of the game or if the game is corrupted (see IsValid)
+        bool NextMove();
+
+        // restart replaying the current game from its initial position
+        void Rewind();
+
+        // false if the current game turned out to be corrupted, no more games can be read then
+        bool IsValid() const { return mIsValid; }
+
+        const Position& GetInitialPosition() const { return mInitialPosition; }
+
+        // position before the current move, or the final position once NextMove() returned false
+        const Position& GetPosition() const { return mPosition; }
+
+        Move GetMove() const { return mMove; }
+        ScoreType GetMoveScore() const { return mMoveScore; }
+
+        // ply of the current move, counted from the initial position
+        uint32_t GetMoveIndex() const { return mMoveIndex - 1; }
+
+        uint32_t GetNumMoves() const { return mNumMoves; }
+        bool HasMoveScores() const { return mHasMoveScores; }
+        Game::Score GetForcedScore() const { return mForcedScore; }
+
+        // number of occurrences of the current position in the game so far (same as Game::GetRepetitionCount)
+        uint32_t GetRepetitionCount() const;
+
+        // game result (same rules as Game::GetScore), valid if the score is forced or when all the moves were replayed
+        Game::Score GetGameScore() const;
+
+        // get game result before replaying the game: if the score is not forced, the game is replayed to its end and rewound
+        Game::Score ResolveGameScore();
+
+    private:
+        bool DecodeNextMove();
+
+        InputStream& mStream;
+        std::unique_ptr<CompactReader> mCompactReader;
+
+        // undecoded moves of the current game: legacy entries or compact encoding (pointing into the reader's block)
+        std::vector<MoveAndScore> mLegacyMoves;
+        const uint8_t* mCompactMovesBegin = nullptr;
+        const uint8_t* mCompactMoves = nullptr;
+        const uint8_t* mCompactMovesEnd = nullptr;
+
+        // hashes of all the positions in the game so far, for repetition detection
+        std::vector<uint64_t> mPositionHashes;
+
+        Position mInitialPosition;
+        Position mPosition;
+        Move mMove = Move::Invalid();
+        ScoreType mMoveScore = 0;
+        uint32_t mMoveIndex = 0;
+        uint32_t mNumMoves = 0;
+        bool mHasMoveScores = false;
+        Game::Score mForcedScore = Game::Score::Unknown;
+        bool mIsValid = true;
+    };
+
 } // namespace GameCollection
@@ -3,6 +3,9 @@
 #include "../backend/TranspositionTable.hpp"
 
 #include <iostream>
+#include <thread>
+#include <atomic>
+#include <sstream>
 
 #define TEST_EXPECT(x) \
     if (!(x)) { std::cout << "Test failed: " << #x << std::endl; DEBUG_BREAK(); }
@@ -28,6 +31,501 @@ static void TestGameSerialization(const Game& originalGame)
     TEST_EXPECT(readGame == originalGame);
 }
 
+static void TestParallelGameWriting()
+{
+    constexpr uint32_t numThreads = 4;
+    constexpr uint32_t numGamesPerThread = 100;
+
+    std::vector<uint8_t> buffer;
+    {
+        MemoryOutputStream stream(buffer);
+
+        // small block size to force many hand-offs
+        ParallelOutputStream parallelStream(stream, numThreads, 256);
+
+        std::vector<std::thread> threads;
+        for (uint32_t threadIndex = 0; threadIndex < numThreads; ++threadIndex)
+        {
+            threads.emplace_back([threadIndex, &parallelStream]()
+            {
+                std::vector<uint8_t> gameData;
+                for (uint32_t i = 0; i < numGamesPerThread; ++i)
+                {
+                    Game game;
+                    game.Reset(Position(Position::InitPositionFEN));
+                    TEST_EXPECT(game.DoMove(Move::Make(Square_e2, Square_e4, Piece::Pawn), static_cast<ScoreType>(threadIndex)));
+                    TEST_EXPECT(game.DoMove(Move::Make(Square_e7, Square_e5, Piece::Pawn), static_cast<ScoreType>(i)));
+
+                    gameData.clear();
+                    TEST_EXPECT(GameCollection::SerializeGame(game, gameData));
+                    TEST_EXPECT(parallelStream.Write(threadIndex, gameData.data(), gameData.size()));
+                }
+            });
+        }
+
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+    // every game must be read back intact, in per-thread order
+    MemoryInputStream stream(buffer);
+    std::vector<uint32_t> numGamesRead(numThreads, 0);
+    Game game;
+    std::vector<Move> moves;
+    while (GameCollection::ReadGame(stream, game, moves))
+    {
+        TEST_EXPECT(moves.size() == 2);
+        const uint32_t threadIndex = static_cast<uint32_t>(game.GetMoveScores()[0]);
+        TEST_EXPECT(threadIndex < numThreads);
+        TEST_EXPECT(game.GetMoveScores()[1] == static_cast<ScoreType>(numGamesRead[threadIndex]));
+        numGamesRead[threadIndex]++;
+    }
+
+    TEST_EXPECT(stream.IsEndOfFile());
+    for (uint32_t threadIndex = 0; threadIndex < numThreads; ++threadIndex)
+    {
+        TEST_EXPECT(numGamesRead[threadIndex] == numGamesPerThread);
+    }
+}
+
+// data written by an idle writer must reach the underlying stream without Flush()
+static void TestParallelStreamIdleFlush()
+{
+    class CountingOutputStream : public OutputStream
+    {
+    public:
+        std::atomic<uint64_t> size = 0;
+        virtual uint64_t GetSize() override { return size; }
+        virtual bool Write(const void*, size_t writeSize) override { size += writeSize; return true; }
+    };
+
+    CountingOutputStream stream;
+    ParallelOutputStream parallelStream(stream, 2, 1024 * 1024, std::chrono::milliseconds(20));
+
+    const uint8_t record[16] = {};
+    TEST_EXPECT(parallelStream.Write(1, record, sizeof(record)));
+
+    for (uint32_t i = 0; i < 500 && stream.size == 0; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    TEST_EXPECT(stream.size == sizeof(record));
+}
+
+static void TestGameCollectionIndex()
+{
+    constexpr uint32_t numGames = 50;
+
+    const Move moves[] =
+    {
+        Move::Make(Square_e2, Square_e4, Piece::Pawn),
+        Move::Make(Square_e7, Square_e5, Piece::Pawn),
+        Move::Make(Square_g1, Square_f3, Piece::Knight),
+    };
+
+    std::vector<uint8_t> buffer;
+    for (uint32_t i = 0; i < numGames; ++i)
+    {
+        Game game;
+        game.Reset(Position(Position::InitPositionFEN));
+        for (uint32_t j = 0; j <= i % 3; ++j)
+        {
+            TEST_EXPECT(game.DoMove(moves[j], static_cast<ScoreType>(i)));
+        }
+        TEST_EXPECT(GameCollection::SerializeGame(game, buffer));
+    }
+
+    const size_t completeSize = buffer.size();
+
+    // incomplete game at the end must not be indexed
+    buffer.resize(buffer.size() + sizeof(GameCollection::GameHeader) - 1);
+
+    GameCollection::Index index;
+    {
+        MemoryInputStream stream(buffer);
+        TEST_EXPECT(index.Build(stream));
+    }
+    TEST_EXPECT(index.GetNumGames() == numGames);
+    TEST_EXPECT(index.GetCollectionSize() == completeSize);
+    TEST_EXPECT(index.GetNumMoves() == 99);
+
+    // random access
+    {
+        MemoryInputStream stream(buffer);
+        Game game;
+        std::vector<Move> decodedMoves;
+        for (uint32_t i : { 17u, 3u, 49u, 0u, 25u })
+        {
+            TEST_EXPECT(index.GetEntry(i).numMoves == i % 3 + 1);
+            TEST_EXPECT(index.ReadGame(stream, i, game, decodedMoves));
+            TEST_EXPECT(decodedMoves.size() == i % 3 + 1);
+            TEST_EXPECT(game.GetMoveScores()[0] == static_cast<ScoreType>(i));
+        }
+        TEST_EXPECT(!index.ReadGame(stream, numGames, game, decodedMoves));
+    }
+
+    // ranges must cover all the games exactly once
+    for (uint32_t numRanges : { 1u, 3u, 7u, 64u })
+    {
+        const std::vector<GameCollection::Index::Range> ranges = index.Split(numRanges);
+        TEST_EXPECT(!ranges.empty() && ranges.size() <= numRanges);
+
+        size_t expectedFirstGame = 0;
+        for (const GameCollection::Index::Range& range : ranges)
+        {
+            TEST_EXPECT(range.firstGame == expectedFirstGame);
+            TEST_EXPECT(range.numGames > 0);
+            TEST_EXPECT(range.beginOffset == index.GetEntry(range.firstGame).offset);
+            expectedFirstGame += range.numGames;
+        }
+        TEST_EXPECT(expectedFirstGame == numGames);
+        TEST_EXPECT(ranges.back().endOffset == completeSize);
+    }
+
+    // extending index after the collection has grown
+    {
+        buffer.resize(completeSize);
+        Game game;
+        game.Reset(Position(Position::InitPositionFEN));
+        TEST_EXPECT(game.DoMove(moves[0], 1234));
+        TEST_EXPECT(GameCollection::SerializeGame(game, buffer));
+
+        MemoryInputStream stream(buffer);
+        TEST_EXPECT(index.Build(stream));
+        TEST_EXPECT(index.GetNumGames() == numGames + 1);
+        TEST_EXPECT(index.GetEntry(numGames).offset == completeSize);
+        TEST_EXPECT(index.GetCollectionSize() == buffer.size());
+    }
+}
+
+static void TestCompactGameCollection()
+{
+    std::vector<Game> games;
+
+    // empty game
+    games.emplace_back();
+    games.back().Reset(Position(Position::InitPositionFEN));
+
+    // game without move scores, ended in checkmate
+    {
+        Game game;
+        game.Reset(Position(Position::InitPositionFEN));
+        TEST_EXPECT(game.DoMove(Move::Make(Square_f2, Square_f3, Piece::Pawn)));
+        TEST_EXPECT(game.DoMove(Move::Make(Square_e7, Square_e5, Piece::Pawn)));
+        TEST_EXPECT(game.DoMove(Move::Make(Square_g2, Square_g4, Piece::Pawn)));
+        TEST_EXPECT(game.DoMove(Move::Make(Square_d8, Square_h4, Piece::Queen)));
+        games.push_back(game);
+    }
+
+    // games with scores (including big jumps) and forced score
+    for (int32_t i = 0; i < 100; ++i)
+    {
+        Game game;
+        game.Reset(Position("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1"));
+        TEST_EXPECT(game.DoMove(game.GetPosition().MoveFromString("e1g1"), static_cast<ScoreType>(i * 37 - 1000)));
+        TEST_EXPECT(game.DoMove(game.GetPosition().MoveFromString("e8c8"), static_cast<ScoreType>(-i)));
+        TEST_EXPECT(game.DoMove(game.GetPosition().MoveFromString("d5e6"), CheckmateValue - i));
+        game.SetScore(static_cast<Game::Score>(i % 3));
+        games.push_back(game);
+    }
+
+    std::vector<uint8_t> buffer;
+    {
+        MemoryOutputStream stream(buffer);
+        // small blocks to test games spanning multiple blocks
+        GameCollection::CompactWriter writer(stream, 256);
+        for (const Game& game : games)
+        {
+            TEST_EXPECT(writer.WriteGame(game));
+        }
+    }
+
+    {
+        MemoryInputStream stream(buffer);
+        TEST_EXPECT(GameCollection::IsCompactCollection(stream));
+
+        GameCollection::Reader reader(stream);
+        TEST_EXPECT(reader.IsCompact());
+
+        Game readGame;
+        std::vector<Move> moves;
+        for (const Game& game : games)
+        {
+            TEST_EXPECT(reader.ReadGame(readGame, moves));
+            TEST_EXPECT(readGame == game);
+            TEST_EXPECT(moves == game.GetMoves());
+        }
+        TEST_EXPECT(!reader.ReadGame(readGame, moves));
+    }
+
+    // corrupted data must be detected by the block checksum
+    {
+        buffer[buffer.size() / 2] ^= 0x10;
+
+        MemoryInputStream stream(buffer);
+        GameCollection::Reader reader(stream);
+
+        Game readGame;
+        std::vector<Move> moves;
+        size_t numGamesRead = 0;
+        while (reader.ReadGame(readGame, moves))
+        {
+            numGamesRead++;
+        }
+        TEST_EXPECT(numGamesRead < games.size());
+    }
+}
+
+static void TestCompactMoveEncoding()
+{
+    // every legal move (promotions, en passant, castling, many queens) must survive compact encoding
+    const char* fens[] =
+    {
+        Position::InitPositionFEN,
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "n1n5/PPPk4/8/8/8/8/4Kppp/5N1N b - - 0 1",
+        "rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3",
+        "k7/8/8/8/2QQ4/2QQ4/8/4KQ2 w - - 0 1",
+    };
+
+    std::vector<Game> games;
+    for (const char* fen : fens)
+    {
+        Position pos;
+        TEST_EXPECT(pos.FromFEN(fen));
+
+        std::vector<Move> legalMoves;
+        TEST_EXPECT(pos.GetNumLegalMoves(&legalMoves) > 0);
+
+        for (const Move move : legalMoves)
+        {
+            Game game;
+            game.Reset(pos);
+            TEST_EXPECT(game.DoMove(move, 0));
+            games.push_back(game);
+        }
+    }
+
+    std::vector<uint8_t> buffer;
+    {
+        MemoryOutputStream stream(buffer);
+        GameCollection::CompactWriter writer(stream);
+        for (const Game& game : games)
+        {
+            TEST_EXPECT(writer.WriteGame(game));
+        }
+        TEST_EXPECT(writer.Flush());
+        TEST_EXPECT(writer.GetStats().numMoves == games.size());
+    }
+
+    {
+        MemoryInputStream stream(buffer);
+        GameCollection::Reader reader(stream);
+
+        Game readGame;
+        std::vector<Move> moves;
+        for (const Game& game : games)
+        {
+            TEST_EXPECT(reader.ReadGame(readGame, moves));
+            TEST_EXPECT(moves == game.GetMoves());
+        }
+        TEST_EXPECT(!reader.ReadGame(readGame, moves));
+    }
+}
+
+static void TestCompactGameCollectionIndex()
+{
+    const Move moves[] =
+    {
+        Move::Make(Square_e2, Square_e4, Piece::Pawn),
+        Move::Make(Square_e7, Square_e5, Piece::Pawn),
+        Move::Make(Square_g1, Square_f3, Piece::Knight),
+    };
+
+    const uint32_t numGames = 50;
+
+    std::vector<uint8_t> buffer;
+    {
+        MemoryOutputStream stream(buffer);
+        // small blocks, so there are a few games per block
+        GameCollection::CompactWriter writer(stream, 128);
+        for (uint32_t i = 0; i < numGames; ++i)
+        {
+            Game game;
+            game.Reset(Position(Position::InitPositionFEN));
+            for (uint32_t j = 0; j <= i % 3; ++j)
+            {
+                TEST_EXPECT(game.DoMove(moves[j], static_cast<ScoreType>(i)));
+            }
+            TEST_EXPECT(writer.WriteGame(game));
+        }
+    }
+
+    GameCollection::Index index;
+    {
+        MemoryInputStream stream(buffer);
+        TEST_EXPECT(index.Build(stream));
+    }
+    TEST_EXPECT(index.GetNumGames() == numGames);
+    TEST_EXPECT(index.GetCollectionSize() == buffer.size());
+    TEST_EXPECT(index.GetNumMoves() == 99);
+    TEST_EXPECT(index.GetEntry(0).offset == index.GetEntry(1).offset);
+
+    // random access, including games in the middle of a block
+    {
+        MemoryInputStream stream(buffer);
+        Game game;
+        std::vector<Move> decodedMoves;
+        for (uint32_t i : { 17u, 3u, 49u, 0u, 25u, 26u })
+        {
+            TEST_EXPECT(index.GetEntry(i).numMoves == i % 3 + 1);
+            TEST_EXPECT(index.ReadGame(stream, i, game, decodedMoves));
+            TEST_EXPECT(decodedMoves.size() == i % 3 + 1);
+            TEST_EXPECT(game.GetMoveScores()[0] == static_cast<ScoreType>(i));
+        }
+        TEST_EXPECT(!index.ReadGame(stream, numGames, game, decodedMoves));
+    }
+
+    // ranges start at block boundaries and must cover all the games exactly once
+    for (uint32_t numRanges : { 1u, 3u, 7u, 64u })
+    {
+        const std::vector<GameCollection::Index::Range> ranges = index.Split(numRanges);
+        TEST_EXPECT(!ranges.empty() && ranges.size() <= numRanges);
+
+        size_t expectedFirstGame = 0;
+        for (const GameCollection::Index::Range& range : ranges)
+        {
+            TEST_EXPECT(range.firstGame == expectedFirstGame);
+            TEST_EXPECT(range.numGames > 0);
+
+            MemoryInputStream stream(buffer);
+            TEST_EXPECT(stream.SetPosition(range.beginOffset));
+
+            GameCollection::GameReplayCursor cursor(stream);
+            for (size_t i = 0; i < range.numGames; ++i)
+            {
+                TEST_EXPECT(cursor.NextGame());
+                TEST_EXPECT(cursor.GetNumMoves() == (range.firstGame + i) % 3 + 1);
+                TEST_EXPECT(cursor.NextMove());
+                TEST_EXPECT(cursor.GetMoveScore() == static_cast<ScoreType>(range.firstGame + i));
+            }
+
+            expectedFirstGame += range.numGames;
+        }
+        TEST_EXPECT(expectedFirstGame == numGames);
+        TEST_EXPECT(ranges.back().endOffset == buffer.size());
+    }
+}
+
+static void TestGameReplayCursor()
+{
+    std::vector<Game> games;
+
+    // game without move scores, ended in checkmate
+    {
+        Game game;
+        game.Reset(Position(Position::InitPositionFEN));
+        TEST_EXPECT(game.DoMove(Move::Make(Square_f2, Square_f3, Piece::Pawn)));
+        TEST_EXPECT(game.DoMove(Move::Make(Square_e7, Square_e5, Piece::Pawn)));
+        TEST_EXPECT(game.DoMove(Move::Make(Square_g2, Square_g4, Piece::Pawn)));
+        TEST_EXPECT(game.DoMove(Move::Make(Square_d8, Square_h4, Piece::Queen)));
+        games.push_back(game);
+    }
+
+    // game ended with 3-fold repetition
+    {
+        Game game;
+        game.Reset(Position(Position::InitPositionFEN));
+        for (uint32_t i = 0; i < 2; ++i)
+        {
+            TEST_EXPECT(game.DoMove(Move::Make(Square_g1, Square_f3, Piece::Knight), 10));
+            TEST_EXPECT(game.DoMove(Move::Make(Square_g8, Square_f6, Piece::Knight), -20));
+            TEST_EXPECT(game.DoMove(Move::Make(Square_f3, Square_g1, Piece::Knight), 30));
+            TEST_EXPECT(game.DoMove(Move::Make(Square_f6, Square_g8, Piece::Knight), -40));
+        }
+        TEST_EXPECT(game.GetScore() == Game::Score::Draw);
+        games.push_back(game);
+    }
+
+    // games with forced score
+    for (int32_t i = 0; i < 10; ++i)
+    {
+        Game game;
+        game.Reset(Position("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1"));
+        TEST_EXPECT(game.DoMove(game.GetPosition().MoveFromString("e1g1"), static_cast<ScoreType>(i * 37 - 1000)));
+        TEST_EXPECT(game.DoMove(game.GetPosition().MoveFromString("e8c8"), static_cast<ScoreType>(-i)));
+        game.SetScore(static_cast<Game::Score>(i % 3));
+        games.push_back(game);
+    }
+
+    const auto validateCursor = [&games](GameCollection::GameReplayCursor& cursor)
+    {
+        for (const Game& game : games)
+        {
+            TEST_EXPECT(cursor.NextGame());
+            TEST_EXPECT(cursor.GetNumMoves() == game.GetMoves().size());
+            TEST_EXPECT(cursor.GetInitialPosition() == game.GetInitialPosition());
+            TEST_EXPECT(cursor.ResolveGameScore() == game.GetScore());
+
+            std::stringstream moveList;
+            Position pos = game.GetInitialPosition();
+            for (size_t i = 0; i < game.GetMoves().size(); ++i)
+            {
+                TEST_EXPECT(cursor.NextMove());
+                TEST_EXPECT(cursor.GetMoveIndex() == i);
+                TEST_EXPECT(cursor.GetPosition() == pos);
+                TEST_EXPECT(cursor.GetMove() == game.GetMoves()[i]);
+                if (cursor.HasMoveScores())
+                {
+                    TEST_EXPECT(cursor.GetMoveScore() == game.GetMoveScores()[i]);
+                }
+                Game::WritePGNMove(moveList, cursor.GetPosition(), cursor.GetMove(), i == 0);
+                TEST_EXPECT(pos.DoMove(game.GetMoves()[i]));
+            }
+            TEST_EXPECT(!cursor.NextMove());
+            TEST_EXPECT(cursor.IsValid());
+            TEST_EXPECT(cursor.GetPosition() == game.GetPosition());
+            TEST_EXPECT(cursor.GetGameScore() == game.GetScore());
+            TEST_EXPECT(cursor.GetRepetitionCount() == game.GetRepetitionCount(game.GetPosition()));
+            TEST_EXPECT(moveList.str() == game.ToPGNMoveList());
+        }
+        TEST_EXPECT(!cursor.NextGame());
+        TEST_EXPECT(cursor.IsValid());
+    };
+
+    // legacy encoding
+    {
+        std::vector<uint8_t> buffer;
+        for (const Game& game : games)
+        {
+            TEST_EXPECT(GameCollection::SerializeGame(game, buffer));
+        }
+
+        MemoryInputStream stream(buffer);
+        GameCollection::GameReplayCursor cursor(stream);
+        validateCursor(cursor);
+    }
+
+    // compact encoding
+    {
+        std::vector<uint8_t> buffer;
+        {
+            MemoryOutputStream stream(buffer);
+            GameCollection::CompactWriter writer(stream, 64);
+            for (const Game& game : games)
+            {
+                TEST_EXPECT(writer.WriteGame(game));
+            }
+        }
+
+        MemoryInputStream stream(buffer);
+        GameCollection::GameReplayCursor cursor(stream);
+        validateCursor(cursor);
+    }
+}
+
 void RunGameTests()
 {
     std::cout << "Running Game tests..." << std::endl;
@@ -69,6 +567,14 @@ void RunGameTests()
         TestGameSerialization(game);
     }
 
+    TestParallelGameWriting();
+    TestParallelStreamIdleFlush();
+    TestGameCollectionIndex();
+    TestCompactGameCollection();
+    TestCompactMoveEncoding();
+    TestCompactGameCollectionIndex();
+    TestGameReplayCursor();
+
     {
         Search search;
         TranspositionTable tt{ 16 * 1024 };
@@ -1,4 +1,5 @@
 #include "Common.hpp"
+#include "ThreadPool.hpp"
 
 #include "../backend/Tablebase.hpp"
 #include "../backend/Evaluate.hpp"
@@ -9,15 +10,23 @@
 
 extern void RunUnitTests();
 extern bool RunPerformanceTests(const std::vector<std::string>& paths);
+extern void RunMicroBenchmarks(const std::vector<std::string>& args);
+extern void RunThreadPoolBenchmark(const std::vector<std::string>& args);
+extern void RunTrainingBenchmark(const std::vector<std::string>& args);
 extern void SelfPlay(const std::vector<std::string>& args);
 extern void PrepareTrainingData(const std::vector<std::string>& args);
 extern void PlainTextToTrainingData(const std::vector<std::string>& args);
 extern void DumpGames(const std::vector<std::string>& args);
+extern void BuildGameIndex(const std::vector<std::string>& args);
+extern void ConvertGames(const std::vector<std::string>& args);
+extern void ConvertTrainingData(const std::vector<std::string>& args);
+extern void DedupTrainingData(const std::vector<std::string>& args);
 extern void PgnToTrainingData(const std::vector<std::string>& args);
+extern void Rescore(const std::vector<std::string>& args);
 extern void GenerateEndgamePositions();
 extern void GenerateRandomPositions(const std::vector<std::string>& args);
 extern bool TestNetwork();
-extern bool TrainNetwork();
+extern bool TrainNetwork(const std::vector<std::string>& args);
 extern void ValidateEndgame();
 extern void AnalyzeGames();
 extern void FindMagics();
@@ -55,6 +64,30 @@ int main(int argc, const char* argv[])
         }
     }
 
+    // thread pool configuration (only before the tool name, tools may have their own "--threads" flags)
+    {
+        threadpool::ThreadPool& threadPool = threadpool::ThreadPool::GetInstance();
+        uint32_t numThreads = threadPool.GetNumThreads();
+        threadpool::ThreadPinning pinning = threadPool.GetThreadPinning();
+
+        while (args.size() >= 2 && (args[0] == "--poolThreads" || args[0] == "--pinning"))
+        {
+            if (args[0] == "--poolThreads")
+            {
+                numThreads = std::max(1, atoi(args[1].c_str()));
+            }
+            else if (!threadpool::ThreadPinningFromString(args[1], pinning))
+            {
+                std::cerr << "Invalid thread pinning policy: " << args[1] << " (expected none, compact, scatter or node)" << std::endl;
+                return 1;
+            }
+            args.erase(args.begin(), args.begin() + 2);
+        }
+
+        // the pool is started before NUMA topology is initialized, so always restart it
+        threadPool.Restart(numThreads, pinning);
+    }
+
     if (args.empty())
     {
         std::cerr << "Missing argument" << std::endl;
@@ -68,6 +101,12 @@ int main(int argc, const char* argv[])
         RunUnitTests();
     else if (toolName == "perftest")
         RunPerformanceTests(args);
+    else if (toolName == "microbench")
+        RunMicroBenchmarks(args);
+    else if (toolName == "threadPoolBench")
+        RunThreadPoolBenchmark(args);
+    else if (toolName == "trainbench")
+        RunTrainingBenchmark(args);
     else if (toolName == "selfplay")
         SelfPlay(args);
     else if (toolName == "prepareTrainingData")
@@ -76,8 +115,18 @@ int main(int argc, const char* argv[])
         PlainTextToTrainingData(args);
     else if (toolName == "dumpGames")
         DumpGames(args);
+    else if (toolName == "buildGameIndex")
+        BuildGameIndex(args);
+    else if (toolName == "convertGames")
+        ConvertGames(args);
+    else if (toolName == "convertTrainingData")
+        ConvertTrainingData(args);
+    else if (toolName == "dedupTrainingData")
+        DedupTrainingData(args);
     else if (toolName == "pgnToTrainingData")
         PgnToTrainingData(args);
+    else if (toolName == "rescore")
+        Rescore(args);
     else if (toolName == "testNetwork")
         TestNetwork();
     else if (toolName == "validateEndgame")
@@ -85,7 +134,7 @@ int main(int argc, const char* argv[])
     else if (toolName == "analyzeGames")
         AnalyzeGames();
     else if (toolName == "trainNetwork")
-        TrainNetwork();
+        TrainNetwork(args);
     else if (toolName == "findMagics")
         FindMagics();
 #ifdef USE_CUDA
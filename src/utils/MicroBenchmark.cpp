@@ -0,0 +1,461 @@
+#include "Common.hpp"
+
+#include "../backend/Position.hpp"
+#include "../backend/PositionUtils.hpp"
+#include "../backend/MoveGen.hpp"
+#include "../backend/MoveOrderer.hpp"
+#include "../backend/Search.hpp"
+#include "../backend/TranspositionTable.hpp"
+#include "../backend/NeuralNetworkEvaluator.hpp"
+#include "../backend/Evaluate.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+// results are written here so the compiler can't optimize away the benchmarked code
+static volatile uint64_t s_sink = 0;
+
+// time stamp counter ticks (reference cycles, not affected by frequency scaling)
+INLINE static uint64_t ReadCycleCounter()
+{
+#if defined(PLATFORM_WINDOWS)
+    return __rdtsc();
+#elif defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return 0;
+#endif
+}
+
+class MicroBenchmarkTimer
+{
+public:
+    INLINE void Start()
+    {
+        mStartTime = Clock::now();
+        mStartCycles = ReadCycleCounter();
+    }
+
+    INLINE void Stop()
+    {
+        const uint64_t endCycles = ReadCycleCounter();
+        const Clock::time_point endTime = Clock::now();
+        mCycles += endCycles - mStartCycles;
+        mNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(endTime - mStartTime).count();
+    }
+
+    uint64_t GetNanoseconds() const { return mNanoseconds; }
+    uint64_t GetCycles() const { return mCycles; }
+
+private:
+    Clock::time_point mStartTime;
+    uint64_t mStartCycles = 0;
+    uint64_t mNanoseconds = 0;
+    uint64_t mCycles = 0;
+};
+
+struct MicroBenchmarkContext
+{
+    double minTime = 0.5; // seconds
+    std::string filter;
+};
+
+// Run benchmark pass until minimum time is reached. Each pass performs 'numOpsPerPass' operations
+// and is responsible for starting/stopping the timer around the measured code.
+template<typename PassFunc>
+static void RunMicroBenchmark(const MicroBenchmarkContext& ctx, const char* name, uint64_t numOpsPerPass, const PassFunc& passFunc)
+{
+    if (!ctx.filter.empty() && std::string(name).find(ctx.filter) == std::string::npos)
+    {
+        return;
+    }
+
+    if (numOpsPerPass == 0)
+    {
+        printf("%-40s no data\n", name);
+        return;
+    }
+
+    // warmup
+    {
+        MicroBenchmarkTimer timer;
+        passFunc(timer);
+    }
+
+    MicroBenchmarkTimer timer;
+    uint64_t numOps = 0;
+    while (timer.GetNanoseconds() < static_cast<uint64_t>(ctx.minTime * 1.0e9))
+    {
+        passFunc(timer);
+        numOps += numOpsPerPass;
+    }
+
+    const double nsPerOp = static_cast<double>(timer.GetNanoseconds()) / static_cast<double>(numOps);
+    const double cyclesPerOp = static_cast<double>(timer.GetCycles()) / static_cast<double>(numOps);
+
+    printf("%-40s %12.2f ns/op %12.1f cycles/op %14.2f Mops/s\n", name, nsPerOp, cyclesPerOp, 1000.0 / nsPerOp);
+}
+
+static bool LoadBenchmarkPositions(const std::string& path, std::vector<Position>& outPositions)
+{
+    std::ifstream file(path);
+    if (!file.good())
+    {
+        std::cout << "Failed to open positions file: " << path << std::endl;
+        return false;
+    }
+
+    std::string lineStr;
+    while (std::getline(file, lineStr))
+    {
+        // EPD lines: strip opcodes (everything starting from "bm"/"am" or the first ';')
+        const size_t endPos = lineStr.find(';');
+        if (endPos != std::string::npos)
+        {
+            lineStr = lineStr.substr(0, endPos);
+        }
+
+        std::istringstream iss(lineStr);
+        std::string token, fenStr;
+        while (iss >> token)
+        {
+            if (token == "bm" || token == "am") break;
+            if (!fenStr.empty()) fenStr += ' ';
+            fenStr += token;
+        }
+
+        if (fenStr.empty()) continue;
+
+        Position pos;
+        if (!pos.FromFEN(fenStr))
+        {
+            std::cout << "Invalid position: " << fenStr << std::endl;
+            continue;
+        }
+
+        outPositions.push_back(pos);
+    }
+
+    return !outPositions.empty();
+}
+
+void RunMicroBenchmarks(const std::vector<std::string>& args)
+{
+    MicroBenchmarkContext ctx;
+    std::string positionsPath = DATA_PATH "testPositions.txt";
+
+    for (size_t i = 0; i + 1 < args.size(); i += 2)
+    {
+        if (args[i] == "positions")
+            positionsPath = args[i + 1];
+        else if (args[i] == "time")
+            ctx.minTime = std::max(0.01, atof(args[i + 1].c_str()));
+        else if (args[i] == "filter")
+            ctx.filter = args[i + 1];
+        else
+        {
+            std::cout << "Unknown microbench argument: " << args[i] << std::endl;
+            return;
+        }
+    }
+
+    std::vector<Position> positions;
+    if (!LoadBenchmarkPositions(positionsPath, positions))
+    {
+        return;
+    }
+
+    struct PositionAndMove
+    {
+        uint32_t positionIndex;
+        Move move;
+    };
+
+    // legal moves and resulting positions, used as a bigger corpus for some of the benchmarks
+    std::vector<PositionAndMove> legalMoves;
+    std::vector<Position> childPositions;
+    for (uint32_t i = 0; i < positions.size(); ++i)
+    {
+        MoveList moves;
+        GenerateMoveList(positions[i], moves);
+
+        for (uint32_t j = 0; j < moves.Size(); ++j)
+        {
+            Position child = positions[i];
+            if (child.DoMove(moves.GetMove(j)))
+            {
+                legalMoves.push_back({ i, moves.GetMove(j) });
+                childPositions.push_back(child);
+            }
+        }
+    }
+
+    std::cout << positions.size() << " positions, " << legalMoves.size() << " legal moves loaded" << std::endl;
+    std::cout << "Cycles are measured with the time stamp counter (reference cycles)" << std::endl << std::endl;
+
+    RunMicroBenchmark(ctx, "GenerateMoveList", positions.size(), [&](MicroBenchmarkTimer& timer)
+    {
+        uint64_t sum = 0;
+        timer.Start();
+        for (const Position& pos : positions)
+        {
+            MoveList moves;
+            GenerateMoveList(pos, moves);
+            sum += moves.Size();
+        }
+        timer.Stop();
+        s_sink = sum;
+    });
+
+    // NOTE: includes copying the position
+    RunMicroBenchmark(ctx, "Position::DoMove", legalMoves.size(), [&](MicroBenchmarkTimer& timer)
+    {
+        uint64_t sum = 0;
+        timer.Start();
+        for (const PositionAndMove& entry : legalMoves)
+        {
+            Position child = positions[entry.positionIndex];
+            sum += child.DoMove(entry.move);
+        }
+        timer.Stop();
+        s_sink = sum;
+    });
+
+    RunMicroBenchmark(ctx, "Position::DoMove (NNEvaluatorContext)", legalMoves.size(), [&](MicroBenchmarkTimer& timer)
+    {
+        uint64_t sum = 0;
+        NNEvaluatorContext nnContext;
+        timer.Start();
+        for (const PositionAndMove& entry : legalMoves)
+        {
+            Position child = positions[entry.positionIndex];
+            sum += child.DoMove(entry.move, nnContext);
+            sum += nnContext.numDirtyPieces;
+        }
+        timer.Stop();
+        s_sink = sum;
+    });
+
+    RunMicroBenchmark(ctx, "Position::StaticExchangeEvaluation", legalMoves.size(), [&](MicroBenchmarkTimer& timer)
+    {
+        uint64_t sum = 0;
+        timer.Start();
+        for (const PositionAndMove& entry : legalMoves)
+        {
+            sum += positions[entry.positionIndex].StaticExchangeEvaluation(entry.move);
+        }
+        timer.Stop();
+        s_sink = sum;
+    });
+
+    {
+        TranspositionTable tt(64ull * 1024ull * 1024ull);
+
+        RunMicroBenchmark(ctx, "TranspositionTable::Write", childPositions.size(), [&](MicroBenchmarkTimer& timer)
+        {
+            timer.Start();
+            for (const Position& pos : childPositions)
+            {
+                tt.Write(pos, 0, 0, 1, TTEntry::Bounds::Exact);
+            }
+            timer.Stop();
+        });
+
+        RunMicroBenchmark(ctx, "TranspositionTable::Read", childPositions.size(), [&](MicroBenchmarkTimer& timer)
+        {
+            uint64_t sum = 0;
+            TTEntry entry;
+            timer.Start();
+            for (const Position& pos : childPositions)
+            {
+                sum += tt.Read(pos, entry);
+            }
+            timer.Stop();
+            s_sink = sum;
+        });
+
+        RunMicroBenchmark(ctx, "TranspositionTable::Prefetch", childPositions.size(), [&](MicroBenchmarkTimer& timer)
+        {
+            timer.Start();
+            for (const Position& pos : childPositions)
+            {
+                tt.Prefetch(pos.GetHash());
+            }
+            timer.Stop();
+        });
+    }
+
+    {
+        std::unique_ptr<MoveOrderer> moveOrderer = std::make_unique<MoveOrderer>();
+        std::unique_ptr<NodeInfo> node = std::make_unique<NodeInfo>();
+
+        RunMicroBenchmark(ctx, "MoveOrderer::ScoreMoves", positions.size(), [&](MicroBenchmarkTimer& timer)
+        {
+            uint64_t sum = 0;
+            for (const Position& pos : positions)
+            {
+                node->Clear();
+                node->position = pos;
+                node->position.ComputeThreats(node->threats);
+                moveOrderer->InitContinuationHistoryPointers(*node);
+
+                MoveList moves;
+                GenerateMoveList(pos, moves);
+
+                timer.Start();
+                moveOrderer->ScoreMoves(*node, moves);
+                timer.Stop();
+
+                sum += moves.Size();
+            }
+            s_sink = sum;
+        });
+    }
+
+    RunMicroBenchmark(ctx, "PackPosition", positions.size(), [&](MicroBenchmarkTimer& timer)
+    {
+        uint64_t sum = 0;
+        PackedPosition packedPos;
+        timer.Start();
+        for (const Position& pos : positions)
+        {
+            sum += PackPosition(pos, packedPos);
+        }
+        timer.Stop();
+        s_sink = sum;
+    });
+
+    {
+        std::vector<PackedPosition> packedPositions(positions.size());
+        for (size_t i = 0; i < positions.size(); ++i)
+        {
+            VERIFY(PackPosition(positions[i], packedPositions[i]));
+        }
+
+        RunMicroBenchmark(ctx, "UnpackPosition", packedPositions.size(), [&](MicroBenchmarkTimer& timer)
+        {
+            uint64_t sum = 0;
+            Position pos;
+            timer.Start();
+            for (const PackedPosition& packedPos : packedPositions)
+            {
+                sum += UnpackPosition(packedPos, pos);
+            }
+            timer.Stop();
+            s_sink = sum;
+        });
+    }
+
+    if (!g_mainNeuralNetwork)
+    {
+        std::cout << "Neural network not loaded, skipping NN benchmarks" << std::endl;
+        return;
+    }
+
+    const nn::PackedNeuralNetwork& network = *g_mainNeuralNetwork;
+
+    constexpr uint32_t maxFeatures = 64;
+
+    struct FeaturesList
+    {
+        uint32_t numFeatures;
+        uint16_t features[maxFeatures];
+    };
+
+    // features for both perspectives (side to move first)
+    std::vector<FeaturesList> features(2 * positions.size());
+    for (size_t i = 0; i < positions.size(); ++i)
+    {
+        for (uint32_t j = 0; j < 2; ++j)
+        {
+            FeaturesList& list = features[2 * i + j];
+            list.numFeatures = PositionToFeaturesVector(positions[i], list.features, positions[i].GetSideToMove() ^ j);
+            ASSERT(list.numFeatures <= maxFeatures);
+        }
+    }
+
+    std::vector<nn::Accumulator> accumulators(2 * positions.size());
+
+    RunMicroBenchmark(ctx, "Accumulator::Refresh", features.size(), [&](MicroBenchmarkTimer& timer)
+    {
+        timer.Start();
+        for (size_t i = 0; i < features.size(); ++i)
+        {
+            accumulators[i].Refresh(network.accumulatorWeights, network.accumulatorBiases, features[i].numFeatures, features[i].features);
+        }
+        timer.Stop();
+    });
+
+    // incremental update of side-to-move accumulator, excluding king moves (these may require refresh)
+    {
+        struct UpdateCase
+        {
+            uint32_t positionIndex;
+            uint32_t numAdded;
+            uint32_t numRemoved;
+            uint16_t added[MaxNumDirtyPieces];
+            uint16_t removed[MaxNumDirtyPieces];
+        };
+
+        std::vector<UpdateCase> updateCases;
+        for (size_t i = 0; i < legalMoves.size(); ++i)
+        {
+            const PositionAndMove& entry = legalMoves[i];
+            if (entry.move.GetPiece() == Piece::King) continue;
+
+            const Position& parent = positions[entry.positionIndex];
+            FeaturesList parentFeatures = features[2 * entry.positionIndex];
+            FeaturesList childFeatures;
+            childFeatures.numFeatures = PositionToFeaturesVector(childPositions[i], childFeatures.features, parent.GetSideToMove());
+
+            std::sort(parentFeatures.features, parentFeatures.features + parentFeatures.numFeatures);
+            std::sort(childFeatures.features, childFeatures.features + childFeatures.numFeatures);
+
+            UpdateCase updateCase;
+            updateCase.positionIndex = entry.positionIndex;
+            updateCase.numAdded = static_cast<uint32_t>(std::set_difference(
+                childFeatures.features, childFeatures.features + childFeatures.numFeatures,
+                parentFeatures.features, parentFeatures.features + parentFeatures.numFeatures,
+                updateCase.added) - updateCase.added);
+            updateCase.numRemoved = static_cast<uint32_t>(std::set_difference(
+                parentFeatures.features, parentFeatures.features + parentFeatures.numFeatures,
+                childFeatures.features, childFeatures.features + childFeatures.numFeatures,
+                updateCase.removed) - updateCase.removed);
+            updateCases.push_back(updateCase);
+        }
+
+        nn::Accumulator target;
+
+        RunMicroBenchmark(ctx, "Accumulator::Update (incremental)", updateCases.size(), [&](MicroBenchmarkTimer& timer)
+        {
+            uint64_t sum = 0;
+            timer.Start();
+            for (const UpdateCase& updateCase : updateCases)
+            {
+                nn::Accumulator::Update(target, accumulators[2 * updateCase.positionIndex], network.accumulatorWeights,
+                    updateCase.numAdded, updateCase.added, updateCase.numRemoved, updateCase.removed);
+                sum += target.values[0];
+            }
+            timer.Stop();
+            s_sink = sum;
+        });
+    }
+
+    RunMicroBenchmark(ctx, "PackedNeuralNetwork::Run", positions.size(), [&](MicroBenchmarkTimer& timer)
+    {
+        int64_t sum = 0;
+        timer.Start();
+        for (size_t i = 0; i < positions.size(); ++i)
+        {
+            sum += network.Run(accumulators[2 * i], accumulators[2 * i + 1], GetNetworkVariant(positions[i]));
+        }
+        timer.Stop();
+        s_sink = static_cast<uint64_t>(sum);
+    });
+}
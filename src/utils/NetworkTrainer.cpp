@@ -30,6 +30,8 @@
 #include <fstream>
 #include <limits.h>
 #include <cmath>
+#include <filesystem>
+#include <sstream>
 
 #define USE_PACKED_NET
 // #define USE_VIRTUAL_FEATURES
@@ -39,28 +41,76 @@ using namespace threadpool;
 static const uint32_t cMaxIterations = 1'000'000'000;
 static const uint32_t cNumTrainingVectorsPerIteration = 512 * 1024;
 static const uint32_t cNumValidationVectorsPerIteration = 128 * 1024;
+static const uint32_t cNumValidationVectorsPerBatch = 64;
 static const uint32_t cBatchSize = 64 * 1024;
+static const uint32_t cGenerateSetChunkSize = 4 * 1024;
+static const uint32_t cCheckpointMagic = 0x4B435443; // "CTCK"
+static const uint32_t cCheckpointVersion = 2;
 #ifdef USE_VIRTUAL_FEATURES
 static const uint32_t cNumVirtualFeatures = 12 * 64;
 #endif // USE_VIRTUAL_FEATURES
 
+struct NetworkTrainerConfig
+{
+    // size of the streaming shuffle buffer, disabled by default (positions are sampled directly from the training files then)
+    float shuffleBufferSizeInGB = 0.0f;
+
+    // number of threads streaming the training files into the shuffle buffer
+    // (0 means the buffer is refilled synchronously, so the run is reproducible)
+    uint32_t numShuffleBufferReaders = 2;
+
+    uint64_t seed = 0;
+
+    // optimizer state (Adam moments) storage format, bfloat16 halves its memory
+    nn::MomentsFormat momentsFormat = nn::MomentsFormat::Float;
+
+    // training state checkpoint written every 'checkpointInterval' iterations (0 disables checkpoints)
+    std::string checkpointPath = "trainer.ckpt";
+    uint32_t checkpointInterval = 10;
+
+    // checkpoint to continue the training from
+    std::string resumePath;
+
+    // number of training sets in the generation pipeline, up to 'pipelineDepth - 1' sets are generated ahead of the training
+    uint32_t pipelineDepth = 3;
+};
+
+// number of values clamped to the quantized type range when packing a layer
+struct QuantizationStats
+{
+    std::atomic<uint64_t> numSaturatedWeights = 0;
+    std::atomic<uint64_t> numSaturatedBiases = 0;
+};
+
 class NetworkTrainer
 {
 public:
 
+    ~NetworkTrainer()
+    {
+        if (m_checkpointThread.joinable())
+        {
+            m_checkpointThread.join();
+        }
+    }
+
     NetworkTrainer()
         : m_randomGenerator(m_randomDevice())
         , m_trainingLog("training.log")
     {
         m_validationSet.resize(cNumTrainingVectorsPerIteration);
-        m_trainingSet.resize(cNumTrainingVectorsPerIteration);
-        m_trainingSetCopy.resize(cNumTrainingVectorsPerIteration);
         m_validationPerThreadData.resize(ThreadPool::GetInstance().GetNumThreads());
+        m_dataLoaderThreadContexts.resize(ThreadPool::GetInstance().GetNumThreads());
+
+        for (size_t i = 0; i < ThreadPool::GetInstance().GetNumThreads(); ++i)
+        {
+            m_threadRandomGenerators.emplace_back(m_randomDevice());
+        }
     }
 
     void InitNetwork();
 
-    bool Train();
+    bool Train(const NetworkTrainerConfig& config);
 
 private:
 
@@ -83,6 +133,12 @@ private:
     };
 
     TrainingDataLoader m_dataLoader;
+    std::vector<TrainingDataLoader::ThreadContext> m_dataLoaderThreadContexts;
+    std::atomic<bool> m_dataLoaderFailed = false;
+
+    NetworkTrainerConfig m_config;
+    std::unique_ptr<TrainingShuffleBuffer> m_shuffleBuffer;
+    uint64_t m_numGeneratedSets = 0;
 
     nn::WeightsStoragePtr m_featureTransformerWeights;
     nn::WeightsStoragePtr m_lastLayerWeights;
@@ -92,11 +148,49 @@ private:
     nn::NeuralNetworkTrainer m_trainer;
 #ifdef USE_PACKED_NET
     nn::PackedNeuralNetwork m_packedNet;
+    QuantizationStats m_featureTransformerQuantizationStats;
+    QuantizationStats m_lastLayerQuantizationStats;
 #endif // USE_PACKED_NET
 
     std::vector<TrainingEntry> m_validationSet;
-    std::vector<TrainingEntry> m_trainingSet;
-    std::vector<TrainingEntry> m_trainingSetCopy; // copy, because training set generation runs in parallel with training
+
+    // Training sets pipeline. Sets are generated ahead into a ring of slots while the trainer consumes older ones,
+    // so it doesn't wait for data as long as loading keeps up on average. Entries are drawn from the shuffle buffer
+    // on the main thread when a slot is queued, so the sets don't depend on tasks scheduling. Remaining stages
+    // (feature extraction, batch assembly) run as thread pool tasks in parallel with the training.
+    struct TrainingSetSlot
+    {
+        std::vector<PositionEntry> drawnEntries;
+        std::vector<TrainingEntry> entries;
+        std::vector<nn::TrainingVector> batch;  // network inputs pointing into 'entries'
+        std::unique_ptr<Waitable> ready;        // signaled when the set is generated, null if there's no generation pending
+    };
+    std::vector<std::unique_ptr<TrainingSetSlot>> m_trainingSetSlots;
+
+    enum class PipelineStage : uint8_t
+    {
+        Read,       // drawing from the shuffle buffer or reading and filtering the training files
+        Features,   // unpacking, labeling and feature extraction
+        Assembly,   // conversion to network inputs
+        Train,
+        Count
+    };
+
+    // throughput counters of a pipeline stage, updated concurrently
+    struct PipelineStageStats
+    {
+        std::atomic<uint64_t> numPositions = 0;
+        std::atomic<uint64_t> timeInMicroseconds = 0;
+
+        void Add(uint64_t positions, float seconds)
+        {
+            numPositions += positions;
+            timeInMicroseconds += static_cast<uint64_t>(seconds * 1.0e6f);
+        }
+    };
+
+    PipelineStageStats m_pipelineStats[static_cast<size_t>(PipelineStage::Count)];
+    float m_trainerWaitTime = 0.0f;
     std::vector<ValidationPerThreadData> m_validationPerThreadData;
 
     alignas(CACHELINE_SIZE)
@@ -107,10 +201,27 @@ private:
 
     std::random_device m_randomDevice;
     std::mt19937 m_randomGenerator;
+    std::vector<std::mt19937> m_threadRandomGenerators;
 
     std::ofstream m_trainingLog;
 
+    // checkpoint is serialized on the training thread and written to the file in the background
+    std::vector<uint8_t> m_checkpointData;
+    std::thread m_checkpointThread;
+
+    bool SaveCheckpoint(size_t iteration, size_t epoch);
+    bool LoadCheckpoint(const std::string& path, size_t& outIteration, size_t& outEpoch, size_t& outNumPendingSets);
+
+    bool DrawEntries(std::vector<PositionEntry>& outEntries, size_t count);
+    void GenerateTrainingSet(std::vector<TrainingEntry>& outEntries, const std::vector<PositionEntry>& drawnEntries, TaskBuilder& taskBuilder, uint64_t kingBucketMask, float baseLambda);
     bool GenerateTrainingSet(std::vector<TrainingEntry>& outEntries, uint64_t kingBucketMask, float baseLambda);
+    void AssembleBatch(TrainingSetSlot& slot, TaskBuilder& taskBuilder);
+
+    // queue generation of the next training set in a free slot
+    void QueueTrainingSet(TrainingSetSlot& slot, uint64_t kingBucketMask, float baseLambda);
+
+    // print and reset pipeline stages throughput
+    void PrintPipelineStats(float iterationTime);
 
     void Validate(size_t iteration);
 
@@ -120,7 +231,8 @@ private:
     bool UnpackNetwork();
 };
 
-void NetworkTrainer::InitNetwork()
+// create weights and nodes of the trained network topology (used by the trainer and the training benchmark)
+static void CreateNetwork(nn::MomentsFormat momentsFormat, nn::NeuralNetwork& outNetwork, nn::WeightsStoragePtr& outFeatureTransformerWeights, nn::WeightsStoragePtr& outLastLayerWeights)
 {
     const uint32_t accumulatorSize = nn::AccumulatorSize;
     const uint32_t networkInputs = nn::NumNetworkInputs
@@ -129,27 +241,32 @@ void NetworkTrainer::InitNetwork()
 #endif // USE_VIRTUAL_FEATURES
         ;
 
-    m_featureTransformerWeights = std::make_shared<nn::WeightsStorage>(networkInputs, accumulatorSize, 1);
-    m_featureTransformerWeights->m_isSparse = true;
+    outFeatureTransformerWeights = std::make_shared<nn::WeightsStorage>(networkInputs, accumulatorSize, 1);
+    outFeatureTransformerWeights->m_isSparse = true;
     // divide by number of active input features to avoid accumulator overflow
-    m_featureTransformerWeights->m_weightsRange = (float)std::numeric_limits<nn::FirstLayerWeightType>::max() / 16 / nn::InputLayerWeightQuantizationScale;
-    m_featureTransformerWeights->m_biasRange = (float)std::numeric_limits<nn::FirstLayerBiasType>::max() / 16 / nn::InputLayerBiasQuantizationScale;
-    m_featureTransformerWeights->Init(32u, 0.0f);
+    outFeatureTransformerWeights->m_weightsRange = (float)std::numeric_limits<nn::FirstLayerWeightType>::max() / 16 / nn::InputLayerWeightQuantizationScale;
+    outFeatureTransformerWeights->m_biasRange = (float)std::numeric_limits<nn::FirstLayerBiasType>::max() / 16 / nn::InputLayerBiasQuantizationScale;
+    outFeatureTransformerWeights->Init(32u, 0.0f);
 
     //nn::WeightsStoragePtr layer1Weights = std::make_shared<nn::WeightsStorage>(2u * accumulatorSize, 1);
     //layer1Weights->m_weightsRange = (float)std::numeric_limits<nn::HiddenLayerWeightType>::max() / nn::HiddenLayerWeightQuantizationScale;
     //layer1Weights->m_biasRange = (float)std::numeric_limits<nn::HiddenLayerWeightType>::max() / nn::HiddenLayerBiasQuantizationScale;
 
-    m_lastLayerWeights = std::make_shared<nn::WeightsStorage>(2u * accumulatorSize, 1, nn::NumVariants);
-    m_lastLayerWeights->m_weightsRange = (float)std::numeric_limits<nn::LastLayerWeightType>::max() / nn::OutputLayerWeightQuantizationScale;
-    m_lastLayerWeights->m_biasRange = (float)std::numeric_limits<nn::LastLayerBiasType>::max() / nn::OutputLayerBiasQuantizationScale;
-    m_lastLayerWeights->Init(2 * nn::AccumulatorSize);
+    outLastLayerWeights = std::make_shared<nn::WeightsStorage>(2u * accumulatorSize, 1, nn::NumVariants);
+    outLastLayerWeights->m_weightsRange = (float)std::numeric_limits<nn::LastLayerWeightType>::max() / nn::OutputLayerWeightQuantizationScale;
+    outLastLayerWeights->m_biasRange = (float)std::numeric_limits<nn::LastLayerBiasType>::max() / nn::OutputLayerBiasQuantizationScale;
+    outLastLayerWeights->Init(2 * nn::AccumulatorSize);
 
-    nn::NodePtr inputNodeA = std::make_shared<nn::SparseBinaryInputNode>(networkInputs, accumulatorSize, m_featureTransformerWeights);
-    nn::NodePtr inputNodeB = std::make_shared<nn::SparseBinaryInputNode>(networkInputs, accumulatorSize, m_featureTransformerWeights);
+    outFeatureTransformerWeights->SetMomentsFormat(momentsFormat);
+    outLastLayerWeights->SetMomentsFormat(momentsFormat);
+    std::cout << "Optimizer state size: "
+        << (outFeatureTransformerWeights->GetMomentsSize() + outLastLayerWeights->GetMomentsSize()) / (1024 * 1024) << " MB" << std::endl;
+
+    nn::NodePtr inputNodeA = std::make_shared<nn::SparseBinaryInputNode>(networkInputs, accumulatorSize, outFeatureTransformerWeights);
+    nn::NodePtr inputNodeB = std::make_shared<nn::SparseBinaryInputNode>(networkInputs, accumulatorSize, outFeatureTransformerWeights);
     nn::NodePtr concatenationNode = std::make_shared<nn::ConcatenationNode>(inputNodeA, inputNodeB);
     nn::NodePtr activationNode = std::make_shared<nn::ActivationNode>(concatenationNode, nn::ActivationFunction::CReLU);
-    nn::NodePtr hiddenNode = std::make_shared<nn::FullyConnectedNode>(activationNode, 2u * accumulatorSize, 1, m_lastLayerWeights);
+    nn::NodePtr hiddenNode = std::make_shared<nn::FullyConnectedNode>(activationNode, 2u * accumulatorSize, 1, outLastLayerWeights);
     nn::NodePtr outputNode = std::make_shared<nn::ActivationNode>(hiddenNode, nn::ActivationFunction::Sigmoid);
 
     std::vector<nn::NodePtr> nodes =
@@ -164,7 +281,13 @@ void NetworkTrainer::InitNetwork()
         outputNode,
     };
 
-    m_network.Init(nodes);
+    outNetwork.Init(nodes);
+}
+
+void NetworkTrainer::InitNetwork()
+{
+    CreateNetwork(m_config.momentsFormat, m_network, m_featureTransformerWeights, m_lastLayerWeights);
+
     m_trainer.Init(m_network);
     m_runCtx.Init(m_network);
 
@@ -216,55 +339,204 @@ static void TrainingEntryToNetworkInput(const TrainingEntry& entry, nn::InputDes
     inputDesc.inputs[1].numFeatures = entry.numBlackFeatures;
 }
 
-bool NetworkTrainer::GenerateTrainingSet(std::vector<TrainingEntry>& outEntries, uint64_t kingBucketMask, float baseLambda)
+bool NetworkTrainer::DrawEntries(std::vector<PositionEntry>& outEntries, size_t count)
 {
-    Position pos;
-    PositionEntry entry;
+    if (!m_shuffleBuffer)
+        return true;
 
-    for (uint32_t i = 0; i < cNumTrainingVectorsPerIteration; ++i)
+    const TimePoint startTime = TimePoint::GetCurrent();
+
+    outEntries.resize(count);
+    if (!m_shuffleBuffer->Draw(outEntries.data(), outEntries.size()))
     {
-        if (!m_dataLoader.FetchNextPosition(m_randomGenerator, entry, pos, kingBucketMask))
-            return false;
+        m_dataLoaderFailed = true;
+        return false;
+    }
+
+    m_pipelineStats[static_cast<size_t>(PipelineStage::Read)].Add(count, (TimePoint::GetCurrent() - startTime).ToSeconds());
+    return true;
+}
+
+// 'drawnEntries' are used with the shuffle buffer (see DrawEntries), otherwise positions are sampled from the files
+void NetworkTrainer::GenerateTrainingSet(std::vector<TrainingEntry>& outEntries, const std::vector<PositionEntry>& drawnEntries, TaskBuilder& taskBuilder, uint64_t kingBucketMask, float baseLambda)
+{
+    const uint32_t numChunks = static_cast<uint32_t>((outEntries.size() + cGenerateSetChunkSize - 1) / cGenerateSetChunkSize);
+    const uint64_t setIndex = m_numGeneratedSets++;
+
+    ASSERT(!m_shuffleBuffer || drawnEntries.size() == outEntries.size());
+
+    taskBuilder.ParallelFor("GenerateSet", numChunks, [this, &outEntries, &drawnEntries, kingBucketMask, baseLambda, setIndex](const TaskContext& ctx, uint32_t chunkIndex)
+    {
+        if (m_dataLoaderFailed)
+            return;
+
+        TrainingDataLoader::ThreadContext& loaderContext = m_dataLoaderThreadContexts[ctx.threadId];
 
-        // flip the board randomly in pawnless positions
-        if (pos.Whites().pawns == 0 && pos.Blacks().pawns == 0)
+        // with the shuffle buffer every chunk gets its own deterministic random sequence
+        std::mt19937 chunkGen;
+        if (m_shuffleBuffer)
         {
-            if (std::uniform_int_distribution<>(0, 1)(m_randomGenerator) != 0)
-                pos.MirrorVertically();
-            if (std::uniform_int_distribution<>(0, 1)(m_randomGenerator) != 0)
-                pos.FlipDiagonally();
+            std::seed_seq seedSequence{ static_cast<uint32_t>(m_config.seed), static_cast<uint32_t>(m_config.seed >> 32), static_cast<uint32_t>(setIndex), chunkIndex };
+            chunkGen.seed(seedSequence);
         }
+        std::mt19937& gen = m_shuffleBuffer ? chunkGen : m_threadRandomGenerators[ctx.threadId];
 
-        // make game score more important for high move count
-        const float wdlLambda = baseLambda * expf(-(float)pos.GetMoveCount() / 120.0f);
+        const TimePoint startTime = TimePoint::GetCurrent();
+        float readTime = 0.0f;
 
-        const Game::Score gameScore = (Game::Score)entry.wdlScore;
-        const Game::Score tbScore = (Game::Score)entry.tbScore;
-        float score = InternalEvalToExpectedGameScore(entry.score);
+        Position pos;
+        PositionEntry entry;
 
-        if (gameScore != Game::Score::Unknown)
+        const size_t chunkBegin = chunkIndex * cGenerateSetChunkSize;
+        const size_t chunkEnd = std::min<size_t>(outEntries.size(), (chunkIndex + 1) * cGenerateSetChunkSize);
+        for (size_t i = chunkBegin; i < chunkEnd; ++i)
         {
-            const float wdlScore = gameScore == Game::Score::WhiteWins ? 1.0f : (gameScore == Game::Score::BlackWins ? 0.0f : 0.5f);
-            score = std::lerp(wdlScore, score, wdlLambda);
+            if (m_shuffleBuffer)
+            {
+                // entries in the shuffle buffer are already filtered
+                entry = drawnEntries[i];
+                VERIFY(UnpackPosition(entry.pos, pos, false));
+                loaderContext.numPositions++;
+                loaderContext.numEntriesRead++;
+            }
+            else
+            {
+                const TimePoint readStartTime = TimePoint::GetCurrent();
+                if (!m_dataLoader.FetchNextPosition(loaderContext, gen, entry, pos, kingBucketMask))
+                {
+                    m_dataLoaderFailed = true;
+                    return;
+                }
+                readTime += (TimePoint::GetCurrent() - readStartTime).ToSeconds();
+            }
+
+            // flip the board randomly in pawnless positions
+            if (pos.Whites().pawns == 0 && pos.Blacks().pawns == 0)
+            {
+                if (std::uniform_int_distribution<>(0, 1)(gen) != 0)
+                    pos.MirrorVertically();
+                if (std::uniform_int_distribution<>(0, 1)(gen) != 0)
+                    pos.FlipDiagonally();
+            }
+
+            // make game score more important for high move count
+            const float wdlLambda = baseLambda * expf(-(float)pos.GetMoveCount() / 120.0f);
+
+            const Game::Score gameScore = (Game::Score)entry.wdlScore;
+            const Game::Score tbScore = (Game::Score)entry.tbScore;
+            float score = InternalEvalToExpectedGameScore(entry.score);
+
+            if (gameScore != Game::Score::Unknown)
+            {
+                const float wdlScore = gameScore == Game::Score::WhiteWins ? 1.0f : (gameScore == Game::Score::BlackWins ? 0.0f : 0.5f);
+                score = std::lerp(wdlScore, score, wdlLambda);
+            }
+
+            if (tbScore == Game::Score::Draw)
+            {
+                const float tbDrawLambda = 0.0f;
+                score = std::lerp(0.5f, score, tbDrawLambda);
+            }
+            else if (tbScore != Game::Score::Unknown)
+            {
+                const float tbLambda = 0.0f;
+                const float wdlScore = tbScore == Game::Score::WhiteWins ? 1.0f : (tbScore == Game::Score::BlackWins ? 0.0f : 0.5f);
+                score = std::lerp(wdlScore, score, tbLambda);
+            }
+
+            PositionToTrainingEntry(pos, outEntries[i]);
+            outEntries[i].targetOutput = score;
         }
 
-        if (tbScore == Game::Score::Draw)
+        const float chunkTime = (TimePoint::GetCurrent() - startTime).ToSeconds();
+        loaderContext.samplingTime += chunkTime;
+
+        if (!m_shuffleBuffer)
         {
-            const float tbDrawLambda = 0.0f;
-            score = std::lerp(0.5f, score, tbDrawLambda);
+            m_pipelineStats[static_cast<size_t>(PipelineStage::Read)].Add(chunkEnd - chunkBegin, readTime);
         }
-        else if (tbScore != Game::Score::Unknown)
+        m_pipelineStats[static_cast<size_t>(PipelineStage::Features)].Add(chunkEnd - chunkBegin, chunkTime - readTime);
+    });
+}
+
+bool NetworkTrainer::GenerateTrainingSet(std::vector<TrainingEntry>& outEntries, uint64_t kingBucketMask, float baseLambda)
+{
+    std::vector<PositionEntry> drawnEntries;
+    if (!DrawEntries(drawnEntries, outEntries.size()))
+        return false;
+
+    Waitable waitable;
+    {
+        TaskBuilder taskBuilder(waitable);
+        GenerateTrainingSet(outEntries, drawnEntries, taskBuilder, kingBucketMask, baseLambda);
+    }
+    waitable.Wait();
+
+    return !m_dataLoaderFailed;
+}
+
+void NetworkTrainer::AssembleBatch(TrainingSetSlot& slot, TaskBuilder& taskBuilder)
+{
+    const uint32_t numChunks = static_cast<uint32_t>((slot.entries.size() + cGenerateSetChunkSize - 1) / cGenerateSetChunkSize);
+
+    slot.batch.resize(slot.entries.size());
+
+    taskBuilder.ParallelFor("AssembleBatch", numChunks, [this, &slot](const TaskContext&, uint32_t chunkIndex)
+    {
+        const TimePoint startTime = TimePoint::GetCurrent();
+
+        const size_t chunkBegin = chunkIndex * cGenerateSetChunkSize;
+        const size_t chunkEnd = std::min<size_t>(slot.entries.size(), (chunkIndex + 1) * cGenerateSetChunkSize);
+        for (size_t i = chunkBegin; i < chunkEnd; ++i)
         {
-            const float tbLambda = 0.0f;
-            const float wdlScore = tbScore == Game::Score::WhiteWins ? 1.0f : (tbScore == Game::Score::BlackWins ? 0.0f : 0.5f);
-            score = std::lerp(wdlScore, score, tbLambda);
+            const TrainingEntry& entry = slot.entries[i];
+
+            nn::TrainingVector& trainingVector = slot.batch[i];
+            trainingVector.output.mode = nn::OutputMode::Single;
+            trainingVector.output.singleValue = entry.targetOutput;
+
+            TrainingEntryToNetworkInput(entry, trainingVector.input);
         }
 
-        PositionToTrainingEntry(pos, outEntries[i]);
-        outEntries[i].targetOutput = score;
+        m_pipelineStats[static_cast<size_t>(PipelineStage::Assembly)].Add(chunkEnd - chunkBegin, (TimePoint::GetCurrent() - startTime).ToSeconds());
+    });
+}
+
+void NetworkTrainer::QueueTrainingSet(TrainingSetSlot& slot, uint64_t kingBucketMask, float baseLambda)
+{
+    ASSERT(!slot.ready);
+
+    slot.entries.resize(cNumTrainingVectorsPerIteration);
+
+    // drawing is done here, on the main thread, so the sets are drawn in order
+    if (!DrawEntries(slot.drawnEntries, slot.entries.size()))
+        return;
+
+    slot.ready = std::make_unique<Waitable>();
+
+    TaskBuilder taskBuilder(*slot.ready);
+    GenerateTrainingSet(slot.entries, slot.drawnEntries, taskBuilder, kingBucketMask, baseLambda);
+    taskBuilder.Fence();
+    AssembleBatch(slot, taskBuilder);
+}
+
+void NetworkTrainer::PrintPipelineStats(float iterationTime)
+{
+    static const char* stageNames[] = { "read", "features", "assembly", "train" };
+    static_assert(std::size(stageNames) == static_cast<size_t>(PipelineStage::Count));
+
+    std::cout << "Pipeline throughput (pos/sec/thread): ";
+    for (size_t i = 0; i < static_cast<size_t>(PipelineStage::Count); ++i)
+    {
+        PipelineStageStats& stats = m_pipelineStats[i];
+        const uint64_t time = stats.timeInMicroseconds.exchange(0);
+        const uint64_t numPositions = stats.numPositions.exchange(0);
+        std::cout << (i > 0 ? ", " : "") << stageNames[i] << " " << (time > 0 ? 1.0e6 * (double)numPositions / (double)time : 0.0);
     }
+    std::cout << std::endl;
 
-    return true;
+    std::cout << "Waiting for data: " << 1000.0f * m_trainerWaitTime << " ms (" << 100.0f * m_trainerWaitTime / iterationTime << "%)" << std::endl;
+    m_trainerWaitTime = 0.0f;
 }
 
 static void ParallelFor(const char* debugName, uint32_t arraySize, const threadpool::ParallelForTaskFunction& func, uint32_t maxThreads = 0)
@@ -278,14 +550,19 @@ static void ParallelFor(const char* debugName, uint32_t arraySize, const threadp
 }
 
 #ifdef USE_PACKED_NET
+static float PackedNetworkOutputToExpectedGameScore(int32_t packedNetworkOutput)
+{
+    const float scaledPackedNetworkOutput = (float)packedNetworkOutput / (float)(nn::OutputScale * nn::WeightScale) * c_nnOutputToCentiPawns / 100.0f;
+    return EvalToExpectedGameScore(scaledPackedNetworkOutput);
+}
+
 static float EvalPackedNetwork(const TrainingEntry& entry, const nn::PackedNeuralNetwork& net)
 {
     const int32_t packedNetworkOutput = net.Run(
         entry.whiteFeatures, entry.numWhiteFeatures,
         entry.blackFeatures, entry.numBlackFeatures,
         entry.variant);
-    const float scaledPackedNetworkOutput = (float)packedNetworkOutput / (float)(nn::OutputScale * nn::WeightScale) * c_nnOutputToCentiPawns / 100.0f;
-    return EvalToExpectedGameScore(scaledPackedNetworkOutput);
+    return PackedNetworkOutputToExpectedGameScore(packedNetworkOutput);
 }
 #endif // USE_PACKED_NET
 
@@ -297,58 +574,80 @@ void NetworkTrainer::Validate(size_t iteration)
         m_validationPerThreadData[i].stats = ValidationStats();
     }
 
+    // the packed network evaluates whole batches of samples
+    const uint32_t numBatches = (cNumValidationVectorsPerIteration + cNumValidationVectorsPerBatch - 1) / cNumValidationVectorsPerBatch;
+
     Waitable waitable;
     {
         TaskBuilder taskBuilder(waitable);
-        taskBuilder.ParallelFor("Validate", cNumValidationVectorsPerIteration, [this](const TaskContext& ctx, uint32_t i)
+        taskBuilder.ParallelFor("Validate", numBatches, [this](const TaskContext& ctx, uint32_t batchIndex)
         {
             ValidationPerThreadData& threadData = m_validationPerThreadData[ctx.threadId];
 
-            const TrainingEntry& entry = m_validationSet[i];
-
-            const float expectedValue = entry.targetOutput;
+            const uint32_t batchStart = batchIndex * cNumValidationVectorsPerBatch;
+            const uint32_t numSamples = std::min(cNumValidationVectorsPerBatch, cNumValidationVectorsPerIteration - batchStart);
 
 #ifdef USE_PACKED_NET
-            const float nnPackedValue = EvalPackedNetwork(entry, m_packedNet);
-#endif // USE_PACKED_NET
+            nn::PackedNeuralNetwork::BatchInput packedInputs[cNumValidationVectorsPerBatch];
+            int32_t packedOutputs[cNumValidationVectorsPerBatch];
 
-            nn::InputDesc inputDesc;
-            TrainingEntryToNetworkInput(entry, inputDesc);
+            for (uint32_t j = 0; j < numSamples; ++j)
+            {
+                const TrainingEntry& entry = m_validationSet[batchStart + j];
+                packedInputs[j] = { entry.whiteFeatures, entry.blackFeatures, entry.numWhiteFeatures, entry.numBlackFeatures, entry.variant };
+            }
 
-            const nn::Values& networkOutput = m_network.Run(inputDesc, threadData.networkRunContext);
-            const float nnValue = networkOutput[0];
+            m_packedNet.Run(packedInputs, numSamples, packedOutputs);
+#endif // USE_PACKED_NET
 
-            if (i + 1 == cNumValidationVectorsPerIteration)
+            for (uint32_t j = 0; j < numSamples; ++j)
             {
-                std::cout
-                    << "True Score:     " << expectedValue << " (" << ExpectedGameScoreToInternalEval(expectedValue) << ")" << std::endl
-                    << "NN eval:        " << nnValue << " (" << ExpectedGameScoreToInternalEval(nnValue) << ")" << std::endl
+                const uint32_t i = batchStart + j;
+                const TrainingEntry& entry = m_validationSet[i];
+
+                const float expectedValue = entry.targetOutput;
+
+                // float network is evaluated per sample, tiled evaluation is slower without the backward pass
+                nn::InputDesc inputDesc;
+                TrainingEntryToNetworkInput(entry, inputDesc);
+
+                const nn::Values& networkOutput = m_network.Run(inputDesc, threadData.networkRunContext);
+                const float nnValue = networkOutput[0];
 #ifdef USE_PACKED_NET
-                    << "Packed NN eval: " << nnPackedValue << " (" << ExpectedGameScoreToInternalEval(nnPackedValue) << ")" << std::endl
+                const float nnPackedValue = PackedNetworkOutputToExpectedGameScore(packedOutputs[j]);
 #endif // USE_PACKED_NET
-                    << std::endl;
-            }
 
-            ValidationStats& stats = threadData.stats;
-            {
-                const float error = expectedValue - nnValue;
-                const float errorDiff = std::abs(error);
-                stats.nnErrorSum += error * error;
-                stats.nnMinError = std::min(stats.nnMinError, errorDiff);
-                stats.nnMaxError = std::max(stats.nnMaxError, errorDiff);
-            }
+                if (i + 1 == cNumValidationVectorsPerIteration)
+                {
+                    std::cout
+                        << "True Score:     " << expectedValue << " (" << ExpectedGameScoreToInternalEval(expectedValue) << ")" << std::endl
+                        << "NN eval:        " << nnValue << " (" << ExpectedGameScoreToInternalEval(nnValue) << ")" << std::endl
 #ifdef USE_PACKED_NET
-            stats.nnPackedQuantizationErrorSum += (nnValue - nnPackedValue) * (nnValue - nnPackedValue);
-
-            {
-                const float error = expectedValue - nnPackedValue;
-                const float errorDiff = std::abs(error);
-                stats.nnPackedErrorSum += error * error;
-                stats.nnPackedMinError = std::min(stats.nnPackedMinError, errorDiff);
-                stats.nnPackedMaxError = std::max(stats.nnPackedMaxError, errorDiff);
-            }
+                        << "Packed NN eval: " << nnPackedValue << " (" << ExpectedGameScoreToInternalEval(nnPackedValue) << ")" << std::endl
 #endif // USE_PACKED_NET
+                        << std::endl;
+                }
 
+                ValidationStats& stats = threadData.stats;
+                {
+                    const float error = expectedValue - nnValue;
+                    const float errorDiff = std::abs(error);
+                    stats.nnErrorSum += error * error;
+                    stats.nnMinError = std::min(stats.nnMinError, errorDiff);
+                    stats.nnMaxError = std::max(stats.nnMaxError, errorDiff);
+                }
+#ifdef USE_PACKED_NET
+                stats.nnPackedQuantizationErrorSum += (nnValue - nnPackedValue) * (nnValue - nnPackedValue);
+
+                {
+                    const float error = expectedValue - nnPackedValue;
+                    const float errorDiff = std::abs(error);
+                    stats.nnPackedErrorSum += error * error;
+                    stats.nnPackedMinError = std::min(stats.nnPackedMinError, errorDiff);
+                    stats.nnPackedMaxError = std::max(stats.nnPackedMaxError, errorDiff);
+                }
+#endif // USE_PACKED_NET
+            }
         });
     }
 
@@ -446,35 +745,102 @@ void NetworkTrainer::Validate(size_t iteration)
     m_network.PrintStats();
 }
 
+// quantize a single value (rounding half away from zero), returns false if it had to be saturated
+template<typename T>
+INLINE static bool QuantizeValue(float value, float scale, T& outValue)
+{
+    const double quantized = std::round(value * scale);
+    const double clamped = std::clamp<double>(quantized, std::numeric_limits<T>::min(), std::numeric_limits<T>::max());
+    outValue = static_cast<T>(clamped);
+    return quantized == clamped;
+}
+
+// quantize an array of values, returns number of saturated values
+template<typename T>
+static uint32_t QuantizeValues(const float* values, T* outValues, uint32_t count, float scale)
+{
+    uint32_t numSaturated = 0;
+    uint32_t i = 0;
+
+#ifdef USE_AVX2
+    if constexpr (std::is_same_v<T, int16_t>)
+    {
+        const __m256 scaleVec = _mm256_set1_ps(scale);
+        const __m256 halfVec = _mm256_set1_ps(0.5f);
+        const __m256 oneVec = _mm256_set1_ps(1.0f);
+        const __m256 signMask = _mm256_set1_ps(-0.0f);
+        const __m256 minVec = _mm256_set1_ps(static_cast<float>(std::numeric_limits<int16_t>::min()));
+        const __m256 maxVec = _mm256_set1_ps(static_cast<float>(std::numeric_limits<int16_t>::max()));
+
+        const auto quantize = [&](const float* ptr) -> __m256i
+        {
+            const __m256 x = _mm256_mul_ps(_mm256_loadu_ps(ptr), scaleVec);
+
+            // same result as std::round: truncate and step away from zero if the fraction is at least half
+            const __m256 truncated = _mm256_round_ps(x, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+            const __m256 fraction = _mm256_andnot_ps(signMask, _mm256_sub_ps(x, truncated));
+            const __m256 step = _mm256_or_ps(oneVec, _mm256_and_ps(x, signMask));
+            const __m256 rounded = _mm256_add_ps(truncated, _mm256_and_ps(_mm256_cmp_ps(fraction, halfVec, _CMP_GE_OQ), step));
+
+            const __m256 saturated = _mm256_or_ps(_mm256_cmp_ps(rounded, minVec, _CMP_LT_OQ), _mm256_cmp_ps(rounded, maxVec, _CMP_GT_OQ));
+            numSaturated += PopCount(static_cast<uint32_t>(_mm256_movemask_ps(saturated)));
+
+            return _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(rounded, minVec), maxVec));
+        };
+
+        for (; i + 16 <= count; i += 16)
+        {
+            const __m256i a = quantize(values + i);
+            const __m256i b = quantize(values + i + 8);
+            // packs works within 128-bit lanes, permute to restore the order
+            const __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0b11011000);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(outValues + i), packed);
+        }
+    }
+#endif // USE_AVX2
+
+    for (; i < count; ++i)
+    {
+        if (!QuantizeValue(values[i], scale, outValues[i]))
+            numSaturated++;
+    }
+
+    return numSaturated;
+}
+
 template<typename WeightType, typename BiasType>
-static void PackWeights(const nn::Values& weights, uint32_t numInputs, uint32_t numOutputs, WeightType* outWeights, BiasType* outBiases, float weightScale, float biasScale, bool transpose)
+static void PackWeights(const nn::Values& weights, uint32_t numInputs, uint32_t numOutputs, WeightType* outWeights, BiasType* outBiases, float weightScale, float biasScale, bool transpose, QuantizationStats& stats)
 {
     // weights
-    for (uint32_t j = 0; j < numInputs; j++)
+    if (transpose || numOutputs == 1)
     {
-        for (uint32_t i = 0; i < numOutputs; i++)
+        // output layout matches the input one, quantize blocks of rows in parallel
+        const uint32_t numRowsPerBlock = std::max(1u, 64u * 1024u / numOutputs);
+        const uint32_t numBlocks = (numInputs + numRowsPerBlock - 1) / numRowsPerBlock;
+
+        ParallelFor("PackWeights", numBlocks, [&](const TaskContext&, uint32_t blockIndex)
         {
-            const float weight = weights[j * numOutputs + i];
-            const int32_t quantizedWeight = (int32_t)std::round(weight * weightScale);
-            ASSERT(quantizedWeight <= std::numeric_limits<WeightType>::max());
-            ASSERT(quantizedWeight >= std::numeric_limits<WeightType>::min());
+            const uint32_t rowBegin = blockIndex * numRowsPerBlock;
+            const uint32_t rowEnd = std::min(rowBegin + numRowsPerBlock, numInputs);
+            const size_t offset = static_cast<size_t>(rowBegin) * numOutputs;
 
-            if (transpose)
-                outWeights[numOutputs * j + i] = (WeightType)quantizedWeight;
-            else
-                outWeights[numInputs * i + j] = (WeightType)quantizedWeight;
+            stats.numSaturatedWeights += QuantizeValues(weights.data() + offset, outWeights + offset, (rowEnd - rowBegin) * numOutputs, weightScale);
+        });
+    }
+    else
+    {
+        for (uint32_t j = 0; j < numInputs; j++)
+        {
+            for (uint32_t i = 0; i < numOutputs; i++)
+            {
+                if (!QuantizeValue(weights[j * numOutputs + i], weightScale, outWeights[numInputs * i + j]))
+                    stats.numSaturatedWeights++;
+            }
         }
     }
 
     // biases
-    for (uint32_t i = 0; i < numOutputs; i++)
-    {
-        const float bias = weights[numInputs * numOutputs + i];
-        const int32_t quantizedBias = (int32_t)std::round(bias * biasScale);
-        ASSERT(quantizedBias <= std::numeric_limits<BiasType>::max());
-        ASSERT(quantizedBias >= std::numeric_limits<BiasType>::min());
-        outBiases[i] = (BiasType)quantizedBias;
-    }
+    stats.numSaturatedBiases += QuantizeValues(weights.data() + numInputs * numOutputs, outBiases, numOutputs, biasScale);
 }
 
 template<typename WeightType, typename BiasType>
@@ -500,6 +866,11 @@ static void UnpackWeights(nn::Values& outWeights, uint32_t numInputs, uint32_t n
 
 bool NetworkTrainer::PackNetwork()
 {
+    m_featureTransformerQuantizationStats.numSaturatedWeights = 0;
+    m_featureTransformerQuantizationStats.numSaturatedBiases = 0;
+    m_lastLayerQuantizationStats.numSaturatedWeights = 0;
+    m_lastLayerQuantizationStats.numSaturatedBiases = 0;
+
     // feature transformer
     {
 #ifdef USE_VIRTUAL_FEATURES
@@ -508,7 +879,7 @@ bool NetworkTrainer::PackNetwork()
         const nn::Values& originalWeights = m_featureTransformerWeights->m_variants.front().m_weights;
 
         // distribute weights of virtual features to all king buckets
-        for (uint32_t kingBucket = 0; kingBucket < nn::NumKingBuckets; ++kingBucket)
+        ParallelFor("DistributeVirtualFeatures", nn::NumKingBuckets, [&](const TaskContext&, uint32_t kingBucket)
         {
             for (uint32_t featureIndex = 0; featureIndex < 12 * 64; ++featureIndex)
             {
@@ -519,7 +890,7 @@ bool NetworkTrainer::PackNetwork()
                         originalWeights[accumIndex + (nn::NumNetworkInputs + featureIndex) * nn::AccumulatorSize];
                 }
             }
-        }
+        });
 
         // copy biases
         for (uint32_t accumIndex = 0; accumIndex < nn::AccumulatorSize; ++accumIndex)
@@ -528,7 +899,7 @@ bool NetworkTrainer::PackNetwork()
                 originalWeights[accumIndex + (nn::NumNetworkInputs + 12 * 64) * nn::AccumulatorSize];
         }
 #else // !USE_VIRTUAL_FEATURES
-        const nn::Values weights = m_featureTransformerWeights->m_variants.front().m_weights;
+        const nn::Values& weights = m_featureTransformerWeights->m_variants.front().m_weights;
 #endif // USE_VIRTUAL_FEATURES
 
         PackWeights(
@@ -539,7 +910,8 @@ bool NetworkTrainer::PackNetwork()
             const_cast<nn::FirstLayerBiasType*>(m_packedNet.accumulatorBiases),
             nn::InputLayerWeightQuantizationScale,
             nn::InputLayerBiasQuantizationScale,
-            true);
+            true,
+            m_featureTransformerQuantizationStats);
     }
 
     // last layer
@@ -553,7 +925,8 @@ bool NetworkTrainer::PackNetwork()
             const_cast<nn::LastLayerBiasType*>(&m_packedNet.lastLayerVariants[variantIdx].bias),
             nn::OutputLayerWeightQuantizationScale,
             nn::OutputLayerBiasQuantizationScale,
-            false);
+            false,
+            m_lastLayerQuantizationStats);
     }
 
     return true;
@@ -605,16 +978,208 @@ static volatile float g_learningRateScale = 0.5f;
 static volatile float g_lambdaScale = 0.0f;
 static volatile float g_weightDecay = 1.0f / 2048.0f;
 
-bool NetworkTrainer::Train()
+bool NetworkTrainer::SaveCheckpoint(size_t iteration, size_t epoch)
 {
-    InitNetwork();
+    // the previous checkpoint must be written before its buffer is reused
+    if (m_checkpointThread.joinable())
+    {
+        m_checkpointThread.join();
+    }
+
+    // sets generated ahead are stored too, so they're not drawn again after resuming
+    const size_t numPendingSets = m_trainingSetSlots.size() - 1;
+    for (size_t i = 0; i < numPendingSets; ++i)
+    {
+        TrainingSetSlot& slot = *m_trainingSetSlots[(iteration + i) % m_trainingSetSlots.size()];
+        if (slot.ready)
+        {
+            slot.ready->Wait();
+            slot.ready.reset();
+        }
+    }
+
+    m_checkpointData.clear();
+    MemoryOutputStream stream(m_checkpointData);
+
+    const uint32_t header[] = { cCheckpointMagic, cCheckpointVersion };
+    const uint64_t state[] = { iteration, epoch, m_numTrainingVectorsPassed, m_numGeneratedSets, m_config.seed, m_threadRandomGenerators.size(), numPendingSets };
+    const uint8_t hasShuffleBuffer = m_shuffleBuffer != nullptr;
+
+    bool success =
+        stream.Write(header, sizeof(header)) &&
+        stream.Write(state, sizeof(state)) &&
+        WriteRandomGenerator(stream, m_randomGenerator);
 
-    if (!m_packedNet.LoadFromFile("eval-68.pnn"))
+    for (const std::mt19937& gen : m_threadRandomGenerators)
     {
-        std::cout << "ERROR: Failed to load packed network" << std::endl;
+        success = success && WriteRandomGenerator(stream, gen);
+    }
+
+    success = success &&
+        m_featureTransformerWeights->Save(stream) &&
+        m_lastLayerWeights->Save(stream) &&
+        WriteArray(stream, m_validationSet);
+
+    for (size_t i = 0; i < numPendingSets; ++i)
+    {
+        success = success && WriteArray(stream, m_trainingSetSlots[(iteration + i) % m_trainingSetSlots.size()]->entries);
+    }
+
+    success = success &&
+        stream.Write(&hasShuffleBuffer, sizeof(hasShuffleBuffer)) &&
+        (!m_shuffleBuffer || m_shuffleBuffer->SaveState(stream));
+
+    if (!success)
+    {
+        std::cout << "ERROR: Failed to serialize checkpoint" << std::endl;
+        return false;
+    }
+
+    // written to a temporary file first, so the checkpoint is never left truncated
+    m_checkpointThread = std::thread([this, iteration]()
+    {
+        const std::string& path = m_config.checkpointPath;
+        const std::string tempPath = path + ".tmp";
+        {
+            FileOutputStream file(tempPath.c_str());
+            if (!file.IsOpen() || !file.Write(m_checkpointData.data(), m_checkpointData.size()))
+            {
+                std::cout << "ERROR: Failed to write checkpoint " << tempPath << std::endl;
+                return;
+            }
+        }
+
+        std::error_code ec;
+        std::filesystem::rename(tempPath, path, ec);
+        if (ec)
+        {
+            std::cout << "ERROR: Failed to write checkpoint " << path << std::endl;
+            return;
+        }
+
+        std::cout << "Checkpoint saved: " << path << " (iteration " << iteration << ", " << m_checkpointData.size() / (1024 * 1024) << " MB)" << std::endl;
+    });
+
+    return true;
+}
+
+bool NetworkTrainer::LoadCheckpoint(const std::string& path, size_t& outIteration, size_t& outEpoch, size_t& outNumPendingSets)
+{
+    std::vector<uint8_t> data;
+    {
+        FileInputStream file(path.c_str());
+        if (!file.IsOpen())
+        {
+            std::cout << "ERROR: Failed to open checkpoint " << path << std::endl;
+            return false;
+        }
+
+        data.resize(file.GetSize());
+        if (!file.Read(data.data(), data.size()))
+        {
+            std::cout << "ERROR: Failed to read checkpoint " << path << std::endl;
+            return false;
+        }
+    }
+
+    MemoryInputStream stream(data);
+
+    uint32_t header[2];
+    uint64_t state[7];
+    if (!stream.Read(header, sizeof(header)) || header[0] != cCheckpointMagic || header[1] != cCheckpointVersion ||
+        !stream.Read(state, sizeof(state)) || !ReadRandomGenerator(stream, m_randomGenerator))
+    {
+        std::cout << "ERROR: Invalid checkpoint " << path << std::endl;
+        return false;
+    }
+
+    outIteration = state[0];
+    outEpoch = state[1];
+    m_numTrainingVectorsPassed = state[2];
+    m_numGeneratedSets = state[3];
+    m_config.seed = state[4];
+    outNumPendingSets = state[6];
+
+    if (outNumPendingSets >= m_trainingSetSlots.size())
+    {
+        std::cout << "ERROR: Checkpoint requires training sets pipeline depth of at least " << (outNumPendingSets + 1) << std::endl;
+        return false;
+    }
+
+    // thread generators are restored only if the number of threads didn't change
+    for (uint64_t i = 0; i < state[5]; ++i)
+    {
+        std::mt19937 gen;
+        if (!ReadRandomGenerator(stream, gen))
+            return false;
+        if (i < m_threadRandomGenerators.size())
+            m_threadRandomGenerators[i] = gen;
+    }
+
+    uint8_t hasShuffleBuffer = 0;
+    if (!m_featureTransformerWeights->Load(stream) ||
+        !m_lastLayerWeights->Load(stream) ||
+        !ReadArray(stream, m_validationSet) ||
+        m_validationSet.size() != cNumTrainingVectorsPerIteration)
+    {
+        std::cout << "ERROR: Invalid checkpoint " << path << std::endl;
+        return false;
+    }
+
+    for (size_t i = 0; i < outNumPendingSets; ++i)
+    {
+        TrainingSetSlot& slot = *m_trainingSetSlots[(outIteration + i) % m_trainingSetSlots.size()];
+        if (!ReadArray(stream, slot.entries) || slot.entries.size() != cNumTrainingVectorsPerIteration)
+        {
+            std::cout << "ERROR: Invalid checkpoint " << path << std::endl;
+            return false;
+        }
+
+        Waitable waitable;
+        {
+            TaskBuilder taskBuilder(waitable);
+            AssembleBatch(slot, taskBuilder);
+        }
+        waitable.Wait();
+    }
+
+    if (!stream.Read(&hasShuffleBuffer, sizeof(hasShuffleBuffer)))
+    {
+        std::cout << "ERROR: Invalid checkpoint " << path << std::endl;
         return false;
     }
-    UnpackNetwork();
+
+    if ((hasShuffleBuffer != 0) != (m_shuffleBuffer != nullptr) ||
+        (m_shuffleBuffer && !m_shuffleBuffer->LoadState(stream)))
+    {
+        std::cout << "ERROR: Failed to restore shuffle buffer state from checkpoint " << path << std::endl;
+        return false;
+    }
+
+    std::cout << "Resuming from checkpoint " << path << " (iteration " << outIteration << ", epoch " << outEpoch << ")" << std::endl;
+
+    return true;
+}
+
+bool NetworkTrainer::Train(const NetworkTrainerConfig& config)
+{
+    m_config = config;
+    m_randomGenerator.seed(static_cast<std::mt19937::result_type>(config.seed));
+
+    InitNetwork();
+
+    const bool resume = !m_config.resumePath.empty();
+
+    // when resuming the weights come from the checkpoint
+    if (!resume)
+    {
+        if (!m_packedNet.LoadFromFile("eval-68.pnn"))
+        {
+            std::cout << "ERROR: Failed to load packed network" << std::endl;
+            return false;
+        }
+        UnpackNetwork();
+    }
 
     if (!m_dataLoader.Init(m_randomGenerator))
     {
@@ -622,7 +1187,12 @@ bool NetworkTrainer::Train()
         return false;
     }
 
-    std::vector<nn::TrainingVector> batch(cNumTrainingVectorsPerIteration);
+    const uint32_t pipelineDepth = std::max(2u, m_config.pipelineDepth);
+    m_trainingSetSlots.clear();
+    for (uint32_t i = 0; i < pipelineDepth; ++i)
+    {
+        m_trainingSetSlots.push_back(std::make_unique<TrainingSetSlot>());
+    }
 
     TimePoint prevIterationStartTime = TimePoint::GetCurrent();
 
@@ -635,50 +1205,71 @@ bool NetworkTrainer::Train()
     // m_featureTransformerWeights->m_updateWeights = false; // freeze feature transformer weights
     // m_lastLayerWeights->m_updateWeights = false; // freeze last layer weights
 
-    GenerateTrainingSet(m_validationSet, kingBucketMask, maxLambda);
+    if (m_config.shuffleBufferSizeInGB > 0.0f)
+    {
+        TrainingShuffleBuffer::Params params;
+        params.sizeInGB = m_config.shuffleBufferSizeInGB;
+        params.numReaderThreads = m_config.numShuffleBufferReaders;
+        params.seed = m_config.seed;
+        params.kingBucketMask = kingBucketMask;
+
+        m_shuffleBuffer = std::make_unique<TrainingShuffleBuffer>();
+        if (!m_shuffleBuffer->Init(m_dataLoader, params))
+            return false;
+    }
 
+    const auto getLambda = [&](size_t iteration)
+    {
+        return g_lambdaScale * std::lerp(minLambda, maxLambda, expf(-0.0005f * (float)iteration));
+    };
+
+    size_t startIteration = 0;
     size_t epoch = 0;
-    for (size_t iteration = 0; iteration < cMaxIterations; ++iteration)
+    size_t numPendingSets = 0;
+    if (resume)
+    {
+        if (!LoadCheckpoint(m_config.resumePath, startIteration, epoch, numPendingSets))
+            return false;
+    }
+    else
+    {
+        GenerateTrainingSet(m_validationSet, kingBucketMask, maxLambda);
+    }
+
+    // fill the pipeline, the last slot is queued by the first iteration
+    for (size_t i = numPendingSets; i + 1 < pipelineDepth; ++i)
+    {
+        QueueTrainingSet(*m_trainingSetSlots[(startIteration + i) % pipelineDepth], kingBucketMask, getLambda(startIteration));
+    }
+
+    for (size_t iteration = startIteration; iteration < cMaxIterations; ++iteration)
     {
         const float warmup = (iteration < 10.0f) ? (float)(iteration + 1) / 10.0f : 1.0f;
         const float learningRate = g_learningRateScale * warmup * std::lerp(minLearningRate, maxLearningRate, expf(-0.0005f * (float)iteration));
-        const float lambda = g_lambdaScale * std::lerp(minLambda, maxLambda, expf(-0.0005f * (float)iteration));
-
-        if (iteration == 0)
-        {
-            if (!GenerateTrainingSet(m_trainingSet, kingBucketMask, lambda))
-                return false;
-        }
+        const float lambda = getLambda(iteration);
 
         TimePoint iterationStartTime = TimePoint::GetCurrent();
         float iterationTime = (iterationStartTime - prevIterationStartTime).ToSeconds();
         prevIterationStartTime = iterationStartTime;
 
-        // use validation set from previous iteration as training set in the current one
-        ParallelFor("PrepareBatch", cNumTrainingVectorsPerIteration, [&batch, this](const TaskContext&, uint32_t i)
+        TrainingSetSlot& slot = *m_trainingSetSlots[iteration % pipelineDepth];
+        if (slot.ready)
         {
-            m_trainingSetCopy[i] = m_trainingSet[i];
+            const TimePoint waitStartTime = TimePoint::GetCurrent();
+            slot.ready->Wait();
+            slot.ready.reset();
+            m_trainerWaitTime += (TimePoint::GetCurrent() - waitStartTime).ToSeconds();
+        }
 
-            const TrainingEntry& entry = m_trainingSetCopy[i];
+        if (m_dataLoaderFailed)
+            return false;
 
-            nn::TrainingVector& trainingVector = batch[i];
-            trainingVector.input.variant = entry.variant;
-            trainingVector.output.mode = nn::OutputMode::Single;
-            trainingVector.output.singleValue = entry.targetOutput;
+        const TimePoint trainStartTime = TimePoint::GetCurrent();
 
-            TrainingEntryToNetworkInput(entry, trainingVector.input);
-        });
-
-        // validation vectors generation can be done in parallel with training
         Waitable waitable;
         {
             TaskBuilder taskBuilder{ waitable };
-            taskBuilder.Task("GenerateSet", [&](const TaskContext&)
-            {
-                GenerateTrainingSet(m_trainingSet, kingBucketMask, lambda);
-            });
-
-            taskBuilder.Task("Train", [this, kingBucketMask, &epoch, &batch, learningRate](const TaskContext& ctx)
+            taskBuilder.Task("Train", [this, kingBucketMask, &epoch, &slot, learningRate](const TaskContext& ctx)
             {
                 nn::TrainParams params;
                 params.optimizer = nn::Optimizer::Adam;
@@ -708,13 +1299,24 @@ bool NetworkTrainer::Train()
                 }
 
                 TaskBuilder taskBuilder{ ctx };
-                epoch += m_trainer.Train(m_network, batch, params, &taskBuilder);
+                epoch += m_trainer.Train(m_network, slot.batch, params, &taskBuilder);
             });
         }
+
+        // the slot trained in the previous iteration is free now, next sets are generated in parallel with the training
+        QueueTrainingSet(*m_trainingSetSlots[(iteration + pipelineDepth - 1) % pipelineDepth], kingBucketMask, lambda);
+
         waitable.Wait();
+        m_pipelineStats[static_cast<size_t>(PipelineStage::Train)].Add(cNumTrainingVectorsPerIteration,
+            (TimePoint::GetCurrent() - trainStartTime).ToSeconds() * ThreadPool::GetInstance().GetNumThreads());
+
+        if (m_dataLoaderFailed)
+            return false;
 
 #ifdef USE_PACKED_NET
+        const TimePoint packStartTime = TimePoint::GetCurrent();
         PackNetwork();
+        const float packTime = (TimePoint::GetCurrent() - packStartTime).ToSeconds();
 #endif // USE_PACKED_NET
 
         m_numTrainingVectorsPassed += cNumTrainingVectorsPerIteration;
@@ -726,10 +1328,21 @@ bool NetworkTrainer::Train()
             << "Num training vectors:   " << std::setprecision(3) << m_numTrainingVectorsPassed / 1.0e9f << "B" << std::endl
             << "Learning rate:          " << learningRate << std::endl;
 
+        const TimePoint validationStartTime = TimePoint::GetCurrent();
         Validate(iteration);
+        const float validationTime = (TimePoint::GetCurrent() - validationStartTime).ToSeconds();
 
         std::cout << "Iteration time:   " << 1000.0f * iterationTime << " ms" << std::endl;
-        std::cout << "Training rate :   " << ((float)cNumTrainingVectorsPerIteration / iterationTime) << " pos/sec" << std::endl << std::endl;
+        std::cout << "Training rate :   " << ((float)cNumTrainingVectorsPerIteration / iterationTime) << " pos/sec" << std::endl;
+#ifdef USE_PACKED_NET
+        std::cout << "Packing time:     " << 1000.0f * packTime << " ms" << std::endl;
+#endif // USE_PACKED_NET
+        std::cout << "Validation time:  " << 1000.0f * validationTime << " ms" << std::endl;
+        PrintPipelineStats(iterationTime);
+        std::cout << std::endl;
+
+        TrainingDataLoader::PrintThreadStats(m_dataLoaderThreadContexts);
+        std::cout << std::endl;
 
         // print weights stats
         {
@@ -738,6 +1351,17 @@ bool NetworkTrainer::Train()
 
             std::cout << "LL weights stats: ";
             m_lastLayerWeights->PrintStats();
+
+#ifdef USE_PACKED_NET
+            std::cout << "Saturated weights/biases: FT "
+                << m_featureTransformerQuantizationStats.numSaturatedWeights << "/" << m_featureTransformerQuantizationStats.numSaturatedBiases << ", LL "
+                << m_lastLayerQuantizationStats.numSaturatedWeights << "/" << m_lastLayerQuantizationStats.numSaturatedBiases << std::endl;
+#endif // USE_PACKED_NET
+        }
+
+        if (m_config.checkpointInterval > 0 && (iteration + 1) % m_config.checkpointInterval == 0)
+        {
+            SaveCheckpoint(iteration + 1, epoch);
         }
 
         if (iteration % 10 == 0)
@@ -769,8 +1393,256 @@ bool NetworkTrainer::Train()
 }
 
 
-bool TrainNetwork()
+bool TrainNetwork(const std::vector<std::string>& args)
+{
+    NetworkTrainerConfig config;
+    config.seed = std::random_device()();
+
+    for (size_t i = 0; i + 1 < args.size(); i += 2)
+    {
+        if (args[i] == "shuffleBuffer")
+            config.shuffleBufferSizeInGB = std::max(0.0f, static_cast<float>(atof(args[i + 1].c_str())));
+        else if (args[i] == "readers")
+            config.numShuffleBufferReaders = static_cast<uint32_t>(std::stoul(args[i + 1]));
+        else if (args[i] == "seed")
+            config.seed = std::stoull(args[i + 1]);
+        else if (args[i] == "moments" && (args[i + 1] == "float" || args[i + 1] == "bf16"))
+            config.momentsFormat = args[i + 1] == "bf16" ? nn::MomentsFormat::BFloat16 : nn::MomentsFormat::Float;
+        else if (args[i] == "checkpoint")
+            config.checkpointPath = args[i + 1];
+        else if (args[i] == "checkpointInterval")
+            config.checkpointInterval = static_cast<uint32_t>(std::stoul(args[i + 1]));
+        else if (args[i] == "--resume")
+            config.resumePath = args[i + 1];
+        else if (args[i] == "pipeline")
+            config.pipelineDepth = static_cast<uint32_t>(std::stoul(args[i + 1]));
+        else
+        {
+            std::cout << "Unknown trainNetwork argument: " << args[i] << std::endl;
+            return false;
+        }
+    }
+
+    // the trainer is too big for the stack (it contains a packed network)
+    std::unique_ptr<NetworkTrainer> trainer = std::make_unique<NetworkTrainer>();
+    return trainer->Train(config);
+}
+
+// Synthetic training entry with pieces on random distinct squares. Features are computed like in PositionToFeaturesVector
+// (king bucket, file and rank flipping, sorted by piece), so the feature counts and the weights access pattern resemble real data.
+static void GenerateSyntheticTrainingEntry(std::mt19937& gen, TrainingEntry& outEntry)
 {
-    NetworkTrainer trainer;
-    return trainer.Train();
+    constexpr uint32_t maxPieces = 32;
+    constexpr uint32_t whiteKing = 5;
+    constexpr uint32_t blackKing = 11;
+
+    // both kings and up to 30 other pieces, number of captured pieces is the smaller of two uniform draws,
+    // so positions with more pieces are more common (like in games)
+    const uint32_t numCapturedPieces = std::min(gen() % (maxPieces - 1), gen() % (maxPieces - 1));
+    const uint32_t numPieces = maxPieces - numCapturedPieces;
+
+    uint8_t squares[64];
+    for (uint8_t i = 0; i < 64; ++i)
+        squares[i] = i;
+
+    uint8_t pieces[maxPieces];
+    for (uint32_t i = 0; i < numPieces; ++i)
+    {
+        std::swap(squares[i], squares[i + gen() % (64 - i)]);
+
+        if (i == 0)
+            pieces[i] = whiteKing;
+        else if (i == 1)
+            pieces[i] = blackKing;
+        else
+        {
+            // non-king pieces of both colors
+            const uint32_t piece = gen() % 10;
+            pieces[i] = static_cast<uint8_t>(piece < 5 ? piece : piece + 1);
+        }
+    }
+
+    const auto writeFeatures = [&](const Color perspective, uint16_t* outFeatures)
+    {
+        Square kingSquare(squares[perspective == White ? 0 : 1]);
+        uint32_t bitFlipMask = 0;
+
+        if (kingSquare.File() >= 4)
+        {
+            kingSquare = kingSquare.FlippedFile();
+            bitFlipMask = 0b000111;
+        }
+
+        if (perspective == Black)
+        {
+            kingSquare = kingSquare.FlippedRank();
+            bitFlipMask |= 0b111000;
+        }
+
+        const uint32_t inputOffset = nn::KingBucketIndex[kingSquare.Index()] * 12 * 64;
+
+        for (uint32_t i = 0; i < numPieces; ++i)
+        {
+            // pieces of the perspective side come first
+            const uint32_t piece = perspective == White ? pieces[i] : (pieces[i] + 6) % 12;
+            outFeatures[i] = static_cast<uint16_t>(inputOffset + piece * 64 + (squares[i] ^ bitFlipMask));
+        }
+
+        std::sort(outFeatures, outFeatures + numPieces);
+    };
+
+    writeFeatures(White, outEntry.whiteFeatures);
+    writeFeatures(Black, outEntry.blackFeatures);
+
+    outEntry.numWhiteFeatures = static_cast<uint8_t>(numPieces);
+    outEntry.numBlackFeatures = static_cast<uint8_t>(numPieces);
+    outEntry.variant = static_cast<uint8_t>(gen() % nn::NumVariants);
+    outEntry.targetOutput = std::uniform_real_distribution<float>(0.0f, 1.0f)(gen);
+}
+
+// Measures the trainer throughput on synthetic data, independently of the training files and convergence:
+// runs forward, backward and update passes of the trainer network and reports positions/s of each stage
+// for a list of thread counts. Stage rates are positions/s as if all the threads worked only on the given stage.
+void RunTrainingBenchmark(const std::vector<std::string>& args)
+{
+    std::vector<uint32_t> threadCounts;
+    uint32_t numIterations = 5;
+    uint32_t numPositions = cNumTrainingVectorsPerIteration;
+    uint64_t seed = 1;
+    nn::MomentsFormat momentsFormat = nn::MomentsFormat::Float;
+
+    for (size_t i = 0; i + 1 < args.size(); i += 2)
+    {
+        if (args[i] == "threads")
+        {
+            // comma separated list
+            std::stringstream ss(args[i + 1]);
+            std::string token;
+            while (std::getline(ss, token, ','))
+            {
+                threadCounts.push_back(std::max(1, atoi(token.c_str())));
+            }
+        }
+        else if (args[i] == "iterations")
+            numIterations = std::max(1u, static_cast<uint32_t>(std::stoul(args[i + 1])));
+        else if (args[i] == "positions")
+            numPositions = std::max(1u, static_cast<uint32_t>(std::stoul(args[i + 1])));
+        else if (args[i] == "seed")
+            seed = std::stoull(args[i + 1]);
+        else if (args[i] == "moments" && (args[i + 1] == "float" || args[i + 1] == "bf16"))
+            momentsFormat = args[i + 1] == "bf16" ? nn::MomentsFormat::BFloat16 : nn::MomentsFormat::Float;
+        else
+        {
+            std::cout << "Unknown trainbench argument: " << args[i] << std::endl;
+            return;
+        }
+    }
+
+    ThreadPool& threadPool = ThreadPool::GetInstance();
+    const uint32_t originalNumThreads = threadPool.GetNumThreads();
+
+    if (threadCounts.empty())
+    {
+        // powers of two up to the pool size
+        for (uint32_t numThreads = 1; numThreads < originalNumThreads; numThreads *= 2)
+        {
+            threadCounts.push_back(numThreads);
+        }
+        threadCounts.push_back(originalNumThreads);
+    }
+
+    std::vector<TrainingEntry> entries(numPositions);
+    std::vector<nn::TrainingVector> batch(numPositions);
+    {
+        std::mt19937 gen(static_cast<uint32_t>(seed));
+        uint64_t numFeatures = 0;
+        for (uint32_t i = 0; i < numPositions; ++i)
+        {
+            GenerateSyntheticTrainingEntry(gen, entries[i]);
+            numFeatures += entries[i].numWhiteFeatures;
+
+            batch[i].output.mode = nn::OutputMode::Single;
+            batch[i].output.singleValue = entries[i].targetOutput;
+            TrainingEntryToNetworkInput(entries[i], batch[i].input);
+        }
+
+        std::cout << "Positions per iteration: " << numPositions << " (" << std::setprecision(3) << (float)numFeatures / numPositions << " features per side on average)" << std::endl;
+    }
+
+    nn::NeuralNetwork network;
+    nn::WeightsStoragePtr featureTransformerWeights;
+    nn::WeightsStoragePtr lastLayerWeights;
+    CreateNetwork(momentsFormat, network, featureTransformerWeights, lastLayerWeights);
+
+    constexpr size_t numStages = static_cast<size_t>(nn::NeuralNetworkTrainer::Stage::Count);
+
+    std::cout << std::setw(8) << "threads" << std::setw(12) << "pos/s" << std::setw(10) << "speedup";
+    for (size_t stage = 0; stage < numStages; ++stage)
+    {
+        std::cout << std::setw(12) << nn::NeuralNetworkTrainer::StageToString(static_cast<nn::NeuralNetworkTrainer::Stage>(stage));
+    }
+    std::cout << std::setw(8) << "idle" << std::endl;
+
+    float baseRate = 0.0f;
+
+    for (const uint32_t numThreads : threadCounts)
+    {
+        threadPool.SetNumThreads(numThreads);
+
+        // per-thread data is sized with the number of pool threads
+        std::unique_ptr<nn::NeuralNetworkTrainer> trainer = std::make_unique<nn::NeuralNetworkTrainer>();
+        trainer->Init(network);
+
+        size_t epoch = 0;
+        const auto runIteration = [&]()
+        {
+            nn::TrainParams params;
+            params.optimizer = nn::Optimizer::Adam;
+            params.iteration = epoch;
+            params.batchSize = cBatchSize;
+            params.learningRate = 1.0e-5f;
+            params.weightDecay = g_weightDecay;
+
+            Waitable waitable;
+            {
+                TaskBuilder taskBuilder{ waitable };
+                epoch += trainer->Train(network, batch, params, &taskBuilder);
+            }
+            waitable.Wait();
+        };
+
+        // warm-up, the first iteration touches the gradients memory
+        runIteration();
+        trainer->ResetStageTimes();
+
+        const TimePoint startTime = TimePoint::GetCurrent();
+        for (uint32_t i = 0; i < numIterations; ++i)
+        {
+            runIteration();
+        }
+        const float elapsedTime = (TimePoint::GetCurrent() - startTime).ToSeconds();
+
+        const float numTrainedPositions = static_cast<float>(numIterations) * numPositions;
+        const float rate = numTrainedPositions / elapsedTime;
+        if (baseRate == 0.0f)
+        {
+            baseRate = rate / threadCounts.front();
+        }
+
+        std::cout << std::setw(8) << numThreads
+            << std::setw(12) << static_cast<uint64_t>(rate)
+            << std::setw(10) << std::fixed << std::setprecision(2) << rate / baseRate << std::defaultfloat;
+
+        // thread time not spent in any stage: scheduling and waiting on fences
+        float idleTime = numThreads * elapsedTime;
+        for (size_t stage = 0; stage < numStages; ++stage)
+        {
+            const float stageTime = trainer->GetStageTime(static_cast<nn::NeuralNetworkTrainer::Stage>(stage));
+            idleTime -= stageTime;
+            std::cout << std::setw(12) << static_cast<uint64_t>(numTrainedPositions * numThreads / std::max(1.0e-6f, stageTime));
+        }
+        std::cout << std::setw(7) << std::fixed << std::setprecision(1) << 100.0f * std::max(0.0f, idleTime) / (numThreads * elapsedTime) << "%" << std::defaultfloat << std::endl;
+    }
+
+    threadPool.SetNumThreads(originalNumThreads);
 }
@@ -1,12 +1,95 @@
+#include "TrainerCommon.hpp"
 #include "../backend/Position.hpp"
 #include "../backend/PositionUtils.hpp"
 #include "../backend/Material.hpp"
+#include "../backend/Move.hpp"
 
 #include <iostream>
 
 #define TEST_EXPECT(x) \
     if (!(x)) { std::cout << "Test failed: " << #x << std::endl; DEBUG_BREAK(); }
 
+static void TestTrainingDataFile()
+{
+    std::mt19937 mt;
+
+    // positions of random games, normalized to white side to move (like prepareTrainingData output)
+    std::vector<PositionEntry> entries;
+    for (uint32_t gameIndex = 0; gameIndex < 20; ++gameIndex)
+    {
+        Position pos(Position::InitPositionFEN);
+        const uint8_t wdlScore = static_cast<uint8_t>(gameIndex % 3);
+
+        std::vector<Move> moves;
+        for (;;)
+        {
+            moves.clear();
+            if (pos.GetNumLegalMoves(&moves) == 0 || pos.GetHalfMoveCount() >= 100)
+            {
+                break;
+            }
+
+            PositionEntry entry{};
+            entry.score = static_cast<ScoreType>(std::uniform_int_distribution<int32_t>(-3000, 3000)(mt));
+            entry.wdlScore = wdlScore;
+            entry.tbScore = pos.GetNumPieces() <= 7 ? wdlScore : 0xFF;
+            TEST_EXPECT(PackPosition(pos.GetSideToMove() == White ? pos : pos.SwappedColors(), entry.pos));
+            entries.push_back(entry);
+
+            TEST_EXPECT(pos.DoMove(moves[std::uniform_int_distribution<size_t>(0, moves.size() - 1)(mt)]));
+        }
+    }
+
+    // unrelated positions
+    for (uint32_t i = 0; i < 100; ++i)
+    {
+        entries.push_back(entries[std::uniform_int_distribution<size_t>(0, entries.size() - 1)(mt)]);
+    }
+
+    std::vector<uint8_t> buffer;
+    {
+        MemoryOutputStream stream(buffer);
+        TrainingDataFile::Writer writer(stream, 1000);
+        for (const PositionEntry& entry : entries)
+        {
+            TEST_EXPECT(writer.Write(entry));
+        }
+        TEST_EXPECT(writer.Finish());
+    }
+
+    TEST_EXPECT(buffer.size() < entries.size() * sizeof(PositionEntry) / 2);
+
+    {
+        MemoryInputStream stream(buffer);
+        TrainingDataFile::Reader reader;
+        TEST_EXPECT(reader.Open(stream));
+        TEST_EXPECT(reader.GetNumEntries() == entries.size());
+        TEST_EXPECT(reader.GetNumChunks() == (entries.size() + 999) / 1000);
+
+        // chunks can be decoded in any order
+        std::vector<PositionEntry> chunkEntries;
+        for (uint32_t chunkIndex = reader.GetNumChunks(); chunkIndex-- > 0; )
+        {
+            TEST_EXPECT(reader.ReadChunk(stream, chunkIndex, chunkEntries));
+            TEST_EXPECT(chunkEntries.size() == std::min<size_t>(1000, entries.size() - chunkIndex * 1000));
+            TEST_EXPECT(memcmp(chunkEntries.data(), entries.data() + chunkIndex * 1000, chunkEntries.size() * sizeof(PositionEntry)) == 0);
+        }
+
+        TEST_EXPECT(!reader.ReadChunk(stream, reader.GetNumChunks(), chunkEntries));
+    }
+
+    // corrupted chunk is detected
+    {
+        buffer[100] ^= 0x10;
+        MemoryInputStream stream(buffer);
+        TrainingDataFile::Reader reader;
+        std::vector<PositionEntry> chunkEntries;
+        TEST_EXPECT(reader.Open(stream));
+        TEST_EXPECT(!reader.ReadChunk(stream, 0, chunkEntries));
+        TEST_EXPECT(chunkEntries.empty());
+    }
+}
+
 void RunPackedPositionTests()
 {
     std::cout << "Running PackedPosition tests..." << std::endl;
@@ -97,4 +180,6 @@ void RunPackedPositionTests()
             TEST_EXPECT(originalPos == unpackedPos);
         }
     }
+
+    TestTrainingDataFile();
 }
@@ -1,16 +1,27 @@
 #include "PgnParser.hpp"
+#include "Stream.hpp"
+#include "ThreadPool.hpp"
 
 #include "../backend/Move.hpp"
 #include "../backend/Position.hpp"
 #include "../backend/Score.hpp"
+#include "../backend/Waitable.hpp"
 
 #include <fstream>
 #include <algorithm>
 #include <cstring>
+#include <string_view>
+#include <atomic>
+#include <memory>
+
+using namespace threadpool;
 
 static constexpr size_t kPgnReadBufferSize = 65536;
 
-// Buffered reader
+// Size of a piece of memory-mapped PGN parsed by a single task
+static constexpr size_t kPgnChunkSize = 4 * 1024 * 1024;
+
+// Buffered stream reader
 struct PgnReader
 {
     explicit PgnReader(std::istream& s) : stream(s) {}
@@ -47,8 +58,82 @@ struct PgnReader
     }
 
     bool atEof() { return peek() == '\0'; }
+
+    // Consumes characters until 'isStop' matches (not consuming it) or EOF.
+    // Returned view is valid until the next readToken() call.
+    template<typename StopPredicate>
+    std::string_view readToken(const StopPredicate& isStop)
+    {
+        token.clear();
+        for (char c = peek(); c != '\0' && !isStop(c); c = peek())
+        {
+            token += c;
+            ++pos;
+        }
+        return token;
+    }
+
+    // Consumes characters until 'isStop' matches (not consuming it) or EOF.
+    template<typename StopPredicate>
+    void skipUntil(const StopPredicate& isStop)
+    {
+        for (char c = peek(); c != '\0' && !isStop(c); c = peek())
+        {
+            ++pos;
+        }
+    }
+
+    // token may span buffer refills, so it has to be copied
+    std::string token;
+};
+
+// Reader of in-memory (e.g. memory mapped) PGN, tokens are returned as views into the memory
+struct PgnMemoryReader
+{
+    PgnMemoryReader(const char* begin, const char* end) : cur(begin), end(end) {}
+
+    const char* cur;
+    const char* end;
+
+    bool refill() { return cur < end; }
+
+    char peek() const { return cur < end ? *cur : '\0'; }
+
+    char get()
+    {
+        const char c = peek();
+        if (c) ++cur;
+        return c;
+    }
+
+    bool atEof() const { return peek() == '\0'; }
+
+    template<typename StopPredicate>
+    std::string_view readToken(const StopPredicate& isStop)
+    {
+        const char* tokenBegin = cur;
+        while (cur < end && *cur != '\0' && !isStop(*cur)) ++cur;
+        return std::string_view(tokenBegin, static_cast<size_t>(cur - tokenBegin));
+    }
+
+    template<typename StopPredicate>
+    void skipUntil(const StopPredicate& isStop)
+    {
+        while (cur < end && *cur != '\0' && !isStop(*cur)) ++cur;
+    }
 };
 
+INLINE static bool IsPgnWhitespace(const char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Characters terminating a move token
+INLINE static bool IsPgnMoveTokenEnd(const char c)
+{
+    return IsPgnWhitespace(c) || c == '{' || c == '(' || c == '$';
+}
+
 // Score parsing
 
 // Parse the first token of a PGN comment as a score in centipawns.
@@ -104,10 +189,12 @@ static bool ParseCommentScore(const char* token, size_t len, ScoreType& outScore
 }
 
 // Main parser implementation
+template<typename ReaderType>
 class PgnParserImpl
 {
 public:
-    explicit PgnParserImpl(std::istream& s) : reader(s) {}
+    template<typename... Args>
+    explicit PgnParserImpl(Args&&... args) : reader(std::forward<Args>(args)...) {}
 
     uint64_t readGames(const std::function<bool(Game&)>& cb)
     {
@@ -183,58 +270,70 @@ private:
         }
     }
 
+    enum class TagType
+    {
+        Other,
+        FEN,
+        Result,
+        Round,
+    };
+
     void parseOneTag()
     {
-        // Read tag name
-        tagKey.clear();
-        while (!reader.atEof())
-        {
-            const char c = reader.peek();
-            if (c == ' ' || c == '\t' || c == '"' || c == ']' || c == '\n') break;
-            tagKey += reader.get();
-        }
+        // Read tag name. Only a few tags are interesting, so classify it right away
+        // (the view may be invalidated by reading the value)
+        const std::string_view tagKey = reader.readToken([](char c) { return c == ' ' || c == '\t' || c == '"' || c == ']' || c == '\n'; });
+        TagType tagType = TagType::Other;
+        if (tagKey == "FEN")            tagType = TagType::FEN;
+        else if (tagKey == "Result")    tagType = TagType::Result;
+        else if (tagKey == "Round")     tagType = TagType::Round;
 
         // Skip whitespace before '"'
-        while (!reader.atEof() && (reader.peek() == ' ' || reader.peek() == '\t'))
-            reader.get();
+        reader.skipUntil([](char c) { return c != ' ' && c != '\t'; });
 
         // Read tag value between quotes
-        tagVal.clear();
+        std::string_view tagVal;
         if (reader.peek() == '"')
         {
             reader.get(); // consume '"'
-            bool esc = false;
-            while (!reader.atEof())
+            tagVal = reader.readToken([](char c) { return c == '"' || c == '\\' || c == '\n'; });
+
+            // Consume the terminator, '\n' means malformed tag
+            if (reader.get() == '\\')
             {
-                const char ch = reader.get();
-                if (ch == '\n') break; // malformed
-                if (esc) { tagVal += ch; esc = false; }
-                else if (ch == '\\') esc = true;
-                else if (ch == '"') break;
-                else tagVal += ch;
+                // Escaped characters inside - fall back to copying the value
+                tagValUnescaped.assign(tagVal);
+                bool esc = true;
+                while (!reader.atEof())
+                {
+                    const char ch = reader.get();
+                    if (ch == '\n') break; // malformed
+                    if (esc) { tagValUnescaped += ch; esc = false; }
+                    else if (ch == '\\') esc = true;
+                    else if (ch == '"') break;
+                    else tagValUnescaped += ch;
+                }
+                tagVal = tagValUnescaped;
             }
         }
 
         // Skip to end of line and consume the '\n' so processHeader() sees clean state
-        while (!reader.atEof())
-        {
-            const char ch = reader.get();
-            if (ch == '\n') break;
-        }
+        reader.skipUntil([](char c) { return c == '\n'; });
+        reader.get();
 
         // Store relevant tags
-        if (tagKey == "FEN")
+        if (tagType == TagType::FEN)
         {
             pendingFen = tagVal;
         }
-        else if (tagKey == "Result")
+        else if (tagType == TagType::Result)
         {
             if (tagVal == "1-0")        pendingResult = Game::Score::WhiteWins;
             else if (tagVal == "0-1")   pendingResult = Game::Score::BlackWins;
             else if (tagVal == "1/2-1/2") pendingResult = Game::Score::Draw;
             else                        pendingResult = Game::Score::Unknown;
         }
-        else if (tagKey == "Round")
+        else if (tagType == TagType::Round)
         {
             pendingRound = 0;
             for (const char ch : tagVal)
@@ -361,13 +460,7 @@ private:
                 if (after == '1') { reader.get(); onGameEnd(); return true; } // "0-1"
                 // "0-0" or "0-0-0": castling — assemble and apply as move
                 moveStr = "0-";
-                while (!reader.atEof())
-                {
-                    const char ch = reader.peek();
-                    if (ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r' || ch == '{' || ch == '(' || ch == '$')
-                        break;
-                    moveStr += reader.get();
-                }
+                moveStr += reader.readToken(IsPgnMoveTokenEnd);
                 parseMoveToBuffer();
                 return false;
             }
@@ -388,15 +481,8 @@ private:
     // Read one SAN move token. Returns true if game ended.
     bool readMoveToken()
     {
-        moveStr.clear();
-
-        while (!reader.atEof())
-        {
-            const char c = reader.peek();
-            if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '{' || c == '(' || c == '$')
-                break;
-            moveStr += reader.get();
-        }
+        // short enough to fit in the small string buffer, so this does not allocate
+        moveStr.assign(reader.readToken(IsPgnMoveTokenEnd));
 
         if (moveStr.empty()) return false;
 
@@ -459,30 +545,17 @@ private:
     bool readCommentAndExtractScore(ScoreType& outScore)
     {
         // Skip leading whitespace inside comment
-        while (!reader.atEof() && reader.peek() != '}')
-        {
-            const char c = reader.peek();
-            if (c != ' ' && c != '\t' && c != '\n' && c != '\r') break;
-            reader.get();
-        }
+        reader.skipUntil([](char c) { return !IsPgnWhitespace(c); });
 
         // Read first token (until whitespace, '/', or '}')
-        char tokenBuf[64];
-        size_t tokenLen = 0;
-
-        while (!reader.atEof() && tokenLen < sizeof(tokenBuf) - 1)
-        {
-            const char c = reader.peek();
-            if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '/' || c == '}')
-                break;
-            tokenBuf[tokenLen++] = reader.get();
-        }
-        tokenBuf[tokenLen] = '\0';
+        const std::string_view token = reader.readToken([](char c) { return IsPgnWhitespace(c) || c == '/' || c == '}'; });
+        const bool hasScore = ParseCommentScore(token.data(), token.size(), outScore);
 
         // Consume rest of comment until '}'
-        while (!reader.atEof() && reader.get() != '}') {}
+        reader.skipUntil([](char c) { return c == '}'; });
+        reader.get();
 
-        return ParseCommentScore(tokenBuf, tokenLen, outScore);
+        return hasScore;
     }
 
     // Skip variation: ( ... ) with nesting
@@ -555,7 +628,7 @@ private:
         pendingRound = 1;
     }
 
-    PgnReader reader;
+    ReaderType reader;
     const std::function<bool(Game&)>* callback = nullptr;
     uint64_t numParsed = 0;
 
@@ -585,8 +658,7 @@ private:
     ScoreType pendingScore = kNoScore;
 
     // Reused buffers
-    std::string tagKey;
-    std::string tagVal;
+    std::string tagValUnescaped;
     std::string moveStr;
 };
 
@@ -594,7 +666,7 @@ private:
 
 uint64_t ParsePgn(std::istream& stream, const std::function<bool(Game&)>& callback)
 {
-    PgnParserImpl parser(stream);
+    PgnParserImpl<PgnReader> parser(stream);
     return parser.readGames(callback);
 }
 
@@ -604,3 +676,213 @@ uint64_t ParsePgn(const std::string& path, const std::function<bool(Game&)>& cal
     if (!file.is_open()) return 0;
     return ParsePgn(file, callback);
 }
+
+// ---------------------------------------------------------------------------
+
+struct PgnChunk
+{
+    const char* begin;
+    const char* end;
+};
+
+// Find start of a game at or after 'from': a '[' at the beginning of a line preceded by a blank line
+static const char* FindPgnGameBoundary(const char* from, const char* begin, const char* end)
+{
+    const std::string_view text(begin, static_cast<size_t>(end - begin));
+
+    for (size_t pos = text.find("\n[", static_cast<size_t>(from - begin)); pos != std::string_view::npos; pos = text.find("\n[", pos + 1))
+    {
+        // check if the previous line is blank
+        size_t i = pos;
+        while (i > 0 && (text[i - 1] == '\r' || text[i - 1] == ' ' || text[i - 1] == '\t')) --i;
+        if (i > 0 && text[i - 1] == '\n')
+        {
+            return begin + pos + 1;
+        }
+    }
+
+    return end;
+}
+
+static void SplitPgnIntoChunks(const MappedFile& file, std::vector<PgnChunk>& outChunks)
+{
+    const char* begin = file.GetData();
+    const char* end = begin + file.GetSize();
+
+    for (const char* chunkBegin = begin; chunkBegin < end; )
+    {
+        const char* chunkEnd = end;
+        if (static_cast<size_t>(end - chunkBegin) > kPgnChunkSize)
+        {
+            chunkEnd = FindPgnGameBoundary(chunkBegin + kPgnChunkSize, begin, end);
+        }
+
+        outChunks.push_back({ chunkBegin, chunkEnd });
+        chunkBegin = chunkEnd;
+    }
+}
+
+// Parsed game waiting for in-order delivery. Game objects carry position history, which is too heavy
+// to keep for thousands of games, so only moves are stored and the game is replayed on delivery.
+struct ParsedPgnGame
+{
+    Position initPosition;
+    GameMetadata metadata;
+    std::vector<Move> moves;
+    std::vector<ScoreType> moveScores;
+    Game::Score forcedScore;
+
+    explicit ParsedPgnGame(const Game& game)
+        : initPosition(game.GetInitialPosition())
+        , metadata(game.GetMetadata())
+        , moves(game.GetMoves())
+        , moveScores(game.GetMoveScores())
+        , forcedScore(game.GetForcedScore())
+    {}
+
+    void Replay(Game& outGame) const
+    {
+        outGame.Reset(initPosition);
+        outGame.SetMetadata(metadata);
+
+        // scores are appended independently of moves, so this reproduces the parsed game exactly
+        for (size_t i = 0; i < moves.size(); ++i)
+        {
+            if (i < moveScores.size())
+                VERIFY(outGame.DoMove(moves[i], moveScores[i]));
+            else
+                VERIFY(outGame.DoMove(moves[i]));
+        }
+
+        if (forcedScore != Game::Score::Unknown)
+            outGame.SetScore(forcedScore);
+    }
+};
+
+static uint64_t ParsePgnChunk(const PgnChunk& chunk, const std::function<bool(Game&)>& callback)
+{
+    PgnParserImpl<PgnMemoryReader> parser(chunk.begin, chunk.end);
+    return parser.readGames(callback);
+}
+
+uint64_t ParsePgnFiles(const std::vector<std::string>& paths, const std::function<bool(Game&)>& callback, bool ordered)
+{
+    std::vector<std::unique_ptr<MappedFile>> files;
+    std::vector<PgnChunk> chunks;
+
+    for (const std::string& path : paths)
+    {
+        files.push_back(std::make_unique<MappedFile>(path.c_str()));
+        if (!files.back()->IsOpen())
+        {
+            std::cout << "ERROR: Failed to open PGN file: " << path << std::endl;
+            continue;
+        }
+        SplitPgnIntoChunks(*files.back(), chunks);
+    }
+
+    const uint32_t numChunks = static_cast<uint32_t>(chunks.size());
+    std::atomic<uint64_t> numGames = 0;
+    std::atomic<bool> stop = false;
+
+    if (!ordered)
+    {
+        // callback is invoked directly on the worker threads
+        const std::function<bool(Game&)> chunkCallback = [&](Game& game)
+        {
+            if (stop) return false;
+            numGames++;
+            if (!callback(game))
+            {
+                stop = true;
+                return false;
+            }
+            return true;
+        };
+
+        Waitable waitable;
+        {
+            TaskBuilder taskBuilder(waitable);
+            taskBuilder.ParallelFor("ParsePgn", numChunks, [&](const TaskContext&, uint32_t chunkIndex)
+            {
+                if (!stop)
+                {
+                    ParsePgnChunk(chunks[chunkIndex], chunkCallback);
+                }
+            });
+        }
+        waitable.Wait();
+
+        return numGames;
+    }
+
+    // Ordered: chunks are parsed in batches on the worker threads into game lists,
+    // the next batch is parsed while the current one is handed to the callback on the calling thread.
+    const uint32_t batchSize = std::max(1u, ThreadPool::GetInstance().GetNumThreads());
+
+    std::vector<std::vector<ParsedPgnGame>> currentBatch;
+    std::vector<std::vector<ParsedPgnGame>> nextBatch;
+
+    const auto parseBatch = [&](std::vector<std::vector<ParsedPgnGame>>& batch, uint32_t firstChunk, TaskBuilder& taskBuilder)
+    {
+        const uint32_t numBatchChunks = std::min(batchSize, numChunks - firstChunk);
+        batch.clear();
+        batch.resize(numBatchChunks);
+
+        taskBuilder.ParallelFor("ParsePgn", numBatchChunks, [&batch, &chunks, &stop, firstChunk](const TaskContext&, uint32_t i)
+        {
+            if (stop) return;
+            std::vector<ParsedPgnGame>& games = batch[i];
+            ParsePgnChunk(chunks[firstChunk + i], [&games](Game& game)
+            {
+                games.emplace_back(game);
+                return true;
+            });
+        });
+    };
+
+    if (numChunks > 0)
+    {
+        Waitable waitable;
+        {
+            TaskBuilder taskBuilder(waitable);
+            parseBatch(nextBatch, 0, taskBuilder);
+        }
+        waitable.Wait();
+    }
+
+    for (uint32_t firstChunk = 0; firstChunk < numChunks && !stop; firstChunk += batchSize)
+    {
+        std::swap(currentBatch, nextBatch);
+
+        Waitable waitable;
+        {
+            TaskBuilder taskBuilder(waitable);
+            if (firstChunk + batchSize < numChunks)
+            {
+                parseBatch(nextBatch, firstChunk + batchSize, taskBuilder);
+            }
+        }
+
+        Game game;
+        for (const std::vector<ParsedPgnGame>& games : currentBatch)
+        {
+            for (const ParsedPgnGame& parsedGame : games)
+            {
+                if (stop) break;
+                parsedGame.Replay(game);
+                numGames++;
+                if (!callback(game)) stop = true;
+            }
+        }
+
+        waitable.Wait();
+    }
+
+    return numGames;
+}
+
+uint64_t ParsePgnFiles(const std::string& path, const std::function<bool(Game&)>& callback, bool ordered)
+{
+    return ParsePgnFiles(std::vector<std::string>{ path }, callback, ordered);
+}
@@ -5,9 +5,19 @@
 #include <functional>
 #include <istream>
 #include <string>
+#include <vector>
 
 // Parse PGN from stream. Callback is invoked for each successfully parsed game.
 // Return false from callback to stop parsing early.
 // Returns number of games successfully parsed.
 uint64_t ParsePgn(std::istream& stream, const std::function<bool(Game&)>& callback);
 uint64_t ParsePgn(const std::string& path, const std::function<bool(Game&)>& callback);
+
+// Parse PGN files using the thread pool. Files are memory mapped and split into chunks at game boundaries,
+// chunks are parsed in parallel.
+// If 'ordered' is true, games are passed to the callback in file order, on the calling thread.
+// Otherwise the callback is invoked concurrently from the worker threads, so it must be thread safe.
+// Must be called from the main thread.
+// Returns number of games passed to the callback.
+uint64_t ParsePgnFiles(const std::vector<std::string>& paths, const std::function<bool(Game&)>& callback, bool ordered = true);
+uint64_t ParsePgnFiles(const std::string& path, const std::function<bool(Game&)>& callback, bool ordered = true);
@@ -7,6 +7,8 @@
 #include <fstream>
 #include <sstream>
 #include <vector>
+#include <filesystem>
+#include <atomic>
 
 #define TEST_EXPECT(x) \
     if (!(x)) { std::cout << "Test failed: " << #x << " at " << __FILE__ << ":" << __LINE__ << std::endl; DEBUG_BREAK(); }
@@ -234,6 +236,81 @@ static void TestRoundTrip()
         TEST_EXPECT_EQ(origScores[i], parsedScores[i]);
 }
 
+static void TestParallelParser()
+{
+    // Big enough to be split into a few chunks, games are tagged with increasing round numbers
+    const uint32_t numGames = 40000;
+
+    std::string pgn;
+    for (uint32_t i = 0; i < numGames; ++i)
+    {
+        pgn += "[Event \"?\"]\n[Round \"" + std::to_string(i + 1) + "\"]\n[Result \"1-0\"]\n\n";
+        if (i % 3 == 0)
+            pgn += "1. e4 {+0.25/0} e5 {-0.30/0} 2. Qh5 {+0.10/0} Nc6 3. Bc4 Nf6 4. Qxf7# 1-0\n\n";
+        else if (i % 3 == 1)
+            pgn += "1. d4 d5 2. c4 e6 3. Nc3 Nf6 4. Bg5 Be7 5. e3 O-O 6. Nf3 h6 7. Bh4 b6 { comment } 1-0\n\n";
+        else
+            pgn += "1. f3 e5 2. g4 (2. Kf2 Qh4+) 2... Qh4# 0-1\r\n\r\n";
+    }
+
+    const std::string path = (std::filesystem::temp_directory_path() / "caissa_pgn_parser_test.pgn").string();
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << pgn;
+    }
+
+    std::istringstream ss(pgn);
+    std::vector<Game> expected;
+    ParsePgn(ss, [&](Game& g) { expected.push_back(g); return true; });
+    TEST_EXPECT_EQ(expected.size(), numGames);
+
+    // ordered
+    {
+        size_t index = 0;
+        bool matches = true;
+        const uint64_t n = ParsePgnFiles(path, [&](Game& g)
+        {
+            if (index >= expected.size() ||
+                g.GetMetadata().roundNumber != expected[index].GetMetadata().roundNumber ||
+                g.GetMoves() != expected[index].GetMoves() ||
+                g.GetMoveScores() != expected[index].GetMoveScores() ||
+                g.GetScore() != expected[index].GetScore())
+            {
+                matches = false;
+            }
+            ++index;
+            return true;
+        });
+        TEST_EXPECT_EQ(n, numGames);
+        TEST_EXPECT(matches);
+    }
+
+    // unordered
+    {
+        std::atomic<uint64_t> roundSum = 0;
+        const uint64_t n = ParsePgnFiles(path, [&](Game& g)
+        {
+            roundSum += g.GetMetadata().roundNumber;
+            return true;
+        }, false);
+        TEST_EXPECT_EQ(n, numGames);
+        TEST_EXPECT_EQ(roundSum.load(), uint64_t(numGames) * (numGames + 1) / 2);
+    }
+
+    // early stop
+    {
+        uint32_t expectedRound = 1;
+        const uint64_t n = ParsePgnFiles(path, [&](Game& g)
+        {
+            TEST_EXPECT_EQ(g.GetMetadata().roundNumber, expectedRound);
+            return expectedRound++ < 100;
+        });
+        TEST_EXPECT_EQ(n, 100u);
+    }
+
+    std::filesystem::remove(path);
+}
+
 void RunPgnParserTests()
 {
     std::cout << "Running PGN parser tests..." << std::endl;
@@ -249,6 +326,7 @@ void RunPgnParserTests()
     TestCastling();
     TestEarlyStop();
     TestRoundTrip();
+    TestParallelParser();
 
     std::cout << "PGN parser tests done." << std::endl;
 }
@@ -1,5 +1,4 @@
 #include "Common.hpp"
-#include "ThreadPool.hpp"
 #include "TrainerCommon.hpp"
 #include "PgnParser.hpp"
 
@@ -7,7 +6,7 @@
 #include "../backend/Evaluate.hpp"
 #include "../backend/Endgame.hpp"
 #include "../backend/Tablebase.hpp"
-#include "../backend/Waitable.hpp"
+#include "../backend/Time.hpp"
 
 #include <filesystem>
 #include <fstream>
@@ -15,8 +14,6 @@
 #include <atomic>
 #include <mutex>
 
-using namespace threadpool;
-
 struct SharedState
 {
     std::mutex mutex;
@@ -24,110 +21,72 @@ struct SharedState
 
     std::atomic<uint64_t> totalGames{ 0 };
     std::atomic<uint64_t> totalPositions{ 0 };
-    std::atomic<uint64_t> totalFiles{ 0 };
 };
 
-static void ProcessPgnFile(const std::string& path, SharedState& shared)
+// extract scored quiet positions from a game
+static void ExtractGamePositions(const Game& game, std::vector<PositionEntry>& outEntries)
 {
-    std::ifstream file(path, std::ios::binary);
-    if (!file.is_open())
-    {
-        std::lock_guard<std::mutex> lock(shared.mutex);
-        std::cerr << "ERROR: Cannot open " << path << std::endl;
+    const Game::Score gameScore = game.GetScore();
+
+    // skip games without a known result
+    if (gameScore == Game::Score::Unknown)
         return;
-    }
 
-    std::vector<PositionEntry> localEntries;
-    uint64_t numGames = 0;
+    const auto& moves     = game.GetMoves();
+    const auto& scores    = game.GetMoveScores();
+    const bool hasScores  = !scores.empty();
+
+    Position pos = game.GetInitialPosition();
 
-    ParsePgn(file, [&](Game& game) -> bool
+    for (size_t i = 0; i < moves.size(); ++i)
     {
-        ++numGames;
+        const Move move = moves[i];
 
-        const Game::Score gameScore = game.GetScore();
+        // Skip if the move has no score annotation
+        const bool hasScore = hasScores && (i < scores.size());
 
-        // skip games without a known result
-        if (gameScore == Game::Score::Unknown)
-            return true;
+        if (hasScore &&
+            move.IsQuiet() &&
+            pos.GetNumPieces() >= 4 &&
+            !pos.IsInCheck())
+        {
+            // print position and score for debugging
+            //std::cout << "FEN: " << pos.ToFEN() << " score=" << scores[i] << " result=" << static_cast<int>(gameScore) << std::endl;
 
-        const auto& moves     = game.GetMoves();
-        const auto& scores    = game.GetMoveScores();
-        const bool hasScores  = !scores.empty();
+            const ScoreType moveScore = scores[i]; // White's perspective
 
-        Position pos = game.GetInitialPosition();
+            PositionEntry entry{};
+            entry.wdlScore = static_cast<uint8_t>(gameScore);
+            entry.tbScore  = static_cast<uint8_t>(Game::Score::Unknown);
+            entry.score    = moveScore;
 
-        for (size_t i = 0; i < moves.size(); ++i)
-        {
-            const Move move = moves[i];
-
-            // Skip if the move has no score annotation
-            const bool hasScore = hasScores && (i < scores.size());
+            Position normalizedPos = pos;
+            if (pos.GetSideToMove() == Black)
+            {
+                normalizedPos = normalizedPos.SwappedColors();
+                entry.score   = -entry.score;
+                if (gameScore == Game::Score::WhiteWins)
+                    entry.wdlScore = static_cast<uint8_t>(Game::Score::BlackWins);
+                else if (gameScore == Game::Score::BlackWins)
+                    entry.wdlScore = static_cast<uint8_t>(Game::Score::WhiteWins);
+            }
 
-            if (hasScore &&
-                move.IsQuiet() &&
-                pos.GetNumPieces() >= 4 &&
-                !pos.IsInCheck())
+            // Enrich with Syzygy tablebase score when available
+            int32_t wdl = 0;
+            if (pos.GetNumPieces() <= 7 && ProbeSyzygy_WDL(pos, &wdl))
             {
-                // print position and score for debugging
-                //std::cout << "FEN: " << pos.ToFEN() << " score=" << scores[i] << " result=" << static_cast<int>(gameScore) << std::endl;
-
-                const ScoreType moveScore = scores[i]; // White's perspective
-
-                PositionEntry entry{};
-                entry.wdlScore = static_cast<uint8_t>(gameScore);
-                entry.tbScore  = static_cast<uint8_t>(Game::Score::Unknown);
-                entry.score    = moveScore;
-
-                Position normalizedPos = pos;
-                if (pos.GetSideToMove() == Black)
-                {
-                    normalizedPos = normalizedPos.SwappedColors();
-                    entry.score   = -entry.score;
-                    if (gameScore == Game::Score::WhiteWins)
-                        entry.wdlScore = static_cast<uint8_t>(Game::Score::BlackWins);
-                    else if (gameScore == Game::Score::BlackWins)
-                        entry.wdlScore = static_cast<uint8_t>(Game::Score::WhiteWins);
-                }
-
-                // Enrich with Syzygy tablebase score when available
-                int32_t wdl = 0;
-                if (pos.GetNumPieces() <= 7 && ProbeSyzygy_WDL(pos, &wdl))
-                {
-                    if (wdl > 0)      entry.tbScore = static_cast<uint8_t>(Game::Score::WhiteWins);
-                    else if (wdl < 0) entry.tbScore = static_cast<uint8_t>(Game::Score::BlackWins);
-                    else              entry.tbScore = static_cast<uint8_t>(Game::Score::Draw);
-                }
-
-                ASSERT(normalizedPos.IsValid());
-                VERIFY(PackPosition(normalizedPos, entry.pos));
-                localEntries.push_back(entry);
+                if (wdl > 0)      entry.tbScore = static_cast<uint8_t>(Game::Score::WhiteWins);
+                else if (wdl < 0) entry.tbScore = static_cast<uint8_t>(Game::Score::BlackWins);
+                else              entry.tbScore = static_cast<uint8_t>(Game::Score::Draw);
             }
 
-            if (!pos.DoMove(move))
-                break;
+            ASSERT(normalizedPos.IsValid());
+            VERIFY(PackPosition(normalizedPos, entry.pos));
+            outEntries.push_back(entry);
         }
 
-        // Game object is released here; only localEntries keep the extracted data.
-        return true;
-    });
-
-    const uint64_t numPositions = localEntries.size();
-
-    {
-        std::lock_guard<std::mutex> lock(shared.mutex);
-        shared.totalGames     += numGames;
-        shared.totalPositions += numPositions;
-        ++shared.totalFiles;
-
-        std::cout << "[" << shared.totalFiles.load() << "] "
-                  << path << ": "
-                  << numGames << " games, "
-                  << numPositions << " positions" << std::endl;
-
-        // Move local batch into the shared vector
-        shared.entries.insert(shared.entries.end(),
-            std::make_move_iterator(localEntries.begin()),
-            std::make_move_iterator(localEntries.end()));
+        if (!pos.DoMove(move))
+            break;
     }
 }
 
@@ -187,25 +146,37 @@ void PgnToTrainingData(const std::vector<std::string>& args)
 
     SharedState shared;
 
-    // Process files in parallel using the thread pool
+    uint64_t totalBytes = 0;
+    for (const std::string& path : inputPaths)
     {
-        Waitable waitable;
-        {
-            TaskBuilder taskBuilder(waitable);
-
-            for (const std::string& path : inputPaths)
-            {
-                taskBuilder.Task("PgnToTrainingData", [path, &shared](const TaskContext&)
-                {
-                    ProcessPgnFile(path, shared);
-                });
-            }
-        }
-        waitable.Wait();
+        std::error_code ec;
+        const uint64_t fileSize = std::filesystem::file_size(path, ec);
+        if (!ec) totalBytes += fileSize;
     }
 
+    // Parse all files in parallel, games are processed on the worker threads as they are parsed
+    const TimePoint startTime = TimePoint::GetCurrent();
+
+    ParsePgnFiles(inputPaths, [&shared](Game& game) -> bool
+    {
+        std::vector<PositionEntry> gameEntries;
+        ExtractGamePositions(game, gameEntries);
+
+        shared.totalGames++;
+        shared.totalPositions += gameEntries.size();
+
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        shared.entries.insert(shared.entries.end(), gameEntries.begin(), gameEntries.end());
+        return true;
+    }, /* ordered */ false);
+
+    const float parsingTime = (TimePoint::GetCurrent() - startTime).ToSeconds();
+
+    std::cout << "Parsed " << (totalBytes / (1024 * 1024)) << " MB in " << parsingTime << " s ("
+        << (totalBytes / (1024.0 * 1024.0) / std::max(1.0e-6f, parsingTime)) << " MB/s)" << std::endl;
+
     std::cout << "Totals: "
-        << shared.totalFiles.load() << " files, "
+        << inputPaths.size() << " files, "
         << shared.totalGames.load() << " games, "
         << shared.totalPositions.load() << " positions" << std::endl;
 
@@ -12,6 +12,8 @@
 
 #include <filesystem>
 #include <fstream>
+#include <memory>
+#include <atomic>
 
 using namespace threadpool;
 
@@ -34,56 +36,46 @@ static bool IsPositionImbalanced(const Position& pos, ScoreType moveScore)
         (moveScore < -c_ScoreTreshold && Evaluate(pos) < -c_EvalTreshold);
 }
 
-static bool ConvertGamesToTrainingData(const std::string& inputPath, const std::string& outputPath)
-{
-    std::vector<PositionEntry> entries;
-    std::vector<Move> moves;
-
-    if (std::filesystem::exists(outputPath))
-    {
-        return true;
-    }
+// games collections bigger than this are split into ranges converted in parallel
+static constexpr uint64_t c_MinGamesRangeSize = 16ull * 1024ull * 1024ull;
 
+static bool ExtractPositions(const std::string& inputPath, const GameCollection::Index::Range& range,
+                             std::vector<PositionEntry>& entries, uint32_t& numGames)
+{
     FileInputStream gamesFile(inputPath.c_str());
-    if (!gamesFile.IsOpen())
+    if (!gamesFile.IsOpen() || !gamesFile.SetPosition(range.beginOffset))
     {
         std::unique_lock<std::mutex> lock(g_mutex);
         std::cout << "ERROR: Failed to load selfplay data file: " << inputPath << std::endl;
         return false;
     }
 
-#ifndef OUTPUT_TEXT_FILE
-    FileOutputStream trainingDataFile(outputPath.c_str());
-    if (!trainingDataFile.IsOpen())
-    {
-        std::unique_lock<std::mutex> lock(g_mutex);
-        std::cout << "ERROR: Failed to load output training data file: " << outputPath << std::endl;
-        return false;
-    }
-#endif // OUTPUT_TEXT_FILE
+    GameCollection::GameReplayCursor cursor(gamesFile);
 
-    uint32_t numGames = 0;
-    uint32_t numPositions = 0;
-
-    Game game;
-    while (GameCollection::ReadGame(gamesFile, game, moves))
+    for (size_t gameIndex = 0; gameIndex < range.numGames; ++gameIndex)
     {
-        Game::Score gameScore = game.GetScore();
+        if (!cursor.NextGame())
+        {
+            break;
+        }
+
+        const Game::Score gameScore = cursor.ResolveGameScore();
 
-        ASSERT(game.GetMoves().size() == game.GetMoveScores().size());
+        ASSERT(cursor.HasMoveScores());
 
-        if (game.GetScore() == Game::Score::Unknown)
+        if (gameScore == Game::Score::Unknown)
         {
             continue;
         }
 
-        Position pos = game.GetInitialPosition();
+        const size_t firstGameEntry = entries.size();
 
         // replay the game
-        for (size_t i = 0; i < game.GetMoves().size(); ++i)
+        while (cursor.NextMove())
         {
-            const Move move = moves[i];
-            const ScoreType moveScore = game.GetMoveScores()[i];
+            const Position& pos = cursor.GetPosition();
+            const Move move = cursor.GetMove();
+            const ScoreType moveScore = cursor.GetMoveScore();
 
             if (move.IsQuiet() &&                                               // best move must be quiet
                 pos.GetNumPieces() >= 4 &&                                      // skip known endgames
@@ -120,21 +112,45 @@ static bool ConvertGamesToTrainingData(const std::string& inputPath, const std::
                 ASSERT(normalizedPos.IsValid());
                 VERIFY(PackPosition(normalizedPos, entry.pos));
                 entries.push_back(entry);
-                numPositions++;
             }
+        }
 
-            if (!pos.DoMove(move))
-            {
-                break;
-            }
+        // drop positions of a corrupted game
+        if (!cursor.IsValid())
+        {
+            entries.resize(firstGameEntry);
+            break;
         }
 
         numGames++;
     }
 
+    return true;
+}
+
+static bool WriteTrainingData(const std::string& outputPath, std::vector<PositionEntry>& entries, bool compressed)
+{
+    // compressed files keep games order (consecutive positions compress well), the training data loader shuffles them
+    if (compressed)
     {
-        std::unique_lock<std::mutex> lock(g_mutex);
-        std::cout << "Parsed " << numGames << " games from " << inputPath << ", extracted " << numPositions << " positions" << std::endl;
+        FileOutputStream trainingDataFile(outputPath.c_str());
+        if (!trainingDataFile.IsOpen())
+        {
+            std::unique_lock<std::mutex> lock(g_mutex);
+            std::cout << "ERROR: Failed to load output training data file: " << outputPath << std::endl;
+            return false;
+        }
+
+        TrainingDataFile::Writer writer(trainingDataFile);
+        for (const PositionEntry& entry : entries)
+        {
+            if (!writer.Write(entry))
+            {
+                return false;
+            }
+        }
+
+        return writer.Finish();
     }
 
     // shuffle the training data
@@ -165,6 +181,14 @@ static bool ConvertGamesToTrainingData(const std::string& inputPath, const std::
     }
 #else // !OUTPUT_TEXT_FILE
 
+    FileOutputStream trainingDataFile(outputPath.c_str());
+    if (!trainingDataFile.IsOpen())
+    {
+        std::unique_lock<std::mutex> lock(g_mutex);
+        std::cout << "ERROR: Failed to load output training data file: " << outputPath << std::endl;
+        return false;
+    }
+
     if (!trainingDataFile.Write(entries.data(), entries.size() * sizeof(PositionEntry)))
     {
         std::unique_lock<std::mutex> lock(g_mutex);
@@ -177,28 +201,101 @@ static bool ConvertGamesToTrainingData(const std::string& inputPath, const std::
     return true;
 }
 
+// conversion of a single games collection, split into ranges
+struct ConversionJob
+{
+    std::string inputPath;
+    std::string outputPath;
+    std::vector<GameCollection::Index::Range> ranges;
+    std::vector<std::vector<PositionEntry>> rangeEntries;
+    std::atomic<uint32_t> numGames = 0;
+    std::atomic<uint32_t> numRangesLeft = 0;
+    bool compressed = false;
+};
+
+static void ConvertGamesRange(ConversionJob& job, uint32_t rangeIndex)
+{
+    uint32_t numGames = 0;
+    ExtractPositions(job.inputPath, job.ranges[rangeIndex], job.rangeEntries[rangeIndex], numGames);
+    job.numGames += numGames;
+
+    // last finished range writes the output file
+    if (job.numRangesLeft.fetch_sub(1) == 1)
+    {
+        std::vector<PositionEntry> entries = std::move(job.rangeEntries.front());
+        for (size_t i = 1; i < job.rangeEntries.size(); ++i)
+        {
+            entries.insert(entries.end(), job.rangeEntries[i].begin(), job.rangeEntries[i].end());
+            job.rangeEntries[i] = {};
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(g_mutex);
+            std::cout << "Parsed " << job.numGames << " games from " << job.inputPath << " (" << job.ranges.size() << " ranges), extracted " << entries.size() << " positions" << std::endl;
+        }
+
+        WriteTrainingData(job.outputPath, entries, job.compressed);
+    }
+}
+
 void PrepareTrainingData(const std::vector<std::string>& args)
 {
-    (void)args;
+    // write compressed chunked files (see TrainingDataFile) instead of raw PositionEntry arrays
+    const bool compressed = std::find(args.begin(), args.end(), "compressed") != args.end();
 
     const std::string gamesPath = DATA_PATH "selfplayGames/";
     const std::string trainingDataPath = DATA_PATH "trainingData/";
 
+    const uint32_t numThreads = ThreadPool::GetInstance().GetNumThreads();
+
+    std::vector<std::shared_ptr<ConversionJob>> jobs;
+
+    for (const auto& path : std::filesystem::directory_iterator(gamesPath))
+    {
+        if (!GameCollection::IsGameCollectionPath(path.path().string()))
+        {
+            continue;
+        }
+
+        const std::string outputPath = trainingDataPath + path.path().stem().string() + ".dat";
+        if (std::filesystem::exists(outputPath))
+        {
+            continue;
+        }
+
+        std::cout << "Loading " << path.path().string() << "..." << std::endl;
+
+        std::vector<GameCollection::Index::Range> ranges;
+        if (!GameCollection::SplitCollection(path.path().string(), c_MinGamesRangeSize, numThreads, ranges))
+        {
+            std::cout << "ERROR: Failed to index selfplay data file: " << path.path().string() << std::endl;
+            continue;
+        }
+
+        if (ranges.empty())
+        {
+            continue;
+        }
+
+        auto job = std::make_shared<ConversionJob>();
+        job->inputPath = path.path().string();
+        job->outputPath = outputPath;
+        job->ranges = std::move(ranges);
+        job->rangeEntries.resize(job->ranges.size());
+        job->numRangesLeft = static_cast<uint32_t>(job->ranges.size());
+        job->compressed = compressed;
+        jobs.push_back(std::move(job));
+    }
+
     Waitable waitable;
     {
         TaskBuilder taskBuilder(waitable);
 
-        for (const auto& path : std::filesystem::directory_iterator(gamesPath))
+        for (const std::shared_ptr<ConversionJob>& job : jobs)
         {
+            taskBuilder.ParallelFor("LoadPositions", static_cast<uint32_t>(job->ranges.size()), [job](const TaskContext&, uint32_t rangeIndex)
             {
-                std::unique_lock<std::mutex> lock(g_mutex);
-                std::cout << "Loading " << path.path().string() << "..." << std::endl;
-            }
-
-            taskBuilder.Task("LoadPositions", [path, &trainingDataPath](const TaskContext&)
-            {
-                const std::string outputPath = trainingDataPath + path.path().stem().string() + ".dat";
-                ConvertGamesToTrainingData(path.path().string().c_str(), outputPath);
+                ConvertGamesRange(*job, rangeIndex);
             });
         }
     }
@@ -0,0 +1,466 @@
+#include "Common.hpp"
+#include "TrainerCommon.hpp"
+
+#include "../backend/Position.hpp"
+#include "../backend/PositionUtils.hpp"
+#include "../backend/Game.hpp"
+#include "../backend/Search.hpp"
+#include "../backend/TranspositionTable.hpp"
+#include "../backend/Evaluate.hpp"
+#include "../backend/NeuralNetworkEvaluator.hpp"
+#include "../backend/Tablebase.hpp"
+#include "../backend/Numa.hpp"
+#include "../backend/Time.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+
+// Relabels training data (raw PositionEntry files) with a fresh static eval or a short fixed-node/fixed-depth search.
+// Positions are processed in blocks, every block starts with cleared search state, so results don't depend on the number of threads.
+// Progress is stored in a checkpoint file next to the output, so an interrupted run can be continued with 'resume'.
+
+// number of positions rescored by a worker at once
+static constexpr uint32_t c_RescoreBlockSize = 1024;
+
+// how often progress is reported and the checkpoint is updated
+static constexpr float c_RescoreCheckpointInterval = 10.0f;
+
+struct RescoreConfig
+{
+    std::string inputPath;
+    std::string outputPath; // same as input for in-place rescoring
+    uint64_t maxNodes = UINT64_MAX;
+    uint32_t maxDepth = UINT8_MAX;
+    uint32_t numThreads = 0;
+    uint32_t hashSizeInMB = 16; // per worker
+    bool staticEval = false;
+    bool resume = false;
+
+    // description of the labeling method, stored in the checkpoint so it's not resumed with different settings
+    std::string GetMethodString() const
+    {
+        std::stringstream ss;
+        if (staticEval)
+            ss << "eval";
+        else
+            ss << "search nodes=" << maxNodes << " depth=" << maxDepth;
+        return ss.str();
+    }
+};
+
+struct RescoreCheckpoint
+{
+    std::string inputPath;
+    std::string method;
+    uint64_t numEntries = 0;
+    uint64_t numEntriesDone = 0;
+
+    static std::string GetPath(const std::string& outputPath)
+    {
+        return outputPath + ".rescore";
+    }
+
+    bool Load(const std::string& path)
+    {
+        std::ifstream file(path);
+        if (!file.good())
+        {
+            return false;
+        }
+
+        std::string line;
+        while (std::getline(file, line))
+        {
+            const size_t separator = line.find('=');
+            if (separator == std::string::npos) continue;
+
+            const std::string key = line.substr(0, separator);
+            const std::string value = line.substr(separator + 1);
+
+            if (key == "input")         inputPath = value;
+            else if (key == "method")   method = value;
+            else if (key == "entries")  numEntries = std::stoull(value);
+            else if (key == "done")     numEntriesDone = std::stoull(value);
+        }
+
+        return true;
+    }
+
+    // written to a temporary file first, so the checkpoint is never left truncated
+    bool Save(const std::string& path) const
+    {
+        const std::string tempPath = path + ".tmp";
+        {
+            std::ofstream file(tempPath);
+            if (!file.good())
+            {
+                return false;
+            }
+
+            file << "input=" << inputPath << "\n";
+            file << "method=" << method << "\n";
+            file << "entries=" << numEntries << "\n";
+            file << "done=" << numEntriesDone << "\n";
+
+            if (!file.good())
+            {
+                return false;
+            }
+        }
+
+        std::error_code ec;
+        std::filesystem::rename(tempPath, path, ec);
+        return !ec;
+    }
+};
+
+// per-thread rescoring state, the neural network is shared
+class PositionRescorer
+{
+public:
+    PositionRescorer(const RescoreConfig& config)
+        : mConfig(config)
+        , mTranspositionTable(1024ull * 1024ull * config.hashSizeInMB)
+    {
+        if (g_mainNeuralNetwork)
+        {
+            mAccumulatorCache.Init(g_mainNeuralNetwork);
+        }
+    }
+
+    // reset search state, so the block result does not depend on previously processed positions
+    void BeginBlock()
+    {
+        if (!mConfig.staticEval)
+        {
+            mSearch.Clear();
+            mTranspositionTable.Clear();
+        }
+    }
+
+    // returns false if the position can't be scored (e.g. it's invalid or there are no legal moves)
+    bool Rescore(PositionEntry& entry)
+    {
+        Position pos;
+        if (!UnpackPosition(entry.pos, pos) || !pos.IsValid())
+        {
+            return false;
+        }
+
+        ScoreType score = InvalidValue;
+
+        if (mConfig.staticEval)
+        {
+            NodeInfo node = { pos };
+            score = Evaluate(node, mAccumulatorCache);
+        }
+        else
+        {
+            mGame.Reset(pos);
+            mTranspositionTable.NextGeneration();
+
+            SearchParam searchParam{ mTranspositionTable };
+            searchParam.debugLog = false;
+            searchParam.useRootTablebase = false;
+            searchParam.limits.maxNodes = mConfig.maxNodes;
+            searchParam.limits.maxDepth = static_cast<uint16_t>(mConfig.maxDepth);
+
+            SearchStats stats;
+            mSearchResult.clear();
+            mSearch.DoSearch(mGame, searchParam, mSearchResult, &stats);
+            numNodes += stats.nodes.load();
+
+            if (mSearchResult.empty() || mSearchResult.front().moves.empty())
+            {
+                return false;
+            }
+
+            score = mSearchResult.front().score;
+        }
+
+        // both static eval and search score are relative to the side to move, same as the entry score
+        entry.score = score;
+
+        int32_t wdl = 0;
+        if (pos.GetNumPieces() <= 7 && ProbeSyzygy_WDL(pos, &wdl))
+        {
+                 if (wdl > 0)   entry.tbScore = static_cast<uint8_t>(Game::Score::WhiteWins);
+            else if (wdl < 0)   entry.tbScore = static_cast<uint8_t>(Game::Score::BlackWins);
+            else                entry.tbScore = static_cast<uint8_t>(Game::Score::Draw);
+        }
+
+        return true;
+    }
+
+    uint64_t numNodes = 0;
+
+private:
+    const RescoreConfig& mConfig;
+    Search mSearch;
+    TranspositionTable mTranspositionTable;
+    AccumulatorCache mAccumulatorCache;
+    Game mGame;
+    SearchResult mSearchResult;
+};
+
+static bool ParseRescoreArgs(const std::vector<std::string>& args, RescoreConfig& config)
+{
+    config.inputPath = args[0];
+    config.outputPath = args[0];
+
+    for (size_t i = 1; i < args.size(); ++i)
+    {
+        const bool hasValue = i + 1 < args.size();
+
+        if (args[i] == "eval")
+            config.staticEval = true;
+        else if (args[i] == "resume")
+            config.resume = true;
+        else if (args[i] == "output" && hasValue)
+            config.outputPath = args[++i];
+        else if (args[i] == "nodes" && hasValue)
+            config.maxNodes = std::max<uint64_t>(1, std::stoull(args[++i]));
+        else if (args[i] == "depth" && hasValue)
+            config.maxDepth = std::clamp(atoi(args[++i].c_str()), 1, static_cast<int32_t>(UINT8_MAX));
+        else if (args[i] == "threads" && hasValue)
+            config.numThreads = std::max(1, atoi(args[++i].c_str()));
+        else if (args[i] == "hash" && hasValue)
+            config.hashSizeInMB = std::max(1, atoi(args[++i].c_str()));
+        else
+        {
+            std::cout << "Invalid rescore argument: " << args[i] << std::endl;
+            return false;
+        }
+    }
+
+    if (!config.staticEval && config.maxNodes == UINT64_MAX && config.maxDepth == UINT8_MAX)
+    {
+        std::cout << "Missing search limit (nodes or depth) or 'eval'" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+void Rescore(const std::vector<std::string>& args)
+{
+    if (args.empty())
+    {
+        std::cout << "Usage: rescore <input> [output <file>] [eval | nodes <n> | depth <d>] [threads <n>] [hash <MB per thread>] [resume]" << std::endl;
+        return;
+    }
+
+    RescoreConfig config;
+    if (!ParseRescoreArgs(args, config))
+    {
+        return;
+    }
+
+    if (TrainingDataFile::IsCompressedFile(config.inputPath))
+    {
+        std::cout << "ERROR: Compressed training data can't be rescored, convert it to raw format first: " << config.inputPath << std::endl;
+        return;
+    }
+
+    const bool inPlace = std::filesystem::exists(config.outputPath) &&
+        std::filesystem::equivalent(config.inputPath, config.outputPath);
+
+    uint64_t numEntries = 0;
+    {
+        FileInputStream inputStream(config.inputPath.c_str());
+        if (!inputStream.IsOpen())
+        {
+            std::cout << "ERROR: Failed to open training data file: " << config.inputPath << std::endl;
+            return;
+        }
+        numEntries = inputStream.GetSize() / sizeof(PositionEntry);
+    }
+
+    const uint64_t numBlocks = (numEntries + c_RescoreBlockSize - 1) / c_RescoreBlockSize;
+
+    RescoreCheckpoint checkpoint;
+    const std::string checkpointPath = RescoreCheckpoint::GetPath(config.outputPath);
+
+    if (config.resume && checkpoint.Load(checkpointPath))
+    {
+        if (checkpoint.numEntries != numEntries || checkpoint.method != config.GetMethodString() ||
+            checkpoint.inputPath != config.inputPath || checkpoint.numEntriesDone > numEntries)
+        {
+            std::cout << "ERROR: Checkpoint " << checkpointPath << " does not match the input file or rescoring settings" << std::endl;
+            return;
+        }
+
+        if (checkpoint.numEntriesDone == numEntries)
+        {
+            std::cout << "Nothing to do, all " << numEntries << " positions are already rescored" << std::endl;
+            return;
+        }
+
+        std::cout << "Resuming from position " << checkpoint.numEntriesDone << std::endl;
+    }
+    else
+    {
+        if (config.resume)
+        {
+            std::cout << "No checkpoint found, starting from the beginning" << std::endl;
+        }
+
+        checkpoint.inputPath = config.inputPath;
+        checkpoint.method = config.GetMethodString();
+        checkpoint.numEntries = numEntries;
+        checkpoint.numEntriesDone = 0;
+    }
+
+    // new output file is created when starting from scratch, otherwise rescored blocks are written in place
+    const bool updateOutput = inPlace || checkpoint.numEntriesDone > 0;
+    FileOutputStream outputStream(config.outputPath.c_str(), updateOutput);
+    if (!outputStream.IsOpen())
+    {
+        std::cout << "ERROR: Failed to open output file: " << config.outputPath << std::endl;
+        return;
+    }
+
+    const uint64_t firstBlock = checkpoint.numEntriesDone / c_RescoreBlockSize;
+    const uint32_t numThreads = static_cast<uint32_t>(std::clamp<uint64_t>(
+        config.numThreads ? config.numThreads : std::thread::hardware_concurrency(), 1, std::max<uint64_t>(1, numBlocks - firstBlock)));
+
+    std::cout << "Rescoring " << (numEntries - firstBlock * c_RescoreBlockSize) << " positions of " << config.inputPath
+        << " (" << config.GetMethodString() << ") using " << numThreads << " threads..." << std::endl;
+
+    std::atomic<uint64_t> nextBlock = firstBlock;
+    std::atomic<uint64_t> numPositionsRescored = 0;
+    std::atomic<uint64_t> numPositionsFailed = 0;
+    std::atomic<uint64_t> totalNodes = 0;
+    std::atomic<uint32_t> numWorkersRunning = numThreads;
+    std::atomic<bool> error = false;
+
+    // blocks are finished out of order, checkpoint covers only the completed prefix
+    std::mutex outputMutex;
+    std::vector<bool> blockDone(numBlocks - firstBlock, false);
+
+    const auto workerFunc = [&](uint32_t workerIndex)
+    {
+        numa::PinCurrentThreadToNumaNode(workerIndex % numa::GetNumNodes());
+
+        PositionRescorer rescorer(config);
+        FileInputStream inputStream(config.inputPath.c_str());
+        std::vector<PositionEntry> entries;
+
+        for (uint64_t blockIndex = nextBlock++; blockIndex < numBlocks && !error; blockIndex = nextBlock++)
+        {
+            const uint64_t blockOffset = blockIndex * c_RescoreBlockSize;
+            entries.resize(std::min<uint64_t>(c_RescoreBlockSize, numEntries - blockOffset));
+
+            if (!inputStream.SetPosition(blockOffset * sizeof(PositionEntry)) ||
+                !inputStream.Read(entries.data(), entries.size() * sizeof(PositionEntry)))
+            {
+                std::cout << "ERROR: Failed to read training data file: " << config.inputPath << std::endl;
+                error = true;
+                break;
+            }
+
+            rescorer.BeginBlock();
+            for (PositionEntry& entry : entries)
+            {
+                // positions which can't be scored are left untouched
+                if (!rescorer.Rescore(entry))
+                {
+                    numPositionsFailed++;
+                }
+            }
+
+            {
+                std::unique_lock<std::mutex> lock(outputMutex);
+                if (!outputStream.Seek(blockOffset * sizeof(PositionEntry)) ||
+                    !outputStream.Write(entries.data(), entries.size() * sizeof(PositionEntry)))
+                {
+                    std::cout << "ERROR: Failed to write output file: " << config.outputPath << std::endl;
+                    error = true;
+                    break;
+                }
+                blockDone[blockIndex - firstBlock] = true;
+            }
+
+            numPositionsRescored += entries.size();
+            totalNodes += rescorer.numNodes;
+            rescorer.numNodes = 0;
+        }
+
+        numWorkersRunning--;
+    };
+
+    const TimePoint startTime = TimePoint::GetCurrent();
+
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < numThreads; ++i)
+    {
+        threads.emplace_back(workerFunc, i);
+    }
+
+    // advance the checkpoint past the completed blocks, output must be flushed before the checkpoint is saved
+    uint64_t numBlocksDone = 0;
+    const auto updateCheckpoint = [&]()
+    {
+        {
+            std::unique_lock<std::mutex> lock(outputMutex);
+            while (numBlocksDone < blockDone.size() && blockDone[numBlocksDone]) ++numBlocksDone;
+            outputStream.Flush();
+        }
+
+        checkpoint.numEntriesDone = std::min(numEntries, (firstBlock + numBlocksDone) * c_RescoreBlockSize);
+        if (!checkpoint.Save(checkpointPath))
+        {
+            std::cout << "WARNING: Failed to write checkpoint file: " << checkpointPath << std::endl;
+        }
+    };
+
+    const auto printProgress = [&]()
+    {
+        const float elapsedTime = std::max(1.0e-6f, (TimePoint::GetCurrent() - startTime).ToSeconds());
+        std::cout << "Rescored " << checkpoint.numEntriesDone << " / " << numEntries << " positions, "
+            << static_cast<uint64_t>(numPositionsRescored / elapsedTime) << " pos/sec";
+        if (!config.staticEval)
+        {
+            std::cout << ", " << static_cast<uint64_t>(totalNodes / elapsedTime) << " nodes/sec";
+        }
+        std::cout << std::endl;
+    };
+
+    TimePoint lastCheckpointTime = startTime;
+    while (numWorkersRunning > 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        if ((TimePoint::GetCurrent() - lastCheckpointTime).ToSeconds() >= c_RescoreCheckpointInterval)
+        {
+            lastCheckpointTime = TimePoint::GetCurrent();
+            updateCheckpoint();
+            printProgress();
+        }
+    }
+
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    updateCheckpoint();
+    printProgress();
+
+    if (error)
+    {
+        std::cout << "Rescoring failed, run again with 'resume' to continue from the checkpoint" << std::endl;
+        return;
+    }
+
+    if (numPositionsFailed > 0)
+    {
+        std::cout << numPositionsFailed << " positions could not be scored and were left unchanged" << std::endl;
+    }
+
+    std::cout << "Done. Rescored positions written to " << config.outputPath << std::endl;
+}
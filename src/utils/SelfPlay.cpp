@@ -109,9 +109,8 @@ static bool SelfPlayThreadFunc(
     const std::vector<PackedPosition>& openingPositions,
     std::atomic<uint32_t>& openingCounter,
     std::atomic<uint32_t>& gameCounter,
-    GameCollection::Writer& writer,
-    std::ofstream* pgnFile,
-    std::mutex& pgnMutex,
+    ParallelOutputStream& gamesStream,
+    ParallelOutputStream* pgnStream,
     SelfPlayStats& stats)
 {
     const size_t c_transpositionTableSize = 4ull * 1024ull * 1024ull;
@@ -122,6 +121,8 @@ static bool SelfPlayThreadFunc(
     Search search;
     TranspositionTable tt{ c_transpositionTableSize };
 
+    std::vector<uint8_t> gameData;
+
     for (;;)
     {
         SearchResult searchResult;
@@ -275,18 +276,21 @@ static bool SelfPlayThreadFunc(
             metadata.roundNumber = index;
             game.SetMetadata(metadata);
 
-            writer.WriteGame(game);
+            gameData.clear();
+            if (GameCollection::SerializeGame(game, gameData))
+            {
+                gamesStream.Write(threadIndex, gameData.data(), gameData.size());
+            }
 
             const bool printToConsole = threadIndex == 0 && config.consolePgnFrequency != 0 && (index % config.consolePgnFrequency == 0);
-            if (pgnFile || printToConsole)
+            if (pgnStream || printToConsole)
             {
                 const std::string pgn = game.ToPGN(true);
 
-                if (pgnFile)
+                if (pgnStream)
                 {
-                    std::lock_guard<std::mutex> lock(pgnMutex);
-                    *pgnFile << pgn << "\n\n";
-                    pgnFile->flush();
+                    const std::string pgnEntry = pgn + "\n\n";
+                    pgnStream->Write(threadIndex, pgnEntry.data(), pgnEntry.size());
                 }
 
                 if (printToConsole)
@@ -481,24 +485,29 @@ void SelfPlay(const std::vector<std::string>& args)
         std::cerr << "Failed to open output file: " << datPath << "\n";
         return;
     }
-    GameCollection::Writer writer(gamesFile);
     std::cout << "Output: " << datPath << "\n";
 
     const uint32_t numThreads = config.numThreads > 0
         ? config.numThreads
         : std::max<uint32_t>(1, std::thread::hardware_concurrency());
 
+    // every thread buffers its games, full buffers (or ones holding games older than a second)
+    // are appended to the file by a background thread
+    constexpr size_t c_outputBlockSize = 256 * 1024;
+    constexpr std::chrono::milliseconds c_outputMaxBufferAge = std::chrono::seconds(1);
+    ParallelOutputStream gamesStream(gamesFile, numThreads, c_outputBlockSize, c_outputMaxBufferAge);
+
     // write config file
     WriteConfigFile(baseName, config, nameSeed, numThreads);
 
     // open optional PGN file
-    std::unique_ptr<std::ofstream> pgnFile;
-    std::mutex pgnMutex;
+    std::unique_ptr<FileOutputStream> pgnFile;
+    std::unique_ptr<ParallelOutputStream> pgnStream;
     if (config.dumpAllPgn)
     {
         const std::string pgnPath = baseName + ".pgn";
-        pgnFile = std::make_unique<std::ofstream>(pgnPath);
-        if (!pgnFile->is_open())
+        pgnFile = std::make_unique<FileOutputStream>(pgnPath.c_str());
+        if (!pgnFile->IsOK())
         {
             std::cerr << "Failed to open PGN file: " << pgnPath << "\n";
             pgnFile.reset();
@@ -506,6 +515,7 @@ void SelfPlay(const std::vector<std::string>& args)
         else
         {
             std::cout << "PGN output: " << pgnPath << "\n";
+            pgnStream = std::make_unique<ParallelOutputStream>(*pgnFile, numThreads, c_outputBlockSize, c_outputMaxBufferAge);
         }
     }
 
@@ -517,9 +527,9 @@ void SelfPlay(const std::vector<std::string>& args)
     std::vector<std::thread> threads;
     for (uint32_t i = 0; i < numThreads; ++i)
     {
-        threads.emplace_back([i, &config, &openingPositions, &openingCounter, &gameCounter, &writer, &pgnFile, &pgnMutex, &stats]()
+        threads.emplace_back([i, &config, &openingPositions, &openingCounter, &gameCounter, &gamesStream, &pgnStream, &stats]()
         {
-            SelfPlayThreadFunc(i, config, openingPositions, openingCounter, gameCounter, writer, pgnFile.get(), pgnMutex, stats);
+            SelfPlayThreadFunc(i, config, openingPositions, openingCounter, gameCounter, gamesStream, pgnStream.get(), stats);
         });
     }
 
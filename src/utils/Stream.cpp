@@ -1,5 +1,18 @@
 #include "Stream.hpp"
 
+#if defined(PLATFORM_WINDOWS)
+    #define WIN32_LEAN_AND_MEAN
+    #ifndef NOMINMAX
+    #define NOMINMAX
+    #endif // NOMINMAX
+    #include <Windows.h>
+#elif defined(PLATFORM_LINUX)
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
 MemoryInputStream::MemoryInputStream(const std::vector<uint8_t>& buffer)
     : mBuffer(buffer)
     , mPosition(0)
@@ -11,6 +24,17 @@ uint64_t MemoryInputStream::GetSize()
     return mBuffer.size();
 }
 
+bool MemoryInputStream::SetPosition(uint64_t offset)
+{
+    if (offset > mBuffer.size())
+    {
+        return false;
+    }
+
+    mPosition = static_cast<size_t>(offset);
+    return true;
+}
+
 bool MemoryInputStream::IsEndOfFile() const
 {
     return mPosition >= mBuffer.size();
@@ -117,9 +141,9 @@ uint64_t FileInputStream::GetPosition() const
 bool FileInputStream::SetPosition(uint64_t offset)
 {
 #if defined(_MSC_VER)
-    return 0 != _fseeki64(mFile, offset, SEEK_SET);
+    return 0 == _fseeki64(mFile, offset, SEEK_SET);
 #else
-    return 0 != fseeko64(mFile, offset, SEEK_SET);
+    return 0 == fseeko64(mFile, offset, SEEK_SET);
 #endif
 }
 
@@ -135,9 +159,9 @@ bool FileInputStream::Read(void* data, size_t size)
 
 //////////////////////////////////////////////////////////////////////////
 
-FileOutputStream::FileOutputStream(const char* filePath)
+FileOutputStream::FileOutputStream(const char* filePath, bool update)
 {
-    mFile = fopen(filePath, "wb");
+    mFile = fopen(filePath, update ? "r+b" : "wb");
     if (!mFile)
     {
         perror(filePath);
@@ -163,7 +187,11 @@ bool FileOutputStream::Seek(uint64_t pos)
 {
     if (mFile != nullptr)
     {
-        fseek(mFile, (long)pos, SEEK_SET);
+#if defined(_MSC_VER)
+        return 0 == _fseeki64(mFile, pos, SEEK_SET);
+#else
+        return 0 == fseeko64(mFile, pos, SEEK_SET);
+#endif
     }
 
     return false;
@@ -197,3 +225,238 @@ bool FileOutputStream::IsOK() const
 {
     return mFile;
 }
+
+//////////////////////////////////////////////////////////////////////////
+
+MappedFile::MappedFile(const char* filePath)
+{
+#if defined(PLATFORM_WINDOWS)
+    mFileHandle = CreateFileA(filePath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (mFileHandle == INVALID_HANDLE_VALUE)
+    {
+        mFileHandle = nullptr;
+        return;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(mFileHandle, &size))
+    {
+        return;
+    }
+    mSize = static_cast<uint64_t>(size.QuadPart);
+
+    if (mSize > 0)
+    {
+        mMappingHandle = CreateFileMappingA(mFileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mMappingHandle)
+        {
+            return;
+        }
+
+        mData = static_cast<const char*>(MapViewOfFile(mMappingHandle, FILE_MAP_READ, 0, 0, 0));
+        if (!mData)
+        {
+            return;
+        }
+    }
+#elif defined(PLATFORM_LINUX)
+    const int file = open(filePath, O_RDONLY);
+    if (file < 0)
+    {
+        perror(filePath);
+        return;
+    }
+
+    struct stat fileStat;
+    if (fstat(file, &fileStat) != 0)
+    {
+        close(file);
+        return;
+    }
+    mSize = static_cast<uint64_t>(fileStat.st_size);
+
+    if (mSize > 0)
+    {
+        void* data = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, file, 0);
+        if (data == MAP_FAILED)
+        {
+            perror(filePath);
+            close(file);
+            return;
+        }
+
+        madvise(data, mSize, MADV_SEQUENTIAL);
+        mData = static_cast<const char*>(data);
+    }
+
+    // the mapping stays valid after the file is closed
+    close(file);
+#endif
+
+    mIsOpen = true;
+}
+
+MappedFile::~MappedFile()
+{
+#if defined(PLATFORM_WINDOWS)
+    if (mData) UnmapViewOfFile(mData);
+    if (mMappingHandle) CloseHandle(mMappingHandle);
+    if (mFileHandle) CloseHandle(mFileHandle);
+#elif defined(PLATFORM_LINUX)
+    if (mData) munmap(const_cast<char*>(mData), mSize);
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+ParallelOutputStream::ParallelOutputStream(OutputStream& stream, uint32_t numThreads, size_t blockSize, std::chrono::milliseconds maxBufferAge)
+    : mStream(stream)
+    , mBlockSize(blockSize)
+    , mMaxBufferAge(maxBufferAge)
+    , mThreadBuffers(numThreads)
+{
+    mFlusherThread = std::thread(&ParallelOutputStream::FlusherThreadFunc, this);
+}
+
+ParallelOutputStream::~ParallelOutputStream()
+{
+    Flush();
+
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mStopFlusher = true;
+        mBlockQueuedCV.notify_one();
+    }
+    mFlusherThread.join();
+}
+
+bool ParallelOutputStream::Write(uint32_t threadIndex, const void* data, size_t size)
+{
+    ASSERT(threadIndex < mThreadBuffers.size());
+    ThreadBuffer& buffer = mThreadBuffers[threadIndex];
+
+    // the lock is contended only when the flusher hands off a stale buffer
+    std::unique_lock<std::mutex> bufferLock(buffer.mutex);
+
+    if (buffer.data.empty())
+    {
+        buffer.oldestDataTime = Clock::now();
+    }
+
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    buffer.data.insert(buffer.data.end(), bytes, bytes + size);
+
+    if (buffer.data.size() >= mBlockSize)
+    {
+        HandOff(buffer);
+    }
+
+    return !mFailed;
+}
+
+void ParallelOutputStream::HandOff(ThreadBuffer& buffer)
+{
+    if (buffer.data.empty())
+    {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    mPendingBlocks.emplace_back(std::move(buffer.data));
+    mNumBlocksInFlight++;
+    mBlockQueuedCV.notify_one();
+
+    // reuse memory of already written blocks
+    if (!mFreeBlocks.empty())
+    {
+        buffer.data = std::move(mFreeBlocks.back());
+        mFreeBlocks.pop_back();
+    }
+    else
+    {
+        buffer.data = std::vector<uint8_t>();
+        buffer.data.reserve(mBlockSize);
+    }
+}
+
+void ParallelOutputStream::HandOffStaleBuffers()
+{
+    const Clock::time_point now = Clock::now();
+
+    for (ThreadBuffer& buffer : mThreadBuffers)
+    {
+        std::unique_lock<std::mutex> bufferLock(buffer.mutex);
+        if (!buffer.data.empty() && now - buffer.oldestDataTime >= mMaxBufferAge)
+        {
+            HandOff(buffer);
+        }
+    }
+}
+
+void ParallelOutputStream::Flush()
+{
+    for (ThreadBuffer& buffer : mThreadBuffers)
+    {
+        std::unique_lock<std::mutex> bufferLock(buffer.mutex);
+        HandOff(buffer);
+    }
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    mBlockWrittenCV.wait(lock, [this]() { return mNumBlocksInFlight == 0; });
+}
+
+void ParallelOutputStream::FlusherThreadFunc()
+{
+    // buffers are checked a few times per max age, so no data stays buffered much longer than that
+    const std::chrono::milliseconds checkInterval = std::max(std::chrono::milliseconds(1), mMaxBufferAge / 4);
+    Clock::time_point lastCheckTime = Clock::now();
+
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    for (;;)
+    {
+        mBlockQueuedCV.wait_for(lock, checkInterval, [this]() { return mStopFlusher || !mPendingBlocks.empty(); });
+
+        if (Clock::now() - lastCheckTime >= checkInterval)
+        {
+            // buffer locks are taken before the queue lock (like in Write)
+            lock.unlock();
+            HandOffStaleBuffers();
+            lock.lock();
+            lastCheckTime = Clock::now();
+        }
+
+        if (mPendingBlocks.empty())
+        {
+            if (mStopFlusher)
+                break;
+            continue;
+        }
+
+        std::vector<uint8_t> block = std::move(mPendingBlocks.front());
+        mPendingBlocks.pop_front();
+
+        // write without holding the lock, so writer threads can keep handing off blocks
+        lock.unlock();
+        if (!mStream.Write(block.data(), block.size()))
+        {
+            std::cout << "Failed to write output stream" << std::endl;
+            mFailed = true;
+        }
+        lock.lock();
+
+        block.clear();
+        mFreeBlocks.push_back(std::move(block));
+
+        if (mPendingBlocks.empty())
+        {
+            lock.unlock();
+            mStream.Flush();
+            lock.lock();
+        }
+
+        mNumBlocksInFlight--;
+        mBlockWrittenCV.notify_all();
+    }
+}
@@ -3,6 +3,11 @@
 #include "../backend/Common.hpp"
 
 #include <vector>
+#include <deque>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 #include <stdio.h>
 
 class InputStream
@@ -11,6 +16,7 @@ public:
     virtual ~InputStream() = default;
     virtual uint64_t GetSize() = 0;
     virtual uint64_t GetPosition() const = 0;
+    virtual bool SetPosition(uint64_t offset) = 0;
     virtual bool IsEndOfFile() const = 0;
     virtual bool Read(void* data, size_t size) = 0;
     virtual const char* GetFileName() const { return ""; }
@@ -22,9 +28,28 @@ public:
     ~OutputStream() = default;
     virtual uint64_t GetSize() = 0;
     virtual bool Write(const void* data, size_t size) = 0;
+    virtual void Flush() { }
     virtual bool IsOK() const { return true; }
 };
 
+// binary serialization of plain data arrays (element count followed by the elements)
+template<typename ArrayType>
+inline bool WriteArray(OutputStream& stream, const ArrayType& values)
+{
+    const uint64_t size = values.size();
+    return stream.Write(&size, sizeof(size)) && stream.Write(values.data(), size * sizeof(values[0]));
+}
+
+template<typename ArrayType>
+inline bool ReadArray(InputStream& stream, ArrayType& values)
+{
+    uint64_t size = 0;
+    if (!stream.Read(&size, sizeof(size)) || size * sizeof(values[0]) > stream.GetSize() - stream.GetPosition())
+        return false;
+    values.resize(size);
+    return stream.Read(values.data(), size * sizeof(values[0]));
+}
+
 //////////////////////////////////////////////////////////////////////////
 
 class MemoryInputStream : public InputStream
@@ -33,6 +58,7 @@ public:
     MemoryInputStream(const std::vector<uint8_t>& buffer);
     virtual uint64_t GetSize() override;
     virtual uint64_t GetPosition() const override { return mPosition; }
+    virtual bool SetPosition(uint64_t offset) override;
     virtual bool IsEndOfFile() const override;
     virtual bool Read(void* data, size_t size) override;
 private:
@@ -59,7 +85,7 @@ public:
     virtual ~FileInputStream();
     bool IsOpen() const;
     virtual uint64_t GetPosition() const override;
-    bool SetPosition(uint64_t offset);
+    virtual bool SetPosition(uint64_t offset) override;
     virtual uint64_t GetSize() override;
     virtual bool IsEndOfFile() const override;
     virtual bool Read(void* data, size_t size) override;
@@ -73,14 +99,102 @@ private:
 class FileOutputStream : public OutputStream
 {
 public:
-    FileOutputStream(const char* filePath);
+    // 'update' opens an existing file for in-place writes instead of truncating it
+    FileOutputStream(const char* filePath, bool update = false);
     virtual ~FileOutputStream();
     bool IsOpen() const;
     bool Seek(uint64_t pos);
-    void Flush();
+    virtual void Flush() override;
     virtual uint64_t GetSize() override;
     virtual bool Write(const void* data, size_t size) override;
     virtual bool IsOK() const override;
 private:
     FILE* mFile;
 };
+
+//////////////////////////////////////////////////////////////////////////
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+    MappedFile(const char* filePath);
+    ~MappedFile();
+
+    bool IsOpen() const { return mIsOpen; }
+    const char* GetData() const { return mData; }
+    uint64_t GetSize() const { return mSize; }
+
+private:
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+#if defined(PLATFORM_WINDOWS)
+    void* mFileHandle = nullptr;
+    void* mMappingHandle = nullptr;
+#endif // PLATFORM_WINDOWS
+    const char* mData = nullptr;
+    uint64_t mSize = 0;
+    bool mIsOpen = false;
+};
+
+//////////////////////////////////////////////////////////////////////////
+
+// Output stream shared by many writer threads. Every thread appends records to its own buffer
+// (guarded by an uncontended per-buffer lock), full buffers are handed over to a background thread
+// that appends them to the underlying stream and flushes it. The background thread also periodically
+// hands over buffers holding data older than 'maxBufferAge', so data of idle or slow writers reaches the file too.
+// A record passed to a single Write() call is never split, so records from different threads
+// don't interleave (but their order in the output is not deterministic).
+class ParallelOutputStream
+{
+public:
+    ParallelOutputStream(OutputStream& stream, uint32_t numThreads,
+                         size_t blockSize = 1024 * 1024,
+                         std::chrono::milliseconds maxBufferAge = std::chrono::seconds(10));
+    ~ParallelOutputStream();
+
+    // can be called concurrently, but each thread must use a different thread index
+    bool Write(uint32_t threadIndex, const void* data, size_t size);
+
+    // write all buffered data and flush the underlying stream
+    // NOTE: must not be called concurrently with Write()
+    void Flush();
+
+    bool IsOK() const { return !mFailed; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct alignas(CACHELINE_SIZE) ThreadBuffer
+    {
+        std::mutex mutex;
+        std::vector<uint8_t> data;
+        Clock::time_point oldestDataTime;   // when the first record was appended to the empty buffer
+    };
+
+    // NOTE: buffer's mutex must be locked
+    void HandOff(ThreadBuffer& buffer);
+
+    // hand off buffers with data older than mMaxBufferAge
+    void HandOffStaleBuffers();
+
+    void FlusherThreadFunc();
+
+    OutputStream& mStream;
+    const size_t mBlockSize;
+    const std::chrono::milliseconds mMaxBufferAge;
+
+    std::vector<ThreadBuffer> mThreadBuffers;
+
+    std::mutex mMutex;
+    std::condition_variable mBlockQueuedCV;
+    std::condition_variable mBlockWrittenCV;
+    std::deque<std::vector<uint8_t>> mPendingBlocks;
+    std::vector<std::vector<uint8_t>> mFreeBlocks;
+    uint32_t mNumBlocksInFlight = 0;
+    bool mStopFlusher = false;
+    std::atomic<bool> mFailed = false;
+
+    std::thread mFlusherThread;
+};
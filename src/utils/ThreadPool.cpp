@@ -1,11 +1,44 @@
 #include "ThreadPool.hpp"
 #include "../backend/Waitable.hpp"
+#include "../backend/Numa.hpp"
 #include "minitrace/minitrace.h"
 
 #include <assert.h>
 
 namespace threadpool {
 
+// marks dependent tasks list of a finished task, so no more tasks can be linked to it
+static constexpr TaskID ClosedListTaskID = InvalidTaskID - 1;
+
+// worker thread index of the calling thread (only valid if 't_workerPool' is set)
+static thread_local const ThreadPool* t_workerPool = nullptr;
+static thread_local uint32_t t_workerId = 0;
+
+const char* ThreadPinningToString(ThreadPinning pinning)
+{
+    switch (pinning)
+    {
+    case ThreadPinning::None:       return "none";
+    case ThreadPinning::Compact:    return "compact";
+    case ThreadPinning::Scatter:    return "scatter";
+    case ThreadPinning::Node:       return "node";
+    }
+    return "unknown";
+}
+
+bool ThreadPinningFromString(const std::string& str, ThreadPinning& outPinning)
+{
+    for (const ThreadPinning pinning : { ThreadPinning::None, ThreadPinning::Compact, ThreadPinning::Scatter, ThreadPinning::Node })
+    {
+        if (str == ThreadPinningToString(pinning))
+        {
+            outPinning = pinning;
+            return true;
+        }
+    }
+    return false;
+}
+
 Task::Task()
 {
     Reset();
@@ -17,10 +50,11 @@ void Task::Reset()
     mDependencyState = 0;
     mTasksLeft = 0;
     mParent = InvalidTaskID;
+    mNextFree = InvalidTaskID;
     mDependency = InvalidTaskID;
     mHead = InvalidTaskID;
-    mTail = InvalidTaskID;
     mSibling = InvalidTaskID;
+    mNode = AnyNode;
     mWaitable = nullptr;
     mDebugName = nullptr;
 }
@@ -30,9 +64,9 @@ Task::Task(Task&& other)
     mState = other.mState.load();
     mTasksLeft = other.mTasksLeft.load();
     mParent = other.mParent;
+    mNextFree = other.mNextFree.load();
     mDependency = other.mDependency;
-    mHead = other.mHead;
-    mTail = other.mTail;
+    mHead = other.mHead.load();
     mSibling = other.mSibling;
     mWaitable = other.mWaitable;
 }
@@ -41,11 +75,123 @@ Task::Task(Task&& other)
 //////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////
 
-WorkerThread::WorkerThread(ThreadPool* pool, uint32_t id)
-    : mThread{&ThreadPool::SchedulerCallback, pool, this}
-    , mId(id)
+WorkStealingQueue::Buffer::Buffer(int64_t capacity)
+    : mask(capacity - 1)
+    , items(std::make_unique<std::atomic<TaskID>[]>(static_cast<size_t>(capacity)))
+{
+    ASSERT((capacity & mask) == 0); // capacity must be a power of two
+}
+
+WorkStealingQueue::WorkStealingQueue(uint32_t initialCapacity)
+    : mTop(0)
+    , mBottom(0)
+{
+    mBuffers.push_back(std::make_unique<Buffer>(static_cast<int64_t>(initialCapacity)));
+    mBuffer = mBuffers.back().get();
+}
+
+bool WorkStealingQueue::IsEmpty() const
+{
+    return mBottom.load(std::memory_order_relaxed) <= mTop.load(std::memory_order_relaxed);
+}
+
+WorkStealingQueue::Buffer* WorkStealingQueue::Grow(Buffer* buffer, int64_t top, int64_t bottom)
+{
+    // the old buffer is retired, not freed, thieves may still be reading from it
+    mBuffers.push_back(std::make_unique<Buffer>(2 * (buffer->mask + 1)));
+    Buffer* newBuffer = mBuffers.back().get();
+
+    for (int64_t i = top; i < bottom; ++i)
+    {
+        newBuffer->Put(i, buffer->Get(i));
+    }
+
+    mBuffer.store(newBuffer, std::memory_order_release);
+    return newBuffer;
+}
+
+void WorkStealingQueue::Push(TaskID taskID)
+{
+    const int64_t bottom = mBottom.load(std::memory_order_relaxed);
+    const int64_t top = mTop.load(std::memory_order_acquire);
+    Buffer* buffer = mBuffer.load(std::memory_order_relaxed);
+
+    if (bottom - top > buffer->mask)
+    {
+        buffer = Grow(buffer, top, bottom);
+    }
+
+    buffer->Put(bottom, taskID);
+    std::atomic_thread_fence(std::memory_order_release);
+    mBottom.store(bottom + 1, std::memory_order_relaxed);
+}
+
+bool WorkStealingQueue::Pop(TaskID& outTaskID)
+{
+    const int64_t bottom = mBottom.load(std::memory_order_relaxed) - 1;
+    Buffer* buffer = mBuffer.load(std::memory_order_relaxed);
+    mBottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = mTop.load(std::memory_order_relaxed);
+
+    if (top > bottom)
+    {
+        // empty
+        mBottom.store(bottom + 1, std::memory_order_relaxed);
+        return false;
+    }
+
+    outTaskID = buffer->Get(bottom);
+
+    if (top == bottom)
+    {
+        // the last element, race against thieves
+        const bool success = mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        mBottom.store(bottom + 1, std::memory_order_relaxed);
+        return success;
+    }
+
+    return true;
+}
+
+bool WorkStealingQueue::Steal(TaskID& outTaskID)
+{
+    for (;;)
+    {
+        int64_t top = mTop.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const int64_t bottom = mBottom.load(std::memory_order_acquire);
+
+        if (top >= bottom)
+        {
+            return false;
+        }
+
+        const Buffer* buffer = mBuffer.load(std::memory_order_acquire);
+        const TaskID taskID = buffer->Get(top);
+
+        if (mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            outTaskID = taskID;
+            return true;
+        }
+
+        // lost the race against the owner or another thief, retry while there are tasks left
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+WorkerThread::WorkerThread(ThreadPool* pool, uint32_t id, uint32_t node, uint32_t processor)
+    : mId(id)
+    , mNode(node)
+    , mProcessor(processor)
     , mStarted(true)
 {
+    // start the thread once the members are initialized, otherwise it could see 'mStarted' unset and exit immediately
+    mThread = std::thread(&ThreadPool::SchedulerCallback, pool, this);
 }
 
 WorkerThread::~WorkerThread()
@@ -64,7 +210,9 @@ ThreadPool& ThreadPool::GetInstance()
 }
 
 ThreadPool::ThreadPool()
-    : mFirstFreeTask(InvalidTaskID)
+    : mNumSleepingThreads(0)
+    , mWorkEpoch(0)
+    , mFreeTasksHead(InvalidTaskID)
 {
     mtr_init("trace.json");
 
@@ -73,27 +221,14 @@ ThreadPool::ThreadPool()
     // TODO make it configurable
     InitTasksTable(TasksCapacity);
 
-    const uint32_t numThreads = std::max<uint32_t>(1, std::thread::hardware_concurrency() - 2);
+    // leave two cores for the main thread and the OS, hardware_concurrency() may report less than that
+    const uint32_t numThreads = std::max<uint32_t>(3, std::thread::hardware_concurrency()) - 2;
     SpawnWorkerThreads(numThreads);
 }
 
 ThreadPool::~ThreadPool()
 {
-    {
-        std::unique_lock<std::mutex> lock(mTasksQueueMutex);
-
-        for (const WorkerThreadPtr& thread : mThreads)
-        {
-            thread->mStarted = false;
-        }
-
-        mTaskQueueCV.notify_all();
-    }
-
-    for (const WorkerThreadPtr& thread : mThreads)
-    {
-        thread->mThread.join();
-    }
+    StopWorkerThreads();
 
     mtr_flush();
     mtr_shutdown();
@@ -103,109 +238,358 @@ bool ThreadPool::InitTasksTable(uint32_t newSize)
 {
     mTasks.resize(newSize);
 
-    mFirstFreeTask = 0;
     for (uint32_t i = 0; i < newSize - 1; ++i)
     {
         mTasks[i].mNextFree = i + 1;
     }
     mTasks[newSize - 1].mNextFree = InvalidTaskID;
+    mFreeTasksHead = 0;
 
     return true;
 }
 
+void ThreadPool::SharedQueue::Push(TaskID taskID, uint8_t priority)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    mTasks[priority].push_back(taskID);
+    mNumTasks++;
+}
+
+bool ThreadPool::SharedQueue::TryPop(uint8_t priority, TaskID& outTaskID)
+{
+    if (mNumTasks.load(std::memory_order_relaxed) == 0)
+    {
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    std::deque<TaskID>& queue = mTasks[priority];
+    if (queue.empty())
+    {
+        return false;
+    }
+
+    outTaskID = queue.front();
+    queue.pop_front();
+    mNumTasks--;
+    return true;
+}
+
 void ThreadPool::SpawnWorkerThreads(uint32_t num)
 {
+    ASSERT(mThreads.empty());
+    ASSERT(num > 0);
+
+    // gather processors of NUMA nodes, a node with no processors ends the list
+    std::vector<std::vector<uint32_t>> nodeProcessors;
+    for (uint32_t node = 0; node < numa::GetNumNodes() && nodeProcessors.size() < num; ++node)
+    {
+        std::vector<uint32_t> processors = numa::GetNodeProcessors(node);
+        if (processors.empty())
+        {
+            break;
+        }
+        nodeProcessors.emplace_back(std::move(processors));
+    }
+    if (nodeProcessors.empty())
+    {
+        nodeProcessors.emplace_back();
+    }
+
+    const uint32_t numNodes = static_cast<uint32_t>(nodeProcessors.size());
+
+    uint32_t numProcessors = 0;
+    for (const std::vector<uint32_t>& processors : nodeProcessors)
+    {
+        numProcessors += static_cast<uint32_t>(processors.size());
+    }
+
+    std::vector<uint32_t> workerNodes(num);
+    std::vector<uint32_t> workerProcessors(num, UINT32_MAX);
+    for (uint32_t i = 0; i < num; ++i)
+    {
+        switch (mPinning)
+        {
+        case ThreadPinning::None:
+        case ThreadPinning::Node:
+            workerNodes[i] = static_cast<uint32_t>(uint64_t(i) * numNodes / num);
+            break;
+
+        case ThreadPinning::Compact:
+        {
+            // wrap around if there are more workers than processors
+            uint32_t processorIndex = i % std::max<uint32_t>(1, numProcessors);
+            uint32_t node = 0;
+            while (node + 1 < numNodes && processorIndex >= nodeProcessors[node].size())
+            {
+                processorIndex -= static_cast<uint32_t>(nodeProcessors[node].size());
+                node++;
+            }
+            workerNodes[i] = node;
+            if (!nodeProcessors[node].empty())
+            {
+                workerProcessors[i] = nodeProcessors[node][processorIndex % nodeProcessors[node].size()];
+            }
+            break;
+        }
+
+        case ThreadPinning::Scatter:
+        {
+            const uint32_t node = i % numNodes;
+            workerNodes[i] = node;
+            if (!nodeProcessors[node].empty())
+            {
+                workerProcessors[i] = nodeProcessors[node][(i / numNodes) % nodeProcessors[node].size()];
+            }
+            break;
+        }
+        }
+    }
+
+    // queues must exist before any worker starts stealing
+    mWorkerQueues.clear();
+    for (uint32_t i = 0; i < num * NumPriorities; ++i)
+    {
+        mWorkerQueues.emplace_back(std::make_unique<WorkStealingQueue>());
+    }
+
+    mNodeQueues.clear();
+    for (uint32_t i = 0; i < numNodes; ++i)
+    {
+        mNodeQueues.emplace_back(std::make_unique<SharedQueue>());
+    }
+    for (uint32_t i = 0; i < num; ++i)
+    {
+        mNodeQueues[workerNodes[i]]->mNumWorkers++;
+    }
+
+    // workers must not access 'mThreads' as it's still being filled when they start
+    mWorkerNodes = workerNodes;
+
     for (uint32_t i = 0; i < num; ++i)
     {
-        mThreads.emplace_back(std::make_unique<WorkerThread>(this, i));
+        mThreads.emplace_back(std::make_unique<WorkerThread>(this, i, workerNodes[i], workerProcessors[i]));
     }
 }
 
-void ThreadPool::SchedulerCallback(WorkerThread* thread)
+void ThreadPool::StopWorkerThreads()
 {
-    TaskContext context;
-    context.pool = this;
-    context.threadId = thread->mId;
+    for (const WorkerThreadPtr& thread : mThreads)
+    {
+        thread->mStarted = false;
+    }
 
-    char threadName[16];
-    sprintf(threadName, "Worker %u", thread->mId);
-    MTR_META_THREAD_NAME(threadName);
+    {
+        std::unique_lock<std::mutex> lock(mSleepMutex);
+        mSleepCV.notify_all();
+    }
 
-    for (;;)
+    for (const WorkerThreadPtr& thread : mThreads)
     {
-        Task* task = nullptr;
+        thread->mThread.join();
+    }
+
+    mThreads.clear();
+}
+
+void ThreadPool::SetNumThreads(uint32_t numThreads)
+{
+    if (numThreads != GetNumThreads())
+    {
+        Restart(numThreads, mPinning);
+    }
+}
+
+void ThreadPool::Restart(uint32_t numThreads, ThreadPinning pinning)
+{
+    ASSERT(numThreads > 0);
+
+    StopWorkerThreads();
+
+    for (const auto& queue : mWorkerQueues)
+    {
+        ASSERT(queue->IsEmpty()); // tasks must not be in flight
+        (void)queue;
+    }
+
+    mPinning = pinning;
+    SpawnWorkerThreads(numThreads);
+}
+
+void ThreadPool::NotifyWorkers(bool all)
+{
+    // sleeping workers re-check the epoch under the lock, so either they see the new epoch or they get notified
+    mWorkEpoch.fetch_add(1);
+
+    if (mNumSleepingThreads.load() > 0)
+    {
+        std::unique_lock<std::mutex> lock(mSleepMutex);
+        if (all)
         {
-            std::unique_lock<std::mutex> lock(mTasksQueueMutex);
+            mSleepCV.notify_all();
+        }
+        else
+        {
+            mSleepCV.notify_one();
+        }
+    }
+}
 
-            std::deque<TaskID>* queue = nullptr;
+bool ThreadPool::TryGetTask(uint32_t threadId, TaskID& outTaskID)
+{
+    const uint32_t numThreads = static_cast<uint32_t>(mWorkerNodes.size());
+    const uint32_t numNodes = GetNumNodes();
+    const uint32_t node = mWorkerNodes[threadId];
 
-            // wait for new task
-            while (thread->mStarted)
+    for (uint8_t priority = 0; priority < NumPriorities; ++priority)
+    {
+        if (mWorkerQueues[threadId * NumPriorities + priority]->Pop(outTaskID))
+        {
+            return true;
+        }
+
+        if (mNodeQueues[node]->TryPop(priority, outTaskID))
+        {
+            return true;
+        }
+
+        if (mExternalQueue.TryPop(priority, outTaskID))
+        {
+            return true;
+        }
+
+        // steal from other workers, starting from the next one so thieves spread over victims
+        // first pass steals only on the same node, second pass from other nodes
+        for (uint32_t pass = 0; pass < (numNodes > 1 ? 2u : 1u); ++pass)
+        {
+            for (uint32_t i = 1; i < numThreads; ++i)
             {
-                // find queue with pending tasks
-                queue = nullptr;
-                for (uint32_t i = 0; i < NumPriorities; ++i)
+                uint32_t victimId = threadId + i;
+                if (victimId >= numThreads)
                 {
-                    if (!mTasksQueues[i].empty())
-                    {
-                        queue = &mTasksQueues[i];
-                        break;
-                    }
+                    victimId -= numThreads;
                 }
 
-                if (queue != nullptr)
+                if (numNodes > 1 && (mWorkerNodes[victimId] == node) != (pass == 0))
                 {
-                    break;
+                    continue;
                 }
 
-                mTaskQueueCV.wait(lock);
+                if (mWorkerQueues[victimId * NumPriorities + priority]->Steal(outTaskID))
+                {
+                    return true;
+                }
             }
+        }
 
-            if (!thread->mStarted)
+        // tasks with affinity to other nodes, rather than going idle
+        for (uint32_t i = 1; i < numNodes; ++i)
+        {
+            if (mNodeQueues[(node + i) % numNodes]->TryPop(priority, outTaskID))
             {
-                break;
+                return true;
             }
-
-            // pop a task from the queue
-            context.taskId = queue->front();
-            task = &mTasks[context.taskId];
-            queue->pop_front();
         }
+    }
+
+    return false;
+}
 
-        if (task->mCallback)
+void ThreadPool::SchedulerCallback(WorkerThread* thread)
+{
+    TaskContext context;
+    context.pool = this;
+    context.threadId = thread->mId;
+    context.node = thread->mNode;
+
+    t_workerPool = this;
+    t_workerId = thread->mId;
+
+    switch (mPinning)
+    {
+    case ThreadPinning::None:
+        break;
+    case ThreadPinning::Compact:
+    case ThreadPinning::Scatter:
+        if (thread->mProcessor != UINT32_MAX)
         {
-            // Queued -> Executing
-            {
-                const Task::State oldState = task->mState.exchange(Task::State::Executing);
-                assert(Task::State::Queued == oldState); // Task is expected to be in 'Queued' state
-                (void)oldState;
-            }
+            numa::PinCurrentThreadToProcessor(thread->mProcessor);
+        }
+        break;
+    case ThreadPinning::Node:
+        numa::PinCurrentThreadToNumaNode(thread->mNode);
+        break;
+    }
 
-            MTR_BEGIN("Task", task->mDebugName);
+    char threadName[16];
+    sprintf(threadName, "Worker %u", thread->mId);
+    MTR_META_THREAD_NAME(threadName);
 
-            // execute
-            task->mCallback(context);
+    for (;;)
+    {
+        // the epoch must be read before looking for tasks, otherwise a task pushed in between could be missed
+        const uint64_t workEpoch = mWorkEpoch.load();
 
-            MTR_END("Task", task->mDebugName);
+        if (TryGetTask(thread->mId, context.taskId))
+        {
+            ExecuteTask(context);
+            continue;
+        }
 
-            // Executing -> Finished
-            {
-                const Task::State oldState = task->mState.exchange(Task::State::Finished);
-                assert(Task::State::Executing == oldState); // Task is expected to be in 'Executing' state
-                (void)oldState;
-            }
+        if (!thread->mStarted)
+        {
+            break;
         }
-        else
+
+        // wait for new task
         {
-            // Queued -> Finished
+            std::unique_lock<std::mutex> lock(mSleepMutex);
+            mNumSleepingThreads++;
+            mSleepCV.wait(lock, [&]() { return mWorkEpoch.load() != workEpoch || !thread->mStarted; });
+            mNumSleepingThreads--;
+        }
+    }
 
-            const Task::State oldState = task->mState.exchange(Task::State::Finished);
+    t_workerPool = nullptr;
+}
+
+void ThreadPool::ExecuteTask(TaskContext& context)
+{
+    Task* task = &mTasks[context.taskId];
+
+    if (task->mCallback)
+    {
+        // Queued -> Executing
+        {
+            const Task::State oldState = task->mState.exchange(Task::State::Executing);
             assert(Task::State::Queued == oldState); // Task is expected to be in 'Queued' state
             (void)oldState;
         }
 
-        FinishTask(context.taskId);
+        MTR_BEGIN("Task", task->mDebugName);
+
+        // execute
+        task->mCallback(context);
+
+        MTR_END("Task", task->mDebugName);
+
+        // Executing -> Finished
+        {
+            const Task::State oldState = task->mState.exchange(Task::State::Finished);
+            assert(Task::State::Executing == oldState); // Task is expected to be in 'Executing' state
+            (void)oldState;
+        }
+    }
+    else
+    {
+        // Queued -> Finished
+
+        const Task::State oldState = task->mState.exchange(Task::State::Finished);
+        assert(Task::State::Queued == oldState); // Task is expected to be in 'Queued' state
+        (void)oldState;
     }
+
+    FinishTask(context.taskId);
 }
 
 void ThreadPool::FinishTask(TaskID taskID)
@@ -215,38 +599,33 @@ void ThreadPool::FinishTask(TaskID taskID)
     // Note: loop instead of recursion to avoid stack overflow in case of long dependency chains
     while (taskToFinish != InvalidTaskID)
     {
-        TaskID parentTask;
-        Waitable* waitable = nullptr;
+        Task& task = mTasks[taskToFinish];
 
+        const int32_t tasksLeft = --task.mTasksLeft;
+        assert(tasksLeft >= 0); // Tasks counter underflow
+        if (tasksLeft > 0)
         {
-            // TODO lockless
-            std::unique_lock<std::mutex> lock(mTaskListMutex);
-
-            Task& task = mTasks[taskToFinish];
-
-            parentTask = task.mParent;
-            waitable = task.mWaitable;
+            return;
+        }
 
-            const int32_t tasksLeft = --task.mTasksLeft;
-            assert(tasksLeft >= 0); // Tasks counter underflow
-            if (tasksLeft > 0)
-            {
-                return;
-            }
+        // the last finished subtask owns the task now
+        const TaskID parentTask = task.mParent;
+        Waitable* waitable = task.mWaitable;
 
-            // notify about fullfilling the dependency
+        // notify about fullfilling the dependency
+        {
+            TaskID dependentID = task.mHead.exchange(ClosedListTaskID, std::memory_order_acq_rel);
+            while (dependentID != InvalidTaskID)
             {
-                TaskID siblingID = task.mHead;
-                while (siblingID != InvalidTaskID)
-                {
-                    OnTaskDependencyFullfilled_NoLock(siblingID);
-                    siblingID = mTasks[siblingID].mSibling;
-                }
+                // read the link first, the dependent task may get executed and freed right after it's enqueued
+                const TaskID nextDependentID = mTasks[dependentID].mSibling;
+                OnTaskDependencyFullfilled(dependentID);
+                dependentID = nextDependentID;
             }
-
-            FreeTask_NoLock(taskToFinish);
         }
 
+        FreeTask(taskToFinish);
+
         // notify waitable object
         if (waitable)
         {
@@ -258,7 +637,7 @@ void ThreadPool::FinishTask(TaskID taskID)
     }
 }
 
-void ThreadPool::EnqueueTaskInternal_NoLock(TaskID taskID)
+void ThreadPool::EnqueueTaskInternal(TaskID taskID)
 {
     Task& task = mTasks[taskID];
 
@@ -267,15 +646,41 @@ void ThreadPool::EnqueueTaskInternal_NoLock(TaskID taskID)
     assert((Task::Flag_IsDispatched | Task::Flag_DependencyFullfilled) == task.mDependencyState);
     (void)oldState;
 
-    // push to queue
+    // push to queue: workers use their own queue, other threads the shared external one
+    // tasks with node affinity go to worker's own queue only if the worker is on that node
+    const bool isWorker = t_workerPool == this;
+    if (task.mNode == AnyNode)
     {
-        std::unique_lock<std::mutex> lock(mTasksQueueMutex);
-        mTasksQueues[task.mPriority].push_back(taskID);
-        mTaskQueueCV.notify_all();
+        if (isWorker)
+        {
+            mWorkerQueues[t_workerId * NumPriorities + task.mPriority]->Push(taskID);
+        }
+        else
+        {
+            mExternalQueue.Push(taskID, task.mPriority);
+        }
+
+        NotifyWorkers();
+    }
+    else
+    {
+        const uint32_t node = task.mNode % GetNumNodes();
+        if (isWorker && mWorkerNodes[t_workerId] == node)
+        {
+            mWorkerQueues[t_workerId * NumPriorities + task.mPriority]->Push(taskID);
+            NotifyWorkers();
+        }
+        else
+        {
+            mNodeQueues[node]->Push(taskID, task.mPriority);
+
+            // the woken worker has to be on the right node
+            NotifyWorkers(GetNumNodes() > 1);
+        }
     }
 }
 
-void ThreadPool::FreeTask_NoLock(TaskID taskID)
+void ThreadPool::FreeTask(TaskID taskID)
 {
     assert(taskID < mTasks.size());
 
@@ -285,26 +690,43 @@ void ThreadPool::FreeTask_NoLock(TaskID taskID)
     assert(Task::State::Finished == oldState); // Task is expected to be in 'Finished' state
     (void)oldState;
 
-    task.mNextFree = mFirstFreeTask;
-    mFirstFreeTask = taskID;
+    // push to the free list, the tag is bumped on every change so a stale head can't be swapped in (ABA problem)
+    uint64_t head = mFreeTasksHead.load(std::memory_order_relaxed);
+    uint64_t newHead;
+    do
+    {
+        task.mNextFree.store(static_cast<TaskID>(head), std::memory_order_relaxed);
+        newHead = (((head >> 32) + 1) << 32) | taskID;
+    } while (!mFreeTasksHead.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed));
 }
 
-TaskID ThreadPool::AllocateTask_NoLock()
+TaskID ThreadPool::AllocateTask()
 {
-    if (mFirstFreeTask == InvalidTaskID)
+    uint64_t head = mFreeTasksHead.load(std::memory_order_acquire);
+    TaskID taskID;
+    for (;;)
     {
-        return InvalidTaskID;
+        taskID = static_cast<TaskID>(head);
+        if (taskID == InvalidTaskID)
+        {
+            return InvalidTaskID;
+        }
+
+        // the task may be allocated by another thread in the meantime, then the CAS fails
+        const TaskID nextFree = mTasks[taskID].mNextFree.load(std::memory_order_relaxed);
+        const uint64_t newHead = (((head >> 32) + 1) << 32) | nextFree;
+        if (mFreeTasksHead.compare_exchange_weak(head, newHead, std::memory_order_acquire, std::memory_order_acquire))
+        {
+            break;
+        }
     }
 
-    Task& task = mTasks[mFirstFreeTask];
+    Task& task = mTasks[taskID];
 
     const Task::State oldState = task.mState.exchange(Task::State::Queued);
     assert(Task::State::Invalid == oldState); // Task is expected to be in 'Invalid' state
     (void)oldState;
 
-    TaskID newNextFree = task.mNextFree;
-    TaskID taskID = mFirstFreeTask;
-    mFirstFreeTask = newNextFree;
     return taskID;
 }
 
@@ -312,10 +734,7 @@ TaskID ThreadPool::CreateTask(const TaskDesc& desc)
 {
     assert(desc.priority < NumPriorities);
 
-    // TODO lockless
-    std::unique_lock<std::mutex> lock(mTaskListMutex);
-
-    TaskID taskID = AllocateTask_NoLock();
+    TaskID taskID = AllocateTask();
     assert(taskID != InvalidTaskID);
 
     if (taskID == InvalidTaskID)
@@ -327,6 +746,7 @@ TaskID ThreadPool::CreateTask(const TaskDesc& desc)
     task.Reset();
     task.mDependencyState = 0;
     task.mPriority = desc.priority;
+    task.mNode = desc.node;
     task.mTasksLeft = 1;
     task.mCallback = desc.function;
     task.mParent = desc.parent;
@@ -350,21 +770,16 @@ TaskID ThreadPool::CreateTask(const TaskDesc& desc)
 
         assert(Task::State::Invalid != dependency.mState); // Invalid state of dependency task
 
-        //NFE_SCOPED_LOCK(mFinishedTasksMutex); // TODO: how to get rid of it?
-        if (dependency.mTasksLeft > 0)
+        // push to dependency list, unless the dependency has finished and closed the list already
+        TaskID head = dependency.mHead.load(std::memory_order_relaxed);
+        while (head != ClosedListTaskID)
         {
-            // update dependency list
-            if (dependency.mTail != InvalidTaskID)
+            task.mSibling = head;
+            if (dependency.mHead.compare_exchange_weak(head, taskID, std::memory_order_release, std::memory_order_relaxed))
             {
-                mTasks[dependency.mTail].mSibling = taskID;
-            }
-            else
-            {
-                dependency.mHead = taskID;
+                dependencyFullfilled = false;
+                break;
             }
-
-            dependency.mTail = taskID;
-            dependencyFullfilled = false;
         }
     }
 
@@ -380,9 +795,6 @@ void ThreadPool::DispatchTask(TaskID taskID)
 {
     assert(taskID != InvalidTaskID);
 
-    // TODO lockless
-    std::unique_lock<std::mutex> lock(mTaskListMutex);
-
     Task& task = mTasks[taskID];
 
     assert(Task::State::Created == task.mState); // Task is expected to be in 'Created' state
@@ -394,11 +806,11 @@ void ThreadPool::DispatchTask(TaskID taskID)
     // can enqueue only if not dispatched yet, but dependency was fullfilled
     if (Task::Flag_DependencyFullfilled == oldDependencyState)
     {
-        EnqueueTaskInternal_NoLock(taskID);
+        EnqueueTaskInternal(taskID);
     }
 }
 
-void ThreadPool::OnTaskDependencyFullfilled_NoLock(TaskID taskID)
+void ThreadPool::OnTaskDependencyFullfilled(TaskID taskID)
 {
     assert(taskID != InvalidTaskID);
 
@@ -413,7 +825,7 @@ void ThreadPool::OnTaskDependencyFullfilled_NoLock(TaskID taskID)
     // can enqueue only if was dispatched
     if (Task::Flag_IsDispatched == oldDependencyState)
     {
-        EnqueueTaskInternal_NoLock(taskID);
+        EnqueueTaskInternal(taskID);
     }
 }
 
@@ -492,7 +904,7 @@ void TaskBuilder::Fence(Waitable* waitable)
     mDependencyTask = dependency;
 }
 
-void TaskBuilder::Task(const char* debugName, const TaskFunction& func, uint8_t priority)
+void TaskBuilder::Task(const char* debugName, const TaskFunction& func, uint8_t priority, uint32_t node)
 {
     ThreadPool& tp = ThreadPool::GetInstance();
 
@@ -502,6 +914,7 @@ void TaskBuilder::Task(const char* debugName, const TaskFunction& func, uint8_t
     desc.parent = mParentTask;
     desc.dependency = mDependencyTask;
     desc.priority = priority;
+    desc.node = node;
 
     TaskID taskID = tp.CreateTask(desc);
     mPendingTasks[mNumPendingTasks++] = taskID;
@@ -521,6 +934,32 @@ void TaskBuilder::CustomTask(TaskID customTask)
 }
 
 void TaskBuilder::ParallelFor(const char* debugName, uint32_t arraySize, const ParallelForTaskFunction& func, uint32_t maxThread)
+{
+    ParallelForInternal(debugName, arraySize, func, maxThread, false);
+}
+
+void TaskBuilder::ParallelForPerNode(const char* debugName, uint32_t arraySize, const ParallelForTaskFunction& func)
+{
+    ParallelForInternal(debugName, arraySize, func, 0, true);
+}
+
+void TaskBuilder::GetNodeRange(uint32_t arraySize, uint32_t node, uint32_t& outBegin, uint32_t& outEnd)
+{
+    const ThreadPool& tp = ThreadPool::GetInstance();
+    ASSERT(node < tp.GetNumNodes());
+
+    uint32_t numWorkersBefore = 0;
+    for (uint32_t i = 0; i < node; ++i)
+    {
+        numWorkersBefore += tp.GetNumNodeWorkers(i);
+    }
+
+    const uint64_t numThreads = std::max(1u, tp.GetNumThreads());
+    outBegin = static_cast<uint32_t>(uint64_t(arraySize) * numWorkersBefore / numThreads);
+    outEnd = static_cast<uint32_t>(uint64_t(arraySize) * (numWorkersBefore + tp.GetNumNodeWorkers(node)) / numThreads);
+}
+
+void TaskBuilder::ParallelForInternal(const char* debugName, uint32_t arraySize, const ParallelForTaskFunction& func, uint32_t maxThread, bool perNode)
 {
     ThreadPool& tp = ThreadPool::GetInstance();
 
@@ -537,65 +976,95 @@ void TaskBuilder::ParallelFor(const char* debugName, uint32_t arraySize, const P
     TaskID parallelForTask = tp.CreateTask(desc);
     mPendingTasks[mNumPendingTasks++] = parallelForTask;
 
-    const uint32_t numThreads = std::thread::hardware_concurrency();
-    uint32_t numTasksToSpawn = std::min(arraySize, numThreads);
-
-    if (maxThread > 1)
-    {
-        numTasksToSpawn = std::min(numThreads, maxThread);
-    }
-
     struct alignas(64) ThreadData
     {
         uint32_t elementOffset = 0; // base element
         uint32_t numElements = 0;
         std::atomic<uint32_t> counter = 0;
-        uint32_t threadDataIndex = 0;
+        uint32_t groupOffset = 0;   // the first thread data of the group (tasks only consume elements within own group)
+        uint32_t groupSize = 0;
+        uint32_t node = AnyNode;
 
         ThreadData() = default;
         ThreadData(const ThreadData & other)
             : elementOffset(other.elementOffset)
             , numElements(other.numElements)
             , counter(other.counter.load())
-            , threadDataIndex(other.threadDataIndex)
+            , groupOffset(other.groupOffset)
+            , groupSize(other.groupSize)
+            , node(other.node)
         {}
     };
 
     // TODO get rid of dynamic allocation, e.g. by using some kind of pool
     using ThreadDataPtr = std::shared_ptr<std::vector<ThreadData>>;
     ThreadDataPtr threadDataPtr = std::make_shared<std::vector<ThreadData>>();
-    threadDataPtr->resize(numThreads);
 
-    // subdivide work
+    // subdivide elements range [begin, end) evenly between 'numTasks' tasks
+    const auto subdivide = [&threadDataPtr](uint32_t begin, uint32_t end, uint32_t numTasks, uint32_t node)
     {
+        const uint32_t groupOffset = static_cast<uint32_t>(threadDataPtr->size());
+        const uint32_t numElements = end - begin;
         uint32_t totalElements = 0;
-        for (uint32_t i = 0; i < numTasksToSpawn; ++i)
+        for (uint32_t i = 0; i < numTasks; ++i)
         {
-            ThreadData& threadData = (*threadDataPtr)[i];
-            threadData.numElements = (arraySize / numTasksToSpawn) + ((arraySize % numTasksToSpawn > i) ? 1 : 0);
-            threadData.elementOffset = totalElements;
-            ASSERT(threadData.numElements + threadData.elementOffset <= arraySize);
+            ThreadData& threadData = threadDataPtr->emplace_back();
+            threadData.numElements = (numElements / numTasks) + ((numElements % numTasks > i) ? 1 : 0);
+            threadData.elementOffset = begin + totalElements;
+            threadData.groupOffset = groupOffset;
+            threadData.groupSize = numTasks;
+            threadData.node = node;
+            ASSERT(threadData.numElements + threadData.elementOffset <= end);
             totalElements += threadData.numElements;
         }
-        ASSERT(totalElements == arraySize);
+        ASSERT(totalElements == numElements);
+    };
+
+    if (perNode)
+    {
+        for (uint32_t node = 0; node < tp.GetNumNodes(); ++node)
+        {
+            uint32_t begin, end;
+            GetNodeRange(arraySize, node, begin, end);
+            if (begin < end)
+            {
+                subdivide(begin, end, std::min(end - begin, tp.GetNumNodeWorkers(node)), node);
+            }
+        }
     }
+    else
+    {
+        const uint32_t numThreads = std::max(1u, tp.GetNumThreads());
+        uint32_t numTasksToSpawn = std::min(arraySize, numThreads);
 
+        if (maxThread > 1)
+        {
+            numTasksToSpawn = std::min(numTasksToSpawn, maxThread);
+        }
+
+        subdivide(0, arraySize, numTasksToSpawn, AnyNode);
+    }
+
+    const uint32_t numTasksToSpawn = static_cast<uint32_t>(threadDataPtr->size());
     for (uint32_t i = 0; i < numTasksToSpawn; ++i)
     {
+        const ThreadData& ownThreadData = (*threadDataPtr)[i];
+
         TaskDesc subTaskDesc;
         subTaskDesc.debugName = debugName;
         subTaskDesc.parent = parallelForTask;
         subTaskDesc.dependency = mDependencyTask;
-        subTaskDesc.function = [func, threadDataPtr, numTasksToSpawn, arraySize](const TaskContext& context)
+        subTaskDesc.node = ownThreadData.node;
+        subTaskDesc.function = [func, threadDataPtr, i, perNode, arraySize](const TaskContext& context)
         {
-            // consume elements assigned to each thread (starting from self)
-            for (uint32_t threadDataOffset = 0; threadDataOffset < numTasksToSpawn; ++threadDataOffset)
+            const uint32_t groupOffset = (*threadDataPtr)[i].groupOffset;
+            const uint32_t groupSize = (*threadDataPtr)[i].groupSize;
+
+            // consume elements assigned to each thread of the group (starting from self)
+            const uint32_t startIndex = perNode ? (i - groupOffset) : context.threadId;
+            for (uint32_t threadDataOffset = 0; threadDataOffset < groupSize; ++threadDataOffset)
             {
-                uint32_t threadDataIndex = context.threadId + threadDataOffset;
-                if (threadDataIndex >= numTasksToSpawn)
-                {
-                    threadDataIndex -= numTasksToSpawn;
-                }
+                const uint32_t threadDataIndex = groupOffset + (startIndex + threadDataOffset) % groupSize;
 
                 ThreadData& threadData = (*threadDataPtr)[threadDataIndex];
 
@@ -9,6 +9,7 @@
 #include <memory>
 #include <vector>
 #include <deque>
+#include <string>
 
 class Waitable;
 
@@ -23,6 +24,23 @@ using TaskID = uint32_t;
 
 static constexpr TaskID InvalidTaskID = UINT32_MAX;
 
+// task affinity hint meaning "run on any NUMA node"
+static constexpr uint32_t AnyNode = UINT32_MAX;
+
+/**
+ * Worker threads pinning policy.
+ */
+enum class ThreadPinning : uint8_t
+{
+    None,       // not pinned, workers are still split into contiguous blocks per NUMA node for task affinity
+    Compact,    // one worker per logical processor, fill NUMA nodes one after another
+    Scatter,    // one worker per logical processor, NUMA nodes assigned round-robin
+    Node,       // workers split into contiguous blocks per NUMA node, each can run on any processor of its node
+};
+
+const char* ThreadPinningToString(ThreadPinning pinning);
+bool ThreadPinningFromString(const std::string& str, ThreadPinning& outPinning);
+
 /**
  * Task execution context.
  */
@@ -30,6 +48,7 @@ struct TaskContext
 {
     ThreadPool* pool;
     uint32_t threadId;  // thread ID (counted from 0)
+    uint32_t node;      // NUMA node the worker thread is assigned to (counted from 0, see ThreadPool::GetNumNodes)
     TaskID taskId;      // this task ID
 };
 
@@ -59,6 +78,11 @@ struct TaskDesc
     // Valid range is 0...(ThreadPool::NumPriorities-1)
     uint8_t priority = 1;
 
+    // Preferred NUMA node (affinity hint)
+    // Such task is executed by a worker assigned to the node unless other workers would otherwise go idle.
+    // Values above ThreadPool::GetNumNodes() are wrapped around.
+    uint32_t node = AnyNode;
+
     const char* debugName = nullptr;
 
     // TODO limiting number of parallel running tasks of certain type
@@ -100,11 +124,10 @@ public:
     // If reaches 0, then whole task is considered as finished.
     std::atomic<int32_t> mTasksLeft;
 
-    union
-    {
-        TaskID mParent;
-        TaskID mNextFree;   //< free tasks list
-    };
+    TaskID mParent;
+
+    // free tasks list (lock-free stack), accessed concurrently with the allocation
+    std::atomic<TaskID> mNextFree;
 
     // optional waitable object (it gets notified in the task is finished)
     Waitable* mWaitable;
@@ -112,13 +135,14 @@ public:
     const char* mDebugName;
 
     // Dependency pointers:
-    TaskID mDependency;  //< dependency tasks ID
-    TaskID mHead;        //< the first task that is dependent on this task
-    TaskID mTail;        //< the last task that is dependent on this task
-    TaskID mSibling;     //< the next task that is dependent on the same "mDependency" task
+    TaskID mDependency;             //< dependency tasks ID
+    std::atomic<TaskID> mHead;      //< the first task that is dependent on this task (lock-free list)
+    TaskID mSibling;                //< the next task that is dependent on the same "mDependency" task
 
     uint8_t mPriority;
 
+    uint32_t mNode;
+
     // TODO: alignment
 
     Task();
@@ -126,6 +150,44 @@ public:
     void Reset();
 };
 
+// Chase-Lev work stealing deque of task IDs.
+// The owning worker pushes and pops tasks at the bottom (LIFO), other threads steal from the top (FIFO).
+// The ring buffer grows when full, old buffers are kept until the queue is destroyed as thieves may still read them.
+class WorkStealingQueue
+{
+public:
+    explicit WorkStealingQueue(uint32_t initialCapacity = 1024);
+
+    // owner thread only
+    void Push(TaskID taskID);
+
+    // owner thread only
+    bool Pop(TaskID& outTaskID);
+
+    // any thread
+    bool Steal(TaskID& outTaskID);
+
+    bool IsEmpty() const;
+
+private:
+    struct Buffer
+    {
+        int64_t mask;
+        std::unique_ptr<std::atomic<TaskID>[]> items;
+
+        explicit Buffer(int64_t capacity);
+        TaskID Get(int64_t index) const { return items[index & mask].load(std::memory_order_relaxed); }
+        void Put(int64_t index, TaskID taskID) { items[index & mask].store(taskID, std::memory_order_relaxed); }
+    };
+
+    Buffer* Grow(Buffer* buffer, int64_t top, int64_t bottom);
+
+    alignas(CACHELINE_SIZE) std::atomic<int64_t> mTop;
+    alignas(CACHELINE_SIZE) std::atomic<int64_t> mBottom;
+    std::atomic<Buffer*> mBuffer;
+    std::vector<std::unique_ptr<Buffer>> mBuffers; // current and retired buffers
+};
+
 // Thread pool's worker thread
 class WorkerThread
 {
@@ -133,10 +195,12 @@ class WorkerThread
 
     std::thread mThread;
     uint32_t mId;                     // thread number
+    uint32_t mNode;                   // NUMA node the thread is assigned to
+    uint32_t mProcessor;              // logical processor the thread is pinned to (if pinned to single processor)
     std::atomic<bool> mStarted;     // if set to false, exit the thread
 
 public:
-    WorkerThread(ThreadPool* pool, uint32_t id);
+    WorkerThread(ThreadPool* pool, uint32_t id, uint32_t node, uint32_t processor);
     ~WorkerThread();
 };
 
@@ -178,6 +242,25 @@ public:
 
     uint32_t GetNumThreads() const { return static_cast<uint32_t>(mThreads.size()); }
 
+    // Restart the pool with a different number of worker threads.
+    // NOTE No tasks can be in flight and per-thread data sized with GetNumThreads() must be recreated afterwards.
+    void SetNumThreads(uint32_t numThreads);
+
+    // Restart worker threads with given pinning policy, also picks up NUMA topology if it was not known before.
+    // NOTE No tasks can be in flight and per-thread data sized with GetNumThreads() must be recreated afterwards.
+    void Restart(uint32_t numThreads, ThreadPinning pinning);
+
+    ThreadPinning GetThreadPinning() const { return mPinning; }
+
+    // number of NUMA nodes the worker threads are spread over
+    uint32_t GetNumNodes() const { return static_cast<uint32_t>(mNodeQueues.size()); }
+
+    // NUMA node a given worker thread is assigned to
+    uint32_t GetWorkerNode(uint32_t threadId) const { return mWorkerNodes[threadId]; }
+
+    // number of worker threads assigned to a given NUMA node
+    uint32_t GetNumNodeWorkers(uint32_t node) const { return mNodeQueues[node]->mNumWorkers; }
+
 private:
 
     ThreadPool(const ThreadPool&) = delete;
@@ -185,28 +268,63 @@ private:
 
     void SchedulerCallback(WorkerThread* thread);
 
-    TaskID AllocateTask_NoLock();
-    void FreeTask_NoLock(TaskID taskID);
+    // queue for tasks enqueued from outside of the workers that should run on a given node (or any node)
+    struct SharedQueue
+    {
+        std::mutex mMutex;
+        std::deque<TaskID> mTasks[NumPriorities];
+        std::atomic<uint32_t> mNumTasks = 0;
+        uint32_t mNumWorkers = 0;
+
+        void Push(TaskID taskID, uint8_t priority);
+        bool TryPop(uint8_t priority, TaskID& outTaskID);
+    };
+
+    // pop a task from own queues, then the node's and external queues, then steal from workers on the same node,
+    // then from other nodes (higher priority first)
+    bool TryGetTask(uint32_t threadId, TaskID& outTaskID);
+    void ExecuteTask(TaskContext& context);
+
+    TaskID AllocateTask();
+    void FreeTask(TaskID taskID);
     void FinishTask(TaskID taskID);
-    void EnqueueTaskInternal_NoLock(TaskID taskID);
-    void OnTaskDependencyFullfilled_NoLock(TaskID taskID);
+    void EnqueueTaskInternal(TaskID taskID);
+    void OnTaskDependencyFullfilled(TaskID taskID);
+    void NotifyWorkers(bool all = false);
 
-    // create "num" additional worker threads
+    // create "num" worker threads assigned to NUMA nodes according to the pinning policy
     void SpawnWorkerThreads(uint32_t num);
+    void StopWorkerThreads();
 
     bool InitTasksTable(uint32_t newSize);
 
     // Worker threads variables:
     std::vector<WorkerThreadPtr> mThreads;
 
-    // queues for tasks with "Queued" state
-    std::deque<TaskID> mTasksQueues[NumPriorities];
-    std::mutex mTasksQueueMutex;                 //< lock for "mTasksQueue" access
-    std::condition_variable mTaskQueueCV;         //< CV for notifying about a new task in the queue
+    // NUMA node of each worker thread
+    std::vector<uint32_t> mWorkerNodes;
+
+    // per-worker queues for tasks with "Queued" state, indexed with [threadId * NumPriorities + priority]
+    std::vector<std::unique_ptr<WorkStealingQueue>> mWorkerQueues;
+
+    ThreadPinning mPinning = ThreadPinning::None;
+
+    // queue for tasks with no affinity enqueued by threads outside of the pool
+    SharedQueue mExternalQueue;
+
+    // queues for tasks with node affinity that couldn't be pushed to a worker's queue on that node
+    std::vector<std::unique_ptr<SharedQueue>> mNodeQueues;
 
-    std::mutex mTaskListMutex;
-    std::vector<Task> mTasks; // TODO growable fixed-size allocator
-    TaskID mFirstFreeTask;
+    // idle workers sleep until the work epoch changes
+    std::mutex mSleepMutex;
+    std::condition_variable mSleepCV;
+    std::atomic<uint32_t> mNumSleepingThreads;
+    std::atomic<uint64_t> mWorkEpoch;
+
+    std::vector<Task> mTasks;
+
+    // head of free tasks list: task ID in lower 32 bits, ABA tag in upper 32 bits
+    std::atomic<uint64_t> mFreeTasksHead;
 };
 
 // helper class that allows easy task-graph building
@@ -222,7 +340,7 @@ public:
 
     // push a new task
     // Note: multiple pushed tasks can run in parallel
-    void Task(const char* debugName, const TaskFunction& func, uint8_t priority = 1);
+    void Task(const char* debugName, const TaskFunction& func, uint8_t priority = 1, uint32_t node = AnyNode);
 
     // Push a custom task
     // Note: The task must be created, but not yet dispatched
@@ -231,6 +349,13 @@ public:
     // push parallel-for task
     void ParallelFor(const char* debugName, uint32_t arraySize, const ParallelForTaskFunction& func, uint32_t maxThread = 0);
 
+    // push parallel-for task with the array split into contiguous ranges, one per NUMA node (see GetNodeRange)
+    // Elements of a range are processed by tasks with affinity to its node, so node-local data stays node-local.
+    void ParallelForPerNode(const char* debugName, uint32_t arraySize, const ParallelForTaskFunction& func);
+
+    // range of array elements assigned to a given NUMA node by ParallelForPerNode (proportional to the node's worker count)
+    static void GetNodeRange(uint32_t arraySize, uint32_t node, uint32_t& outBegin, uint32_t& outEnd);
+
     // Push a sync point
     // All tasks pushed after the fence will start only when all the tasks pushed before the fence finish execution
     // Optionally signals waitable object
@@ -245,6 +370,8 @@ private:
     void* operator new(size_t size, void* ptr) = delete;
     void* operator new[](size_t size, void* ptr) = delete;
 
+    void ParallelForInternal(const char* debugName, uint32_t arraySize, const ParallelForTaskFunction& func, uint32_t maxThread, bool perNode);
+
     Waitable* mWaitable = nullptr;
     const TaskID mParentTask = InvalidTaskID;
     TaskID mDependencyTask = InvalidTaskID;
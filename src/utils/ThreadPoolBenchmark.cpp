@@ -0,0 +1,167 @@
+#include "Common.hpp"
+#include "ThreadPool.hpp"
+
+#include "../backend/Waitable.hpp"
+#include "../backend/Time.hpp"
+
+#include <atomic>
+#include <sstream>
+#include <iomanip>
+
+using namespace threadpool;
+
+// Measures the thread pool scheduling overhead:
+// - empty tasks dispatched from the main thread (external submission path)
+// - empty tasks spawned from inside tasks (worker-local queues and stealing)
+// - latency of a ParallelFor with one element per thread (dispatch + join)
+// - per-element cost of a ParallelFor over a big array with an empty body
+
+static std::atomic<uint64_t> s_counter = 0;
+
+// run 'passFunc' until 'minTime' seconds elapse, returns number of operations per second
+template<typename PassFunc>
+static double MeasureRate(float minTime, uint64_t numOpsPerPass, const PassFunc& passFunc)
+{
+    uint64_t numOps = 0;
+    const TimePoint startTime = TimePoint::GetCurrent();
+    float elapsedTime = 0.0f;
+    do
+    {
+        passFunc();
+        numOps += numOpsPerPass;
+        elapsedTime = (TimePoint::GetCurrent() - startTime).ToSeconds();
+    } while (elapsedTime < minTime);
+
+    return numOps / std::max(1.0e-6, static_cast<double>(elapsedTime));
+}
+
+static void RunSchedulerBenchmarks(float minTime)
+{
+    const uint32_t numThreads = ThreadPool::GetInstance().GetNumThreads();
+
+    // main thread submits tasks in batches that fit in a TaskBuilder
+    const uint32_t numTasksPerBatch = TaskBuilder::MaxTasks / 2;
+    const double externalTasksRate = MeasureRate(minTime, numTasksPerBatch, [&]()
+    {
+        Waitable waitable;
+        {
+            TaskBuilder taskBuilder(waitable);
+            for (uint32_t i = 0; i < numTasksPerBatch; ++i)
+            {
+                taskBuilder.Task("Empty", [](const TaskContext&) { s_counter++; });
+            }
+        }
+        waitable.Wait();
+    });
+
+    // every worker spawns a batch of subtasks
+    const uint32_t numSpawningTasks = numThreads;
+    const uint32_t numSubtasks = 1024;
+    const double workerTasksRate = MeasureRate(minTime, uint64_t(numSpawningTasks) * numSubtasks, [&]()
+    {
+        Waitable waitable;
+        {
+            TaskBuilder taskBuilder(waitable);
+            taskBuilder.ParallelFor("Spawn", numSpawningTasks, [&](const TaskContext& context, uint32_t)
+            {
+                TaskBuilder subtaskBuilder{ context };
+                for (uint32_t i = 0; i < numSubtasks; ++i)
+                {
+                    subtaskBuilder.Task("Empty", [](const TaskContext&) { s_counter++; });
+                }
+            });
+        }
+        waitable.Wait();
+    });
+
+    const double parallelForRate = MeasureRate(minTime, 1, [&]()
+    {
+        Waitable waitable;
+        {
+            TaskBuilder taskBuilder(waitable);
+            taskBuilder.ParallelFor("Empty", numThreads, [](const TaskContext&, uint32_t) { s_counter++; });
+        }
+        waitable.Wait();
+    });
+
+    const uint32_t numElements = 1024 * 1024;
+    const double parallelForElementsRate = MeasureRate(minTime, numElements, [&]()
+    {
+        Waitable waitable;
+        {
+            TaskBuilder taskBuilder(waitable);
+            taskBuilder.ParallelFor("Empty", numElements, [](const TaskContext&, uint32_t) { s_counter++; });
+        }
+        waitable.Wait();
+    });
+
+    const double parallelForPerNodeElementsRate = MeasureRate(minTime, numElements, [&]()
+    {
+        Waitable waitable;
+        {
+            TaskBuilder taskBuilder(waitable);
+            taskBuilder.ParallelForPerNode("Empty", numElements, [](const TaskContext&, uint32_t) { s_counter++; });
+        }
+        waitable.Wait();
+    });
+
+    std::cout << std::setw(8) << numThreads
+        << std::setw(8) << ThreadPool::GetInstance().GetNumNodes()
+        << std::setw(16) << static_cast<uint64_t>(externalTasksRate)
+        << std::setw(16) << static_cast<uint64_t>(workerTasksRate)
+        << std::setw(16) << (1.0e6 / parallelForRate)
+        << std::setw(16) << (1.0e9 / parallelForElementsRate)
+        << std::setw(16) << (1.0e9 / parallelForPerNodeElementsRate)
+        << std::endl;
+}
+
+void RunThreadPoolBenchmark(const std::vector<std::string>& args)
+{
+    std::vector<uint32_t> threadCounts;
+    float minTime = 1.0f;
+
+    for (size_t i = 0; i + 1 < args.size(); i += 2)
+    {
+        if (args[i] == "threads")
+        {
+            // comma separated list
+            std::stringstream ss(args[i + 1]);
+            std::string token;
+            while (std::getline(ss, token, ','))
+            {
+                threadCounts.push_back(std::max(1, atoi(token.c_str())));
+            }
+        }
+        else if (args[i] == "time")
+        {
+            minTime = std::max(0.01f, static_cast<float>(atof(args[i + 1].c_str())));
+        }
+    }
+
+    if (threadCounts.empty())
+    {
+        threadCounts = { 8, 16, 32, 64, 128 };
+    }
+
+    ThreadPool& threadPool = ThreadPool::GetInstance();
+    const uint32_t originalNumThreads = threadPool.GetNumThreads();
+
+    std::cout << "Hardware threads: " << std::thread::hardware_concurrency() << std::endl;
+    std::cout << "Pinning: " << ThreadPinningToString(threadPool.GetThreadPinning()) << std::endl;
+    std::cout << std::setw(8) << "threads"
+        << std::setw(8) << "nodes"
+        << std::setw(16) << "ext. tasks/s"
+        << std::setw(16) << "worker tasks/s"
+        << std::setw(16) << "ParFor us"
+        << std::setw(16) << "ParFor ns/elem"
+        << std::setw(16) << "node ns/elem"
+        << std::endl;
+
+    for (const uint32_t numThreads : threadCounts)
+    {
+        threadPool.SetNumThreads(numThreads);
+        RunSchedulerBenchmarks(minTime);
+    }
+
+    threadPool.SetNumThreads(originalNumThreads);
+}
@@ -8,6 +8,8 @@
 #include "../backend/NeuralNetworkEvaluator.hpp"
 
 #include <filesystem>
+#include <iomanip>
+#include <sstream>
 
 static_assert(sizeof(PositionEntry) == 32, "Invalid PositionEntry size");
 
@@ -23,19 +25,37 @@ bool TrainingDataLoader::Init(std::mt19937& gen, const std::string& trainingData
         auto fileStream = std::make_unique<FileInputStream>(fileName.c_str());
 
         uint64_t fileSize = fileStream->GetSize();
-        totalDataSize += fileSize;
+        uint64_t numEntries = fileSize / sizeof(PositionEntry);
 
-        if (fileStream->IsOpen() && fileSize > sizeof(PositionEntry))
+        // compressed files are weighted by the number of positions, not the file size
+        std::unique_ptr<TrainingDataFile::Reader> compressedFile;
+        if (fileStream->IsOpen() && TrainingDataFile::IsCompressedFile(fileName))
         {
+            compressedFile = std::make_unique<TrainingDataFile::Reader>();
+            numEntries = compressedFile->Open(*fileStream) && compressedFile->GetNumChunks() > 0 ? compressedFile->GetNumEntries() : 0;
+        }
+
+        if (fileStream->IsOpen() && numEntries > 0)
+        {
+            totalDataSize += numEntries * sizeof(PositionEntry);
+
             InputFileContext& ctx = mContexts.emplace_back();
             ctx.mutex = std::make_unique<std::mutex>();
             ctx.fileStream = std::move(fileStream);
+            ctx.compressedFile = std::move(compressedFile);
             ctx.fileName = fileName;
             ctx.fileSize = fileSize;
+            ctx.numEntries = numEntries;
 
             // Seek to random location so that each stream starts at different position.
+            if (ctx.compressedFile)
+            {
+                ctx.decodedChunk = std::make_unique<InputFileContext::DecodedChunk>();
+                std::uniform_int_distribution<uint32_t> distr(0, ctx.compressedFile->GetNumChunks() - 1);
+                ctx.decodedChunk->chunkIndex = distr(gen);
+            }
+            else
             {
-                const uint64_t numEntries = fileSize / sizeof(PositionEntry);
                 std::uniform_int_distribution<uint64_t> distr(0, numEntries - 1);
                 const uint64_t entryIndex = distr(gen);
                 ctx.fileStream->SetPosition(entryIndex * sizeof(PositionEntry));
@@ -105,10 +125,98 @@ bool TrainingDataLoader::FetchNextPosition(std::mt19937& gen, PositionEntry& out
     return mContexts[fileIndex].FetchNextPosition(gen, outEntry, outPosition, kingBucketMask);
 }
 
+// apply training data filtering rules to an entry, unpacks the position if accepted
+static bool AcceptEntry(std::mt19937& gen, float skippingProbability, const PositionEntry& entry, Position& outPosition, uint64_t kingBucketMask)
+{
+    // skip invalid scores
+    if (entry.score >= CheckmateValue || entry.score <= -CheckmateValue)
+        return false;
+
+    // skip positions with very high score and matching WDL score
+    const int32_t WdlSkippingThreshold = 2000;
+    if ((entry.score > WdlSkippingThreshold && entry.wdlScore == 1) ||
+        (entry.score < -WdlSkippingThreshold && entry.wdlScore == 2))
+        return false;
+
+    // constant skipping
+    {
+        std::bernoulli_distribution skippingDistr(skippingProbability);
+        if (skippingDistr(gen))
+            return false;
+    }
+
+    VERIFY(UnpackPosition(entry.pos, outPosition, false));
+    ASSERT(outPosition.IsValid());
+
+    // filter by king bucket
+    if (kingBucketMask != UINT64_MAX)
+    {
+        uint32_t whiteKingSide, blackKingSide;
+        uint32_t whiteKingBucket, blackKingBucket;
+        GetKingSideAndBucket(outPosition.Whites().GetKingSquare(), whiteKingSide, whiteKingBucket);
+        GetKingSideAndBucket(outPosition.Blacks().GetKingSquare().FlippedRank(), blackKingSide, blackKingBucket);
+
+        if ((((1ull << whiteKingBucket) & kingBucketMask) == 0ull) && (((1ull << blackKingBucket) & kingBucketMask) == 0ull))
+            return false;
+    }
+    else
+    {
+        // skip based on half-move counter
+        {
+            const float hmcSkipProb = sqrtf((float)entry.pos.halfMoveCount / 100.0f);
+            std::bernoulli_distribution skippingDistr(hmcSkipProb);
+            if (skippingDistr(gen))
+                return false;
+        }
+
+        const int32_t numPieces = entry.pos.occupied.Count();
+
+        // skip early moves
+        if (entry.pos.moveCount <= 12 && numPieces > 24)
+            return false;
+
+        // skip based on piece count
+        {
+            if (numPieces <= 3)
+                return false;
+
+            if (CheckInsufficientMaterial(outPosition))
+                return false;
+
+            // skip recognized endgames
+            int32_t endgameScore = 0;
+            if (EvaluateEndgame(outPosition, endgameScore))
+                return false;
+
+            const float pieceCountSkipProb = Sqr(static_cast<float>(numPieces - 22) / 30.0f);
+            if (pieceCountSkipProb > 0.0f && std::bernoulli_distribution(pieceCountSkipProb)(gen))
+                return false;
+        }
+    }
+
+    return true;
+}
+
 bool TrainingDataLoader::InputFileContext::FetchNextPosition(std::mt19937& gen, PositionEntry& outEntry, Position& outPosition, uint64_t kingBucketMask) const
 {
     for (;;)
     {
+        if (compressedFile)
+        {
+            std::scoped_lock lock(*mutex);
+            if (decodedChunk->cursor >= decodedChunk->entries.size())
+            {
+                decodedChunk->cursor = 0;
+                decodedChunk->chunkIndex %= compressedFile->GetNumChunks();
+                if (!compressedFile->ReadChunk(*fileStream, decodedChunk->chunkIndex++, decodedChunk->entries) || decodedChunk->entries.empty())
+                {
+                    std::cout << "ERROR: Failed to read from stream " << fileName << std::endl;
+                    return false;
+                }
+            }
+            outEntry = decodedChunk->entries[decodedChunk->cursor++];
+        }
+        else
         {
             std::scoped_lock lock(*mutex);
             if (!fileStream->Read(&outEntry, sizeof(PositionEntry)))
@@ -134,72 +242,526 @@ bool TrainingDataLoader::InputFileContext::FetchNextPosition(std::mt19937& gen,
             }
         }
 
-        // skip invalid scores
-        if (outEntry.score >= CheckmateValue || outEntry.score <= -CheckmateValue)
-            continue;
+        if (AcceptEntry(gen, skippingProbability, outEntry, outPosition, kingBucketMask))
+            return true;
+    }
+}
 
-        // skip positions with very high score and matching WDL score
-        const int32_t WdlSkippingThreshold = 2000;
-        if ((outEntry.score > WdlSkippingThreshold && outEntry.wdlScore == 1) ||
-            (outEntry.score < -WdlSkippingThreshold && outEntry.wdlScore == 2))
-            continue;
+FileInputStream* TrainingDataLoader::GetThreadFileStream(ThreadContext& threadContext, uint32_t fileIndex) const
+{
+    threadContext.numFileUses++;
 
-        // constant skipping
+    for (ThreadContext::OpenFile& openFile : threadContext.openFiles)
+    {
+        if (openFile.fileIndex == fileIndex)
         {
-            std::bernoulli_distribution skippingDistr(skippingProbability);
-            if (skippingDistr(gen))
-                continue;
+            openFile.lastUse = threadContext.numFileUses;
+            return openFile.stream.get();
+        }
+    }
+
+    // close the least recently used file if over this thread's share of the handles
+    const uint32_t maxOpenFiles = std::max(2u, MaxOpenFiles / threadpool::ThreadPool::GetInstance().GetNumThreads());
+    if (threadContext.openFiles.size() >= maxOpenFiles)
+    {
+        const auto leastRecentlyUsed = std::min_element(threadContext.openFiles.begin(), threadContext.openFiles.end(),
+            [](const ThreadContext::OpenFile& a, const ThreadContext::OpenFile& b) { return a.lastUse < b.lastUse; });
+        threadContext.openFiles.erase(leastRecentlyUsed);
+    }
+
+    ThreadContext::OpenFile openFile;
+    openFile.stream = std::make_unique<FileInputStream>(mContexts[fileIndex].fileName.c_str());
+    openFile.fileIndex = fileIndex;
+    openFile.lastUse = threadContext.numFileUses;
+
+    if (!openFile.stream->IsOpen())
+        return nullptr;
+
+    threadContext.openFiles.push_back(std::move(openFile));
+    return threadContext.openFiles.back().stream.get();
+}
+
+bool TrainingDataLoader::ReadBlock(ThreadContext& threadContext, std::mt19937& gen, ThreadContext::Block& block) const
+{
+    const uint32_t fileIndex = SampleInputFileIndex(std::uniform_real_distribution<double>()(gen));
+    ASSERT(fileIndex < mContexts.size());
+
+    if (fileIndex >= mContexts.size())
+        return false;
+
+    const InputFileContext& fileContext = mContexts[fileIndex];
+
+    // threads read through their own file handles, so they never share a file cursor
+    FileInputStream* fileStream = GetThreadFileStream(threadContext, fileIndex);
+
+    block.cursor = 0;
+    block.fileIndex = fileIndex;
+
+    // compressed files are read in whole chunks, shuffled as they contain consecutive positions of games
+    if (fileContext.compressedFile)
+    {
+        const uint32_t chunkIndex = std::uniform_int_distribution<uint32_t>(0, fileContext.compressedFile->GetNumChunks() - 1)(gen);
+        if (!fileStream || !fileContext.compressedFile->ReadChunk(*fileStream, chunkIndex, block.entries) || block.entries.empty())
+        {
+            std::cout << "ERROR: Failed to read from stream " << fileContext.fileName << std::endl;
+            block.entries.clear();
+            return false;
         }
 
-        VERIFY(UnpackPosition(outEntry.pos, outPosition, false));
-        ASSERT(outPosition.IsValid());
+        std::shuffle(block.entries.begin(), block.entries.end(), gen);
+        return true;
+    }
+
+    const uint64_t numEntriesInFile = fileContext.numEntries;
+    const uint64_t numEntries = std::min<uint64_t>(numEntriesInFile, BlockSize);
+    const uint64_t firstEntry = std::uniform_int_distribution<uint64_t>(0, numEntriesInFile - numEntries)(gen);
 
-        // filter by king bucket
-        if (kingBucketMask != UINT64_MAX)
+    block.entries.resize(numEntries);
+
+    if (!fileStream ||
+        !fileStream->SetPosition(firstEntry * sizeof(PositionEntry)) ||
+        !fileStream->Read(block.entries.data(), numEntries * sizeof(PositionEntry)))
+    {
+        std::cout << "ERROR: Failed to read from stream " << fileContext.fileName << std::endl;
+        block.entries.clear();
+        return false;
+    }
+
+    return true;
+}
+
+bool TrainingDataLoader::FetchNextPosition(ThreadContext& threadContext, std::mt19937& gen, PositionEntry& outEntry, Position& outPosition, uint64_t kingBucketMask) const
+{
+    if (threadContext.blocks.empty())
+    {
+        threadContext.blocks.resize(NumBlocksPerThread);
+    }
+
+    for (;;)
+    {
+        ThreadContext::Block& block = threadContext.blocks[std::uniform_int_distribution<uint32_t>(0, NumBlocksPerThread - 1)(gen)];
+
+        if (block.cursor >= block.entries.size())
+        {
+            if (!ReadBlock(threadContext, gen, block))
+                return false;
+        }
+
+        outEntry = block.entries[block.cursor++];
+        threadContext.numEntriesRead++;
+
+        if (AcceptEntry(gen, mContexts[block.fileIndex].skippingProbability, outEntry, outPosition, kingBucketMask))
         {
-            uint32_t whiteKingSide, blackKingSide;
-            uint32_t whiteKingBucket, blackKingBucket;
-            GetKingSideAndBucket(outPosition.Whites().GetKingSquare(), whiteKingSide, whiteKingBucket);
-            GetKingSideAndBucket(outPosition.Blacks().GetKingSquare().FlippedRank(), blackKingSide, blackKingBucket);
+            threadContext.numPositions++;
+            return true;
+        }
+    }
+}
+
+void TrainingDataLoader::PrintThreadStats(std::vector<ThreadContext>& threadContexts)
+{
+    uint64_t totalNumPositions = 0;
+
+    for (size_t i = 0; i < threadContexts.size(); ++i)
+    {
+        ThreadContext& ctx = threadContexts[i];
+        if (ctx.numPositions == 0)
+            continue;
+
+        std::cout
+            << "Thread " << std::setw(3) << i << ": "
+            << std::setw(10) << static_cast<uint64_t>(ctx.numPositions / std::max(1.0e-6f, ctx.samplingTime)) << " pos/sec ("
+            << (100 * ctx.numPositions / ctx.numEntriesRead) << "% accepted)" << std::endl;
+
+        totalNumPositions += ctx.numPositions;
+        ctx.numPositions = 0;
+        ctx.numEntriesRead = 0;
+        ctx.samplingTime = 0.0f;
+    }
+
+    std::cout << "Sampled positions: " << totalNumPositions << std::endl;
+}
+
+bool TrainingDataLoader::ReadStreamChunk(StreamContext& streamContext, std::vector<PositionEntry>& outEntries, uint64_t kingBucketMask) const
+{
+    outEntries.clear();
 
-            if ((((1ull << whiteKingBucket) & kingBucketMask) == 0ull) && (((1ull << blackKingBucket) & kingBucketMask) == 0ull))
-                continue;
+    if (mContexts.empty())
+        return false;
+
+    if (streamContext.numEntriesLeftInRun == 0 || !streamContext.fileStream)
+    {
+        // start streaming another file from a random position
+        streamContext.fileIndex = SampleInputFileIndex(std::uniform_real_distribution<double>()(streamContext.gen));
+        ASSERT(streamContext.fileIndex < mContexts.size());
+
+        const InputFileContext& fileContext = mContexts[streamContext.fileIndex];
+        streamContext.fileStream = std::make_unique<FileInputStream>(fileContext.fileName.c_str());
+
+        bool success = streamContext.fileStream->IsOpen();
+        if (fileContext.compressedFile)
+        {
+            streamContext.chunkIndex = std::uniform_int_distribution<uint32_t>(0, fileContext.compressedFile->GetNumChunks() - 1)(streamContext.gen);
+            streamContext.readBuffer.clear();
+            streamContext.readCursor = 0;
         }
         else
         {
-            // skip based on half-move counter
+            const uint64_t firstEntry = std::uniform_int_distribution<uint64_t>(0, fileContext.numEntries - 1)(streamContext.gen);
+            success = success && streamContext.fileStream->SetPosition(firstEntry * sizeof(PositionEntry));
+        }
+
+        if (!success)
+        {
+            std::cout << "ERROR: Failed to read from stream " << fileContext.fileName << std::endl;
+            return false;
+        }
+
+        streamContext.numEntriesLeftInRun = StreamRunLength;
+    }
+
+    const InputFileContext& fileContext = mContexts[streamContext.fileIndex];
+    FileInputStream& fileStream = *streamContext.fileStream;
+
+    const PositionEntry* entries = nullptr;
+    uint64_t numEntries = 0;
+
+    if (fileContext.compressedFile)
+    {
+        // decode whole chunks and consume them in parts
+        if (streamContext.readCursor >= streamContext.readBuffer.size())
+        {
+            streamContext.readCursor = 0;
+            streamContext.chunkIndex %= fileContext.compressedFile->GetNumChunks();
+            if (!fileContext.compressedFile->ReadChunk(fileStream, streamContext.chunkIndex++, streamContext.readBuffer) || streamContext.readBuffer.empty())
             {
-                const float hmcSkipProb = sqrtf((float)outEntry.pos.halfMoveCount / 100.0f);
-                std::bernoulli_distribution skippingDistr(hmcSkipProb);
-                if (skippingDistr(gen))
-                    continue;
+                std::cout << "ERROR: Failed to read from stream " << fileContext.fileName << std::endl;
+                return false;
             }
+        }
 
-            const int32_t numPieces = outEntry.pos.occupied.Count();
+        numEntries = std::min<uint64_t>({ BlockSize, streamContext.numEntriesLeftInRun, streamContext.readBuffer.size() - streamContext.readCursor });
+        entries = streamContext.readBuffer.data() + streamContext.readCursor;
+        streamContext.readCursor += numEntries;
+    }
+    else
+    {
+        const uint64_t currentEntry = fileStream.GetPosition() / sizeof(PositionEntry);
+        if (currentEntry >= fileContext.numEntries && !fileStream.SetPosition(0))
+        {
+            std::cout << "ERROR: Failed to read from stream " << fileContext.fileName << std::endl;
+            return false;
+        }
 
-            // skip early moves
-            if (outEntry.pos.moveCount <= 12 && numPieces > 24)
-                continue;
+        // don't read past the last complete entry, so the stream wraps around cleanly
+        numEntries = std::min<uint64_t>({ BlockSize, streamContext.numEntriesLeftInRun, fileContext.numEntries - fileStream.GetPosition() / sizeof(PositionEntry) });
 
-            // skip based on piece count
+        streamContext.readBuffer.resize(numEntries);
+        if (!fileStream.Read(streamContext.readBuffer.data(), numEntries * sizeof(PositionEntry)))
+        {
+            std::cout << "ERROR: Failed to read from stream " << fileContext.fileName << std::endl;
+            return false;
+        }
+
+        entries = streamContext.readBuffer.data();
+    }
+
+    streamContext.numEntriesLeftInRun -= numEntries;
+
+    Position pos;
+    for (uint64_t i = 0; i < numEntries; ++i)
+    {
+        if (AcceptEntry(streamContext.gen, fileContext.skippingProbability, entries[i], pos, kingBucketMask))
+        {
+            outEntries.push_back(entries[i]);
+        }
+    }
+
+    return true;
+}
+
+bool TrainingDataLoader::SaveStreamState(const StreamContext& streamContext, OutputStream& stream) const
+{
+    const std::string fileName = streamContext.fileStream ? mContexts[streamContext.fileIndex].fileName : std::string();
+    const uint64_t state[] =
+    {
+        streamContext.fileStream ? streamContext.fileStream->GetPosition() : 0,
+        streamContext.numEntriesLeftInRun,
+        streamContext.readCursor,
+        streamContext.fileIndex,
+        streamContext.chunkIndex,
+    };
+
+    return
+        WriteArray(stream, fileName) &&
+        stream.Write(state, sizeof(state)) &&
+        WriteArray(stream, streamContext.readBuffer) &&
+        WriteRandomGenerator(stream, streamContext.gen);
+}
+
+bool TrainingDataLoader::LoadStreamState(StreamContext& streamContext, InputStream& stream) const
+{
+    std::string fileName;
+    uint64_t state[5];
+    if (!ReadArray(stream, fileName) ||
+        !stream.Read(state, sizeof(state)) ||
+        !ReadArray(stream, streamContext.readBuffer) ||
+        !ReadRandomGenerator(stream, streamContext.gen))
+        return false;
+
+    streamContext.numEntriesLeftInRun = state[1];
+    streamContext.readCursor = static_cast<size_t>(state[2]);
+    streamContext.fileIndex = static_cast<uint32_t>(state[3]);
+    streamContext.chunkIndex = static_cast<uint32_t>(state[4]);
+    streamContext.fileStream.reset();
+
+    if (fileName.empty())
+    {
+        // no file was opened yet
+        return true;
+    }
+
+    if (streamContext.fileIndex >= mContexts.size() || mContexts[streamContext.fileIndex].fileName != fileName)
+    {
+        std::cout << "ERROR: Training file " << fileName << " is missing" << std::endl;
+        return false;
+    }
+
+    streamContext.fileStream = std::make_unique<FileInputStream>(fileName.c_str());
+    if (!streamContext.fileStream->IsOpen() || !streamContext.fileStream->SetPosition(state[0]))
+    {
+        std::cout << "ERROR: Failed to read from stream " << fileName << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+TrainingShuffleBuffer::~TrainingShuffleBuffer()
+{
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mStop = true;
+    }
+    mDrainedCV.notify_all();
+
+    for (std::thread& thread : mReaderThreads)
+    {
+        thread.join();
+    }
+}
+
+bool TrainingShuffleBuffer::Init(const TrainingDataLoader& loader, const Params& params)
+{
+    ASSERT(mReaderThreads.empty());
+
+    mLoader = &loader;
+    mParams = params;
+
+    const size_t capacity = static_cast<size_t>(static_cast<double>(params.sizeInGB) * 1024.0 * 1024.0 * 1024.0 / sizeof(PositionEntry));
+    if (capacity == 0)
+    {
+        std::cout << "ERROR: Shuffle buffer is too small" << std::endl;
+        return false;
+    }
+
+    mEntries.resize(capacity);
+    mSize = 0;
+    mIsWarmedUp = false;
+    mGen.seed(static_cast<std::mt19937::result_type>(params.seed));
+
+    if (params.numReaderThreads == 0)
+    {
+        std::seed_seq seedSequence{ static_cast<uint32_t>(params.seed), static_cast<uint32_t>(params.seed >> 32), 0u };
+        mSyncStream.gen.seed(seedSequence);
+    }
+
+    for (uint32_t i = 0; i < params.numReaderThreads; ++i)
+    {
+        mReaderThreads.emplace_back(&TrainingShuffleBuffer::ReaderThreadFunc, this, i);
+    }
+
+    std::cout << "Shuffle buffer: " << capacity << " entries, " << params.numReaderThreads << " reader threads, seed " << params.seed << std::endl;
+
+    return true;
+}
+
+void TrainingShuffleBuffer::ReaderThreadFunc(uint32_t readerIndex)
+{
+    TrainingDataLoader::StreamContext streamContext;
+    {
+        std::seed_seq seedSequence{ static_cast<uint32_t>(mParams.seed), static_cast<uint32_t>(mParams.seed >> 32), readerIndex + 1u };
+        streamContext.gen.seed(seedSequence);
+    }
+
+    std::vector<PositionEntry> chunk;
+    size_t chunkCursor = 0;
+
+    for (;;)
+    {
+        if (chunkCursor == chunk.size())
+        {
+            chunkCursor = 0;
+            if (!mLoader->ReadStreamChunk(streamContext, chunk, mParams.kingBucketMask))
             {
-                if (numPieces <= 3)
-                    continue;
+                std::unique_lock<std::mutex> lock(mMutex);
+                mFailed = true;
+                mFilledCV.notify_all();
+                return;
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mMutex);
+        mDrainedCV.wait(lock, [this]() { return mStop || mSize < mEntries.size(); });
+
+        if (mStop)
+            return;
 
-                if (CheckInsufficientMaterial(outPosition))
-                    continue;
+        const size_t numEntries = std::min(chunk.size() - chunkCursor, mEntries.size() - mSize);
+        std::copy(chunk.begin() + chunkCursor, chunk.begin() + chunkCursor + numEntries, mEntries.begin() + mSize);
+        mSize += numEntries;
+        chunkCursor += numEntries;
 
-                // skip recognized endgames
-                int32_t endgameScore = 0;
-                if (EvaluateEndgame(outPosition, endgameScore))
-                    continue;
+        lock.unlock();
+        mFilledCV.notify_one();
+    }
+}
+
+bool TrainingShuffleBuffer::RefillSynchronously()
+{
+    while (mSize < mEntries.size())
+    {
+        if (mSyncChunkCursor == mSyncChunk.size())
+        {
+            mSyncChunkCursor = 0;
+            if (!mLoader->ReadStreamChunk(mSyncStream, mSyncChunk, mParams.kingBucketMask))
+                return false;
+            continue;
+        }
+
+        const size_t numEntries = std::min(mSyncChunk.size() - mSyncChunkCursor, mEntries.size() - mSize);
+        std::copy(mSyncChunk.begin() + mSyncChunkCursor, mSyncChunk.begin() + mSyncChunkCursor + numEntries, mEntries.begin() + mSize);
+        mSize += numEntries;
+        mSyncChunkCursor += numEntries;
+    }
+
+    return true;
+}
 
-                const float pieceCountSkipProb = Sqr(static_cast<float>(numPieces - 22) / 30.0f);
-                if (pieceCountSkipProb > 0.0f && std::bernoulli_distribution(pieceCountSkipProb)(gen))
-                    continue;
+bool TrainingShuffleBuffer::Draw(PositionEntry* outEntries, size_t count)
+{
+    ASSERT(mLoader);
+
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    const size_t minSize = std::max<size_t>(1, mEntries.size() / 2);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (!mIsWarmedUp || mSize < minSize)
+        {
+            if (mReaderThreads.empty())
+            {
+                if (!RefillSynchronously())
+                    return false;
             }
+            else
+            {
+                mDrainedCV.notify_all();
+
+                // initially wait for the whole buffer to be filled, later only for half of it
+                const size_t requiredSize = mIsWarmedUp ? minSize : mEntries.size();
+                mFilledCV.wait(lock, [this, requiredSize]() { return mFailed || mSize >= requiredSize; });
+
+                if (mFailed)
+                    return false;
+            }
+
+            mIsWarmedUp = true;
         }
 
+        const size_t index = std::uniform_int_distribution<size_t>(0, mSize - 1)(mGen);
+        outEntries[i] = mEntries[index];
+        mEntries[index] = mEntries[--mSize];
+    }
+
+    lock.unlock();
+    mDrainedCV.notify_all();
+
+    return true;
+}
+
+bool TrainingShuffleBuffer::SaveState(OutputStream& stream)
+{
+    ASSERT(mLoader);
+
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    const uint64_t state[] = { mEntries.size(), mReaderThreads.size(), mIsWarmedUp };
+    if (!stream.Write(state, sizeof(state)) || !WriteRandomGenerator(stream, mGen))
+        return false;
+
+    if (!mReaderThreads.empty())
         return true;
+
+    const uint64_t size = mSize;
+    return
+        stream.Write(&size, sizeof(size)) &&
+        stream.Write(mEntries.data(), mSize * sizeof(PositionEntry)) &&
+        mLoader->SaveStreamState(mSyncStream, stream) &&
+        WriteArray(stream, mSyncChunk) &&
+        stream.Write(&mSyncChunkCursor, sizeof(mSyncChunkCursor));
+}
+
+bool TrainingShuffleBuffer::LoadState(InputStream& stream)
+{
+    ASSERT(mLoader);
+
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    uint64_t state[3];
+    if (!stream.Read(state, sizeof(state)) || !ReadRandomGenerator(stream, mGen))
+        return false;
+
+    if (state[0] != mEntries.size() || (state[1] == 0) != mReaderThreads.empty())
+    {
+        std::cout << "ERROR: Shuffle buffer settings don't match the checkpoint" << std::endl;
+        return false;
     }
+
+    if (!mReaderThreads.empty())
+        return true;
+
+    uint64_t size = 0;
+    if (!stream.Read(&size, sizeof(size)) || size > mEntries.size() ||
+        !stream.Read(mEntries.data(), size * sizeof(PositionEntry)) ||
+        !mLoader->LoadStreamState(mSyncStream, stream) ||
+        !ReadArray(stream, mSyncChunk) ||
+        !stream.Read(&mSyncChunkCursor, sizeof(mSyncChunkCursor)) ||
+        mSyncChunkCursor > mSyncChunk.size())
+        return false;
+
+    mSize = static_cast<size_t>(size);
+    mIsWarmedUp = state[2] != 0;
+
+    return true;
+}
+
+bool WriteRandomGenerator(OutputStream& stream, const std::mt19937& gen)
+{
+    std::stringstream ss;
+    ss << gen;
+    return WriteArray(stream, ss.str());
+}
+
+bool ReadRandomGenerator(InputStream& stream, std::mt19937& gen)
+{
+    std::string state;
+    if (!ReadArray(stream, state))
+        return false;
+
+    std::stringstream ss(state);
+    ss >> gen;
+    return !ss.fail();
 }
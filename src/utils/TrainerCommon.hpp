@@ -3,11 +3,14 @@
 #include "Common.hpp"
 #include "net/Network.hpp"
 #include "GameCollection.hpp"
+#include "TrainingDataFile.hpp"
 
 #include "../backend/Position.hpp"
 #include "../backend/PositionUtils.hpp"
 
 #include <array>
+#include <thread>
+#include <condition_variable>
 
 struct PositionEntry
 {
@@ -30,6 +33,10 @@ struct TrainingEntry
 
 using TrainingDataSet = std::vector<TrainingEntry>;
 
+// random generator state serialization (for trainer checkpoints)
+bool WriteRandomGenerator(OutputStream& stream, const std::mt19937& gen);
+bool ReadRandomGenerator(InputStream& stream, std::mt19937& gen);
+
 class TrainingDataLoader
 {
 public:
@@ -42,14 +49,90 @@ public:
     // sample new position from the training set
     bool FetchNextPosition(std::mt19937& gen, PositionEntry& outEntry, Position& outPosition, uint64_t kingBucketMask) const;
 
+    // Per-thread state of the block sampler. Entries are read in big blocks from random locations of randomly picked files
+    // into a small ring of blocks and positions are sampled from random blocks of the ring, so sampling threads
+    // don't contend on the shared file streams and don't pay a read call per position.
+    // Each thread keeps its own file handles (opened lazily, least recently used one is closed when over the limit),
+    // so reading a block is just a seek and a read.
+    struct ThreadContext
+    {
+        struct Block
+        {
+            std::vector<PositionEntry> entries;
+            size_t cursor = 0;
+            uint32_t fileIndex = 0;
+        };
+
+        struct OpenFile
+        {
+            std::unique_ptr<FileInputStream> stream;
+            uint32_t fileIndex = 0;
+            uint64_t lastUse = 0;
+        };
+
+        std::vector<Block> blocks;
+        std::vector<OpenFile> openFiles;
+        uint64_t numFileUses = 0;
+
+        // statistics, 'samplingTime' is accumulated by the caller
+        uint64_t numPositions = 0;
+        uint64_t numEntriesRead = 0;
+        float samplingTime = 0.0f;
+    };
+
+    // sample new position using thread's own context (lock-free)
+    bool FetchNextPosition(ThreadContext& threadContext, std::mt19937& gen, PositionEntry& outEntry, Position& outPosition, uint64_t kingBucketMask) const;
+
+    // print positions/s per thread and reset the statistics
+    static void PrintThreadStats(std::vector<ThreadContext>& threadContexts);
+
+    // Sequential reader of the training files, used to stream data into a shuffle buffer.
+    // Streams a randomly picked file (starting at a random offset) and switches to another file after a while.
+    struct StreamContext
+    {
+        std::mt19937 gen;
+        std::unique_ptr<FileInputStream> fileStream;
+        uint32_t fileIndex = 0;
+        uint64_t numEntriesLeftInRun = 0;
+        std::vector<PositionEntry> readBuffer;
+        size_t readCursor = 0;      // compressed files: position in the decoded chunk
+        uint32_t chunkIndex = 0;    // compressed files: next chunk to decode
+    };
+
+    // read next chunk of filtered entries
+    bool ReadStreamChunk(StreamContext& streamContext, std::vector<PositionEntry>& outEntries, uint64_t kingBucketMask) const;
+
+    // save/restore the stream position, the file is reopened on load (the set of training files must not change)
+    bool SaveStreamState(const StreamContext& streamContext, OutputStream& stream) const;
+    bool LoadStreamState(StreamContext& streamContext, InputStream& stream) const;
+
 private:
 
+    static constexpr uint32_t BlockSize = 4096;        // entries (128 KB)
+    static constexpr uint32_t NumBlocksPerThread = 8;
+    static constexpr uint64_t StreamRunLength = 1024 * 1024; // entries (32 MB) streamed from a file before switching to another one
+    static constexpr uint32_t MaxOpenFiles = 256;          // file handles of the block sampler, split between the threads
+
+    FileInputStream* GetThreadFileStream(ThreadContext& threadContext, uint32_t fileIndex) const;
+    bool ReadBlock(ThreadContext& threadContext, std::mt19937& gen, ThreadContext::Block& block) const;
+
     struct InputFileContext
     {
+        // currently decoded chunk of a compressed file
+        struct DecodedChunk
+        {
+            std::vector<PositionEntry> entries;
+            size_t cursor = 0;
+            uint32_t chunkIndex = 0;
+        };
+
         std::unique_ptr<std::mutex> mutex;
         std::unique_ptr<FileInputStream> fileStream;
+        std::unique_ptr<TrainingDataFile::Reader> compressedFile; // null for raw PositionEntry files
+        std::unique_ptr<DecodedChunk> decodedChunk;
         std::string fileName;
         uint64_t fileSize = 0;
+        uint64_t numEntries = 0;
         float skippingProbability = 0.0f;
 
         bool FetchNextPosition(std::mt19937& gen, PositionEntry& outEntry, Position& outPosition, uint64_t kingBucketMask) const;
@@ -63,3 +146,60 @@ private:
 
     uint32_t SampleInputFileIndex(double u) const;
 };
+
+// Streaming shuffle buffer (reservoir). Reader threads stream the training files sequentially, filter the entries
+// and append them to a big in-memory buffer. Entries are drawn from random slots and every drawn slot is filled
+// with the last entry, so entries stay in the buffer for a long time and batches are decorrelated without an offline
+// shuffle pass. Draw() waits while the buffer is less than half full.
+// With no reader threads the buffer is refilled synchronously by Draw(), so the drawn sequence depends only on the seed.
+class TrainingShuffleBuffer
+{
+public:
+    struct Params
+    {
+        float sizeInGB = 1.0f;
+        uint32_t numReaderThreads = 2;
+        uint64_t seed = 0;
+        uint64_t kingBucketMask = UINT64_MAX;
+    };
+
+    ~TrainingShuffleBuffer();
+
+    bool Init(const TrainingDataLoader& loader, const Params& params);
+
+    // draw entries from random slots of the buffer, waits for the buffer to be filled
+    bool Draw(PositionEntry* outEntries, size_t count);
+
+    // Save/restore the sampling state for trainer checkpoints. Without reader threads it's the buffer content
+    // and the stream position, so the drawn sequence continues exactly. With reader threads only the sampling generator
+    // is stored and the buffer is refilled from new random positions after loading.
+    bool SaveState(OutputStream& stream);
+    bool LoadState(InputStream& stream);
+
+    size_t GetCapacity() const { return mEntries.size(); }
+
+private:
+    void ReaderThreadFunc(uint32_t readerIndex);
+    bool RefillSynchronously();
+
+    const TrainingDataLoader* mLoader = nullptr;
+    Params mParams;
+
+    std::vector<PositionEntry> mEntries;
+    size_t mSize = 0;
+    bool mIsWarmedUp = false;
+    std::mt19937 mGen;
+
+    // synchronous refilling (no reader threads)
+    TrainingDataLoader::StreamContext mSyncStream;
+    std::vector<PositionEntry> mSyncChunk;
+    size_t mSyncChunkCursor = 0;
+
+    std::mutex mMutex;
+    std::condition_variable mFilledCV;
+    std::condition_variable mDrainedCV;
+    bool mStop = false;
+    bool mFailed = false;
+
+    std::vector<std::thread> mReaderThreads;
+};
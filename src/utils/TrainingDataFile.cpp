@@ -0,0 +1,540 @@
+#include "TrainingDataFile.hpp"
+#include "TrainerCommon.hpp"
+#include "BinaryEncoding.hpp"
+
+namespace TrainingDataFile
+{
+    static constexpr uint64_t c_Magic = 0x314B484344545343ull; // "CSTDCHK1"
+    static constexpr uint64_t c_FooterMagic = 0x3158444944545343ull; // "CSTDIDX1"
+    static constexpr uint32_t c_Version = 1;
+
+    // chunks bigger than this are treated as corrupted
+    static constexpr uint32_t c_MaxChunkPayloadSize = 256 * 1024 * 1024;
+
+    static constexpr uint8_t c_EmptySquare = 0xF;
+
+    enum class BoardEncoding : uint8_t
+    {
+        Full = 0,           // occupied bitboard + 4 bits per piece
+        Delta = 1,          // changed squares against the previous board
+        SwappedDelta = 2,   // changed squares against the color-swapped previous board
+    };
+
+    // entry flags
+    static constexpr uint8_t c_BoardEncodingMask = 0x3;
+    static constexpr uint8_t c_SideToMoveFlag = 1 << 2;
+    static constexpr uint8_t c_MiscFlag = 1 << 3;       // castling rights and en passant file follow
+    static constexpr uint8_t c_ResultsFlag = 1 << 4;    // WDL and tablebase scores follow
+
+#pragma pack(push, 1)
+    struct FileHeader
+    {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t chunkSize;
+    };
+
+    struct ChunkHeader
+    {
+        uint32_t payloadSize;
+        uint32_t numEntries;
+        uint64_t checksum;
+    };
+
+    struct FileFooter
+    {
+        uint64_t numChunks;
+        uint64_t numEntries;
+        uint64_t magic;
+    };
+#pragma pack(pop)
+
+    // previous entry of a chunk, reset at every chunk start
+    struct CodecState
+    {
+        uint8_t board[64];
+        int32_t moveCount = 0;
+        int32_t score = 0;
+        uint8_t misc = 0xF0; // castling rights (low nibble), en passant file (high nibble)
+        uint8_t wdlScore = 0xFF;
+        uint8_t tbScore = 0xFF;
+
+        CodecState()
+        {
+            memset(board, c_EmptySquare, sizeof(board));
+        }
+    };
+
+    INLINE static bool UnpackBoard(const PackedPosition& pos, uint8_t (&outBoard)[64])
+    {
+        if (pos.occupied.Count() > 32)
+        {
+            return false;
+        }
+
+        memset(outBoard, c_EmptySquare, sizeof(outBoard));
+
+        bool success = true;
+        uint32_t offset = 0;
+        pos.occupied.Iterate([&](uint32_t square)
+        {
+            outBoard[square] = (pos.piecesData[offset / 2] >> (4 * (offset % 2))) & 0xF;
+            success &= outBoard[square] != c_EmptySquare;
+            offset++;
+        });
+
+        return success;
+    }
+
+    INLINE static bool PackBoard(const uint8_t (&board)[64], PackedPosition& outPos)
+    {
+        uint64_t occupied = 0;
+        uint32_t offset = 0;
+
+        memset(outPos.piecesData, 0, sizeof(outPos.piecesData));
+
+        for (uint32_t square = 0; square < 64; ++square)
+        {
+            if (board[square] != c_EmptySquare)
+            {
+                if (offset >= 32)
+                {
+                    return false;
+                }
+
+                occupied |= 1ull << square;
+                outPos.piecesData[offset / 2] |= board[square] << (4 * (offset % 2));
+                offset++;
+            }
+        }
+
+        outPos.occupied = occupied;
+        return true;
+    }
+
+    // same as Position::SwappedColors(): flip ranks and piece colors
+    INLINE static void SwapBoardColors(const uint8_t (&board)[64], uint8_t (&outBoard)[64])
+    {
+        for (uint32_t square = 0; square < 64; ++square)
+        {
+            outBoard[square ^ 56] = board[square] == c_EmptySquare ? c_EmptySquare : (board[square] ^ 8);
+        }
+    }
+
+    INLINE static uint32_t GetDeltaSize(uint32_t numChanges)
+    {
+        return 1 + numChanges + (numChanges + 1) / 2;
+    }
+
+    static bool EncodeEntry(CodecState& state, const PositionEntry& entry, std::vector<uint8_t>& out)
+    {
+        uint8_t board[64];
+        if (!UnpackBoard(entry.pos, board))
+        {
+            return false;
+        }
+
+        uint8_t swappedBoard[64];
+        SwapBoardColors(state.board, swappedBoard);
+
+        uint32_t numChanges = 0;
+        uint32_t numSwappedChanges = 0;
+        for (uint32_t square = 0; square < 64; ++square)
+        {
+            numChanges += board[square] != state.board[square];
+            numSwappedChanges += board[square] != swappedBoard[square];
+        }
+
+        const uint32_t numPieces = entry.pos.occupied.Count();
+
+        BoardEncoding boardEncoding = BoardEncoding::Full;
+        uint32_t boardSize = sizeof(uint64_t) + (numPieces + 1) / 2;
+        if (GetDeltaSize(numChanges) < boardSize)
+        {
+            boardEncoding = BoardEncoding::Delta;
+            boardSize = GetDeltaSize(numChanges);
+        }
+        if (GetDeltaSize(numSwappedChanges) < boardSize)
+        {
+            boardEncoding = BoardEncoding::SwappedDelta;
+        }
+
+        const uint8_t misc = static_cast<uint8_t>(entry.pos.castlingRights | (entry.pos.enPassantFile << 4));
+
+        uint8_t flags = static_cast<uint8_t>(boardEncoding);
+        if (entry.pos.sideToMove) flags |= c_SideToMoveFlag;
+        if (misc != state.misc) flags |= c_MiscFlag;
+        if (entry.wdlScore != state.wdlScore || entry.tbScore != state.tbScore) flags |= c_ResultsFlag;
+
+        out.push_back(flags);
+        out.push_back(entry.pos.halfMoveCount);
+        WriteVarUInt(out, ZigZagEncode(static_cast<int32_t>(entry.pos.moveCount) - state.moveCount));
+        WriteVarUInt(out, ZigZagEncode(static_cast<int32_t>(entry.score) - state.score));
+
+        if (flags & c_MiscFlag)
+        {
+            out.push_back(misc);
+        }
+
+        if (flags & c_ResultsFlag)
+        {
+            out.push_back(entry.wdlScore);
+            out.push_back(entry.tbScore);
+        }
+
+        if (boardEncoding == BoardEncoding::Full)
+        {
+            const uint64_t occupied = entry.pos.occupied;
+            const uint8_t* occupiedBytes = reinterpret_cast<const uint8_t*>(&occupied);
+            out.insert(out.end(), occupiedBytes, occupiedBytes + sizeof(occupied));
+            out.insert(out.end(), entry.pos.piecesData, entry.pos.piecesData + (numPieces + 1) / 2);
+        }
+        else
+        {
+            const uint8_t (&referenceBoard)[64] = boardEncoding == BoardEncoding::Delta ? state.board : swappedBoard;
+
+            uint8_t changedPieces[64];
+            uint32_t numChangedPieces = 0;
+
+            out.push_back(static_cast<uint8_t>(boardEncoding == BoardEncoding::Delta ? numChanges : numSwappedChanges));
+            for (uint32_t square = 0; square < 64; ++square)
+            {
+                if (board[square] != referenceBoard[square])
+                {
+                    out.push_back(static_cast<uint8_t>(square));
+                    changedPieces[numChangedPieces++] = board[square];
+                }
+            }
+
+            for (uint32_t i = 0; i < numChangedPieces; i += 2)
+            {
+                const uint8_t high = i + 1 < numChangedPieces ? changedPieces[i + 1] : 0;
+                out.push_back(static_cast<uint8_t>(changedPieces[i] | (high << 4)));
+            }
+        }
+
+        memcpy(state.board, board, sizeof(board));
+        state.moveCount = entry.pos.moveCount;
+        state.score = entry.score;
+        state.misc = misc;
+        state.wdlScore = entry.wdlScore;
+        state.tbScore = entry.tbScore;
+
+        return true;
+    }
+
+    INLINE static bool DecodeEntry(CodecState& state, const uint8_t*& data, const uint8_t* end, PositionEntry& outEntry)
+    {
+        if (end - data < 2)
+        {
+            return false;
+        }
+
+        const uint8_t flags = *data++;
+        const uint8_t halfMoveCount = *data++;
+
+        uint32_t moveCountDelta, scoreDelta;
+        if (!ReadVarUInt(data, end, moveCountDelta) || !ReadVarUInt(data, end, scoreDelta))
+        {
+            return false;
+        }
+
+        if (flags & c_MiscFlag)
+        {
+            if (data >= end) return false;
+            state.misc = *data++;
+        }
+
+        if (flags & c_ResultsFlag)
+        {
+            if (end - data < 2) return false;
+            state.wdlScore = *data++;
+            state.tbScore = *data++;
+        }
+
+        state.moveCount += ZigZagDecode(moveCountDelta);
+        state.score += ZigZagDecode(scoreDelta);
+
+        PackedPosition& pos = outEntry.pos;
+
+        const BoardEncoding boardEncoding = static_cast<BoardEncoding>(flags & c_BoardEncodingMask);
+        if (boardEncoding == BoardEncoding::Full)
+        {
+            uint64_t occupied;
+            if (end - data < static_cast<ptrdiff_t>(sizeof(occupied))) return false;
+            memcpy(&occupied, data, sizeof(occupied));
+            data += sizeof(occupied);
+
+            const uint32_t numPieces = Bitboard(occupied).Count();
+            const uint32_t numPiecesBytes = (numPieces + 1) / 2;
+            if (numPieces > 32 || end - data < static_cast<ptrdiff_t>(numPiecesBytes)) return false;
+
+            pos.occupied = occupied;
+            memset(pos.piecesData, 0, sizeof(pos.piecesData));
+            memcpy(pos.piecesData, data, numPiecesBytes);
+            data += numPiecesBytes;
+
+            if (!UnpackBoard(pos, state.board)) return false;
+        }
+        else if (boardEncoding == BoardEncoding::Delta || boardEncoding == BoardEncoding::SwappedDelta)
+        {
+            if (boardEncoding == BoardEncoding::SwappedDelta)
+            {
+                uint8_t board[64];
+                memcpy(board, state.board, sizeof(board));
+                SwapBoardColors(board, state.board);
+            }
+
+            if (data >= end) return false;
+            const uint32_t numChanges = *data++;
+            const uint8_t* squares = data;
+            const uint8_t* pieces = data + numChanges;
+            data = pieces + (numChanges + 1) / 2;
+            if (numChanges > 64 || data > end) return false;
+
+            for (uint32_t i = 0; i < numChanges; ++i)
+            {
+                state.board[squares[i] & 63] = (pieces[i / 2] >> (4 * (i % 2))) & 0xF;
+            }
+
+            if (!PackBoard(state.board, pos)) return false;
+        }
+        else
+        {
+            return false;
+        }
+
+        pos.moveCount = static_cast<uint16_t>(state.moveCount);
+        pos.sideToMove = (flags & c_SideToMoveFlag) ? 1 : 0;
+        pos.halfMoveCount = halfMoveCount;
+        pos.castlingRights = state.misc & 0xF;
+        pos.enPassantFile = state.misc >> 4;
+
+        outEntry.score = static_cast<ScoreType>(state.score);
+        outEntry.wdlScore = state.wdlScore;
+        outEntry.tbScore = state.tbScore;
+
+        return true;
+    }
+
+    bool IsCompressedFile(const std::string& path)
+    {
+        FileInputStream stream(path.c_str());
+
+        FileHeader header{};
+        return stream.IsOpen() && stream.Read(&header, sizeof(header)) && header.magic == c_Magic;
+    }
+
+    Writer::Writer(OutputStream& stream, uint32_t chunkSize)
+        : mStream(stream)
+        , mState(std::make_unique<CodecState>())
+        , mChunkSize(std::max(1u, chunkSize))
+    {
+        mChunk.reserve(static_cast<size_t>(mChunkSize) * 16);
+    }
+
+    Writer::~Writer()
+    {
+        Finish();
+    }
+
+    bool Writer::Write(const PositionEntry& entry)
+    {
+        ASSERT(!mFinished);
+
+        if (!EncodeEntry(*mState, entry, mChunk))
+        {
+            std::cout << "Invalid training data entry " << mNumEntries << std::endl;
+            return false;
+        }
+
+        mNumEntries++;
+
+        if (++mNumEntriesInChunk >= mChunkSize)
+        {
+            return FlushChunk();
+        }
+
+        return true;
+    }
+
+    bool Writer::FlushChunk()
+    {
+        if (!mHeaderWritten)
+        {
+            const FileHeader header{ c_Magic, c_Version, mChunkSize };
+            if (!mStream.Write(&header, sizeof(header)))
+            {
+                std::cout << "Failed to write training data stream" << std::endl;
+                return false;
+            }
+            mOffset += sizeof(header);
+            mHeaderWritten = true;
+        }
+
+        if (mNumEntriesInChunk == 0)
+        {
+            return true;
+        }
+
+        const ChunkHeader chunkHeader{ static_cast<uint32_t>(mChunk.size()), mNumEntriesInChunk, ComputeChecksum(mChunk.data(), mChunk.size()) };
+
+        const bool success = mStream.Write(&chunkHeader, sizeof(chunkHeader)) && mStream.Write(mChunk.data(), mChunk.size());
+
+        mChunkOffsets.push_back(mOffset);
+        mOffset += sizeof(chunkHeader) + mChunk.size();
+
+        mChunk.clear();
+        mNumEntriesInChunk = 0;
+        *mState = CodecState();
+
+        if (!success)
+        {
+            std::cout << "Failed to write training data stream" << std::endl;
+        }
+
+        return success;
+    }
+
+    bool Writer::Finish()
+    {
+        if (mFinished)
+        {
+            return true;
+        }
+
+        mFinished = true;
+
+        if (!FlushChunk())
+        {
+            return false;
+        }
+
+        const FileFooter footer{ mChunkOffsets.size(), mNumEntries, c_FooterMagic };
+
+        if (!mStream.Write(mChunkOffsets.data(), mChunkOffsets.size() * sizeof(uint64_t)) ||
+            !mStream.Write(&footer, sizeof(footer)))
+        {
+            std::cout << "Failed to write training data stream" << std::endl;
+            return false;
+        }
+
+        mStream.Flush();
+        return true;
+    }
+
+    bool Reader::Open(InputStream& stream)
+    {
+        mChunkOffsets.clear();
+        mNumEntries = 0;
+
+        const uint64_t fileSize = stream.GetSize();
+
+        FileHeader header{};
+        FileFooter footer{};
+        if (fileSize < sizeof(FileHeader) + sizeof(FileFooter) ||
+            !stream.Read(&header, sizeof(header)) ||
+            header.magic != c_Magic ||
+            !stream.SetPosition(fileSize - sizeof(FileFooter)) ||
+            !stream.Read(&footer, sizeof(footer)) ||
+            footer.magic != c_FooterMagic ||
+            footer.numChunks > (fileSize - sizeof(FileHeader) - sizeof(FileFooter)) / sizeof(ChunkHeader))
+        {
+            std::cout << "Invalid training data file: " << stream.GetFileName() << std::endl;
+            return false;
+        }
+
+        if (header.version != c_Version)
+        {
+            std::cout << "Unsupported training data file version " << header.version << ": " << stream.GetFileName() << std::endl;
+            return false;
+        }
+
+        mIndexOffset = fileSize - sizeof(FileFooter) - footer.numChunks * sizeof(uint64_t);
+        mChunkOffsets.resize(footer.numChunks);
+
+        if (!stream.SetPosition(mIndexOffset) ||
+            !stream.Read(mChunkOffsets.data(), mChunkOffsets.size() * sizeof(uint64_t)))
+        {
+            std::cout << "Invalid training data file: " << stream.GetFileName() << std::endl;
+            return false;
+        }
+
+        for (size_t i = 0; i < mChunkOffsets.size(); ++i)
+        {
+            const uint64_t chunkEnd = i + 1 < mChunkOffsets.size() ? mChunkOffsets[i + 1] : mIndexOffset;
+            if (mChunkOffsets[i] < sizeof(FileHeader) || mChunkOffsets[i] + sizeof(ChunkHeader) > chunkEnd)
+            {
+                std::cout << "Invalid training data chunk index: " << stream.GetFileName() << std::endl;
+                mChunkOffsets.clear();
+                return false;
+            }
+        }
+
+        mNumEntries = footer.numEntries;
+
+        return true;
+    }
+
+    bool Reader::ReadChunk(InputStream& stream, uint32_t chunkIndex, std::vector<PositionEntry>& outEntries) const
+    {
+        outEntries.clear();
+
+        if (chunkIndex >= mChunkOffsets.size())
+        {
+            return false;
+        }
+
+        const uint64_t chunkBegin = mChunkOffsets[chunkIndex];
+        const uint64_t chunkEnd = chunkIndex + 1 < mChunkOffsets.size() ? mChunkOffsets[chunkIndex + 1] : mIndexOffset;
+
+        ChunkHeader header{};
+        if (!stream.SetPosition(chunkBegin) || !stream.Read(&header, sizeof(header)) ||
+            header.payloadSize != chunkEnd - chunkBegin - sizeof(ChunkHeader) ||
+            header.payloadSize > c_MaxChunkPayloadSize)
+        {
+            std::cout << "Failed to read training data chunk " << chunkIndex << " from file " << stream.GetFileName() << std::endl;
+            return false;
+        }
+
+        thread_local std::vector<uint8_t> payload;
+        payload.resize(header.payloadSize);
+
+        if (!stream.Read(payload.data(), payload.size()))
+        {
+            std::cout << "Failed to read training data chunk " << chunkIndex << " from file " << stream.GetFileName() << std::endl;
+            return false;
+        }
+
+        if (ComputeChecksum(payload.data(), payload.size()) != header.checksum)
+        {
+            std::cout << "Training data chunk checksum mismatch in file " << stream.GetFileName() << " chunk=" << chunkIndex << std::endl;
+            return false;
+        }
+
+        outEntries.resize(header.numEntries);
+
+        CodecState state;
+        const uint8_t* data = payload.data();
+        const uint8_t* end = data + payload.size();
+
+        bool success = true;
+        for (PositionEntry& entry : outEntries)
+        {
+            if (!DecodeEntry(state, data, end, entry))
+            {
+                success = false;
+                break;
+            }
+        }
+
+        if (!success || data != end)
+        {
+            std::cout << "Failed to decode training data chunk " << chunkIndex << " from file " << stream.GetFileName() << std::endl;
+            outEntries.clear();
+            return false;
+        }
+
+        return true;
+    }
+}
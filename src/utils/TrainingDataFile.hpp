@@ -0,0 +1,72 @@
+#pragma once
+
+#include "Common.hpp"
+#include "Stream.hpp"
+
+#include <vector>
+#include <string>
+
+struct PositionEntry;
+
+// Compressed container of training positions, an alternative to raw PositionEntry (.dat) files:
+// - entries are grouped into chunks, each chunk can be decoded on its own, so many threads can decode different chunks at once
+// - every entry is encoded against the previous entry of the chunk: the board is stored as a list of changed squares
+//   (against the previous board or its color-swapped version, as positions are normalized to white side to move)
+//   or in full if that's shorter, move counter and score are stored as zig-zag varint deltas
+// - chunk offsets are stored at the end of the file, so chunks can be picked at random
+// Game-sequential (not shuffled) data compresses best, shuffling is left to the training data loader.
+namespace TrainingDataFile
+{
+    static constexpr uint32_t DefaultChunkSize = 64 * 1024; // entries (2 MB of raw data)
+
+    // check if a file starts with compressed training data header
+    bool IsCompressedFile(const std::string& path);
+
+    struct CodecState;
+
+    class Writer
+    {
+    public:
+        Writer(OutputStream& stream, uint32_t chunkSize = DefaultChunkSize);
+        ~Writer();
+
+        bool Write(const PositionEntry& entry);
+
+        // write pending chunk and the chunk index, no entries can be written afterwards
+        bool Finish();
+
+        uint64_t GetNumEntries() const { return mNumEntries; }
+
+    private:
+        bool FlushChunk();
+
+        OutputStream& mStream;
+        std::unique_ptr<CodecState> mState;
+        std::vector<uint8_t> mChunk;
+        std::vector<uint64_t> mChunkOffsets;
+        uint64_t mOffset = 0;
+        uint64_t mNumEntries = 0;
+        uint32_t mNumEntriesInChunk = 0;
+        uint32_t mChunkSize;
+        bool mHeaderWritten = false;
+        bool mFinished = false;
+    };
+
+    class Reader
+    {
+    public:
+        // read file header and the chunk index
+        bool Open(InputStream& stream);
+
+        uint64_t GetNumEntries() const { return mNumEntries; }
+        uint32_t GetNumChunks() const { return static_cast<uint32_t>(mChunkOffsets.size()); }
+
+        // decode a chunk, reading it through caller's stream (of the same file), so chunks can be decoded by many threads at once
+        bool ReadChunk(InputStream& stream, uint32_t chunkIndex, std::vector<PositionEntry>& outEntries) const;
+
+    private:
+        std::vector<uint64_t> mChunkOffsets;
+        uint64_t mIndexOffset = 0;
+        uint64_t mNumEntries = 0;
+    };
+}
@@ -160,7 +160,7 @@ void FullyConnectedNode::Backpropagate(const Values& error, INodeContext& ctx, G
                 {
                     gradientsVariant.m_values[j * m_numOutputs + i] += inputValue * error[i];
                 }
-                gradientsVariant.m_dirty[j] = true;
+                gradientsVariant.MarkDirty(j);
             }
         }
     }
@@ -217,8 +217,354 @@ void FullyConnectedNode::Backpropagate(const Values& error, INodeContext& ctx, G
         {
             gradientsVariant.m_values[m_numInputs * m_numOutputs + i] += error[i];
         }
-        gradientsVariant.m_dirty[m_numInputs] = true;
+        gradientsVariant.MarkDirty(m_numInputs);
     }
 }
 
+#ifdef USE_AVX
+
+// number of samples processed at once by the register-blocked kernels
+static constexpr uint32_t c_SampleBlockSize = 4;
+
+// number of outputs processed at once by the register-blocked kernels (two AVX registers)
+static constexpr uint32_t c_OutputBlockSize = 16;
+
+// order samples by weights variant, so blocks of samples can share weights and gradients loads
+static void SortSamplesByVariant(INodeContext* const* contexts, uint32_t numSamples, size_t numVariants, uint32_t* order, uint32_t* variants)
+{
+    for (uint32_t s = 0; s < numSamples; ++s)
+    {
+        order[s] = s;
+        variants[s] = (uint32_t)std::min<size_t>(contexts[s]->variant, numVariants - 1);
+    }
+    std::sort(order, order + numSamples, [variants](uint32_t a, uint32_t b) { return variants[a] < variants[b]; });
+}
+
+#endif // USE_AVX
+
+void FullyConnectedNode::RunTile(INodeContext* const* contexts, uint32_t numSamples) const
+{
+#ifdef USE_AVX
+
+    ASSERT(!m_weightsStorage->m_variants.empty());
+    ASSERT(numSamples <= MaxTileSize);
+
+    if (m_numOutputs == 1)
+    {
+        // dot products of a block of samples at once, each sample has an independent FMA chain
+        uint32_t s = 0;
+        for (; s + c_SampleBlockSize <= numSamples; s += c_SampleBlockSize)
+        {
+            const float* weightsPtrs[c_SampleBlockSize];
+            const float* inputsPtrs[c_SampleBlockSize];
+            for (uint32_t k = 0; k < c_SampleBlockSize; ++k)
+            {
+                const INodeContext& ctx = *contexts[s + k];
+                ASSERT(ctx.outputs.size() == m_numOutputs);
+                ASSERT(ctx.inputs.size() == m_numInputs);
+                const size_t variantIndex = std::min<size_t>(ctx.variant, m_weightsStorage->m_variants.size() - 1);
+                weightsPtrs[k] = m_weightsStorage->m_variants[variantIndex].m_weights.data();
+                inputsPtrs[k] = ctx.inputs.data();
+            }
+
+            __m256 acc[c_SampleBlockSize];
+            uint32_t i = 0;
+
+#ifdef USE_AVX512
+            __m512 acc512[c_SampleBlockSize];
+            for (uint32_t k = 0; k < c_SampleBlockSize; ++k)
+                acc512[k] = _mm512_setzero_ps();
+            for (; i + 16 <= m_numInputs; i += 16)
+            {
+                for (uint32_t k = 0; k < c_SampleBlockSize; ++k)
+                    acc512[k] = _mm512_fmadd_ps(_mm512_loadu_ps(weightsPtrs[k] + i), _mm512_loadu_ps(inputsPtrs[k] + i), acc512[k]);
+            }
+            // fold the 512-bit accumulators into the AVX ones
+            for (uint32_t k = 0; k < c_SampleBlockSize; ++k)
+                acc[k] = _mm256_add_ps(_mm512_castps512_ps256(acc512[k]), _mm256_castsi256_ps(_mm512_extracti64x4_epi64(_mm512_castps_si512(acc512[k]), 1)));
+#else
+            for (uint32_t k = 0; k < c_SampleBlockSize; ++k)
+                acc[k] = _mm256_setzero_ps();
+#endif // USE_AVX512
+
+            for (; i + 8 <= m_numInputs; i += 8)
+            {
+                for (uint32_t k = 0; k < c_SampleBlockSize; ++k)
+                    acc[k] = _mm256_fmadd_ps(_mm256_load_ps(weightsPtrs[k] + i), _mm256_loadu_ps(inputsPtrs[k] + i), acc[k]);
+            }
+
+            for (uint32_t k = 0; k < c_SampleBlockSize; ++k)
+            {
+                float sum = m256_hadd(acc[k]);
+                for (uint32_t j = i; j < m_numInputs; ++j)
+                    sum += weightsPtrs[k][j] * inputsPtrs[k][j];
+
+                // apply bias
+                contexts[s + k]->outputs[0] = weightsPtrs[k][m_numInputs] + sum;
+            }
+        }
+
+        for (; s < numSamples; ++s)
+        {
+            Run(*contexts[s]);
+        }
+    }
+    else
+    {
+        // register-blocked matrix multiplication of a block of samples sharing the weights variant:
+        // each weights load is reused for all the samples in the block
+        uint32_t order[MaxTileSize];
+        uint32_t variants[MaxTileSize];
+        SortSamplesByVariant(contexts, numSamples, m_weightsStorage->m_variants.size(), order, variants);
+
+        for (uint32_t blockStart = 0; blockStart < numSamples; )
+        {
+            const uint32_t variantIndex = variants[order[blockStart]];
+            uint32_t blockEnd = blockStart + 1;
+            while (blockEnd < numSamples && blockEnd - blockStart < c_SampleBlockSize && variants[order[blockEnd]] == variantIndex) ++blockEnd;
+
+            const float* weightsPtr = m_weightsStorage->m_variants[variantIndex].m_weights.data();
+            const float* biasesPtr = weightsPtr + m_numOutputs * m_numInputs;
+
+            // incomplete blocks repeat the last sample, the extra results are discarded
+            const float* inputsPtrs[c_SampleBlockSize];
+            float* outputsPtrs[c_SampleBlockSize];
+            for (uint32_t k = 0; k < c_SampleBlockSize; ++k)
+            {
+                INodeContext& ctx = *contexts[order[std::min(blockStart + k, blockEnd - 1)]];
+                ASSERT(ctx.outputs.size() == m_numOutputs);
+                ASSERT(ctx.inputs.size() == m_numInputs);
+                inputsPtrs[k] = ctx.inputs.data();
+                outputsPtrs[k] = ctx.outputs.data();
+            }
+            const uint32_t blockSize = blockEnd - blockStart;
+
+            uint32_t i = 0;
+            for (; i + c_OutputBlockSize <= m_numOutputs; i += c_OutputBlockSize)
+            {
+                __m256 acc[c_SampleBlockSize][2];
+                for (uint32_t k = 0; k < c_SampleBlockSize; ++k)
+                {
+                    acc[k][0] = _mm256_loadu_ps(biasesPtr + i);
+                    acc[k][1] = _mm256_loadu_ps(biasesPtr + i + 8);
+                }
+
+                for (uint32_t j = 0; j < m_numInputs; ++j)
+                {
+                    const __m256 w0 = _mm256_loadu_ps(weightsPtr + j * m_numOutputs + i);
+                    const __m256 w1 = _mm256_loadu_ps(weightsPtr + j * m_numOutputs + i + 8);
+                    for (uint32_t k = 0; k < c_SampleBlockSize; ++k)
+                    {
+                        const __m256 in = _mm256_broadcast_ss(inputsPtrs[k] + j);
+                        acc[k][0] = _mm256_fmadd_ps(in, w0, acc[k][0]);
+                        acc[k][1] = _mm256_fmadd_ps(in, w1, acc[k][1]);
+                    }
+                }
+
+                for (uint32_t k = 0; k < blockSize; ++k)
+                {
+                    _mm256_storeu_ps(outputsPtrs[k] + i, acc[k][0]);
+                    _mm256_storeu_ps(outputsPtrs[k] + i + 8, acc[k][1]);
+                }
+            }
+
+            for (; i < m_numOutputs; ++i)
+            {
+                for (uint32_t k = 0; k < blockSize; ++k)
+                {
+                    float sum = biasesPtr[i];
+                    for (uint32_t j = 0; j < m_numInputs; ++j)
+                        sum += weightsPtr[j * m_numOutputs + i] * inputsPtrs[k][j];
+                    outputsPtrs[k][i] = sum;
+                }
+            }
+
+            blockStart = blockEnd;
+        }
+    }
+
+#else
+
+    INode::RunTile(contexts, numSamples);
+
+#endif // USE_AVX
+}
+
+void FullyConnectedNode::BackpropagateTile(const Values* const* errors, INodeContext* const* contexts, uint32_t numSamples, Gradients& gradients) const
+{
+#ifdef USE_AVX
+
+    ASSERT(!m_weightsStorage->m_variants.empty());
+    ASSERT(!gradients.m_isSparse);
+    ASSERT(numSamples <= MaxTileSize);
+
+    uint32_t order[MaxTileSize];
+    uint32_t variants[MaxTileSize];
+    SortSamplesByVariant(contexts, numSamples, m_weightsStorage->m_variants.size(), order, variants);
+
+    // process groups of samples sharing the weights variant:
+    // gradients are loaded and stored once per group instead of once per sample
+    for (uint32_t groupStart = 0; groupStart < numSamples; )
+    {
+        const uint32_t variantIndex = variants[order[groupStart]];
+        uint32_t groupEnd = groupStart + 1;
+        while (groupEnd < numSamples && variants[order[groupEnd]] == variantIndex) ++groupEnd;
+
+        const float* weightsPtr = m_weightsStorage->m_variants[variantIndex].m_weights.data();
+        Gradients::Variant& gradientsVariant = gradients.m_variants[variantIndex];
+        float* gradientPtr = gradientsVariant.m_values.data();
+
+        for (uint32_t s = groupStart; s < groupEnd; ++s)
+        {
+            INodeContext& ctx = *contexts[order[s]];
+            ASSERT(ctx.outputs.size() == GetNumOutputs());
+            ASSERT(ctx.inputs.size() == GetNumInputs());
+            ASSERT(ctx.inputError.size() == GetNumInputs());
+            std::fill(ctx.inputError.begin(), ctx.inputError.end(), 0.0f);
+        }
+
+        if (m_numOutputs == 1)
+        {
+            // samples with negligible error don't contribute
+            uint32_t numActive = 0;
+            float activeErrors[MaxTileSize];
+            const float* inputsPtrs[MaxTileSize];
+            float* inputErrorPtrs[MaxTileSize];
+            for (uint32_t s = groupStart; s < groupEnd; ++s)
+            {
+                const float activationError = (*errors[order[s]])[0];
+                if (std::abs(activationError) > c_activationEpsilon)
+                {
+                    activeErrors[numActive] = activationError;
+                    inputsPtrs[numActive] = contexts[order[s]]->inputs.data();
+                    inputErrorPtrs[numActive] = contexts[order[s]]->inputError.data();
+                    numActive++;
+                }
+            }
+
+            if (numActive > 0)
+            {
+                uint32_t j = 0;
+                for (; j + 8 <= m_numInputs; j += 8)
+                {
+                    const __m256 weights = _mm256_load_ps(weightsPtr + j);
+                    __m256 gradient = _mm256_load_ps(gradientPtr + j);
+                    for (uint32_t k = 0; k < numActive; ++k)
+                    {
+                        const __m256 activationErrorV = _mm256_set1_ps(activeErrors[k]);
+
+                        // compute input gradient
+                        _mm256_store_ps(inputErrorPtrs[k] + j, _mm256_mul_ps(weights, activationErrorV));
+
+                        // compute weights gradient
+                        gradient = _mm256_fmadd_ps(activationErrorV, _mm256_loadu_ps(inputsPtrs[k] + j), gradient);
+                    }
+                    _mm256_store_ps(gradientPtr + j, gradient);
+                }
+                for (; j < m_numInputs; ++j)
+                {
+                    for (uint32_t k = 0; k < numActive; ++k)
+                    {
+                        inputErrorPtrs[k][j] += weightsPtr[j] * activeErrors[k];
+                        gradientPtr[j] += inputsPtrs[k][j] * activeErrors[k];
+                    }
+                }
+            }
+        }
+        else
+        {
+            for (uint32_t blockStart = groupStart; blockStart < groupEnd; blockStart += c_SampleBlockSize)
+            {
+                const uint32_t blockSize = std::min(c_SampleBlockSize, groupEnd - blockStart);
+
+                const float* errorPtrs[c_SampleBlockSize];
+                const float* inputsPtrs[c_SampleBlockSize];
+                float* inputErrorPtrs[c_SampleBlockSize];
+                for (uint32_t k = 0; k < blockSize; ++k)
+                {
+                    errorPtrs[k] = errors[order[blockStart + k]]->data();
+                    inputsPtrs[k] = contexts[order[blockStart + k]]->inputs.data();
+                    inputErrorPtrs[k] = contexts[order[blockStart + k]]->inputError.data();
+                }
+
+                for (uint32_t j = 0; j < m_numInputs; ++j)
+                {
+                    const float* weightsRowPtr = weightsPtr + j * m_numOutputs;
+                    float* gradientRowPtr = gradientPtr + j * m_numOutputs;
+
+                    bool hasActiveInput = false;
+                    __m256 inputsV[c_SampleBlockSize];
+                    __m256 inputErrorAcc[c_SampleBlockSize];
+                    for (uint32_t k = 0; k < blockSize; ++k)
+                    {
+                        hasActiveInput |= std::abs(inputsPtrs[k][j]) > c_activationEpsilon;
+                        inputsV[k] = _mm256_set1_ps(inputsPtrs[k][j]);
+                        inputErrorAcc[k] = _mm256_setzero_ps();
+                    }
+
+                    uint32_t i = 0;
+                    for (; i + 8 <= m_numOutputs; i += 8)
+                    {
+                        // weights row is reused for input errors of all the samples in the block
+                        const __m256 weights = _mm256_loadu_ps(weightsRowPtr + i);
+                        __m256 gradient = hasActiveInput ? _mm256_loadu_ps(gradientRowPtr + i) : _mm256_setzero_ps();
+                        for (uint32_t k = 0; k < blockSize; ++k)
+                        {
+                            const __m256 error = _mm256_loadu_ps(errorPtrs[k] + i);
+                            inputErrorAcc[k] = _mm256_fmadd_ps(weights, error, inputErrorAcc[k]);
+                            gradient = _mm256_fmadd_ps(inputsV[k], error, gradient);
+                        }
+                        if (hasActiveInput)
+                            _mm256_storeu_ps(gradientRowPtr + i, gradient);
+                    }
+
+                    for (uint32_t k = 0; k < blockSize; ++k)
+                    {
+                        float inputError = m256_hadd(inputErrorAcc[k]);
+                        for (uint32_t t = i; t < m_numOutputs; ++t)
+                        {
+                            inputError += weightsRowPtr[t] * errorPtrs[k][t];
+                            if (hasActiveInput)
+                                gradientRowPtr[t] += inputsPtrs[k][j] * errorPtrs[k][t];
+                        }
+                        inputErrorPtrs[k][j] = inputError;
+                    }
+
+                    if (hasActiveInput)
+                        gradientsVariant.MarkDirty(j);
+                }
+            }
+        }
+
+        // add bias gradient
+        {
+            float* biasGradientPtr = gradientPtr + m_numInputs * m_numOutputs;
+            for (uint32_t s = groupStart; s < groupEnd; ++s)
+            {
+                const Values& error = *errors[order[s]];
+                uint32_t i = 0;
+                for (; i + 8 <= m_numOutputs; i += 8)
+                {
+                    _mm256_storeu_ps(biasGradientPtr + i,
+                        _mm256_add_ps(_mm256_loadu_ps(error.data() + i),
+                            _mm256_loadu_ps(biasGradientPtr + i)));
+                }
+                for (; i < m_numOutputs; i++)
+                {
+                    biasGradientPtr[i] += error[i];
+                }
+            }
+            gradientsVariant.MarkDirty(m_numInputs);
+        }
+
+        groupStart = groupEnd;
+    }
+
+#else
+
+    INode::BackpropagateTile(errors, contexts, numSamples, gradients);
+
+#endif // USE_AVX
+}
+
 } // namespace nn
@@ -27,6 +27,8 @@ public:
 
     virtual void Run(INodeContext& ctx) const override;
     virtual void Backpropagate(const Values& error, INodeContext& ctx, Gradients& gradients) const override;
+    virtual void RunTile(INodeContext* const* contexts, uint32_t numSamples) const override;
+    virtual void BackpropagateTile(const Values* const* errors, INodeContext* const* contexts, uint32_t numSamples, Gradients& gradients) const override;
     virtual InputMode GetInputMode() const override { return InputMode::Full; }
     virtual bool IsInputNode() const override { return m_previousNode == nullptr; }
 };
@@ -1,6 +1,7 @@
 #include "Gradient.hpp"
 
 #include <random>
+#include <algorithm>
 
 namespace nn {
 
@@ -14,7 +15,8 @@ void Gradients::Init(uint32_t numInputs, uint32_t numOutputs, uint32_t numVarian
     for (Variant& variant : m_variants)
     {
         variant.m_values.resize((numInputs + 1) * numOutputs, 0.0f);
-        variant.m_dirty.resize(numInputs + 1, false);
+        variant.m_dirty.resize(numInputs + 1, 0);
+        variant.m_dirtyRows.reserve(numInputs + 1);
     }
 }
 
@@ -25,7 +27,7 @@ void Gradients::Clear()
         for (Variant& variant : m_variants)
         {
             // clear only dirty gradients
-            for (size_t i = 0; i <= m_numInputs; ++i)
+            for (const uint32_t i : variant.m_dirtyRows)
             {
                 if (variant.m_dirty[i])
                 {
@@ -33,17 +35,21 @@ void Gradients::Clear()
                         variant.m_values.begin() + i * m_numOutputs,
                         variant.m_values.begin() + (i + 1) * m_numOutputs,
                         0.0f);
+                    variant.m_dirty[i] = 0;
                 }
             }
+            variant.m_dirtyRows.clear();
 
 #ifndef CONFIGURATION_FINAL
             for (size_t i = 0; i < variant.m_values.size(); ++i)
             {
                 ASSERT(variant.m_values[i] == 0.0f);
             }
+            for (size_t i = 0; i <= m_numInputs; ++i)
+            {
+                ASSERT(!variant.m_dirty[i]);
+            }
 #endif // CONFIGURATION_FINAL
-
-            std::fill(variant.m_dirty.begin(), variant.m_dirty.end(), false);
         }
     }
     else
@@ -51,76 +57,156 @@ void Gradients::Clear()
         for (Variant& variant : m_variants)
         {
             std::fill(variant.m_values.begin(), variant.m_values.end(), 0.0f);
+            std::fill(variant.m_dirty.begin(), variant.m_dirty.end(), 0);
+            variant.m_dirtyRows.clear();
         }
     }
 }
 
-void Gradients::Accumulate(Gradients& rhs, uint32_t inputIndex)
+// number of sources summed in a single pass over the destination values
+static constexpr uint32_t c_MaxSourcesPerPass = 16;
+
+// sum the sources into the destination and reset them
+// blocks of the destination are kept in registers while all the sources are added
+static void SumAndReset(float* dst, float* const* sources, uint32_t numSources, size_t count)
 {
-    ASSERT(inputIndex <= m_numInputs);
-    ASSERT(rhs.m_numInputs == m_numInputs);
-    ASSERT(rhs.m_numOutputs == m_numOutputs);
-    ASSERT(rhs.m_variants.size() == m_variants.size());
-    ASSERT(rhs.m_isSparse == m_isSparse);
+    size_t j = 0;
 
-    for (size_t variantIndex = 0; variantIndex < m_variants.size(); ++variantIndex)
+#ifdef USE_AVX
+    constexpr uint32_t blockSize = 8;   // registers per block
+    for (; j + 8 * blockSize <= count; j += 8 * blockSize)
     {
-        Variant& variant = m_variants[variantIndex];
-        Variant& rhsVariant = rhs.m_variants[variantIndex];
-
-        ASSERT(rhsVariant.m_values.size() == variant.m_values.size());
-
-        if (m_isSparse && !rhsVariant.m_dirty[inputIndex])
-            continue;
+        __m256 sum[blockSize];
+        for (uint32_t k = 0; k < blockSize; ++k)
+        {
+            sum[k] = _mm256_loadu_ps(dst + j + 8 * k);
+        }
 
-        // NOTE: not updating dirty flags here, because it's not thread-safe
-        // It will be done later in Accumulate_UpdateDirtyFlags
-        //variant.m_dirty[inputIndex] = true;
-        //rhsVariant.m_dirty[inputIndex] = false;
+        for (uint32_t s = 0; s < numSources; ++s)
+        {
+            float* src = sources[s] + j;
+            for (uint32_t k = 0; k < blockSize; ++k)
+            {
+                sum[k] = _mm256_add_ps(sum[k], _mm256_loadu_ps(src + 8 * k));
+                _mm256_storeu_ps(src + 8 * k, _mm256_setzero_ps());
+            }
+        }
 
-        size_t j = inputIndex * m_numOutputs;
-        const size_t j_max = (inputIndex + 1) * m_numOutputs;
+        for (uint32_t k = 0; k < blockSize; ++k)
+        {
+            _mm256_storeu_ps(dst + j + 8 * k, sum[k]);
+        }
+    }
 
-#ifdef USE_AVX
-        float* values = variant.m_values.data();
-        float* rhsValues = rhsVariant.m_values.data();
-        for (; j + 8 <= j_max; j += 8)
+    for (; j + 8 <= count; j += 8)
+    {
+        __m256 sum = _mm256_loadu_ps(dst + j);
+        for (uint32_t s = 0; s < numSources; ++s)
         {
-            _mm256_store_ps(values + j,
-                _mm256_add_ps(_mm256_load_ps(values + j), _mm256_load_ps(rhsValues + j)));
-            _mm256_store_ps(rhsValues + j, _mm256_setzero_ps());
+            sum = _mm256_add_ps(sum, _mm256_loadu_ps(sources[s] + j));
+            _mm256_storeu_ps(sources[s] + j, _mm256_setzero_ps());
         }
+        _mm256_storeu_ps(dst + j, sum);
+    }
 #endif // USE_AVX
 
-        for (; j < j_max; ++j)
+    for (; j < count; ++j)
+    {
+        float sum = dst[j];
+        for (uint32_t s = 0; s < numSources; ++s)
+        {
+            sum += sources[s][j];
+            sources[s][j] = 0.0f;
+        }
+        dst[j] = sum;
+    }
+}
+
+void Gradients::AccumulateRows(Gradients* const* sources, size_t numSources, uint32_t rowBegin, uint32_t rowEnd)
+{
+    ASSERT(rowBegin <= rowEnd);
+    ASSERT(rowEnd <= m_numInputs + 1);
+
+    float* sourceValues[c_MaxSourcesPerPass];
+
+    for (size_t variantIndex = 0; variantIndex < m_variants.size(); ++variantIndex)
+    {
+        Variant& variant = m_variants[variantIndex];
+
+        if (m_isSparse)
+        {
+            for (uint32_t inputIndex = rowBegin; inputIndex < rowEnd; ++inputIndex)
+            {
+                // the flag is set if any of the sources has the row dirty (see MergeDirtyRows)
+                if (!variant.m_dirty[inputIndex])
+                    continue;
+
+                const size_t offset = (size_t)inputIndex * m_numOutputs;
+
+                uint32_t numSourceValues = 0;
+                for (size_t i = 0; i < numSources; ++i)
+                {
+                    ASSERT(sources[i]->m_numOutputs == m_numOutputs);
+                    Variant& sourceVariant = sources[i]->m_variants[variantIndex];
+                    if (!sourceVariant.m_dirty[inputIndex])
+                        continue;
+
+                    sourceVariant.m_dirty[inputIndex] = 0;
+                    sourceValues[numSourceValues++] = sourceVariant.m_values.data() + offset;
+
+                    if (numSourceValues == c_MaxSourcesPerPass)
+                    {
+                        SumAndReset(variant.m_values.data() + offset, sourceValues, numSourceValues, m_numOutputs);
+                        numSourceValues = 0;
+                    }
+                }
+
+                if (numSourceValues > 0)
+                {
+                    SumAndReset(variant.m_values.data() + offset, sourceValues, numSourceValues, m_numOutputs);
+                }
+            }
+        }
+        else
         {
-            variant.m_values[j] += rhsVariant.m_values[j];
-            rhsVariant.m_values[j] = 0.0f;
+            // dense rows are contiguous, so the whole range is summed at once
+            const size_t offset = (size_t)rowBegin * m_numOutputs;
+            const size_t count = (size_t)(rowEnd - rowBegin) * m_numOutputs;
+
+            for (size_t i = 0; i < numSources; i += c_MaxSourcesPerPass)
+            {
+                const uint32_t numSourceValues = (uint32_t)std::min<size_t>(c_MaxSourcesPerPass, numSources - i);
+                for (uint32_t j = 0; j < numSourceValues; ++j)
+                {
+                    ASSERT(sources[i + j]->m_numOutputs == m_numOutputs);
+                    sourceValues[j] = sources[i + j]->m_variants[variantIndex].m_values.data() + offset;
+                }
+                SumAndReset(variant.m_values.data() + offset, sourceValues, numSourceValues, count);
+            }
         }
     }
 }
 
-void Gradients::Accumulate_UpdateDirtyFlags(Gradients& rhs, uint32_t inputIndex)
+void Gradients::MergeDirtyRows(const Gradients& rhs)
 {
-    ASSERT(inputIndex <= m_numInputs);
     ASSERT(rhs.m_numInputs == m_numInputs);
     ASSERT(rhs.m_numOutputs == m_numOutputs);
     ASSERT(rhs.m_variants.size() == m_variants.size());
     ASSERT(rhs.m_isSparse == m_isSparse);
 
+    if (!m_isSparse)
+        return;
+
     for (size_t variantIndex = 0; variantIndex < m_variants.size(); ++variantIndex)
     {
         Variant& variant = m_variants[variantIndex];
-        Variant& rhsVariant = rhs.m_variants[variantIndex];
-
-        ASSERT(rhsVariant.m_values.size() == variant.m_values.size());
+        const Variant& rhsVariant = rhs.m_variants[variantIndex];
 
-        if (m_isSparse)
+        for (const uint32_t i : rhsVariant.m_dirtyRows)
         {
-            if (rhsVariant.m_dirty[inputIndex])
+            if (rhsVariant.m_dirty[i])
             {
-                variant.m_dirty[inputIndex] = true;
-                rhsVariant.m_dirty[inputIndex] = false;
+                variant.MarkDirty(i);
             }
         }
     }
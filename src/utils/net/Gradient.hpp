@@ -13,15 +13,30 @@ struct Gradients
 
     struct Variant
     {
-        Values              m_values;
-        std::vector<bool>   m_dirty;
+        Values                  m_values;
+        std::vector<uint8_t>    m_dirty;        // per-row flag, a byte per row so rows can be written from different threads
+        std::vector<uint32_t>   m_dirtyRows;    // rows marked dirty since the last Clear (may contain rows whose flag was reset since)
+
+        INLINE void MarkDirty(uint32_t inputIndex)
+        {
+            if (!m_dirty[inputIndex])
+            {
+                m_dirty[inputIndex] = 1;
+                m_dirtyRows.push_back(inputIndex);
+            }
+        }
     };
     std::vector<Variant> m_variants;
 
     void Init(uint32_t numInputs, uint32_t numOutputs, uint32_t numVariants, bool isSparse);
     void Clear();
-    void Accumulate(Gradients& rhs, uint32_t inputIndex);
-    void Accumulate_UpdateDirtyFlags(Gradients& rhs, uint32_t inputIndex);
+
+    // add gradients of rows [rowBegin, rowEnd) from all the sources and reset them
+    // each destination block is read and written once for all the sources, disjoint row ranges can be accumulated concurrently
+    void AccumulateRows(Gradients* const* sources, size_t numSources, uint32_t rowBegin, uint32_t rowEnd);
+
+    // mark rows dirty in rhs as dirty here too (rhs dirty flags are kept, they are reset by AccumulateRows)
+    void MergeDirtyRows(const Gradients& rhs);
 };
 
 } // namespace nn
@@ -8,6 +8,7 @@
 #include "../ThreadPool.hpp"
 #include "../../backend/PackedNeuralNetwork.hpp"
 #include "../../backend/Waitable.hpp"
+#include "../../backend/Time.hpp"
 #include "../minitrace/minitrace.h"
 
 #include <random>
@@ -23,6 +24,11 @@ using namespace threadpool;
 
 namespace nn {
 
+// size of weights update tasks: rows of sparse weights visited by the lazy update,
+// or number of weights of dense rows (small dense layers are updated by a single task)
+static constexpr uint32_t c_SparseRowsPerSegment = 16;
+static constexpr uint32_t c_ValuesPerSegment = 16 * 1024;
+
 void NodeInput::Validate() const
 {
     if (mode == InputMode::Full)
@@ -305,83 +311,133 @@ void NeuralNetwork::Init(const std::vector<NodePtr>& nodes)
     m_nodes = nodes;
 }
 
-const Values& NeuralNetwork::Run(const InputDesc& inputDesc, NeuralNetworkRunContext& ctx) const
+void NeuralNetwork::BindNodeInputs(size_t i, const InputDesc& inputDesc, NeuralNetworkRunContext& ctx) const
 {
-    ASSERT(m_nodes.size() == ctx.nodeContexts.size());
+    const NodePtr& node = m_nodes[i];
 
-    for (size_t i = 0; i < m_nodes.size(); i++)
+    if (node->IsCombining())
     {
-        const NodePtr& node = m_nodes[i];
+        const ICombiningNode* concatNode = static_cast<const ICombiningNode*>(node.get());
+        ICombiningNode::Context& nodeCtx = static_cast<ICombiningNode::Context&>(*ctx.nodeContexts[i]);
 
-        if (node->IsCombining())
+        // match node context inputs to the outputs of the previous nodes
+        for (size_t j = 0; j < i; j++)
         {
-            const ICombiningNode* concatNode = static_cast<const ICombiningNode*>(node.get());
-            ICombiningNode::Context& nodeCtx = static_cast<ICombiningNode::Context&>(*ctx.nodeContexts[i]);
-
-            // match node context inputs to the outputs of the previous nodes
-            for (size_t j = 0; j < i; j++)
-            {
-                if (m_nodes[j].get() == concatNode->GetInputNode(0))
-                {
-                    nodeCtx.inputs = ctx.nodeContexts[j]->outputs;
-                }
-                else if (m_nodes[j].get() == concatNode->GetInputNode(1))
-                {
-                    nodeCtx.secondaryInputs = ctx.nodeContexts[j]->outputs;
-                }
-            }
-        }
-        else if (node->IsInputNode())
-        {
-            ASSERT(i < MaxInputNodes);
-            const NodeInput& input = inputDesc.inputs[i];
-
-            switch (input.mode)
-            {
-            case InputMode::Full:
-            {
-                FullyConnectedNode::Context& nodeCtx = static_cast<FullyConnectedNode::Context&>(*ctx.nodeContexts[i]);
-                ASSERT(node->GetInputMode() == InputMode::Full);
-                ASSERT(input.numFeatures == node->GetNumInputs());
-                nodeCtx.inputs = std::span<const float>(input.floatValues, input.numFeatures);
-                node->Run(nodeCtx);
-                break;
-            }
-            case InputMode::Sparse:
+            if (m_nodes[j].get() == concatNode->GetInputNode(0))
             {
-                SparseInputNode::Context& nodeCtx = static_cast<SparseInputNode::Context&>(*ctx.nodeContexts[i]);
-                ASSERT(node->GetInputMode() == InputMode::Sparse);
-                ASSERT(input.numFeatures <= node->GetNumInputs());
-                nodeCtx.sparseInputs = std::span<const ActiveFeature>(input.floatFeatures, input.numFeatures);
-                node->Run(nodeCtx);
-                break;
+                nodeCtx.inputs = ctx.nodeContexts[j]->outputs;
             }
-            case InputMode::SparseBinary:
+            else if (m_nodes[j].get() == concatNode->GetInputNode(1))
             {
-                SparseBinaryInputNode::Context& nodeCtx = static_cast<SparseBinaryInputNode::Context&>(*ctx.nodeContexts[i]);
-                ASSERT(node->GetInputMode() == InputMode::SparseBinary);
-                ASSERT(input.numFeatures <= node->GetNumInputs());
-                nodeCtx.sparseInputs = std::span<const SparseBinaryInputNode::IndexType>(input.binaryFeatures, input.numFeatures);
-                node->Run(nodeCtx);
-                break;
-            }
-            default:
-                ASSERT(false);
+                nodeCtx.secondaryInputs = ctx.nodeContexts[j]->outputs;
             }
         }
-        else
+    }
+    else if (node->IsInputNode())
+    {
+        ASSERT(i < MaxInputNodes);
+        const NodeInput& input = inputDesc.inputs[i];
+
+        switch (input.mode)
+        {
+        case InputMode::Full:
         {
-            ctx.nodeContexts[i]->inputs = ctx.nodeContexts[i - 1]->outputs;
+            FullyConnectedNode::Context& nodeCtx = static_cast<FullyConnectedNode::Context&>(*ctx.nodeContexts[i]);
+            ASSERT(node->GetInputMode() == InputMode::Full);
+            ASSERT(input.numFeatures == node->GetNumInputs());
+            nodeCtx.inputs = std::span<const float>(input.floatValues, input.numFeatures);
+            break;
         }
+        case InputMode::Sparse:
+        {
+            SparseInputNode::Context& nodeCtx = static_cast<SparseInputNode::Context&>(*ctx.nodeContexts[i]);
+            ASSERT(node->GetInputMode() == InputMode::Sparse);
+            ASSERT(input.numFeatures <= node->GetNumInputs());
+            nodeCtx.sparseInputs = std::span<const ActiveFeature>(input.floatFeatures, input.numFeatures);
+            break;
+        }
+        case InputMode::SparseBinary:
+        {
+            SparseBinaryInputNode::Context& nodeCtx = static_cast<SparseBinaryInputNode::Context&>(*ctx.nodeContexts[i]);
+            ASSERT(node->GetInputMode() == InputMode::SparseBinary);
+            ASSERT(input.numFeatures <= node->GetNumInputs());
+            nodeCtx.sparseInputs = std::span<const SparseBinaryInputNode::IndexType>(input.binaryFeatures, input.numFeatures);
+            break;
+        }
+        default:
+            ASSERT(false);
+        }
+    }
+    else
+    {
+        ctx.nodeContexts[i]->inputs = ctx.nodeContexts[i - 1]->outputs;
+    }
+
+    ctx.nodeContexts[i]->variant = inputDesc.variant;
+}
 
-        ctx.nodeContexts[i]->variant = inputDesc.variant;
+const Values& NeuralNetwork::Run(const InputDesc& inputDesc, NeuralNetworkRunContext& ctx) const
+{
+    ASSERT(m_nodes.size() == ctx.nodeContexts.size());
 
-        node->Run(*ctx.nodeContexts[i]);
+    for (size_t i = 0; i < m_nodes.size(); i++)
+    {
+        BindNodeInputs(i, inputDesc, ctx);
+        m_nodes[i]->Run(*ctx.nodeContexts[i]);
     }
 
     return ctx.nodeContexts.back()->outputs;
 }
 
+void NeuralNetwork::RunTile(const InputDesc* const* inputDescs, NeuralNetworkRunContext* const* contexts, uint32_t numSamples) const
+{
+    ASSERT(numSamples <= MaxTileSize);
+
+    INodeContext* nodeContexts[MaxTileSize];
+
+    for (size_t i = 0; i < m_nodes.size(); i++)
+    {
+        for (uint32_t j = 0; j < numSamples; ++j)
+        {
+            ASSERT(m_nodes.size() == contexts[j]->nodeContexts.size());
+            BindNodeInputs(i, *inputDescs[j], *contexts[j]);
+            nodeContexts[j] = contexts[j]->nodeContexts[i].get();
+        }
+
+        m_nodes[i]->RunTile(nodeContexts, numSamples);
+    }
+}
+
+const char* NeuralNetworkTrainer::StageToString(Stage stage)
+{
+    switch (stage)
+    {
+    case Stage::Forward:            return "forward";
+    case Stage::Backpropagation:    return "backprop";
+    case Stage::GradientReduction:  return "reduction";
+    case Stage::WeightsUpdate:      return "update";
+    default:                        return "unknown";
+    }
+}
+
+float NeuralNetworkTrainer::GetStageTime(Stage stage) const
+{
+    float time = 0.0f;
+    for (const PerThreadData& threadData : m_perThreadData)
+    {
+        time += threadData.stageTimes[static_cast<size_t>(stage)];
+    }
+    return time;
+}
+
+void NeuralNetworkTrainer::ResetStageTimes()
+{
+    for (PerThreadData& threadData : m_perThreadData)
+    {
+        std::fill(std::begin(threadData.stageTimes), std::end(threadData.stageTimes), 0.0f);
+    }
+}
+
 NeuralNetworkTrainer::NeuralNetworkTrainer()
 {
     m_perThreadData.resize(ThreadPool::GetInstance().GetNumThreads());
@@ -405,33 +461,60 @@ void NeuralNetworkTrainer::Init(NeuralNetwork& network)
         }
     }
 
-    for (PerThreadData& threadData : m_perThreadData)
-    {
-        threadData.runContext.Init(network);
+    m_updateRows.resize(m_weightsStorages.size());
 
-        threadData.perWeightsStorageGradients.resize(m_weightsStorages.size());
-        for (size_t i = 0; i < m_weightsStorages.size(); ++i)
+    // initialize per-thread data on the thread's NUMA node, so the gradients memory is first touched there
+    ThreadPool& threadPool = ThreadPool::GetInstance();
+    Waitable waitable;
+    {
+        TaskBuilder taskBuilder(waitable);
+        for (uint32_t threadIdx = 0; threadIdx < m_perThreadData.size(); ++threadIdx)
         {
-            const WeightsStorage* weightsStorage = m_weightsStorages[i];
-            threadData.perWeightsStorageGradients[i].Init(
-                weightsStorage->m_inputSize, weightsStorage->m_outputSize, (uint32_t)weightsStorage->m_variants.size(), weightsStorage->m_isSparse);
+            taskBuilder.Task("InitThreadData", [this, &network, threadIdx](const TaskContext&)
+            {
+                PerThreadData& threadData = m_perThreadData[threadIdx];
+                for (NeuralNetworkRunContext& runContext : threadData.runContexts)
+                {
+                    runContext.Init(network);
+                }
+
+                threadData.perWeightsStorageGradients.resize(m_weightsStorages.size());
+                for (size_t i = 0; i < m_weightsStorages.size(); ++i)
+                {
+                    const WeightsStorage* weightsStorage = m_weightsStorages[i];
+                    threadData.perWeightsStorageGradients[i].Init(
+                        weightsStorage->m_inputSize, weightsStorage->m_outputSize, (uint32_t)weightsStorage->m_variants.size(), weightsStorage->m_isSparse);
+                }
+
+                // assign per-node gradients pointers
+                threadData.perNodeGradients.resize(network.m_nodes.size(), nullptr);
+                for (size_t i = 0; i < network.m_nodes.size(); ++i)
+                {
+                    if (network.m_nodes[i]->IsTrainable())
+                    {
+                        WeightsStorage* weightsStorage = static_cast<const ITrainableNode*>(network.m_nodes[i].get())->GetWeightsStorage();
+                        ASSERT(weightsStorage);
+
+                        // find the index of the storage in the list
+                        const auto it = std::find(m_weightsStorages.begin(), m_weightsStorages.end(), weightsStorage);
+                        ASSERT(it != m_weightsStorages.end());
+                        const size_t storageIdx = std::distance(m_weightsStorages.begin(), it);
+                        threadData.perNodeGradients[i] = &threadData.perWeightsStorageGradients[storageIdx];
+                    }
+                }
+            }, 1, threadPool.GetWorkerNode(threadIdx));
         }
+    }
+    waitable.Wait();
 
-        // assign per-node gradients pointers
-        threadData.perNodeGradients.resize(network.m_nodes.size(), nullptr);
-        for (size_t i = 0; i < network.m_nodes.size(); ++i)
+    // per-thread gradients reduced into the first thread's gradients
+    m_reductionSources.resize(m_weightsStorages.size());
+    for (size_t i = 0; i < m_weightsStorages.size(); ++i)
+    {
+        m_reductionSources[i].clear();
+        for (size_t threadIdx = 1; threadIdx < m_perThreadData.size(); ++threadIdx)
         {
-            if (network.m_nodes[i]->IsTrainable())
-            {
-                WeightsStorage* weightsStorage = static_cast<const ITrainableNode*>(network.m_nodes[i].get())->GetWeightsStorage();
-                ASSERT(weightsStorage);
-
-                // find the index of the storage in the list
-                const auto it = std::find(m_weightsStorages.begin(), m_weightsStorages.end(), weightsStorage);
-                ASSERT(it != m_weightsStorages.end());
-                const size_t storageIdx = std::distance(m_weightsStorages.begin(), it);
-                threadData.perNodeGradients[i] = &threadData.perWeightsStorageGradients[storageIdx];
-            }
+            m_reductionSources[i].push_back(&m_perThreadData[threadIdx].perWeightsStorageGradients[i]);
         }
     }
 }
@@ -444,55 +527,86 @@ size_t NeuralNetworkTrainer::Train(NeuralNetwork& network, const TrainingSet& tr
     {
         const auto clearGradientsFunc = [this](uint32_t threadIdx)
         {
+            const TimePoint startTime = TimePoint::GetCurrent();
+
             // clear gradients
             for (Gradients& gradients : m_perThreadData[threadIdx].perWeightsStorageGradients)
             {
                 gradients.Clear();
             }
+
+            m_perThreadData[threadIdx].stageTimes[static_cast<size_t>(Stage::GradientReduction)] += (TimePoint::GetCurrent() - startTime).ToSeconds();
         };
 
-        const auto backpropagateFunc = [this, &network, &trainingSet, batchIdx, params](uint32_t threadIdx, uint32_t indexInBatch)
+        // forward and backward pass over a tile of up to MaxTileSize consecutive samples,
+        // so the nodes can reuse weights and gradients loaded into registers across the samples
+        const auto backpropagateTileFunc = [this, &network, &trainingSet, batchIdx, params](uint32_t threadIdx, uint32_t tileIndex)
         {
             PerThreadData& perThreadData = m_perThreadData[threadIdx];
-            NeuralNetworkRunContext& ctx = perThreadData.runContext;
 
-            const size_t vecIndex = batchIdx * params.batchSize + indexInBatch;
-            if (vecIndex >= trainingSet.size()) return;
+            const size_t batchStart = batchIdx * params.batchSize;
+            const size_t batchEnd = std::min(batchStart + params.batchSize, trainingSet.size());
+            const size_t tileStart = batchStart + (size_t)tileIndex * MaxTileSize;
+            if (tileStart >= batchEnd) return;
+
+            const uint32_t numSamples = (uint32_t)std::min<size_t>(MaxTileSize, batchEnd - tileStart);
+
+            const InputDesc* inputDescs[MaxTileSize];
+            NeuralNetworkRunContext* contexts[MaxTileSize];
+            INodeContext* nodeContexts[MaxTileSize];
+            const Values* errors[MaxTileSize];
 
-            const TrainingVector& vec = trainingSet[vecIndex];
+            for (uint32_t j = 0; j < numSamples; ++j)
+            {
+                inputDescs[j] = &trainingSet[tileStart + j].input;
+                contexts[j] = &perThreadData.runContexts[j];
+            }
 
-            ctx.tempValues = network.Run(vec.input, ctx);
+            const TimePoint forwardStartTime = TimePoint::GetCurrent();
+
+            network.RunTile(inputDescs, contexts, numSamples);
+
+            const TimePoint backpropagationStartTime = TimePoint::GetCurrent();
+            perThreadData.stageTimes[static_cast<size_t>(Stage::Forward)] += (backpropagationStartTime - forwardStartTime).ToSeconds();
 
             // train last node
             {
                 const float errorScale = 2.0f;
 
-                // compute gradient (error derivative)
-                if (vec.output.mode == OutputMode::Single)
+                for (uint32_t j = 0; j < numSamples; ++j)
                 {
-                    ASSERT(ctx.tempValues.size() == 1u);
-                    ctx.tempValues[0] = errorScale * (ctx.tempValues[0] - vec.output.singleValue);
-                }
-                else if (vec.output.mode == OutputMode::Full)
-                {
-                    ASSERT(ctx.tempValues.size() == vec.output.numValues);
-                    for (size_t i = 0; i < ctx.tempValues.size(); i++)
+                    const TrainingVector& vec = trainingSet[tileStart + j];
+                    NeuralNetworkRunContext& ctx = *contexts[j];
+
+                    ctx.tempValues = ctx.nodeContexts.back()->outputs;
+
+                    // compute gradient (error derivative)
+                    if (vec.output.mode == OutputMode::Single)
                     {
-                        // compute gradient (error derivative)
-                        ctx.tempValues[i] = errorScale * (ctx.tempValues[i] - vec.output.floatValues[i]);
+                        ASSERT(ctx.tempValues.size() == 1u);
+                        ctx.tempValues[0] = errorScale * (ctx.tempValues[0] - vec.output.singleValue);
+                    }
+                    else if (vec.output.mode == OutputMode::Full)
+                    {
+                        ASSERT(ctx.tempValues.size() == vec.output.numValues);
+                        for (size_t i = 0; i < ctx.tempValues.size(); i++)
+                        {
+                            // compute gradient (error derivative)
+                            ctx.tempValues[i] = errorScale * (ctx.tempValues[i] - vec.output.floatValues[i]);
+                        }
+                    }
+                    else
+                    {
+                        ASSERT(false);
                     }
-                }
-                else
-                {
-                    ASSERT(false);
-                }
 
-                ctx.nodeContexts.back()->variant = vec.input.variant;
+                    ctx.nodeContexts.back()->variant = vec.input.variant;
 
-                network.m_nodes.back()->Backpropagate(
-                    ctx.tempValues,
-                    *ctx.nodeContexts.back(),
-                    *perThreadData.perNodeGradients.back());
+                    errors[j] = &ctx.tempValues;
+                    nodeContexts[j] = ctx.nodeContexts.back().get();
+                }
+
+                network.m_nodes.back()->BackpropagateTile(errors, nodeContexts, numSamples, *perThreadData.perNodeGradients.back());
             }
 
             // train hidden m_nodes
@@ -502,17 +616,27 @@ size_t NeuralNetworkTrainer::Train(NeuralNetwork& network, const TrainingSet& tr
                 {
                     const NodePtr& node = network.m_nodes[i];
                     ASSERT(node);
-                    ASSERT(ctx.inputErrors[i]);
 
-                    ctx.nodeContexts[i]->variant = vec.input.variant;
+                    for (uint32_t j = 0; j < numSamples; ++j)
+                    {
+                        NeuralNetworkRunContext& ctx = *contexts[j];
+                        ASSERT(ctx.inputErrors[i]);
+
+                        ctx.nodeContexts[i]->variant = inputDescs[j]->variant;
+
+                        errors[j] = ctx.inputErrors[i];
+                        nodeContexts[j] = ctx.nodeContexts[i].get();
+                    }
 
-                    node->Backpropagate(*ctx.inputErrors[i],
-                                        *ctx.nodeContexts[i],
-                                        *perThreadData.perNodeGradients[i]);
+                    node->BackpropagateTile(errors, nodeContexts, numSamples, *perThreadData.perNodeGradients[i]);
                 }
             }
+
+            perThreadData.stageTimes[static_cast<size_t>(Stage::Backpropagation)] += (TimePoint::GetCurrent() - backpropagationStartTime).ToSeconds();
         };
 
+        const uint32_t numTiles = (uint32_t)((params.batchSize + MaxTileSize - 1) / MaxTileSize);
+
         /*
         const auto updateWeightsFunc = [this, batchIdx, params]()
         {
@@ -536,11 +660,8 @@ size_t NeuralNetworkTrainer::Train(NeuralNetwork& network, const TrainingSet& tr
                 for (uint32_t inputIndex = 0; inputIndex <= weightsStorage->m_inputSize; ++inputIndex)
                 {
                     // accumulate gradients from all per-thread gradients
-                    for (size_t threadIdx = 1; threadIdx < m_perThreadData.size(); ++threadIdx)
-                    {
-                        Gradients& srcGradients = m_perThreadData[threadIdx].perWeightsStorageGradients[weightsStorageIndex];
-                        gradients.Accumulate(srcGradients, inputIndex);
-                    }
+                    const std::vector<Gradients*>& sources = m_reductionSources[weightsStorageIndex];
+                    gradients.AccumulateRows(sources.data(), sources.size(), inputIndex, inputIndex + 1);
 
                     // apply weights update
                     switch (params.optimizer)
@@ -566,98 +687,136 @@ size_t NeuralNetworkTrainer::Train(NeuralNetwork& network, const TrainingSet& tr
                 taskBuilder->Fence();
             }
 
-            // clear accumulated gradients
-            taskBuilder->ParallelFor("ClearGradients", (uint32_t)m_perThreadData.size(),
-                                     [clearGradientsFunc](const TaskContext&, uint32_t threadIdx)
+            // clear accumulated gradients (on the node the gradients were allocated on)
+            for (uint32_t threadIdx = 0; threadIdx < m_perThreadData.size(); ++threadIdx)
             {
-                clearGradientsFunc(threadIdx);
-            });
+                taskBuilder->Task("ClearGradients", [clearGradientsFunc, threadIdx](const TaskContext&)
+                {
+                    clearGradientsFunc(threadIdx);
+                }, 1, ThreadPool::GetInstance().GetWorkerNode(threadIdx));
+            }
 
             taskBuilder->Fence();
 
-            taskBuilder->ParallelFor("Backpropagate", (uint32_t)params.batchSize,
-                                     [backpropagateFunc](const TaskContext& taskCtx, uint32_t indexInBatch)
+            taskBuilder->ParallelFor("Backpropagate", numTiles,
+                                     [backpropagateTileFunc](const TaskContext& taskCtx, uint32_t tileIndex)
             {
-                backpropagateFunc(taskCtx.threadId, indexInBatch);
+                backpropagateTileFunc(taskCtx.threadId, tileIndex);
             });
 
             taskBuilder->Fence();
 
             for (size_t weightsStorageIndex = 0; weightsStorageIndex < m_weightsStorages.size(); ++weightsStorageIndex)
             {
-                MTR_SCOPE("NeuralNetworkTrainer::Train", "UpdateWeights");
-
                 WeightsStorage* weightsStorage = m_weightsStorages[weightsStorageIndex];
                 ASSERT(weightsStorage);
 
                 if (!weightsStorage->m_updateWeights) continue;
 
-                //for (uint32_t inputIndex = 0; inputIndex <= weightsStorage->m_inputSize; ++inputIndex)
-                taskBuilder->ParallelFor("UpdateWeights", weightsStorage->m_inputSize + 1,
-                    [this, weightsStorageIndex, params, batchIdx](const TaskContext&, uint32_t inputIndex)
+                taskBuilder->Task("UpdateWeights", [this, weightsStorageIndex, params, batchIdx](const TaskContext& ctx)
                 {
+                    MTR_SCOPE("NeuralNetworkTrainer::Train", "UpdateWeights");
+
+                    const TimePoint startTime = TimePoint::GetCurrent();
+
                     WeightsStorage* weightsStorage = m_weightsStorages[weightsStorageIndex];
                     ASSERT(weightsStorage);
 
                     Gradients& gradients = m_perThreadData.front().perWeightsStorageGradients[weightsStorageIndex];
 
-                    // accumulate gradients from all per-thread gradients
+                    // gather rows that received gradients on any thread
                     for (size_t threadIdx = 1; threadIdx < m_perThreadData.size(); ++threadIdx)
                     {
-                        Gradients& srcGradients = m_perThreadData[threadIdx].perWeightsStorageGradients[weightsStorageIndex];
-                        gradients.Accumulate(srcGradients, inputIndex);
+                        gradients.MergeDirtyRows(m_perThreadData[threadIdx].perWeightsStorageGradients[weightsStorageIndex]);
                     }
 
-                    WeightsStorage::WeightsUpdateOptions updateOptions;
-                    updateOptions.iteration = params.iteration + batchIdx;
-                    updateOptions.weightDecay = params.weightDecay;
-                    updateOptions.learningRate = params.learningRate;
-                    updateOptions.gradientScale = 1.0f; // 1.0f / (float)params.batchSize;
+                    weightsStorage->m_numUpdates++;
 
-                    // apply weights update
-                    switch (params.optimizer)
+                    // lazy update visits only the dirty rows, otherwise every row is updated
+                    const bool lazy = params.lazyUpdate && weightsStorage->m_isSparse && params.optimizer == Optimizer::Adam;
+
+                    std::vector<uint32_t>& rows = m_updateRows[weightsStorageIndex];
+                    rows.clear();
+                    if (lazy)
                     {
-                    case Optimizer::Adadelta:
-                        weightsStorage->Update_Adadelta(gradients, inputIndex, updateOptions);
-                        break;
-                    case Optimizer::Adam:
-                        weightsStorage->Update_Adam(gradients, inputIndex, updateOptions);
-                        break;
-                    default:
-                        DEBUG_BREAK();
+                        for (const Gradients::Variant& variant : gradients.m_variants)
+                        {
+                            rows.insert(rows.end(), variant.m_dirtyRows.begin(), variant.m_dirtyRows.end());
+                        }
+                        std::sort(rows.begin(), rows.end());
+                        rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
                     }
-                });
-            }
 
-            taskBuilder->Fence();
-
-            taskBuilder->Task("UpdateGradientsDirtyFlag", [this](const TaskContext&)
-            {
-                for (size_t weightsStorageIndex = 0; weightsStorageIndex < m_weightsStorages.size(); ++weightsStorageIndex)
-                {
-                    WeightsStorage* weightsStorage = m_weightsStorages[weightsStorageIndex];
-                    ASSERT(weightsStorage);
+                    const uint32_t numRows = lazy ? (uint32_t)rows.size() : (weightsStorage->m_inputSize + 1);
 
-                    if (!weightsStorage->m_updateWeights) continue;
-                    if (!weightsStorage->m_isSparse) continue;
+                    // each task owns a segment of rows and sums the per-thread gradients of the segment
+                    const uint32_t rowsPerSegment = lazy ? c_SparseRowsPerSegment : std::max(1u, c_ValuesPerSegment / weightsStorage->m_outputSize);
+                    const uint32_t numSegments = (numRows + rowsPerSegment - 1) / rowsPerSegment;
 
-                    Gradients& gradients = m_perThreadData.front().perWeightsStorageGradients[weightsStorageIndex];
+                    m_perThreadData[ctx.threadId].stageTimes[static_cast<size_t>(Stage::GradientReduction)] += (TimePoint::GetCurrent() - startTime).ToSeconds();
 
-                    for (size_t threadIdx = 1; threadIdx < m_perThreadData.size(); ++threadIdx)
+                    TaskBuilder taskBuilder{ ctx };
+                    taskBuilder.ParallelFor("UpdateWeights", numSegments,
+                        [this, weightsStorageIndex, params, batchIdx, lazy, numRows, rowsPerSegment](const TaskContext& segmentCtx, uint32_t segmentIndex)
                     {
-                        Gradients& srcGradients = m_perThreadData[threadIdx].perWeightsStorageGradients[weightsStorageIndex];
-                        for (uint32_t i = 0; i < weightsStorage->m_inputSize + 1; ++i)
+                        const TimePoint reductionStartTime = TimePoint::GetCurrent();
+
+                        WeightsStorage* weightsStorage = m_weightsStorages[weightsStorageIndex];
+                        ASSERT(weightsStorage);
+
+                        const uint32_t rowBegin = segmentIndex * rowsPerSegment;
+                        const uint32_t rowEnd = std::min(rowBegin + rowsPerSegment, numRows);
+
+                        Gradients& gradients = m_perThreadData.front().perWeightsStorageGradients[weightsStorageIndex];
+                        const std::vector<Gradients*>& sources = m_reductionSources[weightsStorageIndex];
+                        const std::vector<uint32_t>& rows = m_updateRows[weightsStorageIndex];
+
+                        // accumulate gradients from all per-thread gradients
+                        if (lazy)
+                        {
+                            for (uint32_t rowIndex = rowBegin; rowIndex < rowEnd; ++rowIndex)
+                            {
+                                gradients.AccumulateRows(sources.data(), sources.size(), rows[rowIndex], rows[rowIndex] + 1);
+                            }
+                        }
+                        else
                         {
-                            gradients.Accumulate_UpdateDirtyFlags(srcGradients, i);
+                            gradients.AccumulateRows(sources.data(), sources.size(), rowBegin, rowEnd);
+                        }
+
+                        const TimePoint updateStartTime = TimePoint::GetCurrent();
+
+                        WeightsStorage::WeightsUpdateOptions updateOptions;
+                        updateOptions.iteration = params.iteration + batchIdx;
+                        updateOptions.weightDecay = params.weightDecay;
+                        updateOptions.learningRate = params.learningRate;
+                        updateOptions.gradientScale = 1.0f; // 1.0f / (float)params.batchSize;
+                        updateOptions.lazy = lazy;
 
-                            //for (const Gradients::Variant& variant : srcGradients.m_variants)
-                            //{
-                            //    ASSERT(!variant.m_dirty[i]);
-                            //}
+                        for (uint32_t rowIndex = rowBegin; rowIndex < rowEnd; ++rowIndex)
+                        {
+                            const uint32_t inputIndex = lazy ? rows[rowIndex] : rowIndex;
+
+                            // apply weights update
+                            switch (params.optimizer)
+                            {
+                            case Optimizer::Adadelta:
+                                weightsStorage->Update_Adadelta(gradients, inputIndex, updateOptions);
+                                break;
+                            case Optimizer::Adam:
+                                weightsStorage->Update_Adam(gradients, inputIndex, updateOptions);
+                                break;
+                            default:
+                                DEBUG_BREAK();
+                            }
                         }
-                    }
-                }
-            });
+
+                        float* stageTimes = m_perThreadData[segmentCtx.threadId].stageTimes;
+                        stageTimes[static_cast<size_t>(Stage::GradientReduction)] += (updateStartTime - reductionStartTime).ToSeconds();
+                        stageTimes[static_cast<size_t>(Stage::WeightsUpdate)] += (TimePoint::GetCurrent() - updateStartTime).ToSeconds();
+                    });
+                });
+            }
         }
         else // single-threaded
         {
@@ -665,9 +824,9 @@ size_t NeuralNetworkTrainer::Train(NeuralNetwork& network, const TrainingSet& tr
 
             clearGradientsFunc(dummyThreadIdx);
 
-            for (uint32_t indexInBatch = 0; indexInBatch < (uint32_t)params.batchSize; ++indexInBatch)
+            for (uint32_t tileIndex = 0; tileIndex < numTiles; ++tileIndex)
             {
-                backpropagateFunc(dummyThreadIdx, indexInBatch);
+                backpropagateTileFunc(dummyThreadIdx, tileIndex);
             }
 
             //TODO
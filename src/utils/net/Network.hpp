@@ -126,10 +126,17 @@ public:
     // Calculate neural network output based on input
     const Values& Run(const InputDesc& inputDesc, NeuralNetworkRunContext& ctx) const;
 
+    // Calculate outputs for a mini-batch tile of samples (up to MaxTileSize), each node processes all the samples at once
+    // The outputs are left in the last node context of each sample.
+    void RunTile(const InputDesc* const* inputDescs, NeuralNetworkRunContext* const* contexts, uint32_t numSamples) const;
+
     void PrintStats() const;
 
 private:
 
+    // point node context inputs at the previous nodes outputs or network inputs
+    void BindNodeInputs(size_t nodeIndex, const InputDesc& inputDesc, NeuralNetworkRunContext& ctx) const;
+
     std::vector<NodePtr> m_nodes;
 };
 
@@ -147,28 +154,53 @@ struct TrainParams
     float weightDecay = 1.0e-5f;
     Optimizer optimizer = Optimizer::Adadelta;
     bool clampWeights = true;
+
+    // update only the rows of sparse weights that received gradients in the batch (lazy Adam)
+    bool lazyUpdate = true;
 };
 
 class NeuralNetworkTrainer
 {
 public:
 
+    enum class Stage : uint8_t
+    {
+        Forward,            // forward pass
+        Backpropagation,    // backward pass (per-thread gradients)
+        GradientReduction,  // clearing and summing the per-thread gradients
+        WeightsUpdate,      // optimizer step
+        Count
+    };
+
+    static const char* StageToString(Stage stage);
+
     NeuralNetworkTrainer();
 
     void Init(NeuralNetwork& network);
     size_t Train(NeuralNetwork& network, const TrainingSet& trainingSet, const TrainParams& params, threadpool::TaskBuilder* taskBuilder = nullptr);
 
+    // time spent in a stage summed over all the threads since the last reset (in seconds)
+    float GetStageTime(Stage stage) const;
+    void ResetStageTimes();
+
 private:
 
     struct PerThreadData
     {
         std::vector<Gradients*> perNodeGradients;
         std::vector<Gradients>  perWeightsStorageGradients;
-        NeuralNetworkRunContext runContext;
+        NeuralNetworkRunContext runContexts[MaxTileSize];  // one per sample of a mini-batch tile
+        float stageTimes[static_cast<size_t>(Stage::Count)] = {};
     };
 
     std::vector<WeightsStorage*> m_weightsStorages;
     std::vector<PerThreadData> m_perThreadData;
+
+    // rows to update per weights storage (lazy update only)
+    std::vector<std::vector<uint32_t>> m_updateRows;
+
+    // per weights storage gradients of the threads other than the first one, summed into the first thread's gradients
+    std::vector<std::vector<Gradients*>> m_reductionSources;
 };
 
 } // namespace nn
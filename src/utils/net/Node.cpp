@@ -10,4 +10,20 @@ INode::INode(uint32_t numInputs, uint32_t numOutputs)
 {
 }
 
+void INode::RunTile(INodeContext* const* contexts, uint32_t numSamples) const
+{
+    for (uint32_t i = 0; i < numSamples; ++i)
+    {
+        Run(*contexts[i]);
+    }
+}
+
+void INode::BackpropagateTile(const Values* const* errors, INodeContext* const* contexts, uint32_t numSamples, Gradients& gradients) const
+{
+    for (uint32_t i = 0; i < numSamples; ++i)
+    {
+        Backpropagate(*errors[i], *contexts[i], gradients);
+    }
+}
+
 } // namespace nn
@@ -10,6 +10,9 @@ namespace nn {
 // how many nodes in the network can be input nodes
 static constexpr uint32_t MaxInputNodes = 4;
 
+// maximum number of samples in a mini-batch tile processed by a node at once
+static constexpr uint32_t MaxTileSize = 16;
+
 struct Gradients;
 
 enum class InputMode : uint8_t
@@ -54,6 +57,12 @@ public:
     virtual void Run(INodeContext& ctx) const = 0;
     virtual void Backpropagate(const Values& error, INodeContext& ctx, Gradients& gradients) const = 0;
 
+    // Process a mini-batch tile of samples (up to MaxTileSize), one context per sample.
+    // Nodes override these to reuse weights and gradients across the samples,
+    // the default implementation processes the samples one by one.
+    virtual void RunTile(INodeContext* const* contexts, uint32_t numSamples) const;
+    virtual void BackpropagateTile(const Values* const* errors, INodeContext* const* contexts, uint32_t numSamples, Gradients& gradients) const;
+
     virtual bool IsTrainable() const { return false; }
     virtual bool IsInputNode() const { return false; }
     virtual bool IsCombining() const { return false; }
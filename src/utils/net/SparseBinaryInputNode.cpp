@@ -6,6 +6,9 @@ namespace nn {
 
 static constexpr uint32_t c_NumRegisters = 8;
 
+// how many samples ahead the feature rows are prefetched when processing a mini-batch tile
+static constexpr uint32_t c_PrefetchDistance = 2;
+
 SparseBinaryInputNode::SparseBinaryInputNode(uint32_t inputSize, uint32_t outputSize, const nn::WeightsStoragePtr& weights)
     : ITrainableNode(nullptr, weights, inputSize, outputSize)
 {
@@ -108,7 +111,7 @@ void SparseBinaryInputNode::Backpropagate(const Values& error, INodeContext& ctx
     // mark gradients as dirty
     for (const IndexType featureIdx : context.sparseInputs)
     {
-        gradientsVariant.m_dirty[featureIdx] = true;
+        gradientsVariant.MarkDirty(featureIdx);
     }
 
 #else
@@ -121,7 +124,7 @@ void SparseBinaryInputNode::Backpropagate(const Values& error, INodeContext& ctx
             // not multiplying by input value, because it's equal to 1.0
             gradientsVariant.m_values[j * m_numOutputs + i] += error[i];
         }
-        gradientsVariant.m_dirty[j] = true;
+        gradientsVariant.MarkDirty(j);
     }
 #endif // USE_AVX
 
@@ -142,8 +145,180 @@ void SparseBinaryInputNode::Backpropagate(const Values& error, INodeContext& ctx
         {
             gradientsVariant.m_values[m_numInputs * m_numOutputs + i] += error[i];
         }
-        gradientsVariant.m_dirty[m_numInputs] = true;
+        gradientsVariant.MarkDirty(m_numInputs);
+    }
+}
+
+#ifdef USE_AVX
+
+// prefetch a chunk of weights (or gradients) rows of a sample later in the tile,
+// so the rows are already in cache when the sample is processed
+INLINE static void PrefetchRowsChunk(const float* basePtr, std::span<const SparseBinaryInputNode::IndexType> features, uint32_t rowSize, uint32_t chunkBase)
+{
+    for (const SparseBinaryInputNode::IndexType featureIdx : features)
+    {
+        const char* ptr = reinterpret_cast<const char*>(basePtr + featureIdx * rowSize + chunkBase);
+        for (uint32_t i = 0; i < c_NumRegisters * 8u * sizeof(float); i += CACHELINE_SIZE)
+            _mm_prefetch(ptr + i, _MM_HINT_T0);
+    }
+}
+
+#endif // USE_AVX
+
+void SparseBinaryInputNode::RunTile(INodeContext* const* contexts, uint32_t numSamples) const
+{
+#ifdef USE_AVX
+
+    ASSERT(!m_weightsStorage->m_variants.empty());
+    ASSERT(m_numOutputs % (c_NumRegisters * 8) == 0);
+
+    const uint32_t numTiles = m_numOutputs / (c_NumRegisters * 8u);
+
+    __m256 regs[c_NumRegisters];
+
+    for (uint32_t s = 0; s < numSamples; ++s)
+    {
+        const Context& context = static_cast<const Context&>(*contexts[s]);
+        ASSERT(context.outputs.size() == m_numOutputs);
+
+        const size_t variantIndex = std::min<size_t>(context.variant, m_weightsStorage->m_variants.size() - 1);
+        const float* weightsPtr = m_weightsStorage->m_variants[variantIndex].m_weights.data();
+        const float* biasesPtr = weightsPtr + m_numOutputs * m_numInputs;
+        float* valuesPtr = contexts[s]->outputs.data();
+
+        const Context* prefetchContext = s + c_PrefetchDistance < numSamples ? static_cast<const Context*>(contexts[s + c_PrefetchDistance]) : nullptr;
+        const float* prefetchWeightsPtr = prefetchContext ?
+            m_weightsStorage->m_variants[std::min<size_t>(prefetchContext->variant, m_weightsStorage->m_variants.size() - 1)].m_weights.data() :
+            nullptr;
+
+        for (uint32_t tile = 0; tile < numTiles; ++tile)
+        {
+            const uint32_t chunkBase = tile * (c_NumRegisters * 8u);
+
+            if (prefetchContext)
+                PrefetchRowsChunk(prefetchWeightsPtr, prefetchContext->sparseInputs, m_numOutputs, chunkBase);
+
+            // load biases
+            for (uint32_t i = 0; i < c_NumRegisters; ++i)
+                regs[i] = _mm256_load_ps(biasesPtr + chunkBase + i * 8u);
+
+            // accumulate active feature weights
+            for (const IndexType featureIdx : context.sparseInputs)
+            {
+                const float* rowPtr = weightsPtr + featureIdx * m_numOutputs + chunkBase;
+                for (uint32_t i = 0; i < c_NumRegisters; ++i)
+                    regs[i] = _mm256_add_ps(regs[i], _mm256_load_ps(rowPtr + i * 8u));
+            }
+
+            // store results
+            for (uint32_t i = 0; i < c_NumRegisters; ++i)
+                _mm256_store_ps(valuesPtr + chunkBase + i * 8u, regs[i]);
+        }
     }
+
+#else
+
+    INode::RunTile(contexts, numSamples);
+
+#endif // USE_AVX
+}
+
+void SparseBinaryInputNode::BackpropagateTile(const Values* const* errors, INodeContext* const* contexts, uint32_t numSamples, Gradients& gradients) const
+{
+#ifdef USE_AVX
+
+    ASSERT(!m_weightsStorage->m_variants.empty());
+    ASSERT(gradients.m_isSparse);
+    ASSERT(m_numOutputs % (c_NumRegisters * 8) == 0);
+
+    const uint32_t numTiles = m_numOutputs / (c_NumRegisters * 8u);
+
+    __m256 regs[c_NumRegisters];
+
+    for (uint32_t s = 0; s < numSamples; ++s)
+    {
+        const Context& context = static_cast<const Context&>(*contexts[s]);
+        const size_t variantIndex = std::min<size_t>(context.variant, m_weightsStorage->m_variants.size() - 1);
+        Gradients::Variant& gradientsVariant = gradients.m_variants[variantIndex];
+        float* gradientsPtr = gradientsVariant.m_values.data();
+        const float* errorPtr = errors[s]->data();
+
+        const Context* prefetchContext = s + c_PrefetchDistance < numSamples ? static_cast<const Context*>(contexts[s + c_PrefetchDistance]) : nullptr;
+        const float* prefetchGradientsPtr = prefetchContext ?
+            gradients.m_variants[std::min<size_t>(prefetchContext->variant, m_weightsStorage->m_variants.size() - 1)].m_values.data() :
+            nullptr;
+
+        for (uint32_t tile = 0; tile < numTiles; ++tile)
+        {
+            const uint32_t chunkBase = tile * (c_NumRegisters * 8u);
+
+            if (prefetchContext)
+                PrefetchRowsChunk(prefetchGradientsPtr, prefetchContext->sparseInputs, m_numOutputs, chunkBase);
+
+            // load error into AVX registers, skip registers where error is zero in every lane
+            uint32_t nonZeroMask = 0;
+            for (uint32_t i = 0; i < c_NumRegisters; ++i)
+            {
+                regs[i] = _mm256_load_ps(errorPtr + chunkBase + i * 8u);
+                if (0xFF != _mm256_movemask_ps(_mm256_cmp_ps(regs[i], _mm256_setzero_ps(), _CMP_EQ_OQ)))
+                    nonZeroMask |= 1u << i;
+            }
+
+            if (nonZeroMask == 0)
+                continue;
+
+            // accumulate error to active feature's gradients
+            for (const IndexType featureIdx : context.sparseInputs)
+            {
+                float* gradientPtr = gradientsPtr + featureIdx * m_numOutputs + chunkBase;
+                for (uint32_t i = 0; i < c_NumRegisters; ++i)
+                {
+                    if (nonZeroMask & (1u << i))
+                        _mm256_store_ps(gradientPtr + i * 8u, _mm256_add_ps(_mm256_load_ps(gradientPtr + i * 8u), regs[i]));
+                }
+            }
+        }
+
+        // mark gradients as dirty
+        for (const IndexType featureIdx : context.sparseInputs)
+        {
+            gradientsVariant.MarkDirty(featureIdx);
+        }
+    }
+
+    // add bias gradient, summed over the samples sharing the variant
+    for (uint32_t s = 0; s < numSamples; ++s)
+    {
+        const size_t variantIndex = std::min<size_t>(contexts[s]->variant, m_weightsStorage->m_variants.size() - 1);
+
+        // skip samples already summed with an earlier sample of the same variant
+        bool alreadySummed = false;
+        for (uint32_t k = 0; k < s; ++k)
+            alreadySummed |= std::min<size_t>(contexts[k]->variant, m_weightsStorage->m_variants.size() - 1) == variantIndex;
+        if (alreadySummed)
+            continue;
+
+        Gradients::Variant& gradientsVariant = gradients.m_variants[variantIndex];
+        float* gradientPtr = gradientsVariant.m_values.data() + m_numInputs * m_numOutputs;
+
+        for (uint32_t i = 0; i < m_numOutputs; i += 8u)
+        {
+            __m256 sum = _mm256_load_ps(gradientPtr + i);
+            for (uint32_t k = s; k < numSamples; ++k)
+            {
+                if (std::min<size_t>(contexts[k]->variant, m_weightsStorage->m_variants.size() - 1) == variantIndex)
+                    sum = _mm256_add_ps(sum, _mm256_load_ps(errors[k]->data() + i));
+            }
+            _mm256_store_ps(gradientPtr + i, sum);
+        }
+        gradientsVariant.MarkDirty(m_numInputs);
+    }
+
+#else
+
+    INode::BackpropagateTile(errors, contexts, numSamples, gradients);
+
+#endif // USE_AVX
 }
 
 } // namespace nn
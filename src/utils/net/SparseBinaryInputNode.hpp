@@ -27,6 +27,8 @@ public:
 
     void Run(INodeContext& ctx) const override;
     void Backpropagate(const Values& error, INodeContext& ctx, Gradients& gradients) const override;
+    void RunTile(INodeContext* const* contexts, uint32_t numSamples) const override;
+    void BackpropagateTile(const Values* const* errors, INodeContext* const* contexts, uint32_t numSamples, Gradients& gradients) const override;
     virtual InputMode GetInputMode() const override { return InputMode::SparseBinary; }
     virtual bool IsInputNode() const override { return true; }
 };
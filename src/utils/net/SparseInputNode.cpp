@@ -75,7 +75,7 @@ void SparseInputNode::Backpropagate(const Values& error, INodeContext& ctx, Grad
         {
             gradientsVariant.m_values[feature.index * m_numOutputs + i] += feature.value * error[i];
         }
-        gradientsVariant.m_dirty[feature.index] = true;
+        gradientsVariant.MarkDirty(feature.index);
     }
 
     // add bias gradient
@@ -94,7 +94,7 @@ void SparseInputNode::Backpropagate(const Values& error, INodeContext& ctx, Grad
         {
             gradientsVariant.m_values[m_numInputs * m_numOutputs + i] += error[i];
         }
-        gradientsVariant.m_dirty[m_numInputs] = true;
+        gradientsVariant.MarkDirty(m_numInputs);
     }
 }
 
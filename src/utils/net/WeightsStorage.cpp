@@ -1,5 +1,6 @@
 #include "WeightsStorage.hpp"
 #include "Gradient.hpp"
+#include "../Stream.hpp"
 #include "../minitrace/minitrace.h"
 
 #include <algorithm>
@@ -7,6 +8,67 @@
 
 namespace nn {
 
+// bfloat16 is the upper half of a float, so conversion is just a shift.
+// Stores use stochastic rounding (random lower bits are added before truncation), so the rounding
+// is unbiased on average and small moment updates are not lost to the 8-bit mantissa.
+
+INLINE static uint32_t XorShift(uint32_t& state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+INLINE static float LoadBF16(const uint16_t* ptr)
+{
+    const uint32_t bits = static_cast<uint32_t>(*ptr) << 16;
+    float result;
+    memcpy(&result, &bits, sizeof(float));
+    return result;
+}
+
+INLINE static void StoreBF16(uint16_t* ptr, float value, uint32_t& rng)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(float));
+    bits += XorShift(rng) & 0xFFFF;
+    *ptr = static_cast<uint16_t>(bits >> 16);
+}
+
+#ifdef USE_AVX
+
+INLINE static __m256i XorShift(__m256i& state)
+{
+    state = _mm256_xor_si256(state, _mm256_slli_epi32(state, 13));
+    state = _mm256_xor_si256(state, _mm256_srli_epi32(state, 17));
+    state = _mm256_xor_si256(state, _mm256_slli_epi32(state, 5));
+    return state;
+}
+
+INLINE static __m256 LoadBF16x8(const uint16_t* ptr)
+{
+    const __m256i bits = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr)));
+    return _mm256_castsi256_ps(_mm256_slli_epi32(bits, 16));
+}
+
+INLINE static void StoreBF16x8(uint16_t* ptr, const __m256 value, __m256i& rng)
+{
+    const __m256i noise = _mm256_and_si256(XorShift(rng), _mm256_set1_epi32(0xFFFF));
+    __m256i bits = _mm256_srli_epi32(_mm256_add_epi32(_mm256_castps_si256(value), noise), 16);
+    bits = _mm256_packus_epi32(bits, bits);
+    bits = _mm256_permute4x64_epi64(bits, 0b1000);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(ptr), _mm256_castsi256_si128(bits));
+}
+
+#endif // USE_AVX
+
+// rounding noise seed, different for each row, variant and update
+INLINE static uint64_t GetRoundingSeed(uint32_t inputIndex, size_t variantIndex, uint32_t numUpdates)
+{
+    return Murmur3((static_cast<uint64_t>(numUpdates) << 32) ^ (static_cast<uint64_t>(inputIndex) << 8) ^ variantIndex);
+}
+
 WeightsStorage::WeightsStorage(uint32_t inputSize, uint32_t outputSize, uint32_t numVariants)
     : m_inputSize(inputSize)
     , m_outputSize(outputSize)
@@ -20,6 +82,7 @@ WeightsStorage::WeightsStorage(uint32_t inputSize, uint32_t outputSize, uint32_t
         variant.m_weights.resize(numWeights, 0.0f);
         variant.m_gradientMoment1.resize(numWeights, 0.0f);
         variant.m_gradientMoment2.resize(numWeights, 0.0f);
+        variant.m_rowLastUpdate.resize(inputSize + 1, 0);
     }
 }
 
@@ -29,13 +92,20 @@ void WeightsStorage::Init(uint32_t numActiveNeurons, float bias)
 
     std::fill(m_weightsMask.begin(), m_weightsMask.end(), 1.0f);
 
+    m_numUpdates = 0;
+    for (Variant& variant : m_variants)
+    {
+        std::fill(variant.m_rowLastUpdate.begin(), variant.m_rowLastUpdate.end(), 0);
+        std::fill(variant.m_gradientMoment1.begin(), variant.m_gradientMoment1.end(), 0.0f);
+        std::fill(variant.m_gradientMoment2.begin(), variant.m_gradientMoment2.end(), 0.0f);
+        std::fill(variant.m_packedGradientMoment1.begin(), variant.m_packedGradientMoment1.end(), uint16_t(0));
+        std::fill(variant.m_packedGradientMoment2.begin(), variant.m_packedGradientMoment2.end(), uint16_t(0));
+    }
+
     // init first variant
     {
         Variant& variant = m_variants[0];
 
-        memset(variant.m_gradientMoment1.data(), 0, sizeof(float) * variant.m_gradientMoment1.size());
-        memset(variant.m_gradientMoment2.data(), 0, sizeof(float) * variant.m_gradientMoment2.size());
-
         std::random_device rd;
         std::mt19937 gen(rd());
 
@@ -60,12 +130,134 @@ void WeightsStorage::Init(uint32_t numActiveNeurons, float bias)
     for (size_t i = 1; i < m_variants.size(); i++)
     {
         Variant& variant = m_variants[i];
-        memset(variant.m_gradientMoment1.data(), 0, sizeof(float) * variant.m_gradientMoment1.size());
-        memset(variant.m_gradientMoment2.data(), 0, sizeof(float) * variant.m_gradientMoment2.size());
         memcpy(variant.m_weights.data(), m_variants[0].m_weights.data(), sizeof(float) * variant.m_weights.size());
     }
 }
 
+void WeightsStorage::SetMomentsFormat(MomentsFormat format)
+{
+    if (format == m_momentsFormat)
+        return;
+
+    for (size_t variantIndex = 0; variantIndex < m_variants.size(); ++variantIndex)
+    {
+        Variant& variant = m_variants[variantIndex];
+
+        if (format == MomentsFormat::BFloat16)
+        {
+            const size_t size = variant.m_gradientMoment1.size();
+            variant.m_packedGradientMoment1.resize(size);
+            variant.m_packedGradientMoment2.resize(size);
+
+            uint32_t rng = static_cast<uint32_t>(GetRoundingSeed(0, variantIndex, m_numUpdates)) | 1;
+            for (size_t i = 0; i < size; ++i)
+            {
+                StoreBF16(&variant.m_packedGradientMoment1[i], variant.m_gradientMoment1[i], rng);
+                StoreBF16(&variant.m_packedGradientMoment2[i], variant.m_gradientMoment2[i], rng);
+            }
+
+            Values().swap(variant.m_gradientMoment1);
+            Values().swap(variant.m_gradientMoment2);
+        }
+        else
+        {
+            const size_t size = variant.m_packedGradientMoment1.size();
+            variant.m_gradientMoment1.resize(size);
+            variant.m_gradientMoment2.resize(size);
+
+            for (size_t i = 0; i < size; ++i)
+            {
+                variant.m_gradientMoment1[i] = LoadBF16(&variant.m_packedGradientMoment1[i]);
+                variant.m_gradientMoment2[i] = LoadBF16(&variant.m_packedGradientMoment2[i]);
+            }
+
+            std::vector<uint16_t>().swap(variant.m_packedGradientMoment1);
+            std::vector<uint16_t>().swap(variant.m_packedGradientMoment2);
+        }
+    }
+
+    m_momentsFormat = format;
+}
+
+size_t WeightsStorage::GetMomentsSize() const
+{
+    size_t size = 0;
+    for (const Variant& variant : m_variants)
+    {
+        size += sizeof(float) * (variant.m_gradientMoment1.size() + variant.m_gradientMoment2.size());
+        size += sizeof(uint16_t) * (variant.m_packedGradientMoment1.size() + variant.m_packedGradientMoment2.size());
+    }
+    return size;
+}
+
+bool WeightsStorage::Save(OutputStream& stream) const
+{
+    const uint32_t header[] = { m_inputSize, m_outputSize, (uint32_t)m_variants.size(), (uint32_t)m_momentsFormat, m_numUpdates };
+    if (!stream.Write(header, sizeof(header)))
+        return false;
+
+    for (const Variant& variant : m_variants)
+    {
+        bool success = WriteArray(stream, variant.m_weights) && WriteArray(stream, variant.m_rowLastUpdate);
+        if (m_momentsFormat == MomentsFormat::BFloat16)
+            success = success && WriteArray(stream, variant.m_packedGradientMoment1) && WriteArray(stream, variant.m_packedGradientMoment2);
+        else
+            success = success && WriteArray(stream, variant.m_gradientMoment1) && WriteArray(stream, variant.m_gradientMoment2);
+
+        if (!success)
+            return false;
+    }
+
+    return true;
+}
+
+bool WeightsStorage::Load(InputStream& stream)
+{
+    uint32_t header[5];
+    if (!stream.Read(header, sizeof(header)))
+        return false;
+
+    if (header[0] != m_inputSize || header[1] != m_outputSize || header[2] != m_variants.size() || header[3] > (uint32_t)MomentsFormat::BFloat16)
+    {
+        std::cout << "ERROR: Weights storage size mismatch" << std::endl;
+        return false;
+    }
+
+    const MomentsFormat targetFormat = m_momentsFormat;
+    m_momentsFormat = (MomentsFormat)header[3];
+    m_numUpdates = header[4];
+
+    const size_t numWeights = (size_t)(m_inputSize + 1) * m_outputSize;
+    for (Variant& variant : m_variants)
+    {
+        bool success = ReadArray(stream, variant.m_weights) && ReadArray(stream, variant.m_rowLastUpdate);
+        if (m_momentsFormat == MomentsFormat::BFloat16)
+        {
+            success = success && ReadArray(stream, variant.m_packedGradientMoment1) && ReadArray(stream, variant.m_packedGradientMoment2);
+            success = success && variant.m_packedGradientMoment1.size() == numWeights && variant.m_packedGradientMoment2.size() == numWeights;
+            Values().swap(variant.m_gradientMoment1);
+            Values().swap(variant.m_gradientMoment2);
+        }
+        else
+        {
+            success = success && ReadArray(stream, variant.m_gradientMoment1) && ReadArray(stream, variant.m_gradientMoment2);
+            success = success && variant.m_gradientMoment1.size() == numWeights && variant.m_gradientMoment2.size() == numWeights;
+            std::vector<uint16_t>().swap(variant.m_packedGradientMoment1);
+            std::vector<uint16_t>().swap(variant.m_packedGradientMoment2);
+        }
+
+        if (!success || variant.m_weights.size() != numWeights || variant.m_rowLastUpdate.size() != m_inputSize + 1)
+        {
+            std::cout << "ERROR: Failed to load weights storage" << std::endl;
+            return false;
+        }
+    }
+
+    SetMomentsFormat(targetFormat);
+
+    return true;
+}
+
 void WeightsStorage::Update_Adadelta(const Gradients& gradients, uint32_t inputIndex, const WeightsUpdateOptions& options)
 {
     ASSERT(inputIndex <= m_inputSize);
@@ -90,6 +282,15 @@ void WeightsStorage::Update_Adadelta(const Gradients& gradients, uint32_t inputI
         const __m256 gradientScaleVec = _mm256_set1_ps(options.gradientScale);
 #endif
 
+        const bool packed = m_momentsFormat == MomentsFormat::BFloat16;
+        const size_t rowOffset = inputIndex * m_outputSize;
+        const uint64_t roundingSeed = packed ? GetRoundingSeed(inputIndex, variantIndex, m_numUpdates) : 0;
+        uint32_t rng = static_cast<uint32_t>(roundingSeed) | 1;
+#ifdef USE_AVX
+        __m256i rngVec = _mm256_or_si256(_mm256_set1_epi32(1),
+            _mm256_set_epi64x(Murmur3(roundingSeed + 1), Murmur3(roundingSeed + 2), Murmur3(roundingSeed + 3), Murmur3(roundingSeed + 4)));
+#endif // USE_AVX
+
         {
             const float maxWeightValue = inputIndex < m_inputSize ? m_weightsRange : m_biasRange;
 
@@ -100,15 +301,22 @@ void WeightsStorage::Update_Adadelta(const Gradients& gradients, uint32_t inputI
             const __m256 maxValueV = _mm256_set1_ps(maxWeightValue);
             for (; i + 8 <= m_outputSize; i += 8)
             {
-                float* mPtr = variant.m_gradientMoment1.data() + inputIndex * m_outputSize + i;
-                float* vPtr = variant.m_gradientMoment2.data() + inputIndex * m_outputSize + i;
                 float* wPtr = variant.m_weights.data() + inputIndex * m_outputSize + i;
                 float* wMaskPtr = m_weightsMask.data() + inputIndex * m_outputSize + i;
                 const float* gPtr = gradientsVariant.m_values.data() + inputIndex * m_outputSize + i;
 
                 __m256 g = _mm256_mul_ps(gradientScaleVec, _mm256_load_ps(gPtr));
-                __m256 v = _mm256_load_ps(vPtr);
-                __m256 m = _mm256_load_ps(mPtr);
+                __m256 m, v;
+                if (packed)
+                {
+                    m = LoadBF16x8(variant.m_packedGradientMoment1.data() + rowOffset + i);
+                    v = LoadBF16x8(variant.m_packedGradientMoment2.data() + rowOffset + i);
+                }
+                else
+                {
+                    m = _mm256_load_ps(variant.m_gradientMoment1.data() + rowOffset + i);
+                    v = _mm256_load_ps(variant.m_gradientMoment2.data() + rowOffset + i);
+                }
                 __m256 w = _mm256_load_ps(wPtr);
                 const __m256 wMask = _mm256_load_ps(wMaskPtr);
 
@@ -126,16 +334,24 @@ void WeightsStorage::Update_Adadelta(const Gradients& gradients, uint32_t inputI
                 w = _mm256_min_ps(w, maxValueV);
                 w = _mm256_max_ps(w, minValueV);
 
-                _mm256_store_ps(vPtr, v);
-                _mm256_store_ps(mPtr, m);
+                if (packed)
+                {
+                    StoreBF16x8(variant.m_packedGradientMoment1.data() + rowOffset + i, m, rngVec);
+                    StoreBF16x8(variant.m_packedGradientMoment2.data() + rowOffset + i, v, rngVec);
+                }
+                else
+                {
+                    _mm256_store_ps(variant.m_gradientMoment1.data() + rowOffset + i, m);
+                    _mm256_store_ps(variant.m_gradientMoment2.data() + rowOffset + i, v);
+                }
                 _mm256_store_ps(wPtr, w);
             }
 #endif // USE_AVX
 
             for (; i < m_outputSize; ++i)
             {
-                float& m = variant.m_gradientMoment1[inputIndex * m_outputSize + i];
-                float& v = variant.m_gradientMoment2[inputIndex * m_outputSize + i];
+                float m = packed ? LoadBF16(&variant.m_packedGradientMoment1[rowOffset + i]) : variant.m_gradientMoment1[rowOffset + i];
+                float v = packed ? LoadBF16(&variant.m_packedGradientMoment2[rowOffset + i]) : variant.m_gradientMoment2[rowOffset + i];
                 float& w = variant.m_weights[inputIndex * m_outputSize + i];
                 const float& wMask = m_weightsMask[inputIndex * m_outputSize + i];
                 float g = options.gradientScale * gradientsVariant.m_values[inputIndex * m_outputSize + i];
@@ -160,6 +376,17 @@ void WeightsStorage::Update_Adadelta(const Gradients& gradients, uint32_t inputI
 
                 // clamping
                 w = std::clamp(w, -maxWeightValue, maxWeightValue);
+
+                if (packed)
+                {
+                    StoreBF16(&variant.m_packedGradientMoment1[rowOffset + i], m, rng);
+                    StoreBF16(&variant.m_packedGradientMoment2[rowOffset + i], v, rng);
+                }
+                else
+                {
+                    variant.m_gradientMoment1[rowOffset + i] = m;
+                    variant.m_gradientMoment2[rowOffset + i] = v;
+                }
             }
         }
     }
@@ -178,6 +405,9 @@ void WeightsStorage::Update_Adam(const Gradients& gradients, uint32_t inputIndex
 
         ASSERT(gradientsVariant.m_values.size() == (m_inputSize + 1) * m_outputSize);
 
+        if (options.lazy && !gradientsVariant.m_dirty[inputIndex])
+            continue;
+
         const float cBeta1 = 0.9f;
         const float cBeta2 = 0.999f;
         const float cEpsilon = 1.0e-12f;
@@ -186,15 +416,42 @@ void WeightsStorage::Update_Adam(const Gradients& gradients, uint32_t inputIndex
         const float cBeta1Mult = 1.0f / (1.0f - powf(cBeta1, cIter));
         const float cBeta2Mult = 1.0f / (1.0f - powf(cBeta2, cIter));
 
+        // catch up with the updates skipped since the row was last touched (zero gradient in each of them):
+        // moments decay geometrically, so the momentum steps taken meanwhile form a geometric series
+        // with ratio beta1/sqrt(beta2) (ignoring epsilon and the bias correction change)
+        const uint32_t lastUpdate = variant.m_rowLastUpdate[inputIndex];
+        const float numSkipped = m_numUpdates > lastUpdate ? (float)(m_numUpdates - lastUpdate - 1) : 0.0f;
+        const bool hasSkipped = numSkipped > 0.0f;
+        variant.m_rowLastUpdate[inputIndex] = m_numUpdates;
+
+        const float beta1 = cBeta1 * powf(cBeta1, numSkipped);
+        const float beta2 = cBeta2 * powf(cBeta2, numSkipped);
+        const float ratio = cBeta1 / sqrtf(cBeta2);
+        const float skippedStepsScale = options.learningRate * ratio * (1.0f - powf(ratio, numSkipped)) / (1.0f - ratio);
+        const float weightDecayLoss = 1.0f - powf(1.0f - options.learningRate * options.weightDecay, numSkipped);
+
 #ifdef USE_AVX
         const __m256 cOneMinusBeta1Vec = _mm256_set1_ps(1.0f - cBeta1);
-        const __m256 cBeta1Vec = _mm256_set1_ps(cBeta1);
+        const __m256 cBeta1Vec = _mm256_set1_ps(beta1);
         const __m256 cOneMinusBeta2Vec = _mm256_set1_ps(1.0f - cBeta2);
-        const __m256 cBeta2Vec = _mm256_set1_ps(cBeta2);
+        const __m256 cBeta2Vec = _mm256_set1_ps(beta2);
         const __m256 cEpsilonVec = _mm256_set1_ps(cEpsilon);
         const __m256 gradientScaleVec = _mm256_set1_ps(options.gradientScale);
+        const __m256 weightDecayLossVec = _mm256_set1_ps(weightDecayLoss);
+        const __m256 skippedStepsScaleVec = _mm256_set1_ps(skippedStepsScale);
+        const __m256 cBeta1MultVec = _mm256_set1_ps(cBeta1Mult);
+        const __m256 cBeta2MultVec = _mm256_set1_ps(cBeta2Mult);
 #endif
 
+        const bool packed = m_momentsFormat == MomentsFormat::BFloat16;
+        const size_t rowOffset = inputIndex * m_outputSize;
+        const uint64_t roundingSeed = packed ? GetRoundingSeed(inputIndex, variantIndex, m_numUpdates) : 0;
+        uint32_t rng = static_cast<uint32_t>(roundingSeed) | 1;
+#ifdef USE_AVX
+        __m256i rngVec = _mm256_or_si256(_mm256_set1_epi32(1),
+            _mm256_set_epi64x(Murmur3(roundingSeed + 1), Murmur3(roundingSeed + 2), Murmur3(roundingSeed + 3), Murmur3(roundingSeed + 4)));
+#endif // USE_AVX
+
         {
             const float maxWeightValue = inputIndex < m_inputSize ? m_weightsRange : m_biasRange;
 
@@ -205,18 +462,34 @@ void WeightsStorage::Update_Adam(const Gradients& gradients, uint32_t inputIndex
             const __m256 maxValueV = _mm256_set1_ps(maxWeightValue);
             for (; i + 8 <= m_outputSize; i += 8)
             {
-                float* mPtr = variant.m_gradientMoment1.data() + inputIndex * m_outputSize + i;
-                float* vPtr = variant.m_gradientMoment2.data() + inputIndex * m_outputSize + i;
                 float* wPtr = variant.m_weights.data() + inputIndex * m_outputSize + i;
                 float* wMaskPtr = m_weightsMask.data() + inputIndex * m_outputSize + i;
                 const float* gPtr = gradientsVariant.m_values.data() + inputIndex * m_outputSize + i;
 
                 __m256 g = _mm256_mul_ps(gradientScaleVec, _mm256_load_ps(gPtr));
-                __m256 v = _mm256_load_ps(vPtr);
-                __m256 m = _mm256_load_ps(mPtr);
+                __m256 m, v;
+                if (packed)
+                {
+                    m = LoadBF16x8(variant.m_packedGradientMoment1.data() + rowOffset + i);
+                    v = LoadBF16x8(variant.m_packedGradientMoment2.data() + rowOffset + i);
+                }
+                else
+                {
+                    m = _mm256_load_ps(variant.m_gradientMoment1.data() + rowOffset + i);
+                    v = _mm256_load_ps(variant.m_gradientMoment2.data() + rowOffset + i);
+                }
                 __m256 w = _mm256_load_ps(wPtr);
                 const __m256 wMask = _mm256_load_ps(wMaskPtr);
 
+                if (hasSkipped)
+                {
+                    // momentum and weight decay of the skipped updates
+                    const __m256 skippedDelta = _mm256_div_ps(_mm256_mul_ps(m, cBeta1MultVec),
+                        _mm256_add_ps(cEpsilonVec, _mm256_sqrt_ps(_mm256_mul_ps(v, cBeta2MultVec))));
+                    w = _mm256_fnmadd_ps(_mm256_mul_ps(wMask, skippedDelta), skippedStepsScaleVec, w);
+                    w = _mm256_fnmadd_ps(_mm256_mul_ps(wMask, w), weightDecayLossVec, w);
+                }
+
                 // update biased first moment estimate
                 m = _mm256_fmadd_ps(cOneMinusBeta1Vec, g, _mm256_mul_ps(cBeta1Vec, m));
 
@@ -237,16 +510,24 @@ void WeightsStorage::Update_Adam(const Gradients& gradients, uint32_t inputIndex
                 w = _mm256_min_ps(w, maxValueV);
                 w = _mm256_max_ps(w, minValueV);
 
-                _mm256_store_ps(vPtr, v);
-                _mm256_store_ps(mPtr, m);
+                if (packed)
+                {
+                    StoreBF16x8(variant.m_packedGradientMoment1.data() + rowOffset + i, m, rngVec);
+                    StoreBF16x8(variant.m_packedGradientMoment2.data() + rowOffset + i, v, rngVec);
+                }
+                else
+                {
+                    _mm256_store_ps(variant.m_gradientMoment1.data() + rowOffset + i, m);
+                    _mm256_store_ps(variant.m_gradientMoment2.data() + rowOffset + i, v);
+                }
                 _mm256_store_ps(wPtr, w);
             }
 #endif // USE_AVX
 
             for (; i < m_outputSize; ++i)
             {
-                float& m = variant.m_gradientMoment1[inputIndex * m_outputSize + i];
-                float& v = variant.m_gradientMoment2[inputIndex * m_outputSize + i];
+                float m = packed ? LoadBF16(&variant.m_packedGradientMoment1[rowOffset + i]) : variant.m_gradientMoment1[rowOffset + i];
+                float v = packed ? LoadBF16(&variant.m_packedGradientMoment2[rowOffset + i]) : variant.m_gradientMoment2[rowOffset + i];
                 float& w = variant.m_weights[inputIndex * m_outputSize + i];
                 const float wMask = m_weightsMask[inputIndex * m_outputSize + i];
                 float g = options.gradientScale * gradientsVariant.m_values[inputIndex * m_outputSize + i];
@@ -254,12 +535,19 @@ void WeightsStorage::Update_Adam(const Gradients& gradients, uint32_t inputIndex
                 ASSERT(!std::isnan(g));
                 ASSERT(v >= 0.0f);
 
+                if (hasSkipped)
+                {
+                    // momentum and weight decay of the skipped updates
+                    w -= wMask * skippedStepsScale * (m * cBeta1Mult) / (cEpsilon + sqrtf(v * cBeta2Mult));
+                    w -= wMask * w * weightDecayLoss;
+                }
+
                 // update biased first moment estimate
-                m = cBeta1 * m + (1.0f - cBeta1) * g;
+                m = beta1 * m + (1.0f - cBeta1) * g;
                 ASSERT(!std::isnan(m));
 
                 // update biased second moment estimate
-                v = cBeta2 * v + (1.0f - cBeta2) * g * g;
+                v = beta2 * v + (1.0f - cBeta2) * g * g;
                 ASSERT(!std::isnan(v));
 
                 // compute bias-corrected moment estimates
@@ -275,6 +563,17 @@ void WeightsStorage::Update_Adam(const Gradients& gradients, uint32_t inputIndex
 
                 // clamping
                 w = std::clamp(w, -maxWeightValue, maxWeightValue);
+
+                if (packed)
+                {
+                    StoreBF16(&variant.m_packedGradientMoment1[rowOffset + i], m, rng);
+                    StoreBF16(&variant.m_packedGradientMoment2[rowOffset + i], v, rng);
+                }
+                else
+                {
+                    variant.m_gradientMoment1[rowOffset + i] = m;
+                    variant.m_gradientMoment2[rowOffset + i] = v;
+                }
             }
         }
     }
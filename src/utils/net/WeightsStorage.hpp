@@ -2,10 +2,20 @@
 
 #include "Node.hpp"
 
+class InputStream;
+class OutputStream;
+
 namespace nn {
 
 struct Gradients;
 
+// storage format of the optimizer state (gradient moments)
+enum class MomentsFormat : uint8_t
+{
+    Float,
+    BFloat16,   // upper half of float (same range, 8-bit mantissa), stored with stochastic rounding
+};
+
 struct WeightsStorage
 {
 public:
@@ -15,12 +25,27 @@ public:
 
     void PrintStats() const;
 
+    // convert gradient moments to a different storage format, the other format memory is released
+    void SetMomentsFormat(MomentsFormat format);
+
+    // memory used by the optimizer state in bytes
+    size_t GetMomentsSize() const;
+
+    // save/load weights with the whole optimizer state (for trainer checkpoints)
+    // moments are loaded in the format they were saved in and converted to the current one
+    bool Save(OutputStream& stream) const;
+    bool Load(InputStream& stream);
+
     struct WeightsUpdateOptions
     {
         float learningRate = 1.0f;
         float gradientScale = 1.0f;
         float weightDecay = 0.0f;
         size_t iteration = 0;
+
+        // lazy (sparse) update: skip variants where the row received no gradients,
+        // the moments decay of the skipped updates is applied when the row is touched again
+        bool lazy = false;
     };
 
     void Update_Adadelta(const Gradients& gradients, uint32_t inputIndex, const WeightsUpdateOptions& options);
@@ -31,6 +56,11 @@ public:
     bool m_isSparse = false;
 
     bool m_updateWeights = true;
+
+    MomentsFormat m_momentsFormat = MomentsFormat::Float;
+
+    // number of batches applied so far, incremented by the trainer before updating the rows
+    uint32_t m_numUpdates = 0;
     Values m_weightsMask;
 
     float m_weightsRange = 10.0f;
@@ -43,6 +73,13 @@ public:
         // used for learning
         Values m_gradientMoment1;
         Values m_gradientMoment2;
+
+        // gradient moments when stored in 16-bit format (m_gradientMoment1/2 are empty then)
+        std::vector<uint16_t> m_packedGradientMoment1;
+        std::vector<uint16_t> m_packedGradientMoment2;
+
+        // value of m_numUpdates when each row was last updated (used by lazy update)
+        std::vector<uint32_t> m_rowLastUpdate;
     };
 
     std::vector<Variant> m_variants;